@@ -0,0 +1 @@
+#define DYIBICC_SOURCE_HASH 0xe0ac36f1d596f87bULL
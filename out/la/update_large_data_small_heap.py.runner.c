@@ -0,0 +1,138 @@
+
+#include "libdyibicc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void* get_host_helper_func(const char* name) {
+  (void)name;
+  return NULL;
+
+}
+
+static char initial_0[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x6e,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x30,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x31,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x32,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x33,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x34,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x35,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x36,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x37,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x38,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x39,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x58,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x31,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x32,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x44,0x45,0x46,0x49,0x4e,0x45,0x28,0x69,0x29,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x68,0x61,0x72,0x20,0x61,0x23,0x23,0x69,0x5b,0x31,0x30,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x42,0x55,0x4d,0x50,0x28,0x69,0x29,0x20,0x61,0x23,0x23,0x69,0x5b,0x73,0x69,0x7a,0x65,0x6f,0x66,0x28,0x61,0x23,0x23,0x69,0x29,0x20,0x2d,0x20,0x31,0x5d,0x20,0x2b,0x3d,0x20,0x31,0x3b,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x2b,0x3d,0x20,0x61,0x23,0x23,0x69,0x5b,0x73,0x69,0x7a,0x65,0x6f,0x66,0x28,0x61,0x23,0x23,0x69,0x29,0x20,0x2d,0x20,0x31,0x5d,0x3b,0xa,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x44,0x45,0x46,0x49,0x4e,0x45,0x29,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x69,0x6e,0x74,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x3d,0x20,0x30,0x3b,0xa,0x20,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x42,0x55,0x4d,0x50,0x29,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x2a,0x20,0x31,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_0 = initial_0;
+
+static bool get_file_by_name(const char* filename, char** contents, size_t* size) {
+
+  if (strcmp("main.c", filename) == 0) {
+    *size = strlen(source_contents_0);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_0, *size);
+    return true;
+  }
+
+
+
+  // Otherwise, fallback to normal file loading (for includes, etc.)
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  rewind(fp);
+  *contents = malloc(*size);
+  fread(*contents, 1, *size, fp);
+  fclose(fp);
+  return true;
+}
+
+
+int main(void) {
+
+  char* include_paths[] = {
+    NULL
+  };
+  char* input_paths[] = {
+    "main.c", NULL
+  };
+
+  DyibiccEnviromentData env_data = {
+      .include_paths = (const char**)include_paths,
+      .files = (const char**)input_paths,
+      .load_file_contents = get_file_by_name,
+      .get_function_address = get_host_helper_func,
+      .output_function = NULL,
+      .use_ansi_codes = false,
+      .generate_debug_symbols = false,
+      .cache_dir = NULL,
+  };
+
+
+  DyibiccContext* ctx = dyibicc_set_environment(&env_data);
+
+  int final_result = 0;
+  void* stable_main = NULL;
+  (void)stable_main;
+
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("initial update failed\n");
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step0[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x6e,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x30,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x31,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x32,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x33,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x34,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x35,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x36,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x37,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x38,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x39,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x58,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x31,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x32,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x44,0x45,0x46,0x49,0x4e,0x45,0x28,0x69,0x29,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x68,0x61,0x72,0x20,0x61,0x23,0x23,0x69,0x5b,0x31,0x30,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x42,0x55,0x4d,0x50,0x28,0x69,0x29,0x20,0x61,0x23,0x23,0x69,0x5b,0x73,0x69,0x7a,0x65,0x6f,0x66,0x28,0x61,0x23,0x23,0x69,0x29,0x20,0x2d,0x20,0x31,0x5d,0x20,0x2b,0x3d,0x20,0x31,0x3b,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x2b,0x3d,0x20,0x61,0x23,0x23,0x69,0x5b,0x73,0x69,0x7a,0x65,0x6f,0x66,0x28,0x61,0x23,0x23,0x69,0x29,0x20,0x2d,0x20,0x31,0x5d,0x3b,0xa,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x44,0x45,0x46,0x49,0x4e,0x45,0x29,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x69,0x6e,0x74,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x3d,0x20,0x30,0x3b,0xa,0x20,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x42,0x55,0x4d,0x50,0x29,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x2a,0x20,0x31,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step0)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 20) {
+      printf("update_large_data_small_heap.py:21: got %d, but expected %d\n", result, 20);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_large_data_small_heap.py:21: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step2[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x6e,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x30,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x31,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x32,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x33,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x34,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x35,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x36,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x37,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x38,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x39,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x58,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x31,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x32,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x44,0x45,0x46,0x49,0x4e,0x45,0x28,0x69,0x29,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x68,0x61,0x72,0x20,0x61,0x23,0x23,0x69,0x5b,0x31,0x30,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x42,0x55,0x4d,0x50,0x28,0x69,0x29,0x20,0x61,0x23,0x23,0x69,0x5b,0x73,0x69,0x7a,0x65,0x6f,0x66,0x28,0x61,0x23,0x23,0x69,0x29,0x20,0x2d,0x20,0x31,0x5d,0x20,0x2b,0x3d,0x20,0x31,0x3b,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x2b,0x3d,0x20,0x61,0x23,0x23,0x69,0x5b,0x73,0x69,0x7a,0x65,0x6f,0x66,0x28,0x61,0x23,0x23,0x69,0x29,0x20,0x2d,0x20,0x31,0x5d,0x3b,0xa,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x44,0x45,0x46,0x49,0x4e,0x45,0x29,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x69,0x6e,0x74,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x3d,0x20,0x30,0x3b,0xa,0x20,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x42,0x55,0x4d,0x50,0x29,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x74,0x6f,0x74,0x61,0x6c,0x20,0x2a,0x20,0x32,0x3b,0xa,0x7d,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step2)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 80) {
+      printf("update_large_data_small_heap.py:25: got %d, but expected %d\n", result, 80);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_large_data_small_heap.py:25: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  printf("OK\n");
+fail:
+  dyibicc_free(ctx);
+
+  return final_result;
+}
@@ -0,0 +1,170 @@
+
+#ifdef _WIN32
+#include <windows.h>
+int is_read_only(char* p) {
+  MEMORY_BASIC_INFORMATION mbi;
+  VirtualQuery(p, &mbi, sizeof(mbi));
+  return mbi.Protect == PAGE_READONLY;
+}
+#else
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+static sigjmp_buf fault_jmp;
+static void on_fault(int sig) {
+  (void)sig;
+  siglongjmp(fault_jmp, 1);
+}
+int is_read_only(char* p) {
+  struct sigaction sa, old;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_fault;
+  sigaction(SIGSEGV, &sa, &old);
+  int faulted = 1;
+  if (!sigsetjmp(fault_jmp, 1)) {
+    *(volatile char*)p = *p;
+    faulted = 0;
+  }
+  sigaction(SIGSEGV, &old, NULL);
+  return faulted;
+}
+#endif
+
+#include "libdyibicc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void* get_host_helper_func(const char* name) {
+  (void)name;
+  if (strcmp("is_read_only", name) == 0) return (void*)is_read_only;
+  return NULL;
+
+}
+
+static char initial_0[] = {0x69,0x6e,0x74,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x63,0x68,0x61,0x72,0x2a,0x20,0x70,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x62,0x75,0x66,0x5b,0x34,0x5d,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x22,0x66,0x69,0x72,0x73,0x74,0x22,0x29,0x20,0x2a,0x20,0x31,0x30,0x20,0x2b,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x28,0x63,0x68,0x61,0x72,0x2a,0x29,0x62,0x75,0x66,0x29,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_0 = initial_0;
+
+static bool get_file_by_name(const char* filename, char** contents, size_t* size) {
+
+  if (strcmp("main.c", filename) == 0) {
+    *size = strlen(source_contents_0);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_0, *size);
+    return true;
+  }
+
+
+
+  // Otherwise, fallback to normal file loading (for includes, etc.)
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  rewind(fp);
+  *contents = malloc(*size);
+  fread(*contents, 1, *size, fp);
+  fclose(fp);
+  return true;
+}
+
+
+int main(void) {
+
+  char* include_paths[] = {
+    NULL
+  };
+  char* input_paths[] = {
+    "main.c", NULL
+  };
+
+  DyibiccEnviromentData env_data = {
+      .include_paths = (const char**)include_paths,
+      .files = (const char**)input_paths,
+      .load_file_contents = get_file_by_name,
+      .get_function_address = get_host_helper_func,
+      .output_function = NULL,
+      .use_ansi_codes = false,
+      .generate_debug_symbols = false,
+      .cache_dir = NULL,
+  };
+
+
+  DyibiccContext* ctx = dyibicc_set_environment(&env_data);
+
+  int final_result = 0;
+  void* stable_main = NULL;
+  (void)stable_main;
+
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("initial update failed\n");
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step0[] = {0x69,0x6e,0x74,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x63,0x68,0x61,0x72,0x2a,0x20,0x70,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x62,0x75,0x66,0x5b,0x34,0x5d,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x22,0x66,0x69,0x72,0x73,0x74,0x22,0x29,0x20,0x2a,0x20,0x31,0x30,0x20,0x2b,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x28,0x63,0x68,0x61,0x72,0x2a,0x29,0x62,0x75,0x66,0x29,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step0)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 10) {
+      printf("update_rodata_protect.py:48: got %d, but expected %d\n", result, 10);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_rodata_protect.py:48: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step2[] = {0x69,0x6e,0x74,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x63,0x68,0x61,0x72,0x2a,0x20,0x70,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x62,0x75,0x66,0x5b,0x34,0x5d,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x22,0x73,0x65,0x63,0x6f,0x6e,0x64,0x22,0x29,0x20,0x2a,0x20,0x31,0x30,0x20,0x2b,0x20,0x69,0x73,0x5f,0x72,0x65,0x61,0x64,0x5f,0x6f,0x6e,0x6c,0x79,0x28,0x28,0x63,0x68,0x61,0x72,0x2a,0x29,0x62,0x75,0x66,0x29,0x3b,0xa,0x7d,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step2)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 10) {
+      printf("update_rodata_protect.py:52: got %d, but expected %d\n", result, 10);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_rodata_protect.py:52: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  printf("OK\n");
+fail:
+  dyibicc_free(ctx);
+
+  return final_result;
+}
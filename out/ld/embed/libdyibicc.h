@@ -0,0 +1,197 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// ANSI escape code decoding expected if use_ansi_codes is set in
+// DyibiccEnviromentData.
+typedef int (*DyibiccOutputFn)(const char* fmt, va_list ap);
+
+// Returns the address of a function by name.
+typedef void* (*DyibiccFunctionLookupFn)(const char* name);
+
+// Get the current contents of a file. Should return true on success with
+// *contents and *size filled out. *contents need not be null-terminated.
+// *contents ownership is taken and will be free()d.
+typedef bool (*DyibiccLoadFileContents)(const char* filename, char** contents, size_t* size);
+
+typedef struct DyibiccEnviromentData {
+  // NULL-terminated list of user include paths to search.
+  const char** include_paths;
+
+  // NULL-terminated list of .c files to include in the project.
+  const char** files;
+
+  // Load the contents of a file by name (typically from disk).
+  //
+  // NOTE/TODO: There is currently a gotcha with this callback. It is used in
+  // two situations:
+  //
+  // 1) for loading all .c files on initial startup (when update is
+  // typically called as `dyibicc_update(ctx, NULL, NULL)`), and;
+  //
+  // 2) at all times when files are loaded by an `#include`.
+  //
+  // However! If a single file and contents are provided to update via
+  // `dyibicc_update(ctx, "myfile.c", "...contents...")`, then the contents will
+  // be used directly and there will be no callback to this function.
+  //
+  // For files that exist on disk, the loaded contents are kept across updates
+  // and reused while the file's modification time and size are unchanged. Use
+  // `dyibicc_update_changed()` to force a file to be loaded again regardless.
+  //
+  // If NULL, files are read from disk. Where possible they're mapped read-only
+  // rather than copied, so a file should not be truncated while an update that
+  // uses it is running.
+  DyibiccLoadFileContents load_file_contents;
+
+  // Should resolve a function by name, for symbols that aren't defined by code
+  // in |files|. i.e. to call system functionality. Results are kept for the
+  // lifetime of the context, so this is called at most once per name that's
+  // found. See also dyibicc_register_symbols().
+  DyibiccFunctionLookupFn get_function_address;
+
+  // Customizable output, all output from compiler error messages, etc. will be
+  // vectored through this function.
+  DyibiccOutputFn output_function;
+
+  // If non-NULL, a directory in which compiled code is saved, keyed by a hash
+  // of the preprocessed source. When a file's preprocessed source matches a
+  // previous compile (possibly from a different process), the compiled code is
+  // loaded from here rather than compiled again. The directory is created if
+  // it doesn't exist. Not currently implemented on Windows.
+  const char* cache_dir;
+
+  // Are simple ANSI colours supported by |output_function|.
+  bool use_ansi_codes;
+
+  // Should debug symbols (pdb) be generated. Only implemented on Windows.
+  bool generate_debug_symbols;
+
+  bool padding[6];  // Avoid C4820 padding warning on MSVC /Wall.
+} DyibiccEnviromentData;
+
+typedef struct DyibiccContext DyibiccContext;
+
+// Sets up the environment for the compiler. There can currently only be a
+// single active DyibiccContext, despite the implication that there could be
+// multiple. See notes in the structure about how it should be filled out.
+DyibiccContext* dyibicc_set_environment(DyibiccEnviromentData* env_data);
+
+// Called once on initialization with a file == NULL and contents == NULL, and
+// subsequently whenever any file contents are updated and the running code
+// should be recompiled/relinked.
+//
+// Code of files that aren't recompiled can keep running during an update (on
+// another thread), as their code pages are left executable. Code of a file
+// that is recompiled must not run until the update returns, as the entries of
+// its changed functions are rewritten.
+//
+// Returns true on success, or false if there was a compile or link error.
+bool dyibicc_update(DyibiccContext* context, char* file, char* contents);
+
+// Called when the contents of |path| have changed. |path| can be one of the .c
+// files in the project, or any file that was #included (directly or
+// indirectly) by them. Only the files that depend on |path| are recompiled
+// (their contents are reloaded via load_file_contents, and any cached contents
+// of |path| are discarded), followed by a relink.
+// As dyibicc_update(), returns true on success and false if there was a
+// compile or link error. Also returns true if nothing depends on |path|, in
+// which case nothing is recompiled.
+bool dyibicc_update_changed(DyibiccContext* context, const char* path);
+
+// Provides the addresses of |count| symbols that aren't defined by code in
+// |files|, in preference to get_function_address and the system's symbols.
+// Can be called at any time, and takes effect from the next update.
+void dyibicc_register_symbols(DyibiccContext* context,
+                              const char** names,
+                              void** addresses,
+                              size_t count);
+
+// After a successful call to dyibicc_update(), retrieve the address of a
+// non-static function to call it. The returned function address cannot be
+// cached across dyibicc_update() calls.
+void* dyibicc_find_export(DyibiccContext* context, char* name);
+
+// As dyibicc_find_export(), but the returned address is a small stub that
+// jumps to the current code for |name|, and is retargeted by each successful
+// update, so it can be cached (e.g. registered as a callback) until
+// dyibicc_free(). If |name| is no longer defined after an update, calling the
+// stub reports an error and aborts.
+void* dyibicc_find_stable_export(DyibiccContext* context, char* name);
+
+// Phases of compilation that are timed separately by dyibicc_get_stats().
+typedef enum DyibiccPhase {
+  DYIBICC_PHASE_TOKENIZE,
+  DYIBICC_PHASE_PREPROCESS,  // Not including tokenizing of the source and included files.
+  DYIBICC_PHASE_CONTAINERS,  // Instantiating $vec/$map, not including tokenizing.
+  DYIBICC_PHASE_PARSE,
+  DYIBICC_PHASE_CODEGEN,  // Also loading of code from cache_dir.
+  DYIBICC_PHASE_ENCODE,   // dasm_link() and dasm_encode(), and data emission.
+  DYIBICC_PHASE_LINK,     // Only set in DyibiccStats, as linking isn't per-file.
+  DYIBICC_NUM_PHASES,
+} DyibiccPhase;
+
+// The compiler's internal bump heaps, as reported in DyibiccStats.
+typedef enum DyibiccHeap {
+  DYIBICC_HEAP_COMPILE,  // Reset after each file is compiled.
+  DYIBICC_HEAP_TEMP,     // Reset after each update.
+  DYIBICC_HEAP_LINK,     // Reset after each link.
+  DYIBICC_HEAP_USER_CONTEXT,
+  DYIBICC_HEAP_SNAPSHOT,  // Cached preprocessed headers.
+  DYIBICC_NUM_HEAPS,
+} DyibiccHeap;
+
+typedef struct DyibiccFileStats {
+  // Stats are for the most recent compile of this file, which may not have
+  // been in the most recent update.
+  const char* name;
+  bool compiled_in_last_update;
+  bool loaded_from_cache;  // Code came from cache_dir rather than parse/codegen.
+  bool patched;            // Only functions that changed were compiled, the rest reused.
+  bool padding[5];         // Avoid C4820 padding warning on MSVC /Wall.
+
+  double phase_seconds[DYIBICC_NUM_PHASES];
+  double total_seconds;
+
+  size_t num_tokens;  // Including those of #included files.
+  size_t num_macro_expansions;
+  size_t num_nodes;
+  size_t num_objs;  // Variables and functions, local and global.
+
+  // Emitted, or loaded from the cache. Functions that are unchanged from the
+  // previous compile of the file are reused rather than emitted again.
+  size_t code_bytes;
+  size_t data_bytes;  // Global data and string literals.
+} DyibiccFileStats;
+
+typedef struct DyibiccStats {
+  // Summed over the files compiled by the most recent update, plus its link.
+  double phase_seconds[DYIBICC_NUM_PHASES];
+  double update_seconds;  // Wall time of the whole of the most recent update.
+  size_t num_files_compiled;
+  size_t num_tokens;
+  size_t num_macro_expansions;
+  size_t num_nodes;
+  size_t num_objs;
+
+  // Memory currently used for the code of all files, including reused
+  // functions, and the data emitted by the most recent compile of each file.
+  size_t code_bytes;
+  size_t data_bytes;
+
+  // Largest number of bytes each heap held during the most recent update.
+  size_t heap_high_water[DYIBICC_NUM_HEAPS];
+
+  size_t num_files;
+  const DyibiccFileStats* files;  // Owned by the context; valid until dyibicc_free().
+} DyibiccStats;
+
+// Fills out |stats| with timing and memory usage of the most recent
+// dyibicc_update() (or dyibicc_update_changed()), and per file. If that update
+// failed, its stats cover the work done up to the error.
+void dyibicc_get_stats(DyibiccContext* context, DyibiccStats* stats);
+
+// Free all memory associated with the compiler context.
+void dyibicc_free(DyibiccContext* context);
@@ -0,0 +1 @@
+#define DYIBICC_SOURCE_HASH 0x5bf8ee827f0785c4ULL
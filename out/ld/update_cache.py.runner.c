@@ -0,0 +1,328 @@
+
+#include "libdyibicc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+void* get_host_helper_func(const char* name) {
+  (void)name;
+  return NULL;
+
+}
+
+static char initial_0[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x69,0x6e,0x74,0x20,0x69,0x29,0x20,0x7b,0xa,0x20,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x5d,0x20,0x3d,0x20,0x7b,0x26,0x26,0x7a,0x65,0x72,0x6f,0x2c,0x20,0x26,0x26,0x6f,0x6e,0x65,0x7d,0x3b,0xa,0x20,0x20,0x67,0x6f,0x74,0x6f,0x20,0x2a,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x69,0x5d,0x3b,0xa,0x7a,0x65,0x72,0x6f,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x30,0x3b,0xa,0x6f,0x6e,0x65,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x32,0x30,0x3b,0xa,0x7d,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x6f,0x6e,0x73,0x74,0x20,0x63,0x68,0x61,0x72,0x20,0x6d,0x73,0x67,0x5b,0x5d,0x20,0x3d,0x20,0x22,0x68,0x65,0x6c,0x6c,0x6f,0x22,0x3b,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x69,0x6e,0x74,0x20,0x28,0x2a,0x66,0x70,0x29,0x28,0x69,0x6e,0x74,0x29,0x20,0x3d,0x20,0x74,0x61,0x62,0x6c,0x65,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x31,0x29,0x20,0x2b,0x20,0x66,0x70,0x28,0x30,0x29,0x20,0x2b,0x20,0x6d,0x73,0x67,0x5b,0x31,0x5d,0x20,0x2d,0x20,0x27,0x65,0x27,0x20,0x2b,0x20,0x2b,0x2b,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_0 = initial_0;
+
+static bool get_file_by_name(const char* filename, char** contents, size_t* size) {
+
+  if (strcmp("main.c", filename) == 0) {
+    *size = strlen(source_contents_0);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_0, *size);
+    return true;
+  }
+
+
+
+  // Otherwise, fallback to normal file loading (for includes, etc.)
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  rewind(fp);
+  *contents = malloc(*size);
+  fread(*contents, 1, *size, fp);
+  fclose(fp);
+  return true;
+}
+
+
+static void remove_cache_dir(const char* path) {
+#ifdef _WIN32
+  (void)path;  // The cache isn't implemented on Windows.
+#else
+  DIR* dir = opendir(path);
+  if (!dir)
+    return;
+  struct dirent* ent;
+  while ((ent = readdir(dir))) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+      continue;
+    char file[1024];
+    snprintf(file, sizeof(file), "%s/%s", path, ent->d_name);
+    unlink(file);
+  }
+  closedir(dir);
+  rmdir(path);
+#endif
+}
+
+int main(void) {
+
+#ifdef _WIN32
+  char cache_dir[] = "update_cache.cache";
+#else
+  char cache_dir[] = "update_cache.cache.XXXXXX";
+  if (!mkdtemp(cache_dir)) {
+    printf("couldn't create cache dir\n");
+    return 1;
+  }
+#endif
+
+  char* include_paths[] = {
+    NULL
+  };
+  char* input_paths[] = {
+    "main.c", NULL
+  };
+
+  DyibiccEnviromentData env_data = {
+      .include_paths = (const char**)include_paths,
+      .files = (const char**)input_paths,
+      .load_file_contents = get_file_by_name,
+      .get_function_address = get_host_helper_func,
+      .output_function = NULL,
+      .use_ansi_codes = false,
+      .generate_debug_symbols = false,
+      .cache_dir = cache_dir,
+  };
+
+
+  DyibiccContext* ctx = dyibicc_set_environment(&env_data);
+
+  int final_result = 0;
+  void* stable_main = NULL;
+  (void)stable_main;
+
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("initial update failed\n");
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step0[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x69,0x6e,0x74,0x20,0x69,0x29,0x20,0x7b,0xa,0x20,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x5d,0x20,0x3d,0x20,0x7b,0x26,0x26,0x7a,0x65,0x72,0x6f,0x2c,0x20,0x26,0x26,0x6f,0x6e,0x65,0x7d,0x3b,0xa,0x20,0x20,0x67,0x6f,0x74,0x6f,0x20,0x2a,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x69,0x5d,0x3b,0xa,0x7a,0x65,0x72,0x6f,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x30,0x3b,0xa,0x6f,0x6e,0x65,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x32,0x30,0x3b,0xa,0x7d,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x6f,0x6e,0x73,0x74,0x20,0x63,0x68,0x61,0x72,0x20,0x6d,0x73,0x67,0x5b,0x5d,0x20,0x3d,0x20,0x22,0x68,0x65,0x6c,0x6c,0x6f,0x22,0x3b,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x69,0x6e,0x74,0x20,0x28,0x2a,0x66,0x70,0x29,0x28,0x69,0x6e,0x74,0x29,0x20,0x3d,0x20,0x74,0x61,0x62,0x6c,0x65,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x31,0x29,0x20,0x2b,0x20,0x66,0x70,0x28,0x30,0x29,0x20,0x2b,0x20,0x6d,0x73,0x67,0x5b,0x31,0x5d,0x20,0x2d,0x20,0x27,0x65,0x27,0x20,0x2b,0x20,0x2b,0x2b,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step0)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 31) {
+      printf("update_cache.py:22: got %d, but expected %d\n", result, 31);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache.py:22: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  source_contents_0 = initial_0;
+
+  dyibicc_free(ctx);
+  stable_main = NULL;
+  ctx = dyibicc_set_environment(&env_data);
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("update after restart failed\n");
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 31) {
+      printf("update_cache.py:27: got %d, but expected %d\n", result, 31);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache.py:27: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.files[0].loaded_from_cache)) {
+    printf("update_cache.py:28: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step5[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x69,0x6e,0x74,0x20,0x69,0x29,0x20,0x7b,0xa,0x20,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x5d,0x20,0x3d,0x20,0x7b,0x26,0x26,0x7a,0x65,0x72,0x6f,0x2c,0x20,0x26,0x26,0x6f,0x6e,0x65,0x7d,0x3b,0xa,0x20,0x20,0x67,0x6f,0x74,0x6f,0x20,0x2a,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x69,0x5d,0x3b,0xa,0x7a,0x65,0x72,0x6f,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x31,0x3b,0xa,0x6f,0x6e,0x65,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x32,0x30,0x3b,0xa,0x7d,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x6f,0x6e,0x73,0x74,0x20,0x63,0x68,0x61,0x72,0x20,0x6d,0x73,0x67,0x5b,0x5d,0x20,0x3d,0x20,0x22,0x68,0x65,0x6c,0x6c,0x6f,0x22,0x3b,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x69,0x6e,0x74,0x20,0x28,0x2a,0x66,0x70,0x29,0x28,0x69,0x6e,0x74,0x29,0x20,0x3d,0x20,0x74,0x61,0x62,0x6c,0x65,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x31,0x29,0x20,0x2b,0x20,0x66,0x70,0x28,0x30,0x29,0x20,0x2b,0x20,0x6d,0x73,0x67,0x5b,0x31,0x5d,0x20,0x2d,0x20,0x27,0x65,0x27,0x20,0x2b,0x20,0x2b,0x2b,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x7d,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step5)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 33) {
+      printf("update_cache.py:32: got %d, but expected %d\n", result, 33);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache.py:32: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  source_contents_0 = initial_0;
+
+  dyibicc_free(ctx);
+  stable_main = NULL;
+  ctx = dyibicc_set_environment(&env_data);
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("update after restart failed\n");
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 31) {
+      printf("update_cache.py:36: got %d, but expected %d\n", result, 31);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache.py:36: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.files[0].loaded_from_cache)) {
+    printf("update_cache.py:37: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step10[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x69,0x6e,0x74,0x20,0x69,0x29,0x20,0x7b,0xa,0x20,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x5d,0x20,0x3d,0x20,0x7b,0x26,0x26,0x7a,0x65,0x72,0x6f,0x2c,0x20,0x26,0x26,0x6f,0x6e,0x65,0x7d,0x3b,0xa,0x20,0x20,0x67,0x6f,0x74,0x6f,0x20,0x2a,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x69,0x5d,0x3b,0xa,0x7a,0x65,0x72,0x6f,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x30,0x3b,0xa,0x6f,0x6e,0x65,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x32,0x30,0x3b,0xa,0x7d,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x6f,0x6e,0x73,0x74,0x20,0x63,0x68,0x61,0x72,0x20,0x6d,0x73,0x67,0x5b,0x5d,0x20,0x3d,0x20,0x22,0x68,0x65,0x6c,0x6c,0x6f,0x22,0x3b,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x69,0x6e,0x74,0x20,0x28,0x2a,0x66,0x70,0x29,0x28,0x69,0x6e,0x74,0x29,0x20,0x3d,0x20,0x74,0x61,0x62,0x6c,0x65,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x31,0x29,0x20,0x2b,0x20,0x66,0x70,0x28,0x30,0x29,0x20,0x2b,0x20,0x75,0x22,0x61,0x62,0x22,0x5b,0x31,0x5d,0x20,0x2d,0x20,0x27,0x62,0x27,0x20,0x2b,0x20,0x2b,0x2b,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x7d,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step10)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 32) {
+      printf("update_cache.py:43: got %d, but expected %d\n", result, 32);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache.py:43: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step12[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x69,0x6e,0x74,0x20,0x69,0x29,0x20,0x7b,0xa,0x20,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x5d,0x20,0x3d,0x20,0x7b,0x26,0x26,0x7a,0x65,0x72,0x6f,0x2c,0x20,0x26,0x26,0x6f,0x6e,0x65,0x7d,0x3b,0xa,0x20,0x20,0x67,0x6f,0x74,0x6f,0x20,0x2a,0x6c,0x61,0x62,0x65,0x6c,0x73,0x5b,0x69,0x5d,0x3b,0xa,0x7a,0x65,0x72,0x6f,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x30,0x3b,0xa,0x6f,0x6e,0x65,0x3a,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x32,0x30,0x3b,0xa,0x7d,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x6f,0x6e,0x73,0x74,0x20,0x63,0x68,0x61,0x72,0x20,0x6d,0x73,0x67,0x5b,0x5d,0x20,0x3d,0x20,0x22,0x68,0x65,0x6c,0x6c,0x6f,0x22,0x3b,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x69,0x6e,0x74,0x20,0x28,0x2a,0x66,0x70,0x29,0x28,0x69,0x6e,0x74,0x29,0x20,0x3d,0x20,0x74,0x61,0x62,0x6c,0x65,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x74,0x61,0x62,0x6c,0x65,0x28,0x31,0x29,0x20,0x2b,0x20,0x66,0x70,0x28,0x30,0x29,0x20,0x2b,0x20,0x22,0x61,0x5c,0x30,0x62,0x5c,0x30,0x5c,0x30,0x22,0x5b,0x31,0x5d,0x20,0x2d,0x20,0x27,0x62,0x27,0x20,0x2b,0x20,0x2b,0x2b,0x63,0x6f,0x75,0x6e,0x74,0x65,0x72,0x3b,0xa,0x7d,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step12)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != -65) {
+      printf("update_cache.py:46: got %d, but expected %d\n", result, -65);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache.py:46: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(!stats.files[0].loaded_from_cache)) {
+    printf("update_cache.py:47: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  printf("OK\n");
+fail:
+  dyibicc_free(ctx);
+  remove_cache_dir(cache_dir);
+  return final_result;
+}
@@ -0,0 +1,258 @@
+
+#include "libdyibicc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+void* get_host_helper_func(const char* name) {
+  (void)name;
+  return NULL;
+
+}
+
+static char initial_0[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x67,0x5b,0x32,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x69,0x6e,0x74,0x20,0x62,0x75,0x6d,0x70,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x2b,0x2b,0x67,0x5b,0x30,0x5d,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_0 = initial_0;
+static char initial_1[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x67,0x5b,0x32,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x69,0x6e,0x74,0x20,0x62,0x75,0x6d,0x70,0x5f,0x62,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x2b,0x2b,0x67,0x5b,0x30,0x5d,0x3b,0xa,0x7d,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x6e,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x30,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x31,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x32,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x33,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x34,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x35,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x36,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x37,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x38,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x39,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x58,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x31,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x32,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x33,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x34,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x35,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x44,0x45,0x46,0x49,0x4e,0x45,0x28,0x69,0x29,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x68,0x61,0x72,0x20,0x66,0x23,0x23,0x69,0x5b,0x34,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x44,0x45,0x46,0x49,0x4e,0x45,0x29,0xa,'\0'};
+static char* source_contents_1 = initial_1;
+static char initial_2[] = {0x69,0x6e,0x74,0x20,0x62,0x75,0x6d,0x70,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x62,0x75,0x6d,0x70,0x28,0x29,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_2 = initial_2;
+
+static bool get_file_by_name(const char* filename, char** contents, size_t* size) {
+
+  if (strcmp("a.c", filename) == 0) {
+    *size = strlen(source_contents_0);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_0, *size);
+    return true;
+  }
+
+  if (strcmp("b.c", filename) == 0) {
+    *size = strlen(source_contents_1);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_1, *size);
+    return true;
+  }
+
+  if (strcmp("main.c", filename) == 0) {
+    *size = strlen(source_contents_2);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_2, *size);
+    return true;
+  }
+
+
+
+  // Otherwise, fallback to normal file loading (for includes, etc.)
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  rewind(fp);
+  *contents = malloc(*size);
+  fread(*contents, 1, *size, fp);
+  fclose(fp);
+  return true;
+}
+
+
+static void remove_cache_dir(const char* path) {
+#ifdef _WIN32
+  (void)path;  // The cache isn't implemented on Windows.
+#else
+  DIR* dir = opendir(path);
+  if (!dir)
+    return;
+  struct dirent* ent;
+  while ((ent = readdir(dir))) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+      continue;
+    char file[1024];
+    snprintf(file, sizeof(file), "%s/%s", path, ent->d_name);
+    unlink(file);
+  }
+  closedir(dir);
+  rmdir(path);
+#endif
+}
+
+int main(void) {
+
+#ifdef _WIN32
+  char cache_dir[] = "update_cache_placement_small_heap.cache";
+#else
+  char cache_dir[] = "update_cache_placement_small_heap.cache.XXXXXX";
+  if (!mkdtemp(cache_dir)) {
+    printf("couldn't create cache dir\n");
+    return 1;
+  }
+#endif
+
+  char* include_paths[] = {
+    NULL
+  };
+  char* input_paths[] = {
+    "a.c", "b.c", "main.c", NULL
+  };
+
+  DyibiccEnviromentData env_data = {
+      .include_paths = (const char**)include_paths,
+      .files = (const char**)input_paths,
+      .load_file_contents = get_file_by_name,
+      .get_function_address = get_host_helper_func,
+      .output_function = NULL,
+      .use_ansi_codes = false,
+      .generate_debug_symbols = false,
+      .cache_dir = cache_dir,
+  };
+
+
+  DyibiccContext* ctx = dyibicc_set_environment(&env_data);
+
+  int final_result = 0;
+  void* stable_main = NULL;
+  (void)stable_main;
+
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("initial update failed\n");
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step0[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x67,0x5b,0x32,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x69,0x6e,0x74,0x20,0x62,0x75,0x6d,0x70,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x2b,0x2b,0x67,0x5b,0x30,0x5d,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "a.c", contents_step0)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step1[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x67,0x5b,0x32,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x69,0x6e,0x74,0x20,0x62,0x75,0x6d,0x70,0x5f,0x62,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x2b,0x2b,0x67,0x5b,0x30,0x5d,0x3b,0xa,0x7d,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x6e,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x30,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x31,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x32,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x33,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x34,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x35,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x36,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x37,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x38,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x39,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x58,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x31,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x32,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x33,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x34,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x35,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x44,0x45,0x46,0x49,0x4e,0x45,0x28,0x69,0x29,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x68,0x61,0x72,0x20,0x66,0x23,0x23,0x69,0x5b,0x34,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x44,0x45,0x46,0x49,0x4e,0x45,0x29,0xa,'\0'};
+  if (!dyibicc_update(ctx, "b.c", contents_step1)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step2[] = {0x69,0x6e,0x74,0x20,0x62,0x75,0x6d,0x70,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x62,0x75,0x6d,0x70,0x28,0x29,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step2)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 1) {
+      printf("update_cache_placement_small_heap.py:33: got %d, but expected %d\n", result, 1);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache_placement_small_heap.py:33: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 2) {
+      printf("update_cache_placement_small_heap.py:34: got %d, but expected %d\n", result, 2);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache_placement_small_heap.py:34: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step5[] = {0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x69,0x6e,0x74,0x20,0x67,0x5b,0x32,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,0x69,0x6e,0x74,0x20,0x62,0x75,0x6d,0x70,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x2b,0x2b,0x67,0x5b,0x30,0x5d,0x3b,0xa,0x7d,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x6e,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x30,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x31,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x32,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x33,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x34,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x35,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x36,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x37,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x38,0x29,0x20,0x58,0x28,0x6e,0x23,0x23,0x39,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x41,0x52,0x52,0x41,0x59,0x53,0x28,0x58,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x31,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x32,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x33,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x34,0x29,0x20,0x54,0x45,0x4e,0x28,0x58,0x2c,0x20,0x35,0x29,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x44,0x45,0x46,0x49,0x4e,0x45,0x28,0x69,0x29,0x20,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x63,0x68,0x61,0x72,0x20,0x66,0x23,0x23,0x69,0x5b,0x34,0x30,0x30,0x30,0x30,0x30,0x5d,0x3b,0xa,'\0'};
+  if (!dyibicc_update(ctx, "b.c", contents_step5)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 1) {
+      printf("update_cache_placement_small_heap.py:40: got %d, but expected %d\n", result, 1);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache_placement_small_heap.py:40: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 2) {
+      printf("update_cache_placement_small_heap.py:41: got %d, but expected %d\n", result, 2);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_cache_placement_small_heap.py:41: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(!stats.files[1].loaded_from_cache)) {
+    printf("update_cache_placement_small_heap.py:42: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  printf("OK\n");
+fail:
+  dyibicc_free(ctx);
+  remove_cache_dir(cache_dir);
+  return final_result;
+}
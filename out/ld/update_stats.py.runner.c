@@ -0,0 +1,372 @@
+
+#include "libdyibicc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void* get_host_helper_func(const char* name) {
+  (void)name;
+  return NULL;
+
+}
+
+static char initial_0[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x57,0x49,0x43,0x45,0x28,0x78,0x29,0x20,0x28,0x28,0x78,0x29,0x20,0x2a,0x20,0x32,0x29,0xa,0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x76,0x61,0x6c,0x75,0x65,0x20,0x3d,0x20,0x35,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x54,0x57,0x49,0x43,0x45,0x28,0x76,0x61,0x6c,0x75,0x65,0x29,0x20,0x2b,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x29,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_0 = initial_0;
+static char initial_1[] = {0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_1 = initial_1;
+static char header_initial_0[] = {0x69,0x6e,0x74,0x20,0x75,0x6e,0x75,0x73,0x65,0x64,0x3b,0xa,'\0'};
+static char* header_contents_0 = header_initial_0;
+
+static bool get_file_by_name(const char* filename, char** contents, size_t* size) {
+  if (strcmp("unused.h", filename) == 0) {
+    *size = strlen(header_contents_0);
+    *contents = malloc(*size);
+    memcpy(*contents, header_contents_0, *size);
+    return true;
+  }
+
+
+  if (strcmp("main.c", filename) == 0) {
+    *size = strlen(source_contents_0);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_0, *size);
+    return true;
+  }
+
+  if (strcmp("other.c", filename) == 0) {
+    *size = strlen(source_contents_1);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_1, *size);
+    return true;
+  }
+
+
+
+  // Otherwise, fallback to normal file loading (for includes, etc.)
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  rewind(fp);
+  *contents = malloc(*size);
+  fread(*contents, 1, *size, fp);
+  fclose(fp);
+  return true;
+}
+
+
+int main(void) {
+
+  char* include_paths[] = {
+    NULL
+  };
+  char* input_paths[] = {
+    "main.c", "other.c", NULL
+  };
+
+  DyibiccEnviromentData env_data = {
+      .include_paths = (const char**)include_paths,
+      .files = (const char**)input_paths,
+      .load_file_contents = get_file_by_name,
+      .get_function_address = get_host_helper_func,
+      .output_function = NULL,
+      .use_ansi_codes = false,
+      .generate_debug_symbols = false,
+      .cache_dir = NULL,
+  };
+
+
+  DyibiccContext* ctx = dyibicc_set_environment(&env_data);
+
+  int final_result = 0;
+  void* stable_main = NULL;
+  (void)stable_main;
+
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("initial update failed\n");
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step0[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x57,0x49,0x43,0x45,0x28,0x78,0x29,0x20,0x28,0x28,0x78,0x29,0x20,0x2a,0x20,0x32,0x29,0xa,0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x76,0x61,0x6c,0x75,0x65,0x20,0x3d,0x20,0x35,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x54,0x57,0x49,0x43,0x45,0x28,0x76,0x61,0x6c,0x75,0x65,0x29,0x20,0x2b,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x29,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step0)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step1[] = {0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "other.c", contents_step1)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 11) {
+      printf("update_stats.py:19: got %d, but expected %d\n", result, 11);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_stats.py:19: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.num_files == 2 && stats.code_bytes > 0)) {
+    printf("update_stats.py:20: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.files[0].data_bytes >= sizeof(int))) {
+    printf("update_stats.py:21: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 11) {
+      printf("update_stats.py:24: got %d, but expected %d\n", result, 11);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_stats.py:24: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.num_files_compiled == 2)) {
+    printf("update_stats.py:25: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.num_tokens > 0 && stats.num_macro_expansions > 0)) {
+    printf("update_stats.py:26: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.num_nodes > 0 && stats.num_objs >= 3)) {
+    printf("update_stats.py:27: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.update_seconds > 0 && stats.phase_seconds[DYIBICC_PHASE_PARSE] > 0)) {
+    printf("update_stats.py:28: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.heap_high_water[DYIBICC_HEAP_COMPILE] > 0)) {
+    printf("update_stats.py:29: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.files[0].compiled_in_last_update && stats.files[1].compiled_in_last_update)) {
+    printf("update_stats.py:30: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step13[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x57,0x49,0x43,0x45,0x28,0x78,0x29,0x20,0x28,0x28,0x78,0x29,0x20,0x2a,0x20,0x32,0x29,0xa,0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x76,0x61,0x6c,0x75,0x65,0x20,0x3d,0x20,0x35,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x76,0x61,0x6c,0x75,0x65,0x20,0x2b,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x29,0x3b,0xa,0x7d,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step13)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 6) {
+      printf("update_stats.py:35: got %d, but expected %d\n", result, 6);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_stats.py:35: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.num_files_compiled == 1 && stats.num_macro_expansions == 0)) {
+    printf("update_stats.py:36: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.files[0].compiled_in_last_update && !stats.files[1].compiled_in_last_update)) {
+    printf("update_stats.py:37: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.files[1].num_tokens > 0)) {
+    printf("update_stats.py:38: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step18[] = {0x69,0x6e,0x74,0x20,0x73,0x74,0x69,0x6c,0x6c,0x5f,0x75,0x6e,0x75,0x73,0x65,0x64,0x3b,'\0'};
+  header_contents_0 = contents_step18;
+  if (!dyibicc_update_changed(ctx, "unused.h")) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.num_files_compiled == 0)) {
+    printf("update_stats.py:44: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.heap_high_water[DYIBICC_HEAP_COMPILE] == 0)) {
+    printf("update_stats.py:45: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step21[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x57,0x49,0x43,0x45,0x28,0x78,0x29,0x20,0x28,0x28,0x78,0x29,0x20,0x2a,0x20,0x32,0x29,0xa,0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x23,0x65,0x72,0x72,0x6f,0x72,0x20,0x73,0x74,0x6f,0x70,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x76,0x61,0x6c,0x75,0x65,0x20,0x2b,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x29,0x3b,0xa,0x7d,'\0'};
+  source_contents_0 = contents_step21;
+  if (dyibicc_update_changed(ctx, "main.c")) {
+    printf("update_stats.py:49: update succeeded, but expected failure\n");
+    final_result = 251;
+    goto fail;
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.update_seconds > 0 && stats.phase_seconds[DYIBICC_PHASE_PREPROCESS] > 0)) {
+    printf("update_stats.py:50: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(stats.phase_seconds[DYIBICC_PHASE_PREPROCESS] <= stats.update_seconds)) {
+    printf("update_stats.py:51: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  printf("OK\n");
+fail:
+  dyibicc_free(ctx);
+
+  return final_result;
+}
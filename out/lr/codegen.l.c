@@ -0,0 +1,4139 @@
+/*
+** This file has been pre-processed with DynASM.
+** https://luajit.org/dynasm.html
+** DynASM version 1.5.0, DynASM x64 version 1.5.0
+** DO NOT EDIT! The original file is in "../../src/codegen.in.c".
+*/
+
+#line 1 "../../src/codegen.in.c"
+#include "dyibicc.h"
+
+#define C(x) compiler_state.codegen__##x
+
+#define DASM_CHECKS 1
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4127)
+#pragma warning(disable : 4244)
+#endif
+#include "dynasm/dasm_proto.h"
+#include "dynasm/dasm_x86.h"
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include "dyn_basic_pdb.h"
+
+//| .arch x64
+#if DASM_VERSION != 10500
+#error "Version mismatch between DynASM and included encoding engine"
+#endif
+#line 21 "../../src/codegen.in.c"
+//| .section code, pdata
+#define DASM_SECTION_CODE	0
+#define DASM_SECTION_PDATA	1
+#define DASM_MAXSECTION		2
+#line 22 "../../src/codegen.in.c"
+//| .actionlist dynasm_actions
+static const unsigned char dynasm_actions[1729] = {
+  249,255,80,255,64,88,240,42,255,72,131,252,236,8,252,242,15,17,4,36,255,252,
+  242,64,15,16,4,240,140,36,72,131,196,8,255,252,243,15,16,0,255,252,242,15,
+  16,0,255,219,40,255,15,182,0,255,15,190,0,255,15,183,0,255,15,191,0,255,72,
+  99,0,255,72,139,0,255,68,138,128,233,68,136,135,233,255,252,243,15,17,7,255,
+  252,242,15,17,7,255,219,63,255,136,7,255,102,137,7,255,72,137,7,255,72,139,
+  133,233,255,72,141,133,233,255,72,141,5,245,255,249,72,139,5,0,0,0,0,255,
+  249,72,141,5,0,0,0,0,255,72,129,192,239,255,15,87,201,15,46,193,255,102,15,
+  87,201,102,15,46,193,255,217,252,238,223,232,221,216,255,131,252,248,0,255,
+  72,131,252,248,0,255,15,190,192,255,15,182,192,255,15,191,192,255,15,183,
+  192,255,252,243,15,42,192,255,72,99,192,255,252,242,15,42,192,255,137,68,
+  36,252,252,219,68,36,252,252,255,137,192,252,243,72,15,42,192,255,137,192,
+  255,137,192,252,242,72,15,42,192,255,137,192,72,137,68,36,252,248,223,108,
+  36,252,248,255,72,133,192,15,136,244,247,102,15,252,239,192,252,242,72,15,
+  42,192,252,233,244,248,248,1,72,137,199,131,224,1,102,15,252,239,192,72,209,
+  252,239,72,9,199,252,242,72,15,42,199,252,242,15,88,192,248,2,255,72,137,
+  68,36,252,248,223,108,36,252,248,72,133,192,15,137,244,247,184,0,0,128,95,
+  137,68,36,252,252,216,68,36,252,252,248,1,255,252,243,15,44,192,15,190,192,
+  255,252,243,15,44,192,15,182,192,255,252,243,15,44,192,15,191,192,255,252,
+  243,15,44,192,15,183,192,255,252,243,15,44,192,255,252,243,72,15,44,192,255,
+  252,243,15,90,192,255,252,243,15,17,68,36,252,252,217,68,36,252,252,255,252,
+  242,15,44,192,15,190,192,255,252,242,15,44,192,15,182,192,255,252,242,15,
+  44,192,15,191,192,255,252,242,15,44,192,15,183,192,255,252,242,15,44,192,
+  255,252,242,72,15,44,192,255,252,242,15,90,192,255,252,242,15,17,68,36,252,
+  248,221,68,36,252,248,255,217,124,36,252,246,15,183,68,36,252,246,128,204,
+  12,102,137,68,36,252,244,217,108,36,252,244,255,219,92,36,232,217,108,36,
+  252,246,15,191,68,36,232,255,219,92,36,232,217,108,36,252,246,15,183,68,36,
+  232,37,252,255,0,0,0,255,219,92,36,232,217,108,36,252,246,15,183,68,36,232,
+  255,219,92,36,232,217,108,36,252,246,139,68,36,232,255,223,124,36,232,217,
+  108,36,252,246,72,139,68,36,232,255,217,92,36,252,248,252,243,15,16,68,36,
+  252,248,255,221,92,36,252,248,252,242,15,16,68,36,252,248,255,15,149,208,
+  15,182,192,255,72,129,252,236,239,255,68,138,144,233,68,136,148,253,36,233,
+  255,72,131,252,236,8,255,72,131,252,236,16,219,60,36,255,252,243,15,17,133,
+  233,255,252,242,15,17,133,233,255,136,133,233,72,193,232,8,255,252,243,64,
+  15,17,133,253,240,140,233,255,252,242,64,15,17,133,253,240,140,233,255,64,
+  136,133,253,240,131,233,72,193,232,240,35,8,255,72,137,199,255,252,243,15,
+  16,7,255,252,242,15,16,7,255,72,199,192,0,0,0,0,255,72,193,224,8,102,139,
+  135,233,255,252,243,64,15,16,71,240,140,8,255,252,242,64,15,16,71,240,140,
+  8,255,72,199,192,240,35,0,0,0,0,255,72,193,224,240,35,8,64,138,135,253,240,
+  131,233,255,72,139,189,233,255,138,144,233,136,151,233,255,72,131,199,15,
+  131,231,252,240,255,72,139,141,233,72,41,225,72,137,224,72,41,252,252,72,
+  137,226,248,1,72,131,252,249,0,15,132,244,248,68,138,0,68,136,2,72,252,255,
+  194,72,252,255,192,72,252,255,201,252,233,244,1,248,2,255,72,139,133,233,
+  72,41,252,248,72,137,133,233,255,184,237,102,72,15,110,192,255,72,184,237,
+  237,102,72,15,110,192,255,72,184,237,237,72,137,68,36,252,240,72,184,237,
+  237,72,137,68,36,252,248,219,108,36,252,240,255,72,184,237,237,255,72,199,
+  192,237,255,72,199,192,1,0,0,0,72,193,224,31,102,72,15,110,200,15,87,193,
+  255,72,199,192,1,0,0,0,72,193,224,63,102,72,15,110,200,102,15,87,193,255,
+  217,224,255,72,252,247,216,255,72,193,224,235,255,72,193,232,235,255,72,193,
+  252,248,235,255,72,199,192,237,137,133,233,255,73,137,192,255,72,137,199,
+  72,129,231,239,72,193,231,235,255,72,139,4,36,255,73,199,193,237,76,33,200,
+  72,9,252,248,255,76,137,192,255,87,255,72,199,193,237,72,141,189,233,176,
+  0,252,243,170,255,95,255,15,132,245,255,252,233,245,249,255,15,148,208,72,
+  15,182,192,255,72,252,247,208,255,15,132,245,72,199,192,1,0,0,0,252,233,245,
+  249,72,199,192,0,0,0,0,249,255,15,133,245,255,15,133,245,72,199,192,0,0,0,
+  0,252,233,245,249,72,199,192,1,0,0,0,249,255,72,131,192,8,255,102,72,15,126,
+  192,240,132,240,36,255,72,129,252,236,239,73,137,194,65,252,255,210,72,129,
+  196,239,255,72,137,133,233,72,141,133,233,255,73,137,194,72,199,192,237,65,
+  252,255,210,72,129,196,239,255,252,240,15,176,23,255,102,252,240,15,177,23,
+  255,252,240,72,15,177,23,255,15,148,209,15,132,244,247,255,65,136,0,255,102,
+  65,137,0,255,73,137,0,255,248,1,15,182,193,255,134,7,255,102,135,7,255,72,
+  135,7,255,252,243,15,88,193,255,252,242,15,88,193,255,252,243,15,92,193,255,
+  252,242,15,92,193,255,252,243,15,89,193,255,252,242,15,89,193,255,252,243,
+  15,94,193,255,252,242,15,94,193,255,15,46,200,255,102,15,46,200,255,15,148,
+  208,15,155,210,32,208,255,15,149,208,15,154,210,8,208,255,15,151,208,255,
+  15,147,208,255,36,1,72,15,182,192,255,222,193,255,222,225,255,222,201,255,
+  222,252,241,255,223,252,241,221,216,255,15,148,208,255,15,149,208,255,72,
+  1,252,248,255,72,41,252,248,255,72,15,175,199,255,72,199,194,0,0,0,0,72,252,
+  247,252,247,255,186,0,0,0,0,252,247,252,247,255,72,153,255,72,252,247,252,
+  255,255,72,137,208,255,72,33,252,248,255,72,49,252,248,255,72,57,252,248,
+  255,15,146,208,255,15,156,208,255,15,150,208,255,15,158,208,255,72,137,252,
+  249,255,72,211,224,255,72,211,232,255,72,211,252,248,255,15,133,245,249,255,
+  72,129,252,248,239,255,72,137,199,72,129,252,239,239,72,129,252,255,239,255,
+  137,199,129,252,239,239,129,252,255,239,255,15,134,245,255,252,233,245,255,
+  252,255,224,255,64,136,133,253,240,131,233,255,102,64,137,133,253,240,139,
+  233,255,72,137,133,253,240,131,233,255,254,0,250,15,249,255,85,72,137,229,
+  255,249,76,139,21,0,0,0,0,65,252,255,210,72,41,196,255,254,1,250,3,249,235,
+  255,235,235,255,235,236,255,235,235,235,235,255,72,137,165,233,255,199,133,
+  233,237,199,133,233,237,72,137,173,233,72,131,133,233,16,72,137,173,233,72,
+  129,133,233,239,255,72,137,189,233,72,137,181,233,72,137,149,233,72,137,141,
+  233,76,137,133,233,76,137,141,233,252,242,15,17,133,233,252,242,15,17,141,
+  233,252,242,15,17,149,233,252,242,15,17,157,233,252,242,15,17,165,233,252,
+  242,15,17,173,233,252,242,15,17,181,233,252,242,15,17,189,233,255,72,137,
+  189,233,72,137,181,233,72,137,149,233,72,137,141,233,255,72,141,101,0,255,
+  72,137,252,236,255,93,195,255,250,3,249,254,0
+};
+
+#line 23 "../../src/codegen.in.c"
+//| .globals dynasm_globals
+enum {
+  dynasm_globals_MAX
+};
+#line 24 "../../src/codegen.in.c"
+//| .if WIN
+//| .define X64WIN, 1
+//| .endif
+
+#define Dst &C(dynasm)
+
+#define REG_DI 7
+#define REG_SI 6
+#define REG_DX 2
+#define REG_CX 1
+#define REG_R8 8
+#define REG_R9 9
+
+// Used with Rq(), Rd(), Rw(), Rb()
+#if X64WIN
+static int dasmargreg[] = {REG_CX, REG_DX, REG_R8, REG_R9};
+#define REG_UTIL REG_CX
+#define X64WIN_REG_MAX 4
+#define PARAMETER_SAVE_SIZE (4 * 8)
+#else
+static int dasmargreg[] = {REG_DI, REG_SI, REG_DX, REG_CX, REG_R8, REG_R9};
+#define REG_UTIL REG_DI
+#define SYSV_GP_MAX 6
+#define SYSV_FP_MAX 8
+#endif
+//| .if X64WIN
+//| .define CARG1, rcx
+//| .define CARG1d, ecx
+//| .define CARG2, rdx
+//| .define CARG3, r8
+//| .define CARG4, r9
+//| .define RUTIL, rcx
+//| .define RUTILd, ecx
+//| .define RUTILenc, 0x11
+//| .else
+//| .define CARG1, rdi
+//| .define CARG1d, edi
+//| .define CARG2, rsi
+//| .define CARG3, rdx
+//| .define CARG4, rcx
+//| .define CARG5, r8
+//| .define CARG6, r9
+//| .define RUTIL, rdi
+//| .define RUTILd, edi
+//| .define RUTILenc, 0x17
+//| .endif
+
+static void gen_expr(Node* node);
+static void gen_stmt(Node* node);
+static EmittedFunction* find_emitted_function(FileLinkData* fld, Obj* fn);
+
+// Whether code for `fn` is generated by this compile.
+static bool is_emitted_function(Obj* fn) {
+  return fn->is_function && fn->is_definition && fn->is_live && !fn->reuse_code;
+}
+
+#if X64WIN
+static void record_line_syminfo(int file_no, int line_no, int pclabel) {
+  // If file and line haven't changed, then we're working through parts of a
+  // single statement; just ignore.
+  int cur_len = C(current_fn)->file_line_label_data.len;
+  if (cur_len > 0 && C(current_fn)->file_line_label_data.data[cur_len - 1].a == file_no &&
+      C(current_fn)->file_line_label_data.data[cur_len - 1].b == line_no) {
+    return;
+  }
+
+  //|=>pclabel:
+  dasm_put(Dst, 0, pclabel);
+#line 91 "../../src/codegen.in.c"
+  intintintarray_push(&C(current_fn)->file_line_label_data, (IntIntInt){file_no, line_no, pclabel},
+                      AL_Compile);
+  // printf("%s:%d:label %d\n", compiler_state.tokenize__all_tokenized_files.data[file_no]->name,
+  // line_no, pclabel);
+}
+#endif
+
+IMPLSTATIC int codegen_pclabel(void) {
+  int ret = C(numlabels);
+  dasm_growpc(&C(dynasm), ++C(numlabels));
+  return ret;
+}
+
+// Code loads the address of symbols outside the file (and of functions whose
+// code is being reused or replaced) from a slot in the GOT, so linking never
+// writes to code. Returns a label at which a 7 byte `mov reg, [rip+disp32]`
+// should be emitted, whose disp32 is filled out by fill_out_got(). Slots are
+// shared by the loads in a function.
+#define GOT_LOAD_SIZE 7
+
+static int got_load_label(char* name) {
+  if (C(got_fn) != C(current_fn)) {
+    C(got_fn) = C(current_fn);
+    C(got_slots) = (HashMap){.alloc_lifetime = AL_Compile};
+  }
+  intptr_t slot = (intptr_t)hashmap_get(&C(got_slots), name);
+  if (!slot) {
+    strarray_push(&C(got_names), name, AL_Compile);
+    slot = C(got_names).len;
+    hashmap_put(&C(got_slots), name, (void*)slot);
+  }
+  int label = codegen_pclabel();
+  intintintarray_push(&C(got_uses),
+                      (IntIntInt){label, (int)slot - 1, C(current_fn)->dasm_entry_label},
+                      AL_Compile);
+  return label;
+}
+
+// Globals defined in this file are in range of the code, and don't move while
+// the code that refers to them is live: writable data is never reallocated
+// (see allocate_global_data()), and string literals that are unchanged keep
+// their pooled storage (see intern_rodata()). So code can refer to them with a
+// rip-relative lea rather than through the GOT. The exception is writable data
+// that's too big for the code heap, see place_global_data().
+static bool can_address_data_directly(Obj* var) {
+#if X64WIN
+  // The code is in the pdb image, rather than the code heap, in this case.
+  if (user_context->generate_debug_symbols)
+    return false;
+#endif
+  return var->is_definition && !var->is_tls && (var->is_rodata || var->in_code_heap);
+}
+
+// Writable globals at least this big are always allocated outside the code
+// heap (as with the medium code model's large data), so that a few large
+// arrays don't use up the space for everything else.
+#define LARGE_DATA_THRESHOLD (1 << 20)
+
+// Decides which of the writable globals defined in |prog| are in the code
+// heap, before code that refers to them is generated. Those that already exist
+// stay where they are. New ones go in the code heap if they're small enough
+// and there will be room for them when they're allocated by emit_data().
+static void place_global_data(Obj* prog) {
+  UserContext* uc = user_context;
+  size_t promised[NUM_CODE_HEAP_KINDS] = {0};
+  for (Obj* var = prog; var; var = var->next) {
+    if (var->is_function || !var->is_definition || var->is_rodata || var->is_tls)
+      continue;
+    size_t idx = var->is_static ? C(file_index) : uc->num_files;
+    char* existing = hashmap_get(&uc->global_data[idx], var->name);
+    if (existing) {
+      var->in_code_heap = code_heap_contains(existing);
+      continue;
+    }
+    CodeHeapKind kind = var->init_data ? CH_Data : CH_Bss;
+    size_t needed = (size_t)var->ty->size + global_data_alignment(var);
+    var->in_code_heap = var->ty->size < LARGE_DATA_THRESHOLD &&
+                        promised[kind] + needed <= code_heap_room(kind);
+    if (var->in_code_heap)
+      promised[kind] += needed;
+  }
+}
+
+// Returns a label at which a 7 byte `lea rax, [rip+disp32]` of |var| should be
+// emitted, whose disp32 is filled out by fill_out_data_loads().
+static int data_load_label(Obj* var) {
+  strarray_push(&C(data_names), var->name, AL_Compile);
+  int label = codegen_pclabel();
+  intintintarray_push(&C(data_uses), (IntIntInt){label, C(data_names).len - 1, var->is_static},
+                      AL_Compile);
+  return label;
+}
+
+static void push(void) {
+  //| push rax
+  dasm_put(Dst, 2);
+#line 186 "../../src/codegen.in.c"
+  C(depth)++;
+}
+
+static void pop(int dasmreg) {
+  //| pop Rq(dasmreg)
+  dasm_put(Dst, 4, (dasmreg));
+#line 191 "../../src/codegen.in.c"
+  C(depth)--;
+}
+
+static void pushf(void) {
+  //| sub rsp, 8
+  //| movsd qword [rsp], xmm0
+  dasm_put(Dst, 9);
+#line 197 "../../src/codegen.in.c"
+  C(depth)++;
+}
+
+static void popf(int reg) {
+  //| movsd xmm(reg), qword [rsp]
+  //| add rsp, 8
+  dasm_put(Dst, 21, (reg));
+#line 203 "../../src/codegen.in.c"
+  C(depth)--;
+}
+
+// Load a value from where %rax is pointing to.
+static void load(Type* ty) {
+  switch (ty->kind) {
+    case TY_STRUCT:
+    case TY_UNION:
+    case TY_ARRAY:
+    case TY_FUNC:
+    case TY_VLA:
+      // If it is an array, do not attempt to load a value to the
+      // register because in general we can't load an entire array to a
+      // register. As a result, the result of an evaluation of an array
+      // becomes not the array itself but the address of the array.
+      // This is where "array is automatically converted to a pointer to
+      // the first element of the array in C" occurs.
+      return;
+    case TY_FLOAT:
+      //| movss xmm0, dword [rax]
+      dasm_put(Dst, 35);
+#line 223 "../../src/codegen.in.c"
+      return;
+    case TY_DOUBLE:
+      //| movsd xmm0, qword [rax]
+      dasm_put(Dst, 41);
+#line 226 "../../src/codegen.in.c"
+      return;
+#if !X64WIN
+    case TY_LDOUBLE:
+      //| fld tword [rax]
+      dasm_put(Dst, 47);
+#line 230 "../../src/codegen.in.c"
+      return;
+#endif
+  }
+
+  // When we load a char or a short value to a register, we always
+  // extend them to the size of int, so we can assume the lower half of
+  // a register always contains a valid value. The upper half of a
+  // register for char, short and int may contain garbage. When we load
+  // a long value to a register, it simply occupies the entire register.
+  if (ty->size == 1) {
+    if (ty->is_unsigned) {
+      //| movzx eax, byte [rax]
+      dasm_put(Dst, 50);
+#line 242 "../../src/codegen.in.c"
+    } else {
+      //| movsx eax, byte [rax]
+      dasm_put(Dst, 54);
+#line 244 "../../src/codegen.in.c"
+    }
+  } else if (ty->size == 2) {
+    if (ty->is_unsigned) {
+      //| movzx eax, word [rax]
+      dasm_put(Dst, 58);
+#line 248 "../../src/codegen.in.c"
+    } else {
+      //| movsx eax, word [rax]
+      dasm_put(Dst, 62);
+#line 250 "../../src/codegen.in.c"
+    }
+  } else if (ty->size == 4) {
+    //| movsxd rax, dword [rax]
+    dasm_put(Dst, 66);
+#line 253 "../../src/codegen.in.c"
+  } else {
+    //| mov rax, qword [rax]
+    dasm_put(Dst, 70);
+#line 255 "../../src/codegen.in.c"
+  }
+}
+
+// Store %rax to an address that the stack top is pointing to.
+static void store(Type* ty) {
+  pop(REG_UTIL);
+
+  switch (ty->kind) {
+    case TY_STRUCT:
+    case TY_UNION:
+      for (int i = 0; i < ty->size; i++) {
+        //| mov r8b, [rax+i]
+        //| mov [RUTIL+i], r8b
+        dasm_put(Dst, 74, i, i);
+#line 268 "../../src/codegen.in.c"
+      }
+      return;
+    case TY_FLOAT:
+      //| movss dword [RUTIL], xmm0
+      dasm_put(Dst, 83);
+#line 272 "../../src/codegen.in.c"
+      return;
+    case TY_DOUBLE:
+      //| movsd qword [RUTIL], xmm0
+      dasm_put(Dst, 89);
+#line 275 "../../src/codegen.in.c"
+      return;
+#if !X64WIN
+    case TY_LDOUBLE:
+      //| fstp tword [RUTIL]
+      dasm_put(Dst, 95);
+#line 279 "../../src/codegen.in.c"
+      return;
+#endif
+  }
+
+  if (ty->size == 1) {
+    //| mov [RUTIL], al
+    dasm_put(Dst, 98);
+#line 285 "../../src/codegen.in.c"
+  } else if (ty->size == 2) {
+    //| mov [RUTIL], ax
+    dasm_put(Dst, 101);
+#line 287 "../../src/codegen.in.c"
+  } else if (ty->size == 4) {
+    //| mov [RUTIL], eax
+    dasm_put(Dst, 102);
+#line 289 "../../src/codegen.in.c"
+  } else {
+    //| mov [RUTIL], rax
+    dasm_put(Dst, 105);
+#line 291 "../../src/codegen.in.c"
+  }
+}
+
+// Compute the absolute address of a given node.
+// It's an error if a given node does not reside in memory.
+static void gen_addr(Node* node) {
+  switch (node->kind) {
+    case ND_VAR:
+      // Variable-length array, which is always local.
+      if (node->var->ty->kind == TY_VLA) {
+        //| mov rax, [rbp+node->var->offset]
+        dasm_put(Dst, 109, node->var->offset);
+#line 302 "../../src/codegen.in.c"
+        return;
+      }
+
+      // Local variable
+      if (node->var->is_local) {
+        //| lea rax, [rbp+node->var->offset]
+        dasm_put(Dst, 114, node->var->offset);
+#line 308 "../../src/codegen.in.c"
+#if X64WIN
+        if (node->var->is_param_passed_by_reference) {
+          //| mov rax, [rax]
+          dasm_put(Dst, 70);
+#line 311 "../../src/codegen.in.c"
+        }
+#endif
+        return;
+      }
+
+      // Thread-local variable
+      if (node->var->is_tls) {
+        // println("  mov rax, fs:0");
+        // println("  add rax, [rel %s wrt ..gottpoff]", node->var->name);
+        error_tok(node->tok, "TLS not implemented");
+        return;
+      }
+
+      // Function
+      if (node->ty->kind == TY_FUNC) {
+        // A replaced function's address is its original entry, which is
+        // where the reused code and the exports refer to.
+        if (node->var->is_definition && !node->var->reuse_code && !node->var->replaces_code) {
+          //| lea rax, [=>node->var->dasm_entry_label]
+          dasm_put(Dst, 119, node->var->dasm_entry_label);
+#line 330 "../../src/codegen.in.c"
+        } else {
+          int got_load = got_load_label(node->var->name);
+          //|=>got_load:
+          //| .byte 0x48, 0x8b, 0x05  // mov rax, [rip+disp32]
+          //| .dword 0
+          dasm_put(Dst, 124, got_load);
+#line 335 "../../src/codegen.in.c"
+        }
+        return;
+      }
+
+      // Global variable
+      if (can_address_data_directly(node->var)) {
+        int data_load = data_load_label(node->var);
+        //|=>data_load:
+        //| .byte 0x48, 0x8d, 0x05  // lea rax, [rip+disp32]
+        //| .dword 0
+        dasm_put(Dst, 133, data_load);
+#line 345 "../../src/codegen.in.c"
+        return;
+      }
+      int got_load = got_load_label(node->var->name);
+      //|=>got_load:
+      //| .byte 0x48, 0x8b, 0x05  // mov rax, [rip+disp32]
+      //| .dword 0
+      dasm_put(Dst, 124, got_load);
+#line 351 "../../src/codegen.in.c"
+      return;
+    case ND_DEREF:
+      gen_expr(node->lhs);
+      return;
+    case ND_COMMA:
+      gen_expr(node->lhs);
+      gen_addr(node->rhs);
+      return;
+    case ND_MEMBER:
+      gen_addr(node->lhs);
+      //| add rax, node->member->offset
+      dasm_put(Dst, 142, node->member->offset);
+#line 362 "../../src/codegen.in.c"
+      return;
+    case ND_FUNCALL:
+      if (node->ret_buffer) {
+        gen_expr(node);
+        return;
+      }
+      break;
+    case ND_ASSIGN:
+    case ND_COND:
+      if (node->ty->kind == TY_STRUCT || node->ty->kind == TY_UNION) {
+        gen_expr(node);
+        return;
+      }
+      break;
+    case ND_VLA_PTR:
+      //| lea rax, [rbp+node->var->offset]
+      dasm_put(Dst, 114, node->var->offset);
+#line 378 "../../src/codegen.in.c"
+      return;
+  }
+
+  error_tok(node->tok, "not an lvalue");
+}
+
+static void cmp_zero(Type* ty) {
+  switch (ty->kind) {
+    case TY_FLOAT:
+      //| xorps xmm1, xmm1
+      //| ucomiss xmm0, xmm1
+      dasm_put(Dst, 147);
+#line 389 "../../src/codegen.in.c"
+      return;
+    case TY_DOUBLE:
+      //| xorpd xmm1, xmm1
+      //| ucomisd xmm0, xmm1
+      dasm_put(Dst, 154);
+#line 393 "../../src/codegen.in.c"
+      return;
+#if !X64WIN
+    case TY_LDOUBLE:
+      //| fldz
+      //| fucomip st0
+      //| fstp st0
+      dasm_put(Dst, 163);
+#line 399 "../../src/codegen.in.c"
+      return;
+#endif
+  }
+
+  if (is_integer(ty) && ty->size <= 4) {
+    //| cmp eax, 0
+    dasm_put(Dst, 171);
+#line 405 "../../src/codegen.in.c"
+  } else {
+    //| cmp rax, 0
+    dasm_put(Dst, 176);
+#line 407 "../../src/codegen.in.c"
+  }
+}
+
+enum { I8, I16, I32, I64, U8, U16, U32, U64, F32, F64, F80 };
+
+static int get_type_id(Type* ty) {
+  switch (ty->kind) {
+    case TY_CHAR:
+      return ty->is_unsigned ? U8 : I8;
+    case TY_SHORT:
+      return ty->is_unsigned ? U16 : I16;
+    case TY_INT:
+      return ty->is_unsigned ? U32 : I32;
+    case TY_LONG:
+      return ty->is_unsigned ? U64 : I64;
+    case TY_FLOAT:
+      return F32;
+    case TY_DOUBLE:
+      return F64;
+#if !X64WIN
+    case TY_LDOUBLE:
+      return F80;
+#endif
+  }
+  return U64;
+}
+
+static void i32i8(void) {
+  //| movsx eax, al
+  dasm_put(Dst, 182);
+#line 436 "../../src/codegen.in.c"
+}
+static void i32u8(void) {
+  //| movzx eax, al
+  dasm_put(Dst, 186);
+#line 439 "../../src/codegen.in.c"
+}
+static void i32i16(void) {
+  //| movsx eax, ax
+  dasm_put(Dst, 190);
+#line 442 "../../src/codegen.in.c"
+}
+static void i32u16(void) {
+  //| movzx eax, ax
+  dasm_put(Dst, 194);
+#line 445 "../../src/codegen.in.c"
+}
+static void i32f32(void) {
+  //| cvtsi2ss xmm0, eax
+  dasm_put(Dst, 198);
+#line 448 "../../src/codegen.in.c"
+}
+static void i32i64(void) {
+  //| movsxd rax, eax
+  dasm_put(Dst, 204);
+#line 451 "../../src/codegen.in.c"
+}
+static void i32f64(void) {
+  //| cvtsi2sd xmm0, eax
+  dasm_put(Dst, 208);
+#line 454 "../../src/codegen.in.c"
+}
+static void i32f80(void) {
+  //| mov [rsp-4], eax
+  //| fild dword [rsp-4]
+  dasm_put(Dst, 214);
+#line 458 "../../src/codegen.in.c"
+}
+
+static void u32f32(void) {
+  //| mov eax, eax
+  //| cvtsi2ss xmm0, rax
+  dasm_put(Dst, 225);
+#line 463 "../../src/codegen.in.c"
+}
+static void u32i64(void) {
+  //| mov eax, eax
+  dasm_put(Dst, 234);
+#line 466 "../../src/codegen.in.c"
+}
+static void u32f64(void) {
+  //| mov eax, eax
+  //| cvtsi2sd xmm0, rax
+  dasm_put(Dst, 237);
+#line 470 "../../src/codegen.in.c"
+}
+static void u32f80(void) {
+  //| mov eax, eax
+  //| mov [rsp-8], rax
+  //| fild qword [rsp-8]
+  dasm_put(Dst, 246);
+#line 475 "../../src/codegen.in.c"
+}
+
+static void i64f32(void) {
+  //| cvtsi2ss xmm0, rax
+  dasm_put(Dst, 227);
+#line 479 "../../src/codegen.in.c"
+}
+static void i64f64(void) {
+  //| cvtsi2sd xmm0, rax
+  dasm_put(Dst, 239);
+#line 482 "../../src/codegen.in.c"
+}
+static void i64f80(void) {
+  //| mov [rsp-8], rax
+  //| fild qword [rsp-8]
+  dasm_put(Dst, 248);
+#line 486 "../../src/codegen.in.c"
+}
+
+static void u64f32(void) {
+  //| cvtsi2ss xmm0, rax
+  dasm_put(Dst, 227);
+#line 490 "../../src/codegen.in.c"
+}
+static void u64f64(void) {
+  //| test rax,rax
+  //| js >1
+  //| pxor xmm0,xmm0
+  //| cvtsi2sd xmm0,rax
+  //| jmp >2
+  //|1:
+  //| mov RUTIL,rax
+  //| and eax,1
+  //| pxor xmm0,xmm0
+  //| shr RUTIL, 1
+  //| or RUTIL,rax
+  //| cvtsi2sd xmm0,RUTIL
+  //| addsd xmm0,xmm0
+  //|2:
+  dasm_put(Dst, 260);
+#line 506 "../../src/codegen.in.c"
+}
+static void u64f80(void) {
+  //| mov [rsp-8], rax
+  //| fild qword [rsp-8]
+  //| test rax, rax
+  //| jns >1
+  //| mov eax, 1602224128
+  //| mov [rsp-4], eax
+  //| fadd dword [rsp-4]
+  //|1:
+  dasm_put(Dst, 316);
+#line 516 "../../src/codegen.in.c"
+}
+
+static void f32i8(void) {
+  //| cvttss2si eax, xmm0
+  //| movsx eax, al
+  dasm_put(Dst, 352);
+#line 521 "../../src/codegen.in.c"
+}
+static void f32u8(void) {
+  //| cvttss2si eax, xmm0
+  //| movzx eax, al
+  dasm_put(Dst, 361);
+#line 525 "../../src/codegen.in.c"
+}
+static void f32i16(void) {
+  //| cvttss2si eax, xmm0
+  //| movsx eax, ax
+  dasm_put(Dst, 370);
+#line 529 "../../src/codegen.in.c"
+}
+static void f32u16(void) {
+  //| cvttss2si eax, xmm0
+  //| movzx eax, ax
+  dasm_put(Dst, 379);
+#line 533 "../../src/codegen.in.c"
+}
+static void f32i32(void) {
+  //| cvttss2si eax, xmm0
+  dasm_put(Dst, 388);
+#line 536 "../../src/codegen.in.c"
+}
+static void f32u32(void) {
+  //| cvttss2si rax, xmm0
+  dasm_put(Dst, 394);
+#line 539 "../../src/codegen.in.c"
+}
+static void f32i64(void) {
+  //| cvttss2si rax, xmm0
+  dasm_put(Dst, 394);
+#line 542 "../../src/codegen.in.c"
+}
+static void f32u64(void) {
+  //| cvttss2si rax, xmm0
+  dasm_put(Dst, 394);
+#line 545 "../../src/codegen.in.c"
+}
+static void f32f64(void) {
+  //| cvtss2sd xmm0, xmm0
+  dasm_put(Dst, 401);
+#line 548 "../../src/codegen.in.c"
+}
+static void f32f80(void) {
+  //| movss dword [rsp-4], xmm0
+  //| fld dword [rsp-4]
+  dasm_put(Dst, 407);
+#line 552 "../../src/codegen.in.c"
+}
+
+static void f64i8(void) {
+  //| cvttsd2si eax, xmm0
+  //| movsx eax, al
+  dasm_put(Dst, 421);
+#line 557 "../../src/codegen.in.c"
+}
+static void f64u8(void) {
+  //| cvttsd2si eax, xmm0
+  //| movzx eax, al
+  dasm_put(Dst, 430);
+#line 561 "../../src/codegen.in.c"
+}
+static void f64i16(void) {
+  //| cvttsd2si eax, xmm0
+  //| movsx eax, ax
+  dasm_put(Dst, 439);
+#line 565 "../../src/codegen.in.c"
+}
+static void f64u16(void) {
+  //| cvttsd2si eax, xmm0
+  //| movzx eax, ax
+  dasm_put(Dst, 448);
+#line 569 "../../src/codegen.in.c"
+}
+static void f64i32(void) {
+  //| cvttsd2si eax, xmm0
+  dasm_put(Dst, 457);
+#line 572 "../../src/codegen.in.c"
+}
+static void f64u32(void) {
+  //| cvttsd2si rax, xmm0
+  dasm_put(Dst, 463);
+#line 575 "../../src/codegen.in.c"
+}
+static void f64i64(void) {
+  //| cvttsd2si rax, xmm0
+  dasm_put(Dst, 463);
+#line 578 "../../src/codegen.in.c"
+}
+static void f64u64(void) {
+  //| cvttsd2si rax, xmm0
+  dasm_put(Dst, 463);
+#line 581 "../../src/codegen.in.c"
+}
+static void f64f32(void) {
+  //| cvtsd2ss xmm0, xmm0
+  dasm_put(Dst, 470);
+#line 584 "../../src/codegen.in.c"
+}
+static void f64f80(void) {
+  //| movsd qword [rsp-8], xmm0
+  //| fld qword [rsp-8]
+  dasm_put(Dst, 476);
+#line 588 "../../src/codegen.in.c"
+}
+
+static void from_f80_1(void) {
+  //| fnstcw word [rsp-10]
+  //| movzx eax, word [rsp-10]
+  //| or ah, 12
+  //| mov [rsp-12], ax
+  //| fldcw word [rsp-12]
+  dasm_put(Dst, 490);
+#line 596 "../../src/codegen.in.c"
+}
+
+#define FROM_F80_2 " [rsp-24]\n fldcw [rsp-10]\n "
+
+static void f80i8(void) {
+  from_f80_1();
+  //| fistp dword [rsp-24]
+  //| fldcw word [rsp-10]
+  //| movsx eax, word [rsp-24]
+  dasm_put(Dst, 516);
+#line 605 "../../src/codegen.in.c"
+}
+static void f80u8(void) {
+  from_f80_1();
+  //| fistp dword [rsp-24]
+  //| fldcw word [rsp-10]
+  //| movzx eax, word [rsp-24]
+  //| and eax, 0xff
+  dasm_put(Dst, 531);
+#line 612 "../../src/codegen.in.c"
+}
+static void f80i16(void) {
+  from_f80_1();
+  //| fistp dword [rsp-24]
+  //| fldcw word [rsp-10]
+  //| movsx eax, word [rsp-24]
+  dasm_put(Dst, 516);
+#line 618 "../../src/codegen.in.c"
+}
+static void f80u16(void) {
+  from_f80_1();
+  //| fistp dword [rsp-24]
+  //| fldcw word [rsp-10]
+  //| movzx eax, word [rsp-24]
+  dasm_put(Dst, 552);
+#line 624 "../../src/codegen.in.c"
+}
+static void f80i32(void) {
+  from_f80_1();
+  //| fistp dword [rsp-24]
+  //| fldcw word [rsp-10]
+  //| mov eax, [rsp-24]
+  dasm_put(Dst, 567);
+#line 630 "../../src/codegen.in.c"
+}
+static void f80u32(void) {
+  from_f80_1();
+  //| fistp dword [rsp-24]
+  //| fldcw word [rsp-10]
+  //| mov eax, [rsp-24]
+  dasm_put(Dst, 567);
+#line 636 "../../src/codegen.in.c"
+}
+static void f80i64(void) {
+  from_f80_1();
+  //| fistp qword [rsp-24]
+  //| fldcw word [rsp-10]
+  //| mov rax, [rsp-24]
+  dasm_put(Dst, 581);
+#line 642 "../../src/codegen.in.c"
+}
+static void f80u64(void) {
+  from_f80_1();
+  //| fistp qword [rsp-24]
+  //| fldcw word [rsp-10]
+  //| mov rax, [rsp-24]
+  dasm_put(Dst, 581);
+#line 648 "../../src/codegen.in.c"
+}
+static void f80f32(void) {
+  //| fstp dword [rsp-8]
+  //| movss xmm0, dword [rsp-8]
+  dasm_put(Dst, 596);
+#line 652 "../../src/codegen.in.c"
+}
+static void f80f64(void) {
+  //| fstp qword [rsp-8]
+  //| movsd xmm0, qword [rsp-8]
+  dasm_put(Dst, 610);
+#line 656 "../../src/codegen.in.c"
+}
+
+typedef void (*DynasmCastFunc)(void);
+
+// clang-format off
+
+// The table for type casts
+static DynasmCastFunc dynasm_cast_table[][11] = {
+  // "to" is the rows, "from" the columns
+  // i8   i16     i32     i64     u8     u16     u32     u64     f32     f64     f80
+  {NULL,  NULL,   NULL,   i32i64, i32u8, i32u16, NULL,   i32i64, i32f32, i32f64, i32f80}, // i8
+  {i32i8, NULL,   NULL,   i32i64, i32u8, i32u16, NULL,   i32i64, i32f32, i32f64, i32f80}, // i16
+  {i32i8, i32i16, NULL,   i32i64, i32u8, i32u16, NULL,   i32i64, i32f32, i32f64, i32f80}, // i32
+  {i32i8, i32i16, NULL,   NULL,   i32u8, i32u16, NULL,   NULL,   i64f32, i64f64, i64f80}, // i64
+
+  {i32i8, NULL,   NULL,   i32i64, NULL,  NULL,   NULL,   i32i64, i32f32, i32f64, i32f80}, // u8
+  {i32i8, i32i16, NULL,   i32i64, i32u8, NULL,   NULL,   i32i64, i32f32, i32f64, i32f80}, // u16
+  {i32i8, i32i16, NULL,   u32i64, i32u8, i32u16, NULL,   u32i64, u32f32, u32f64, u32f80}, // u32
+  {i32i8, i32i16, NULL,   NULL,   i32u8, i32u16, NULL,   NULL,   u64f32, u64f64, u64f80}, // u64
+
+  {f32i8, f32i16, f32i32, f32i64, f32u8, f32u16, f32u32, f32u64, NULL,   f32f64, f32f80}, // f32
+  {f64i8, f64i16, f64i32, f64i64, f64u8, f64u16, f64u32, f64u64, f64f32, NULL,   f64f80}, // f64
+  {f80i8, f80i16, f80i32, f80i64, f80u8, f80u16, f80u32, f80u64, f80f32, f80f64, NULL},   // f80
+};
+
+// clang-format on
+
+// This can't be "cast()" when amalgamated because parse has a cast() as well.
+static void cg_cast(Type* from, Type* to) {
+  if (to->kind == TY_VOID)
+    return;
+
+  if (to->kind == TY_BOOL) {
+    cmp_zero(from);
+    //| setne al
+    //| movzx eax, al
+    dasm_put(Dst, 624);
+#line 692 "../../src/codegen.in.c"
+    return;
+  }
+
+  int t1 = get_type_id(from);
+  int t2 = get_type_id(to);
+  if (dynasm_cast_table[t1][t2]) {
+    dynasm_cast_table[t1][t2]();
+  }
+}
+
+#if !X64WIN
+
+// Structs or unions equal or smaller than 16 bytes are passed
+// using up to two registers.
+//
+// If the first 8 bytes contains only floating-point type members,
+// they are passed in an XMM register. Otherwise, they are passed
+// in a general-purpose register.
+//
+// If a struct/union is larger than 8 bytes, the same rule is
+// applied to the the next 8 byte chunk.
+//
+// This function returns true if `ty` has only floating-point
+// members in its byte range [lo, hi).
+static bool has_flonum(Type* ty, int lo, int hi, int offset) {
+  if (ty->kind == TY_STRUCT || ty->kind == TY_UNION) {
+    for (Member* mem = ty->members; mem; mem = mem->next)
+      if (!has_flonum(mem->ty, lo, hi, offset + mem->offset))
+        return false;
+    return true;
+  }
+
+  if (ty->kind == TY_ARRAY) {
+    for (int i = 0; i < ty->array_len; i++)
+      if (!has_flonum(ty->base, lo, hi, offset + ty->base->size * i))
+        return false;
+    return true;
+  }
+
+  return offset < lo || hi <= offset || ty->kind == TY_FLOAT || ty->kind == TY_DOUBLE;
+}
+
+static bool has_flonum1(Type* ty) {
+  return has_flonum(ty, 0, 8, 0);
+}
+
+static bool has_flonum2(Type* ty) {
+  return has_flonum(ty, 8, 16, 0);
+}
+
+#endif
+
+static int push_struct(Type* ty) {
+  int sz = (int)align_to_s(ty->size, 8);
+  //| sub rsp, sz
+  dasm_put(Dst, 631, sz);
+#line 747 "../../src/codegen.in.c"
+  C(depth) += sz / 8;
+
+  for (int i = 0; i < ty->size; i++) {
+    //| mov r10b, [rax+i]
+    //| mov [rsp+i], r10b
+    dasm_put(Dst, 637, i, i);
+#line 752 "../../src/codegen.in.c"
+  }
+
+  return sz;
+}
+
+#if X64WIN
+
+bool type_passed_in_register(Type* ty) {
+  // https://learn.microsoft.com/en-us/cpp/build/x64-calling-convention:
+  //   "__m128 types, arrays, and strings are never passed by immediate value.
+  //   Instead, a pointer is passed to memory allocated by the caller. Structs
+  //   and unions of size 8, 16, 32, or 64 bits, and __m64 types, are passed as
+  //   if they were integers of the same size."
+  //
+  // Note that e.g. a pragma pack 5 byte structure will be passed by reference,
+  // so this is not just size <= 8 as it is for 16 on SysV.
+  //
+  // Arrays and strings as mentioned won't be TY_STRUCT/TY_UNION so they should
+  // not use this function.
+  return ty->size == 1 || ty->size == 2 || ty->size == 4 || ty->size == 8;
+}
+
+static void push_args2_win(Node* args, bool first_pass) {
+  if (!args)
+    return;
+  push_args2_win(args->next, first_pass);
+
+  // Push all the by-stack first, then on the second pass, push all the things
+  // that will be popped back into registers by the actual call.
+  if ((first_pass && !args->pass_by_stack) || (!first_pass && args->pass_by_stack))
+    return;
+
+  if ((args->ty->kind != TY_STRUCT && args->ty->kind != TY_UNION) ||
+      type_passed_in_register(args->ty)) {
+    gen_expr(args);
+  }
+
+  switch (args->ty->kind) {
+    case TY_STRUCT:
+    case TY_UNION:
+      if (!type_passed_in_register(args->ty)) {
+        assert(args->pass_by_reference);
+        //| lea rax, [rbp - C(current_fn)->stack_size - args->pass_by_reference]
+        dasm_put(Dst, 114, - C(current_fn)->stack_size - args->pass_by_reference);
+#line 795 "../../src/codegen.in.c"
+      } else {
+        //| mov rax, [rax]
+        dasm_put(Dst, 70);
+#line 797 "../../src/codegen.in.c"
+      }
+      push();
+      break;
+    case TY_FLOAT:
+    case TY_DOUBLE:
+      pushf();
+      break;
+    default:
+      push();
+      break;
+  }
+}
+
+// --- Windows ---
+// Load function call arguments. Arguments are already evaluated and
+// stored to the stack as local variables. What we need to do in this
+// function is to load them to registers or push them to the stack as
+// required by the Windows ABI.
+//
+// - Integer arguments in the leftmost four positions are passed in RCX, RDX,
+//   R8, and R9.
+//
+// - Floating point arguments in the leftmost four position are passed in
+//   XMM0-XM3.
+//
+// - The 5th and subsequent arguments are push on the stack in right-to-left
+//   order.
+//
+// - Arguments larger than 8 bytes are always passed by reference.
+//
+// - When mixing integer and floating point arguments, the opposite type's
+//   register is left unused, e.g.
+//
+//     void func(int a, double b, int c, float d, int e, float f);
+//
+//   would have a in RCX, b in XMM1, c in R8, d in XMM3, f then e pushed on stack.
+//
+// - Varargs follow the same conventions, but floating point values must also
+//   have their value stored in the corresponding integer register for the first
+//   four arguments.
+//
+// - For larger than 8 byte structs, they're passed by reference. So we first
+//   need to make a local copy on the stack (since they're still passed by value
+//   not reference as far as the language is concerned), but then pass a pointer
+//   to the copy rather than to the actual data. This difference definitely
+//   casues the most changes vs. SysV in the rest of the compiler.
+//
+// - Integer return values of 8 bytes or less are in RAX (including user-defined
+//   types like small structures). Floating point are returned in XMM0. For
+//   user-defined types that are larger than 8 bytes, the caller allocates a
+//   buffer and passes the address of the buffer in RCX, taking up the first
+//   integer register slot. The function returns the same address passed in RCX
+//   in RAX.
+//
+// - RAX, RCX, RDX, R8, R9, R10, R11, and XMM0-XMM5 are volatile.
+// - RBX, RBP, RDI, RSI, RSP, R12, R13, R14, R15, and XMM6-XMM15 are
+//   non-volatile.
+//
+// --- Windows ---
+static int push_args_win(Node* node, int* by_ref_copies_size) {
+  int stack = 0, reg = 0;
+
+  bool has_by_ref_args = false;
+  for (Node* arg = node->args; arg; arg = arg->next) {
+    if ((arg->ty->kind == TY_STRUCT || arg->ty->kind == TY_UNION) &&
+        !type_passed_in_register(arg->ty)) {
+      has_by_ref_args = true;
+      break;
+    }
+  }
+
+  // If the return type is a large struct/union, the caller passes
+  // a pointer to a buffer as if it were the first argument.
+  if (node->ret_buffer && !type_passed_in_register(node->ty))
+    reg++;
+
+  *by_ref_copies_size = 0;
+
+  // Load as many arguments to the registers as possible.
+  for (Node* arg = node->args; arg; arg = arg->next) {
+    Type* ty = arg->ty;
+
+    switch (ty->kind) {
+      case TY_STRUCT:
+      case TY_UNION:
+        // It's either small and so passed in a register, or isn't and then
+        // we're instead storing the pointer to the larger struct.
+        if (reg++ >= X64WIN_REG_MAX) {
+          arg->pass_by_stack = true;
+          ++stack;
+        }
+        if (!type_passed_in_register(ty)) {
+          // Make a copy, and note the offset for passing by reference.
+          gen_expr(arg);
+          *by_ref_copies_size += push_struct(ty);
+          arg->pass_by_reference = C(depth) * 8;
+        }
+        break;
+      case TY_FLOAT:
+      case TY_DOUBLE:
+        if (reg++ >= X64WIN_REG_MAX) {
+          arg->pass_by_stack = true;
+          stack++;
+        }
+        break;
+      default:
+        if (reg++ >= X64WIN_REG_MAX) {
+          arg->pass_by_stack = true;
+          stack++;
+        }
+    }
+  }
+
+  assert((*by_ref_copies_size == 0 && !has_by_ref_args) ||
+         (*by_ref_copies_size && has_by_ref_args));
+
+  // Realign the stack to 16 bytes if rsp fiddling mucked it up.
+  if ((C(depth) + stack) % 2 == 1) {
+    //| sub rsp, 8
+    dasm_put(Dst, 648);
+#line 916 "../../src/codegen.in.c"
+    C(depth)++;
+    stack++;
+  }
+
+  push_args2_win(node->args, true);
+  push_args2_win(node->args, false);
+
+  // If the return type is a large struct/union, the caller passes
+  // a pointer to a buffer as if it were the first argument.
+  if (node->ret_buffer && !type_passed_in_register(node->ty)) {
+    //| lea rax, [rbp+node->ret_buffer->offset]
+    dasm_put(Dst, 114, node->ret_buffer->offset);
+#line 927 "../../src/codegen.in.c"
+    push();
+  }
+
+  return stack;
+}
+
+#else
+
+static void push_args2_sysv(Node* args, bool first_pass) {
+  if (!args)
+    return;
+  push_args2_sysv(args->next, first_pass);
+
+  // Push all the by-stack first, then on the second pass, push all the things
+  // that will be popped back into registers by the actual call.
+  if ((first_pass && !args->pass_by_stack) || (!first_pass && args->pass_by_stack))
+    return;
+
+  gen_expr(args);
+
+  switch (args->ty->kind) {
+    case TY_STRUCT:
+    case TY_UNION:
+      push_struct(args->ty);
+      break;
+    case TY_FLOAT:
+    case TY_DOUBLE:
+      pushf();
+      break;
+    case TY_LDOUBLE:
+      //| sub rsp, 16
+      //| fstp tword [rsp]
+      dasm_put(Dst, 654);
+#line 959 "../../src/codegen.in.c"
+      C(depth) += 2;
+      break;
+    default:
+      push();
+      break;
+  }
+}
+
+// --- SysV ---
+//
+// Load function call arguments. Arguments are already evaluated and
+// stored to the stack as local variables. What we need to do in this
+// function is to load them to registers or push them to the stack as
+// specified by the x86-64 psABI. Here is what the spec says:
+//
+// - Up to 6 arguments of integral type are passed using RDI, RSI,
+//   RDX, RCX, R8 and R9.
+//
+// - Up to 8 arguments of floating-point type are passed using XMM0 to
+//   XMM7.
+//
+// - If all registers of an appropriate type are already used, push an
+//   argument to the stack in the right-to-left order.
+//
+// - Each argument passed on the stack takes 8 bytes, and the end of
+//   the argument area must be aligned to a 16 byte boundary.
+//
+// - If a function is variadic, set the number of floating-point type
+//   arguments to RAX.
+//
+// --- SysV ---
+static int push_args_sysv(Node* node) {
+  int stack = 0, gp = 0, fp = 0;
+
+  // If the return type is a large struct/union, the caller passes
+  // a pointer to a buffer as if it were the first argument.
+  if (node->ret_buffer && node->ty->size > 16)
+    gp++;
+
+  // Load as many arguments to the registers as possible.
+  for (Node* arg = node->args; arg; arg = arg->next) {
+    Type* ty = arg->ty;
+
+    switch (ty->kind) {
+      case TY_STRUCT:
+      case TY_UNION:
+        if (ty->size > 16) {
+          arg->pass_by_stack = true;
+          stack += align_to_s(ty->size, 8) / 8;
+        } else {
+          bool fp1 = has_flonum1(ty);
+          bool fp2 = has_flonum2(ty);
+
+          if (fp + fp1 + fp2 < SYSV_FP_MAX && gp + !fp1 + !fp2 < SYSV_GP_MAX) {
+            fp = fp + fp1 + fp2;
+            gp = gp + !fp1 + !fp2;
+          } else {
+            arg->pass_by_stack = true;
+            stack += align_to_s(ty->size, 8) / 8;
+          }
+        }
+        break;
+      case TY_FLOAT:
+      case TY_DOUBLE:
+        if (fp++ >= SYSV_FP_MAX) {
+          arg->pass_by_stack = true;
+          stack++;
+        }
+        break;
+      case TY_LDOUBLE:
+        arg->pass_by_stack = true;
+        stack += 2;
+        break;
+      default:
+        if (gp++ >= SYSV_GP_MAX) {
+          arg->pass_by_stack = true;
+          stack++;
+        }
+    }
+  }
+
+  if ((C(depth) + stack) % 2 == 1) {
+    //| sub rsp, 8
+    dasm_put(Dst, 648);
+#line 1042 "../../src/codegen.in.c"
+    C(depth)++;
+    stack++;
+  }
+
+  push_args2_sysv(node->args, true);
+  push_args2_sysv(node->args, false);
+
+  // If the return type is a large struct/union, the caller passes
+  // a pointer to a buffer as if it were the first argument.
+  if (node->ret_buffer && node->ty->size > 16) {
+    //| lea rax, [rbp+node->ret_buffer->offset]
+    dasm_put(Dst, 114, node->ret_buffer->offset);
+#line 1053 "../../src/codegen.in.c"
+    push();
+  }
+
+  return stack;
+}
+
+static void copy_ret_buffer(Obj* var) {
+  Type* ty = var->ty;
+  int gp = 0, fp = 0;
+
+  if (has_flonum1(ty)) {
+    assert(ty->size == 4 || 8 <= ty->size);
+    if (ty->size == 4) {
+      //| movss dword [rbp+var->offset], xmm0
+      dasm_put(Dst, 663, var->offset);
+#line 1067 "../../src/codegen.in.c"
+    } else {
+      //| movsd qword [rbp+var->offset], xmm0
+      dasm_put(Dst, 670, var->offset);
+#line 1069 "../../src/codegen.in.c"
+    }
+    fp++;
+  } else {
+    for (int i = 0; i < MIN(8, ty->size); i++) {
+      //| mov [rbp+var->offset+i], al
+      //| shr rax, 8
+      dasm_put(Dst, 677, var->offset+i);
+#line 1075 "../../src/codegen.in.c"
+    }
+    gp++;
+  }
+
+  if (ty->size > 8) {
+    if (has_flonum2(ty)) {
+      assert(ty->size == 12 || ty->size == 16);
+      if (ty->size == 12) {
+        //| movss dword [rbp+var->offset+8], xmm(fp)
+        dasm_put(Dst, 685, (fp), var->offset+8);
+#line 1084 "../../src/codegen.in.c"
+      } else {
+        //| movsd qword [rbp+var->offset+8], xmm(fp)
+        dasm_put(Dst, 696, (fp), var->offset+8);
+#line 1086 "../../src/codegen.in.c"
+      }
+    } else {
+      for (int i = 8; i < MIN(16, ty->size); i++) {
+        //| mov [rbp+var->offset+i], Rb(gp)
+        //| shr Rq(gp), 8
+        dasm_put(Dst, 707, (gp), var->offset+i, (gp));
+#line 1091 "../../src/codegen.in.c"
+      }
+    }
+  }
+}
+
+#endif
+
+static void copy_struct_reg(void) {
+#if X64WIN
+  // TODO: I'm not sure if this is right/sufficient.
+  //| mov rax, [rax]
+  dasm_put(Dst, 70);
+#line 1102 "../../src/codegen.in.c"
+#else
+  Type* ty = C(current_fn)->ty->return_ty;
+
+  int gp = 0, fp = 0;
+
+  //| mov RUTIL, rax
+  dasm_put(Dst, 721);
+#line 1108 "../../src/codegen.in.c"
+
+  if (has_flonum(ty, 0, 8, 0)) {
+    assert(ty->size == 4 || 8 <= ty->size);
+    if (ty->size == 4) {
+      //| movss xmm0, dword [RUTIL]
+      dasm_put(Dst, 725);
+#line 1113 "../../src/codegen.in.c"
+    } else {
+      //| movsd xmm0, qword [RUTIL]
+      dasm_put(Dst, 731);
+#line 1115 "../../src/codegen.in.c"
+    }
+    fp++;
+  } else {
+    //| mov rax, 0
+    dasm_put(Dst, 737);
+#line 1119 "../../src/codegen.in.c"
+    for (int i = MIN(8, ty->size) - 1; i >= 0; i--) {
+      //| shl rax, 8
+      //| mov ax, [RUTIL+i]
+      dasm_put(Dst, 745, i);
+#line 1122 "../../src/codegen.in.c"
+    }
+    gp++;
+  }
+
+  if (ty->size > 8) {
+    if (has_flonum(ty, 8, 16, 0)) {
+      assert(ty->size == 12 || ty->size == 16);
+      if (ty->size == 4) {
+        //| movss xmm(fp), dword [RUTIL+8]
+        dasm_put(Dst, 754, (fp));
+#line 1131 "../../src/codegen.in.c"
+      } else {
+        //| movsd xmm(fp), qword [RUTIL+8]
+        dasm_put(Dst, 764, (fp));
+#line 1133 "../../src/codegen.in.c"
+      }
+    } else {
+      //| mov Rq(gp), 0
+      dasm_put(Dst, 774, (gp));
+#line 1136 "../../src/codegen.in.c"
+      for (int i = MIN(16, ty->size) - 1; i >= 8; i--) {
+        //| shl Rq(gp), 8
+        //| mov Rb(gp), [RUTIL+i]
+        dasm_put(Dst, 784, (gp), (gp), i);
+#line 1139 "../../src/codegen.in.c"
+      }
+    }
+  }
+#endif
+}
+
+static void copy_struct_mem(void) {
+  Type* ty = C(current_fn)->ty->return_ty;
+  Obj* var = C(current_fn)->params;
+
+  //| mov RUTIL, [rbp+var->offset]
+  dasm_put(Dst, 798, var->offset);
+#line 1150 "../../src/codegen.in.c"
+
+  for (int i = 0; i < ty->size; i++) {
+    //| mov dl, [rax+i]
+    //| mov [RUTIL+i], dl
+    dasm_put(Dst, 803, i, i);
+#line 1154 "../../src/codegen.in.c"
+  }
+}
+
+static void builtin_alloca(void) {
+  // Align size to 16 bytes.
+  //| add CARG1, 15
+  //| and CARG1d, 0xfffffff0
+  dasm_put(Dst, 810);
+#line 1161 "../../src/codegen.in.c"
+
+  // Shift the temporary area by CARG1.
+  //| mov CARG4, [rbp+C(current_fn)->alloca_bottom->offset]
+  //| sub CARG4, rsp
+  //| mov rax, rsp
+  //| sub rsp, CARG1
+  //| mov rdx, rsp
+  //|1:
+  //| cmp CARG4, 0
+  //| je >2
+  //| mov r8b, [rax]
+  //| mov [rdx], r8b
+  //| inc rdx
+  //| inc rax
+  //| dec CARG4
+  //| jmp <1
+  //|2:
+  dasm_put(Dst, 819, C(current_fn)->alloca_bottom->offset);
+#line 1178 "../../src/codegen.in.c"
+
+  // Move alloca_bottom pointer.
+  //| mov rax, [rbp+C(current_fn)->alloca_bottom->offset]
+  //| sub rax, CARG1
+  //| mov [rbp+C(current_fn)->alloca_bottom->offset], rax
+  dasm_put(Dst, 872, C(current_fn)->alloca_bottom->offset, C(current_fn)->alloca_bottom->offset);
+#line 1183 "../../src/codegen.in.c"
+}
+
+// Generate code for a given node.
+static void gen_expr(Node* node) {
+  switch (node->kind) {
+    case ND_NULL_EXPR:
+      return;
+    case ND_NUM: {
+      switch (node->ty->kind) {
+        case TY_FLOAT: {
+          union {
+            float f32;
+            uint32_t u32;
+          } u = {(float)node->fval};
+          //| mov eax, u.u32
+          //| movd xmm0, rax
+          dasm_put(Dst, 885, u.u32);
+#line 1199 "../../src/codegen.in.c"
+          return;
+        }
+        case TY_DOUBLE: {
+          union {
+            double f64;
+            uint64_t u64;
+          } u = {(double)node->fval};
+          //| mov64 rax, u.u64
+          //| movd xmm0, rax
+          dasm_put(Dst, 893, (unsigned int)(u.u64), (unsigned int)((u.u64)>>32));
+#line 1208 "../../src/codegen.in.c"
+          return;
+        }
+#if !X64WIN
+        case TY_LDOUBLE: {
+          union {
+            long double f80;
+            uint64_t u64[2];
+          } u;
+          memset(&u, 0, sizeof(u));
+          u.f80 = node->fval;
+          //| mov64 rax, u.u64[0]
+          //| mov [rsp-16], rax
+          //| mov64 rax, u.u64[1]
+          //| mov [rsp-8], rax
+          //| fld tword [rsp-16]
+          dasm_put(Dst, 903, (unsigned int)(u.u64[0]), (unsigned int)((u.u64[0])>>32), (unsigned int)(u.u64[1]), (unsigned int)((u.u64[1])>>32));
+#line 1223 "../../src/codegen.in.c"
+          return;
+        }
+#endif
+      }
+
+      if (node->val < INT_MIN || node->val > INT_MAX) {
+        //| mov64 rax, node->val
+        dasm_put(Dst, 929, (unsigned int)(node->val), (unsigned int)((node->val)>>32));
+#line 1230 "../../src/codegen.in.c"
+      } else {
+        //| mov rax, node->val
+        dasm_put(Dst, 934, node->val);
+#line 1232 "../../src/codegen.in.c"
+      }
+      return;
+    }
+    case ND_NEG:
+      gen_expr(node->lhs);
+
+      switch (node->ty->kind) {
+        case TY_FLOAT:
+          //| mov rax, 1
+          //| shl rax, 31
+          //| movd xmm1, rax
+          //| xorps xmm0, xmm1
+          dasm_put(Dst, 939);
+#line 1244 "../../src/codegen.in.c"
+          return;
+        case TY_DOUBLE:
+          //| mov rax, 1
+          //| shl rax, 63
+          //| movd xmm1, rax
+          //| xorpd xmm0, xmm1
+          dasm_put(Dst, 959);
+#line 1250 "../../src/codegen.in.c"
+          return;
+#if !X64WIN
+        case TY_LDOUBLE:
+          //| fchs
+          dasm_put(Dst, 980);
+#line 1254 "../../src/codegen.in.c"
+          return;
+#endif
+      }
+
+      //| neg rax
+      dasm_put(Dst, 983);
+#line 1259 "../../src/codegen.in.c"
+      return;
+    case ND_VAR:
+      gen_addr(node);
+      load(node->ty);
+      return;
+    case ND_MEMBER: {
+      gen_addr(node);
+      load(node->ty);
+
+      Member* mem = node->member;
+      if (mem->is_bitfield) {
+        //| shl rax, 64 - mem->bit_width - mem->bit_offset
+        dasm_put(Dst, 988, 64 - mem->bit_width - mem->bit_offset);
+#line 1271 "../../src/codegen.in.c"
+        if (mem->ty->is_unsigned) {
+          //| shr rax, 64 - mem->bit_width
+          dasm_put(Dst, 993, 64 - mem->bit_width);
+#line 1273 "../../src/codegen.in.c"
+        } else {
+          //| sar rax, 64 - mem->bit_width
+          dasm_put(Dst, 998, 64 - mem->bit_width);
+#line 1275 "../../src/codegen.in.c"
+        }
+      }
+      return;
+    }
+    case ND_DEREF:
+      gen_expr(node->lhs);
+      load(node->ty);
+      return;
+    case ND_ADDR:
+      gen_addr(node->lhs);
+      return;
+    case ND_ASSIGN:
+      // Special case "int into a local". Normally this would compile to:
+      //   lea rax,[rbp+node->lhs->offset]
+      //   push rax
+      //   mov rax, node->rhs->val
+      //   pop rcx
+      //   mov [rcx], eax
+      if (node->lhs->kind == ND_VAR && node->lhs->var->is_local && node->rhs->kind == ND_NUM &&
+          node->rhs->ty->kind != TY_FLOAT && node->rhs->ty->kind != TY_DOUBLE &&
+          node->rhs->ty->kind != TY_LDOUBLE && node->rhs->val >= INT_MIN &&
+          node->rhs->val <= INT_MAX) {
+        //| mov rax, node->rhs->val
+        //| mov dword [rbp+node->lhs->var->offset], eax
+        dasm_put(Dst, 1004, node->rhs->val, node->lhs->var->offset);
+#line 1299 "../../src/codegen.in.c"
+      } else {
+        gen_addr(node->lhs);
+        push();
+        gen_expr(node->rhs);
+
+        if (node->lhs->kind == ND_MEMBER && node->lhs->member->is_bitfield) {
+          //| mov r8, rax
+          dasm_put(Dst, 1012);
+#line 1306 "../../src/codegen.in.c"
+
+          // If the lhs is a bitfield, we need to read the current value
+          // from memory and merge it with a new value.
+          Member* mem = node->lhs->member;
+          //| mov RUTIL, rax
+          //| and RUTIL, (1L << mem->bit_width) - 1
+          //| shl RUTIL, mem->bit_offset
+          dasm_put(Dst, 1016, (1L << mem->bit_width) - 1, mem->bit_offset);
+#line 1313 "../../src/codegen.in.c"
+
+          //| mov rax, [rsp]
+          dasm_put(Dst, 1028);
+#line 1315 "../../src/codegen.in.c"
+          load(mem->ty);
+
+          long mask = ((1L << mem->bit_width) - 1) << mem->bit_offset;
+          //| mov r9, ~mask
+          //| and rax, r9
+          //| or rax, RUTIL
+          dasm_put(Dst, 1033, ~mask);
+#line 1321 "../../src/codegen.in.c"
+          store(node->ty);
+          //| mov rax, r8
+          dasm_put(Dst, 1045);
+#line 1323 "../../src/codegen.in.c"
+          return;
+        }
+
+        store(node->ty);
+      }
+      return;
+    case ND_STMT_EXPR:
+      for (Node* n = node->body; n; n = n->next)
+        gen_stmt(n);
+      return;
+    case ND_COMMA:
+      gen_expr(node->lhs);
+      gen_expr(node->rhs);
+      return;
+    case ND_CAST:
+      gen_expr(node->lhs);
+      cg_cast(node->lhs->ty, node->ty);
+      return;
+    case ND_MEMZERO:
+      // `rep stosb` is equivalent to `memset(rdi, al, rcx)`.
+#if X64WIN
+      //| push rdi
+      dasm_put(Dst, 1049);
+#line 1345 "../../src/codegen.in.c"
+#endif
+      //| mov rcx, node->var->ty->size
+      //| lea rdi, [rbp+node->var->offset]
+      //| mov al, 0
+      //| rep
+      //| stosb
+      dasm_put(Dst, 1051, node->var->ty->size, node->var->offset);
+#line 1351 "../../src/codegen.in.c"
+#if X64WIN
+      //| pop rdi
+      dasm_put(Dst, 1065);
+#line 1353 "../../src/codegen.in.c"
+#endif
+      return;
+    case ND_COND: {
+      int lelse = codegen_pclabel();
+      int lend = codegen_pclabel();
+      gen_expr(node->cond);
+      cmp_zero(node->cond->ty);
+      //| je =>lelse
+      dasm_put(Dst, 1067, lelse);
+#line 1361 "../../src/codegen.in.c"
+      gen_expr(node->then);
+      //| jmp =>lend
+      //|=>lelse:
+      dasm_put(Dst, 1071, lend, lelse);
+#line 1364 "../../src/codegen.in.c"
+      gen_expr(node->els);
+      //|=>lend:
+      dasm_put(Dst, 0, lend);
+#line 1366 "../../src/codegen.in.c"
+      return;
+    }
+    case ND_NOT:
+      gen_expr(node->lhs);
+      cmp_zero(node->lhs->ty);
+      //| sete al
+      //| movzx rax, al
+      dasm_put(Dst, 1076);
+#line 1373 "../../src/codegen.in.c"
+      return;
+    case ND_BITNOT:
+      gen_expr(node->lhs);
+      //| not rax
+      dasm_put(Dst, 1084);
+#line 1377 "../../src/codegen.in.c"
+      return;
+    case ND_LOGAND: {
+      int lfalse = codegen_pclabel();
+      int lend = codegen_pclabel();
+      gen_expr(node->lhs);
+      cmp_zero(node->lhs->ty);
+      //| je =>lfalse
+      dasm_put(Dst, 1067, lfalse);
+#line 1384 "../../src/codegen.in.c"
+      gen_expr(node->rhs);
+      cmp_zero(node->rhs->ty);
+      //| je =>lfalse
+      //| mov rax, 1
+      //| jmp =>lend
+      //|=>lfalse:
+      //| mov rax, 0
+      //|=>lend:
+      dasm_put(Dst, 1089, lfalse, lend, lfalse, lend);
+#line 1392 "../../src/codegen.in.c"
+      return;
+    }
+    case ND_LOGOR: {
+      int ltrue = codegen_pclabel();
+      int lend = codegen_pclabel();
+      gen_expr(node->lhs);
+      cmp_zero(node->lhs->ty);
+      //| jne =>ltrue
+      dasm_put(Dst, 1112, ltrue);
+#line 1400 "../../src/codegen.in.c"
+      gen_expr(node->rhs);
+      cmp_zero(node->rhs->ty);
+      //| jne =>ltrue
+      //| mov rax, 0
+      //| jmp =>lend
+      //|=>ltrue:
+      //| mov rax, 1
+      //|=>lend:
+      dasm_put(Dst, 1116, ltrue, lend, ltrue, lend);
+#line 1408 "../../src/codegen.in.c"
+      return;
+    }
+    case ND_FUNCALL: {
+      if (node->lhs->kind == ND_VAR && !strcmp(node->lhs->var->name, "alloca")) {
+        gen_expr(node->args);
+        //| mov CARG1, rax
+        dasm_put(Dst, 721);
+#line 1414 "../../src/codegen.in.c"
+        builtin_alloca();
+        return;
+      }
+
+#if X64WIN
+      if (node->lhs->kind == ND_VAR && !strcmp(node->lhs->var->name, "__va_start")) {
+        // va_start(ap, x) turns into __va_start(&ap, x), so we only want the
+        // expr here, not the address.
+        gen_expr(node->args);
+        push();
+        // ToS is now &ap.
+
+        gen_addr(node->args->next);
+        // RAX is now &x, move it to the next qword.
+        //| add rax, 8
+        dasm_put(Dst, 1139);
+#line 1429 "../../src/codegen.in.c"
+
+        // Store one-past the second argument into &ap.
+        pop(REG_UTIL);
+        //| mov [RUTIL], rax
+        dasm_put(Dst, 105);
+#line 1433 "../../src/codegen.in.c"
+        return;
+      }
+#endif
+
+#if X64WIN
+
+      int by_ref_copies_size = 0;
+      int stack_args = push_args_win(node, &by_ref_copies_size);
+      gen_expr(node->lhs);
+
+      int reg = 0;
+
+      // If the return type is a large struct/union, the caller passes
+      // a pointer to a buffer as if it were the first argument.
+      if (node->ret_buffer && !type_passed_in_register(node->ty)) {
+        pop(dasmargreg[reg++]);
+      }
+
+      for (Node* arg = node->args; arg; arg = arg->next) {
+        Type* ty = arg->ty;
+
+        switch (ty->kind) {
+          case TY_STRUCT:
+          case TY_UNION:
+            if ((type_passed_in_register(ty) && reg < X64WIN_REG_MAX) ||
+                (arg->pass_by_reference && reg < X64WIN_REG_MAX)) {
+              pop(dasmargreg[reg++]);
+            }
+            break;
+          case TY_FLOAT:
+          case TY_DOUBLE:
+            if (reg < X64WIN_REG_MAX) {
+              popf(reg);
+              // Varargs requires a copy of fp in gp.
+              //| movd Rq(dasmargreg[reg]), xmm(reg)
+              dasm_put(Dst, 1144, (reg), (dasmargreg[reg]));
+#line 1468 "../../src/codegen.in.c"
+              ++reg;
+            }
+            break;
+          default:
+            if (reg < X64WIN_REG_MAX) {
+              pop(dasmargreg[reg++]);
+            }
+        }
+      }
+
+      //| sub rsp, PARAMETER_SAVE_SIZE
+      //| mov r10, rax
+      //| call r10
+      //| add rsp, stack_args*8 + PARAMETER_SAVE_SIZE + by_ref_copies_size
+      dasm_put(Dst, 1154, PARAMETER_SAVE_SIZE, stack_args*8 + PARAMETER_SAVE_SIZE + by_ref_copies_size);
+#line 1482 "../../src/codegen.in.c"
+
+      C(depth) -= by_ref_copies_size / 8;
+      C(depth) -= stack_args;
+
+      // It looks like the most significant 48 or 56 bits in RAX may
+      // contain garbage if a function return type is short or bool/char,
+      // respectively. We clear the upper bits here.
+      switch (node->ty->kind) {
+        case TY_BOOL:
+          //| movzx eax, al
+          dasm_put(Dst, 186);
+#line 1492 "../../src/codegen.in.c"
+          return;
+        case TY_CHAR:
+          if (node->ty->is_unsigned) {
+            //| movzx eax, al
+            dasm_put(Dst, 186);
+#line 1496 "../../src/codegen.in.c"
+          } else {
+            //| movsx eax, al
+            dasm_put(Dst, 182);
+#line 1498 "../../src/codegen.in.c"
+          }
+          return;
+        case TY_SHORT:
+          if (node->ty->is_unsigned) {
+            //| movzx eax, ax
+            dasm_put(Dst, 194);
+#line 1503 "../../src/codegen.in.c"
+          } else {
+            //| movsx eax, ax
+            dasm_put(Dst, 190);
+#line 1505 "../../src/codegen.in.c"
+          }
+          return;
+      }
+
+      // If the return type is a small struct, a value is returned it's actually
+      // returned in rax, so copy it back into the return buffer where we're
+      // expecting it.
+      if (node->ret_buffer && type_passed_in_register(node->ty)) {
+        //| mov [rbp+node->ret_buffer->offset], rax
+        //| lea rax, [rbp+node->ret_buffer->offset]
+        dasm_put(Dst, 1171, node->ret_buffer->offset, node->ret_buffer->offset);
+#line 1515 "../../src/codegen.in.c"
+      }
+
+#else  // SysV
+
+      int stack_args = push_args_sysv(node);
+      gen_expr(node->lhs);
+
+      int gp = 0, fp = 0;
+
+      // If the return type is a large struct/union, the caller passes
+      // a pointer to a buffer as if it were the first argument.
+      if (node->ret_buffer && node->ty->size > 16) {
+        pop(dasmargreg[gp++]);
+      }
+
+      for (Node* arg = node->args; arg; arg = arg->next) {
+        Type* ty = arg->ty;
+
+        switch (ty->kind) {
+          case TY_STRUCT:
+          case TY_UNION:
+            if (ty->size > 16)
+              continue;
+
+            bool fp1 = has_flonum1(ty);
+            bool fp2 = has_flonum2(ty);
+
+            if (fp + fp1 + fp2 < SYSV_FP_MAX && gp + !fp1 + !fp2 < SYSV_GP_MAX) {
+              if (fp1) {
+                popf(fp++);
+              } else {
+                pop(dasmargreg[gp++]);
+              }
+
+              if (ty->size > 8) {
+                if (fp2) {
+                  popf(fp++);
+                } else {
+                  pop(dasmargreg[gp++]);
+                }
+              }
+            }
+            break;
+          case TY_FLOAT:
+          case TY_DOUBLE:
+            if (fp < SYSV_FP_MAX)
+              popf(fp++);
+            break;
+          case TY_LDOUBLE:
+            break;
+          default:
+            if (gp < SYSV_GP_MAX) {
+              pop(dasmargreg[gp++]);
+            }
+        }
+      }
+
+      //| mov r10, rax
+      //| mov rax, fp
+      //| call r10
+      //| add rsp, stack_args*8
+      dasm_put(Dst, 1180, fp, stack_args*8);
+#line 1576 "../../src/codegen.in.c"
+
+      C(depth) -= stack_args;
+
+      // It looks like the most significant 48 or 56 bits in RAX may
+      // contain garbage if a function return type is short or bool/char,
+      // respectively. We clear the upper bits here.
+      switch (node->ty->kind) {
+        case TY_BOOL:
+          //| movzx eax, al
+          dasm_put(Dst, 186);
+#line 1585 "../../src/codegen.in.c"
+          return;
+        case TY_CHAR:
+          if (node->ty->is_unsigned) {
+            //| movzx eax, al
+            dasm_put(Dst, 186);
+#line 1589 "../../src/codegen.in.c"
+          } else {
+            //| movsx eax, al
+            dasm_put(Dst, 182);
+#line 1591 "../../src/codegen.in.c"
+          }
+          return;
+        case TY_SHORT:
+          if (node->ty->is_unsigned) {
+            //| movzx eax, ax
+            dasm_put(Dst, 194);
+#line 1596 "../../src/codegen.in.c"
+          } else {
+            //| movsx eax, ax
+            dasm_put(Dst, 190);
+#line 1598 "../../src/codegen.in.c"
+          }
+          return;
+      }
+
+      // If the return type is a small struct, a value is returned
+      // using up to two registers.
+      if (node->ret_buffer && node->ty->size <= 16) {
+        copy_ret_buffer(node->ret_buffer);
+        //| lea rax, [rbp+node->ret_buffer->offset]
+        dasm_put(Dst, 114, node->ret_buffer->offset);
+#line 1607 "../../src/codegen.in.c"
+      }
+
+#endif  // SysV
+
+      return;
+    }
+    case ND_LABEL_VAL:
+      //| lea rax, [=>node->pc_label]
+      dasm_put(Dst, 119, node->pc_label);
+#line 1615 "../../src/codegen.in.c"
+      return;
+    case ND_REFLECT_TYPE_PTR:
+      //| mov64 rax, node->reflect_ty;
+      dasm_put(Dst, 929, (unsigned int)(node->reflect_ty), (unsigned int)((node->reflect_ty)>>32));
+#line 1618 "../../src/codegen.in.c"
+      C(position_dependent) = true;
+      return;
+    case ND_CAS:
+    case ND_LOCKCE: {
+      bool is_locked_ce = node->kind == ND_LOCKCE;
+
+      gen_expr(node->cas_addr);
+      push();
+      gen_expr(node->cas_new);
+      push();
+      gen_expr(node->cas_old);
+      if (!is_locked_ce) {
+        //| mov r8, rax
+        dasm_put(Dst, 1012);
+#line 1631 "../../src/codegen.in.c"
+        load(node->cas_old->ty->base);
+      }
+      pop(REG_DX);    // new
+      pop(REG_UTIL);  // addr
+
+      int sz = node->cas_addr->ty->base->size;
+      // dynasm doesn't support cmpxchg, and I didn't grok the encoding yet.
+      // Hack in the various bytes for the instructions we want since there's
+      // limited forms. RUTILenc is either 0x17 for RDI or 0x11 for RCX
+      // depending on whether we're encoding for Windows or SysV.
+      switch (sz) {
+        case 1:
+          // lock cmpxchg BYTE PTR [rdi/rcx], dl
+          //| .byte 0xf0
+          //| .byte 0x0f
+          //| .byte 0xb0
+          //| .byte RUTILenc
+          dasm_put(Dst, 1196);
+#line 1648 "../../src/codegen.in.c"
+          break;
+        case 2:
+          // lock cmpxchg WORD PTR [rdi/rcx],dx
+          //| .byte 0x66
+          //| .byte 0xf0
+          //| .byte 0x0f
+          //| .byte 0xb1
+          //| .byte RUTILenc
+          dasm_put(Dst, 1202);
+#line 1656 "../../src/codegen.in.c"
+          break;
+        case 4:
+          // lock cmpxchg DWORD PTR [rdi/rcx],edx
+          //| .byte 0xf0
+          //| .byte 0x0f
+          //| .byte 0xb1
+          //| .byte RUTILenc
+          dasm_put(Dst, 1203);
+#line 1663 "../../src/codegen.in.c"
+          break;
+        case 8:
+          // lock cmpxchg QWORD PTR [rdi/rcx],rdx
+          //| .byte 0xf0
+          //| .byte 0x48
+          //| .byte 0x0f
+          //| .byte 0xb1
+          //| .byte RUTILenc
+          dasm_put(Dst, 1209);
+#line 1671 "../../src/codegen.in.c"
+          break;
+        default:
+          unreachable();
+      }
+      if (!is_locked_ce) {
+        //| sete cl
+        //| je >1
+        dasm_put(Dst, 1216);
+#line 1678 "../../src/codegen.in.c"
+        switch (sz) {
+          case 1:
+            //| mov [r8], al
+            dasm_put(Dst, 1224);
+#line 1681 "../../src/codegen.in.c"
+            break;
+          case 2:
+            //| mov [r8], ax
+            dasm_put(Dst, 1228);
+#line 1684 "../../src/codegen.in.c"
+            break;
+          case 4:
+            //| mov [r8], eax
+            dasm_put(Dst, 1229);
+#line 1687 "../../src/codegen.in.c"
+            break;
+          case 8:
+            //| mov [r8], rax
+            dasm_put(Dst, 1233);
+#line 1690 "../../src/codegen.in.c"
+            break;
+          default:
+            unreachable();
+        }
+        //|1:
+        //| movzx eax, cl
+        dasm_put(Dst, 1237);
+#line 1696 "../../src/codegen.in.c"
+      }
+
+      return;
+    }
+    case ND_EXCH: {
+      gen_expr(node->lhs);
+      push();
+      gen_expr(node->rhs);
+      pop(REG_UTIL);
+
+      int sz = node->lhs->ty->base->size;
+      switch (sz) {
+        case 1:
+          //| xchg [RUTIL], al
+          dasm_put(Dst, 1243);
+#line 1710 "../../src/codegen.in.c"
+          break;
+        case 2:
+          //| xchg [RUTIL], ax
+          dasm_put(Dst, 1246);
+#line 1713 "../../src/codegen.in.c"
+          break;
+        case 4:
+          //| xchg [RUTIL], eax
+          dasm_put(Dst, 1247);
+#line 1716 "../../src/codegen.in.c"
+          break;
+        case 8:
+          //| xchg [RUTIL], rax
+          dasm_put(Dst, 1250);
+#line 1719 "../../src/codegen.in.c"
+          break;
+        default:
+          unreachable();
+      }
+      return;
+    }
+  }
+
+  switch (node->lhs->ty->kind) {
+    case TY_FLOAT:
+    case TY_DOUBLE: {
+      gen_expr(node->rhs);
+      pushf();
+      gen_expr(node->lhs);
+      popf(1);
+
+      bool is_float = node->lhs->ty->kind == TY_FLOAT;
+
+      switch (node->kind) {
+        case ND_ADD:
+          if (is_float) {
+            //| addss xmm0, xmm1
+            dasm_put(Dst, 1254);
+#line 1741 "../../src/codegen.in.c"
+          } else {
+            //| addsd xmm0, xmm1
+            dasm_put(Dst, 1260);
+#line 1743 "../../src/codegen.in.c"
+          }
+          return;
+        case ND_SUB:
+          if (is_float) {
+            //| subss xmm0, xmm1
+            dasm_put(Dst, 1266);
+#line 1748 "../../src/codegen.in.c"
+          } else {
+            //| subsd xmm0, xmm1
+            dasm_put(Dst, 1272);
+#line 1750 "../../src/codegen.in.c"
+          }
+          return;
+        case ND_MUL:
+          if (is_float) {
+            //| mulss xmm0, xmm1
+            dasm_put(Dst, 1278);
+#line 1755 "../../src/codegen.in.c"
+          } else {
+            //| mulsd xmm0, xmm1
+            dasm_put(Dst, 1284);
+#line 1757 "../../src/codegen.in.c"
+          }
+          return;
+        case ND_DIV:
+          if (is_float) {
+            //| divss xmm0, xmm1
+            dasm_put(Dst, 1290);
+#line 1762 "../../src/codegen.in.c"
+          } else {
+            //| divsd xmm0, xmm1
+            dasm_put(Dst, 1296);
+#line 1764 "../../src/codegen.in.c"
+          }
+          return;
+        case ND_EQ:
+        case ND_NE:
+        case ND_LT:
+        case ND_LE:
+          if (is_float) {
+            //| ucomiss xmm1, xmm0
+            dasm_put(Dst, 1302);
+#line 1772 "../../src/codegen.in.c"
+          } else {
+            //| ucomisd xmm1, xmm0
+            dasm_put(Dst, 1306);
+#line 1774 "../../src/codegen.in.c"
+          }
+
+          if (node->kind == ND_EQ) {
+            //| sete al
+            //| setnp dl
+            //| and al, dl
+            dasm_put(Dst, 1311);
+#line 1780 "../../src/codegen.in.c"
+          } else if (node->kind == ND_NE) {
+            //| setne al
+            //| setp dl
+            //| or al, dl
+            dasm_put(Dst, 1320);
+#line 1784 "../../src/codegen.in.c"
+          } else if (node->kind == ND_LT) {
+            //| seta al
+            dasm_put(Dst, 1329);
+#line 1786 "../../src/codegen.in.c"
+          } else {
+            //| setae al
+            dasm_put(Dst, 1333);
+#line 1788 "../../src/codegen.in.c"
+          }
+
+          //| and al, 1
+          //| movzx rax, al
+          dasm_put(Dst, 1337);
+#line 1792 "../../src/codegen.in.c"
+          return;
+      }
+
+      error_tok(node->tok, "invalid expression");
+    }
+#if !X64WIN
+    case TY_LDOUBLE: {
+      gen_expr(node->lhs);
+      gen_expr(node->rhs);
+
+      switch (node->kind) {
+        case ND_ADD:
+          //| faddp st1, st0
+          dasm_put(Dst, 1344);
+#line 1805 "../../src/codegen.in.c"
+          return;
+        case ND_SUB:
+          //| fsubrp st1, st0
+          dasm_put(Dst, 1347);
+#line 1808 "../../src/codegen.in.c"
+          return;
+        case ND_MUL:
+          //| fmulp st1, st0
+          dasm_put(Dst, 1350);
+#line 1811 "../../src/codegen.in.c"
+          return;
+        case ND_DIV:
+          //| fdivrp st1, st0
+          dasm_put(Dst, 1353);
+#line 1814 "../../src/codegen.in.c"
+          return;
+        case ND_EQ:
+        case ND_NE:
+        case ND_LT:
+        case ND_LE:
+          //| fcomip st1
+          //| fstp st0
+          dasm_put(Dst, 1357);
+#line 1821 "../../src/codegen.in.c"
+
+          if (node->kind == ND_EQ) {
+            //| sete al
+            dasm_put(Dst, 1363);
+#line 1824 "../../src/codegen.in.c"
+          } else if (node->kind == ND_NE) {
+            //| setne al
+            dasm_put(Dst, 1367);
+#line 1826 "../../src/codegen.in.c"
+          } else if (node->kind == ND_LT) {
+            //| seta al
+            dasm_put(Dst, 1329);
+#line 1828 "../../src/codegen.in.c"
+          } else {
+            //| setae al
+            dasm_put(Dst, 1333);
+#line 1830 "../../src/codegen.in.c"
+          }
+
+          //| movzx rax, al
+          dasm_put(Dst, 1079);
+#line 1833 "../../src/codegen.in.c"
+          return;
+      }
+
+      error_tok(node->tok, "invalid expression");
+    }
+#endif
+  }
+
+  gen_expr(node->rhs);
+  push();
+  gen_expr(node->lhs);
+  pop(REG_UTIL);
+
+  bool is_long = node->lhs->ty->kind == TY_LONG || node->lhs->ty->base;
+
+  switch (node->kind) {
+    case ND_ADD:
+      if (is_long) {
+        //| add rax, RUTIL
+        dasm_put(Dst, 1371);
+#line 1852 "../../src/codegen.in.c"
+      } else {
+        //| add eax, RUTILd
+        dasm_put(Dst, 1372);
+#line 1854 "../../src/codegen.in.c"
+      }
+      return;
+    case ND_SUB:
+      if (is_long) {
+        //| sub rax, RUTIL
+        dasm_put(Dst, 1376);
+#line 1859 "../../src/codegen.in.c"
+      } else {
+        //| sub eax, RUTILd
+        dasm_put(Dst, 1377);
+#line 1861 "../../src/codegen.in.c"
+      }
+      return;
+    case ND_MUL:
+      if (is_long) {
+        //| imul rax, RUTIL
+        dasm_put(Dst, 1381);
+#line 1866 "../../src/codegen.in.c"
+      } else {
+        //| imul eax, RUTILd
+        dasm_put(Dst, 1382);
+#line 1868 "../../src/codegen.in.c"
+      }
+      return;
+    case ND_DIV:
+    case ND_MOD:
+      if (node->ty->is_unsigned) {
+        if (is_long) {
+          //| mov rdx, 0
+          //| div RUTIL
+          dasm_put(Dst, 1386);
+#line 1876 "../../src/codegen.in.c"
+        } else {
+          //| mov edx, 0
+          //| div RUTILd
+          dasm_put(Dst, 1399);
+#line 1879 "../../src/codegen.in.c"
+        }
+      } else {
+        if (node->lhs->ty->size == 8) {
+          //| cqo
+          dasm_put(Dst, 1409);
+#line 1883 "../../src/codegen.in.c"
+        } else {
+          //| cdq
+          dasm_put(Dst, 1410);
+#line 1885 "../../src/codegen.in.c"
+        }
+        if (is_long) {
+          //| idiv RUTIL
+          dasm_put(Dst, 1412);
+#line 1888 "../../src/codegen.in.c"
+        } else {
+          //| idiv RUTILd
+          dasm_put(Dst, 1413);
+#line 1890 "../../src/codegen.in.c"
+        }
+      }
+
+      if (node->kind == ND_MOD) {
+        //| mov rax, rdx
+        dasm_put(Dst, 1418);
+#line 1895 "../../src/codegen.in.c"
+      }
+      return;
+    case ND_BITAND:
+      if (is_long) {
+        //| and rax, RUTIL
+        dasm_put(Dst, 1422);
+#line 1900 "../../src/codegen.in.c"
+      } else {
+        //| and eax, RUTILd
+        dasm_put(Dst, 1423);
+#line 1902 "../../src/codegen.in.c"
+      }
+      return;
+    case ND_BITOR:
+      if (is_long) {
+        //| or rax, RUTIL
+        dasm_put(Dst, 1040);
+#line 1907 "../../src/codegen.in.c"
+      } else {
+        //| or eax, RUTILd
+        dasm_put(Dst, 1041);
+#line 1909 "../../src/codegen.in.c"
+      }
+      return;
+    case ND_BITXOR:
+      if (is_long) {
+        //| xor rax, RUTIL
+        dasm_put(Dst, 1427);
+#line 1914 "../../src/codegen.in.c"
+      } else {
+        //| xor eax, RUTILd
+        dasm_put(Dst, 1428);
+#line 1916 "../../src/codegen.in.c"
+      }
+      return;
+    case ND_EQ:
+    case ND_NE:
+    case ND_LT:
+    case ND_LE:
+      if (is_long) {
+        //| cmp rax, RUTIL
+        dasm_put(Dst, 1432);
+#line 1924 "../../src/codegen.in.c"
+      } else {
+        //| cmp eax, RUTILd
+        dasm_put(Dst, 1433);
+#line 1926 "../../src/codegen.in.c"
+      }
+
+      if (node->kind == ND_EQ) {
+        //| sete al
+        dasm_put(Dst, 1363);
+#line 1930 "../../src/codegen.in.c"
+      } else if (node->kind == ND_NE) {
+        //| setne al
+        dasm_put(Dst, 1367);
+#line 1932 "../../src/codegen.in.c"
+      } else if (node->kind == ND_LT) {
+        if (node->lhs->ty->is_unsigned) {
+          //| setb al
+          dasm_put(Dst, 1437);
+#line 1935 "../../src/codegen.in.c"
+        } else {
+          //| setl al
+          dasm_put(Dst, 1441);
+#line 1937 "../../src/codegen.in.c"
+        }
+      } else if (node->kind == ND_LE) {
+        if (node->lhs->ty->is_unsigned) {
+          //| setbe al
+          dasm_put(Dst, 1445);
+#line 1941 "../../src/codegen.in.c"
+        } else {
+          //| setle al
+          dasm_put(Dst, 1449);
+#line 1943 "../../src/codegen.in.c"
+        }
+      }
+
+      //| movzx rax, al
+      dasm_put(Dst, 1079);
+#line 1947 "../../src/codegen.in.c"
+      return;
+    case ND_SHL:
+      //| mov rcx, RUTIL
+      dasm_put(Dst, 1453);
+#line 1950 "../../src/codegen.in.c"
+      if (is_long) {
+        //| shl rax, cl
+        dasm_put(Dst, 1458);
+#line 1952 "../../src/codegen.in.c"
+      } else {
+        //| shl eax, cl
+        dasm_put(Dst, 1459);
+#line 1954 "../../src/codegen.in.c"
+      }
+      return;
+    case ND_SHR:
+      //| mov rcx, RUTIL
+      dasm_put(Dst, 1453);
+#line 1958 "../../src/codegen.in.c"
+      if (node->lhs->ty->is_unsigned) {
+        if (is_long) {
+          //| shr rax, cl
+          dasm_put(Dst, 1462);
+#line 1961 "../../src/codegen.in.c"
+        } else {
+          //| shr eax, cl
+          dasm_put(Dst, 1463);
+#line 1963 "../../src/codegen.in.c"
+        }
+      } else {
+        if (is_long) {
+          //| sar rax, cl
+          dasm_put(Dst, 1466);
+#line 1967 "../../src/codegen.in.c"
+        } else {
+          //| sar eax, cl
+          dasm_put(Dst, 1467);
+#line 1969 "../../src/codegen.in.c"
+        }
+      }
+      return;
+  }
+
+  error_tok(node->tok, "invalid expression");
+}
+
+static void gen_stmt(Node* node) {
+#if X64WIN
+  if (user_context->generate_debug_symbols) {
+    record_line_syminfo(node->tok->file->file_no, node->tok->line_no, codegen_pclabel());
+  }
+#endif
+
+  switch (node->kind) {
+    case ND_IF: {
+      int lelse = codegen_pclabel();
+      int lend = codegen_pclabel();
+      gen_expr(node->cond);
+      cmp_zero(node->cond->ty);
+      //| je =>lelse
+      dasm_put(Dst, 1067, lelse);
+#line 1991 "../../src/codegen.in.c"
+      gen_stmt(node->then);
+      //| jmp =>lend
+      //|=>lelse:
+      dasm_put(Dst, 1071, lend, lelse);
+#line 1994 "../../src/codegen.in.c"
+      if (node->els)
+        gen_stmt(node->els);
+      //|=>lend:
+      dasm_put(Dst, 0, lend);
+#line 1997 "../../src/codegen.in.c"
+      return;
+    }
+    case ND_FOR: {
+      if (node->init)
+        gen_stmt(node->init);
+      int lbegin = codegen_pclabel();
+      //|=>lbegin:
+      dasm_put(Dst, 0, lbegin);
+#line 2004 "../../src/codegen.in.c"
+      if (node->cond) {
+        gen_expr(node->cond);
+        cmp_zero(node->cond->ty);
+        //| je =>node->brk_pc_label
+        dasm_put(Dst, 1067, node->brk_pc_label);
+#line 2008 "../../src/codegen.in.c"
+      }
+      gen_stmt(node->then);
+      //|=>node->cont_pc_label:
+      dasm_put(Dst, 0, node->cont_pc_label);
+#line 2011 "../../src/codegen.in.c"
+      if (node->inc)
+        gen_expr(node->inc);
+      //| jmp =>lbegin
+      //|=>node->brk_pc_label:
+      dasm_put(Dst, 1071, lbegin, node->brk_pc_label);
+#line 2015 "../../src/codegen.in.c"
+      return;
+    }
+    case ND_DO: {
+      int lbegin = codegen_pclabel();
+      //|=>lbegin:
+      dasm_put(Dst, 0, lbegin);
+#line 2020 "../../src/codegen.in.c"
+      gen_stmt(node->then);
+      //|=>node->cont_pc_label:
+      dasm_put(Dst, 0, node->cont_pc_label);
+#line 2022 "../../src/codegen.in.c"
+      gen_expr(node->cond);
+      cmp_zero(node->cond->ty);
+      //| jne =>lbegin
+      //|=>node->brk_pc_label:
+      dasm_put(Dst, 1471, lbegin, node->brk_pc_label);
+#line 2026 "../../src/codegen.in.c"
+      return;
+    }
+    case ND_SWITCH:
+      gen_expr(node->cond);
+
+      for (Node* n = node->case_next; n; n = n->case_next) {
+        bool is_long = node->cond->ty->size == 8;
+
+        if (n->begin == n->end) {
+          if (is_long) {
+            //| cmp rax, n->begin
+            dasm_put(Dst, 1476, n->begin);
+#line 2037 "../../src/codegen.in.c"
+          } else {
+            //| cmp eax, n->begin
+            dasm_put(Dst, 1477, n->begin);
+#line 2039 "../../src/codegen.in.c"
+          }
+          //| je =>n->pc_label
+          dasm_put(Dst, 1067, n->pc_label);
+#line 2041 "../../src/codegen.in.c"
+          continue;
+        }
+
+        // [GNU] Case ranges
+        if (is_long) {
+          //| mov RUTIL, rax
+          //| sub RUTIL, n->begin
+          //| cmp RUTIL, n->end - n->begin
+          dasm_put(Dst, 1482, n->begin, n->end - n->begin);
+#line 2049 "../../src/codegen.in.c"
+        } else {
+          //| mov RUTILd, eax
+          //| sub RUTILd, n->begin
+          //| cmp RUTILd, n->end - n->begin
+          dasm_put(Dst, 1496, n->begin, n->end - n->begin);
+#line 2053 "../../src/codegen.in.c"
+        }
+        //| jbe =>n->pc_label
+        dasm_put(Dst, 1507, n->pc_label);
+#line 2055 "../../src/codegen.in.c"
+      }
+
+      if (node->default_case) {
+        //| jmp =>node->default_case->pc_label
+        dasm_put(Dst, 1511, node->default_case->pc_label);
+#line 2059 "../../src/codegen.in.c"
+      }
+
+      //| jmp =>node->brk_pc_label
+      dasm_put(Dst, 1511, node->brk_pc_label);
+#line 2062 "../../src/codegen.in.c"
+      gen_stmt(node->then);
+      //|=>node->brk_pc_label:
+      dasm_put(Dst, 0, node->brk_pc_label);
+#line 2064 "../../src/codegen.in.c"
+      return;
+    case ND_CASE:
+      //|=>node->pc_label:
+      dasm_put(Dst, 0, node->pc_label);
+#line 2067 "../../src/codegen.in.c"
+      gen_stmt(node->lhs);
+      return;
+    case ND_BLOCK:
+      for (Node* n = node->body; n; n = n->next)
+        gen_stmt(n);
+      return;
+    case ND_GOTO:
+      //| jmp =>node->pc_label
+      dasm_put(Dst, 1511, node->pc_label);
+#line 2075 "../../src/codegen.in.c"
+      return;
+    case ND_GOTO_EXPR:
+      gen_expr(node->lhs);
+      //| jmp rax
+      dasm_put(Dst, 1515);
+#line 2079 "../../src/codegen.in.c"
+      return;
+    case ND_LABEL:
+      //|=>node->pc_label:
+      dasm_put(Dst, 0, node->pc_label);
+#line 2082 "../../src/codegen.in.c"
+      gen_stmt(node->lhs);
+      return;
+    case ND_RETURN:
+      if (node->lhs) {
+        gen_expr(node->lhs);
+        Type* ty = node->lhs->ty;
+
+        switch (ty->kind) {
+          case TY_STRUCT:
+          case TY_UNION:
+            if (
+#if X64WIN
+                type_passed_in_register(ty)
+#else
+                ty->size <= 16
+#endif
+            ) {
+              copy_struct_reg();
+            } else {
+              copy_struct_mem();
+            }
+            break;
+        }
+      }
+
+      //| jmp =>C(current_fn)->dasm_return_label
+      dasm_put(Dst, 1511, C(current_fn)->dasm_return_label);
+#line 2108 "../../src/codegen.in.c"
+      return;
+    case ND_EXPR_STMT:
+      gen_expr(node->lhs);
+      return;
+    case ND_ASM:
+      error_tok(node->tok, "asm statement not supported");
+  }
+
+  error_tok(node->tok, "invalid statement");
+}
+
+#if X64WIN
+
+// Assign offsets to local variables.
+static void assign_lvar_offsets(Obj* prog) {
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!fn->is_function || !fn->is_definition || !fn->is_live)
+      continue;
+
+    // outaf("--- %s\n", fn->name);
+
+    // The parameter home area starts at 16 above rbp:
+    //   ...
+    //   stack arg 2 (6th arg)
+    //   stack arg 1 (5th arg)
+    //   R9 home
+    //   R8 home
+    //   RDX home
+    //   RCX home
+    //   return address pushed by call instr
+    //   old RBP (for the called function)  <<< RBP after push rbp; mov rbp, rsp
+    //   ...
+    //   ... stack space used by called function
+    //   ...
+    //
+    // The top of the diagram is addr 0xffffffff.. and the bottom is 0.
+    // PUSH decrements RSP and then stores.
+    // So, "top" means the highest numbered address corresponding the to root
+    // function and bottom moves to the frames for the leaf-ward functions.
+    int top = 16;
+    int bottom = 8;
+
+    int reg = 0;
+
+    // Assign offsets to pass-by-stack parameters and register homes.
+    for (Obj* var = fn->params; var; var = var->next) {
+      Type* ty = var->ty;
+
+      switch (ty->kind) {
+        case TY_STRUCT:
+        case TY_UNION:
+          if (!type_passed_in_register(ty)) {
+            // If it's too big for a register, then the value we're getting is a
+            // pointer to a copy, rather than the actual value, so flag it as
+            // such and then either assign a register or stack slot for the
+            // reference.
+            // outaf("by ref %s\n", var->name);
+            assert(var->is_param_passed_by_reference);
+          }
+
+          // If the pointer to a referenced value or the value itself can be
+          // passed in a register then assign here.
+          if (reg++ < X64WIN_REG_MAX) {
+            var->offset = top;
+            // outaf("  assigned reg offset 0x%x\n", var->offset);
+            top += 8;
+            continue;
+          }
+
+          // Otherwise fall through to the stack slot assignment below.
+          break;
+        case TY_FLOAT:
+        case TY_DOUBLE:
+          if (reg++ < X64WIN_REG_MAX) {
+            var->offset = top;
+            top += 8;
+            continue;
+          }
+          break;
+        default:
+          if (reg++ < X64WIN_REG_MAX) {
+            var->offset = top;
+            top += 8;
+            // outaf("int reg %s at home 0x%x\n", var->name, var->offset);
+            continue;
+          }
+      }
+
+      var->offset = top;
+      // outaf("int stack %s at stack 0x%x\n", var->name, var->offset);
+      if (var->is_param_passed_by_reference) {
+        top += 8;
+      } else {
+        top += MAX(8, var->ty->size);
+      }
+    }
+
+    // Assign offsets to local variables.
+    for (Obj* var = fn->locals; var; var = var->next) {
+      if (var->offset) {
+        continue;
+      }
+
+      int align =
+          (var->ty->kind == TY_ARRAY && var->ty->size >= 16) ? MAX(16, var->align) : var->align;
+
+      bottom += var->ty->size;
+      bottom = (int)align_to_s(bottom, align);
+      var->offset = -bottom;
+      // outaf("local %s at -0x%x\n", var->name, -var->offset);
+    }
+
+    fn->stack_size = (int)align_to_s(bottom, 16);
+  }
+}
+
+#else  // SysV
+
+// Assign offsets to local variables.
+static void assign_lvar_offsets(Obj* prog) {
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!fn->is_function)
+      continue;
+
+    // If a function has many parameters, some parameters are
+    // inevitably passed by stack rather than by register.
+    // The first passed-by-stack parameter resides at RBP+16.
+    int top = 16;
+    int bottom = 0;
+
+    int gp = 0, fp = 0;
+
+    // Assign offsets to pass-by-stack parameters.
+    for (Obj* var = fn->params; var; var = var->next) {
+      Type* ty = var->ty;
+
+      switch (ty->kind) {
+        case TY_STRUCT:
+        case TY_UNION:
+          if (ty->size <= 8) {
+            bool fp1 = has_flonum(ty, 0, 8, 0);
+            if (fp + fp1 < SYSV_FP_MAX && gp + !fp1 < SYSV_GP_MAX) {
+              fp = fp + fp1;
+              gp = gp + !fp1;
+              continue;
+            }
+          } else if (ty->size <= 16) {
+            bool fp1 = has_flonum(ty, 0, 8, 0);
+            bool fp2 = has_flonum(ty, 8, 16, 8);
+            if (fp + fp1 + fp2 < SYSV_FP_MAX && gp + !fp1 + !fp2 < SYSV_GP_MAX) {
+              fp = fp + fp1 + fp2;
+              gp = gp + !fp1 + !fp2;
+              continue;
+            }
+          }
+          break;
+        case TY_FLOAT:
+        case TY_DOUBLE:
+          if (fp++ < SYSV_FP_MAX)
+            continue;
+          break;
+        case TY_LDOUBLE:
+          break;
+        default:
+          if (gp++ < SYSV_GP_MAX)
+            continue;
+      }
+
+      top = align_to_s(top, 8);
+      var->offset = top;
+      top += var->ty->size;
+    }
+
+    // Assign offsets to pass-by-register parameters and local variables.
+    for (Obj* var = fn->locals; var; var = var->next) {
+      if (var->offset)
+        continue;
+
+      // AMD64 System V ABI has a special alignment rule for an array of
+      // length at least 16 bytes. We need to align such array to at least
+      // 16-byte boundaries. See p.14 of
+      // https://github.com/hjl-tools/x86-psABI/wiki/x86-64-psABI-draft.pdf.
+      int align =
+          (var->ty->kind == TY_ARRAY && var->ty->size >= 16) ? MAX(16, var->align) : var->align;
+
+      bottom += var->ty->size;
+      bottom = align_to_s(bottom, align);
+      var->offset = -bottom;
+    }
+
+    fn->stack_size = align_to_s(bottom, 16);
+  }
+}
+
+#endif  // SysV
+
+IMPLSTATIC void linkfixup_push(FileLinkData* fld,
+                               char* target,
+                               char* fixup,
+                               int addend,
+                               char* user) {
+  if (!fld->fixups) {
+    fld->fixups = calloc(8, sizeof(LinkFixup));
+    fld->fcap = 8;
+  }
+
+  if (fld->fcap == fld->flen) {
+    fld->fixups = realloc(fld->fixups, sizeof(LinkFixup) * fld->fcap * 2);
+    fld->fcap *= 2;
+  }
+
+  Atom* name = intern(target, (int)strlen(target));
+  fld->fixups[fld->flen++] = (LinkFixup){fixup, name, addend, user};
+}
+
+IMPLSTATIC int global_data_alignment(Obj* var) {
+  return (var->ty->kind == TY_ARRAY && var->ty->size >= 16) ? MAX(16, var->align) : var->align;
+}
+
+// String literals are pooled by contents across all files, so that identical
+// literals share storage, and so that a literal that's unchanged by a
+// recompile keeps its address (which code that's reused relies on). Each file
+// holds a reference to the entries used by its last compile.
+static void release_rodata(PooledRodata* entry) {
+  if (--entry->refs > 0)
+    return;
+  code_heap_free(CH_Rodata, entry->data, entry->size);
+  hashmap_delete2(&user_context->rodata_pool, entry->key, entry->keylen);
+  free(entry);
+}
+
+// Starts recreating the string literals of |file_index|. The names from the
+// previous compile are dropped, but their storage is kept until
+// end_file_rodata() so that literals that are interned again don't move.
+IMPLSTATIC void begin_file_rodata(size_t file_index) {
+  FileLinkData* fld = &user_context->files[file_index];
+  if (fld->num_prev_rodata)
+    end_file_rodata(file_index);  // The last compile didn't finish.
+  HashMap* statics = &user_context->global_data[file_index];
+  for (int i = 0; i < fld->num_rodata; ++i) {
+    if (hashmap_get(statics, fld->rodata[i].name) == fld->rodata[i].entry->data)
+      hashmap_delete(statics, fld->rodata[i].name);
+  }
+  fld->num_prev_rodata = fld->num_rodata;
+}
+
+IMPLSTATIC void end_file_rodata(size_t file_index) {
+  FileLinkData* fld = &user_context->files[file_index];
+  for (int i = 0; i < fld->num_prev_rodata; ++i) {
+    free(fld->rodata[i].name);
+    release_rodata(fld->rodata[i].entry);
+  }
+  fld->num_rodata -= fld->num_prev_rodata;
+  memmove(fld->rodata, fld->rodata + fld->num_prev_rodata, sizeof(FileRodata) * fld->num_rodata);
+  fld->num_prev_rodata = 0;
+}
+
+// Returns the pooled storage for the string literal |name| of |file_index|
+// with the given contents, which must not be written to.
+IMPLSTATIC char* intern_rodata(size_t file_index, char* name, char* contents, int size, int align) {
+  UserContext* uc = user_context;
+  int keylen = size + (int)sizeof(align);
+  char* key = malloc(keylen);
+  memcpy(key, contents, size);
+  memcpy(key + size, &align, sizeof(align));
+  PooledRodata* entry = hashmap_get2(&uc->rodata_pool, key, keylen);
+  if (entry) {
+    free(key);
+  } else {
+    entry = calloc(1, sizeof(PooledRodata));
+    entry->data = code_heap_alloc(CH_Rodata, size, align);
+    memcpy(entry->data, contents, size);
+    // Literals are shared by every file, so a write through one (which is
+    // undefined behaviour) faults rather than changing all of them.
+    code_heap_protect(entry->data, size, false);
+    entry->size = size;
+    entry->key = key;
+    entry->keylen = keylen;
+    hashmap_put2(&uc->rodata_pool, key, keylen, entry);
+  }
+  ++entry->refs;
+  C(data_bytes) += size;
+
+  FileLinkData* fld = &uc->files[file_index];
+  if (fld->num_rodata == fld->rodata_cap) {
+    fld->rodata_cap = MAX(fld->rodata_cap * 2, 16);
+    fld->rodata = realloc(fld->rodata, sizeof(FileRodata) * fld->rodata_cap);
+  }
+  fld->rodata[fld->num_rodata++] = (FileRodata){strdup(name), entry};
+  hashmap_put(&uc->global_data[file_index], strdup(name), entry->data);
+  return entry->data;
+}
+
+IMPLSTATIC void free_rodata_pool(UserContext* ctx) {
+  for (size_t i = 0; i < ctx->num_files; ++i) {
+    FileLinkData* fld = &ctx->files[i];
+    for (int j = 0; j < fld->num_rodata; ++j)
+      free(fld->rodata[j].name);
+    free(fld->rodata);
+    fld->rodata = NULL;
+    fld->num_rodata = 0;
+    fld->num_prev_rodata = 0;
+    fld->rodata_cap = 0;
+  }
+  // The storage itself is released along with the code heap.
+  hashmap_clear_manual_key_owned_value_owned(&ctx->rodata_pool);
+}
+
+// Returns zeroed storage for the writable global variable |name| that should
+// be initialized, or NULL if it already exists, in which case it keeps its
+// current value. New storage is in the code heap if |in_code_heap|, and
+// otherwise mapped separately. String literals are handled by intern_rodata()
+// instead.
+IMPLSTATIC char* allocate_global_data(size_t file_index,
+                                      char* name,
+                                      bool is_static,
+                                      bool has_init_data,
+                                      bool in_code_heap,
+                                      int size,
+                                      int align) {
+  // - if writeable data has an entry, it shouldn't be recreated. the
+  // dyo version doesn't reprocess kTypeInitializerDataRelocation or
+  // kTypeInitializerCodeRelocation; that's possibly a bug, but it'll
+  // need some testing to get a case where it comes up.
+  //
+  // TODO: if it changes from static to extern, is it the same
+  // variable? currently they're separate, so a switch causes a
+  // reinit, a leak, and some confusion.
+  //
+  // writable data can't be packed into a single allocation per file,
+  // because it doesn't move or reinit, but new ones get added as code
+  // evolves and we can't blow away or move the old ones. so each one is
+  // allocated separately from the data or bss part of the code heap (or
+  // mapped on its own if it's large), and lives as long as the context.
+
+  UserContext* uc = user_context;
+  C(data_bytes) += size;
+  size_t idx = is_static ? file_index : uc->num_files;
+
+  if (hashmap_get(&uc->global_data[idx], name)) {
+    // data already created and initialized, don't reinit.
+    return NULL;
+  }
+  char* global_data = in_code_heap
+                          ? code_heap_try_alloc(has_init_data ? CH_Data : CH_Bss, size, align)
+                          : allocate_large_data(size, align);
+  if (!global_data) {
+    error("couldn't allocate %d bytes for global '%s'%s", size, name,
+          in_code_heap ? ", the code heap is full" : "");
+  }
+
+  // TODO: Is this wrong (or above)? If writable |x| in one file
+  // already existed and |x| in another is added, then it'll be
+  // silently ignored.
+  // Need to figure out where/how to have a duplicate symbol check.
+#if 0
+      if (!was_freed) {
+        void* prev = hashmap_get(&uc->global_data[idx], strings.data[name_index]);
+        if (prev) {
+          outaf("duplicated symbol: %s\n", strings.data[name_index]);
+          goto fail;
+        }
+      }
+#endif
+  hashmap_put(&uc->global_data[idx], strdup(name), global_data);
+  return global_data;
+}
+
+// Writable data isn't reinitialized when its file is recompiled, so pointers
+// in it to the file's functions would be left pointing at the old code, which
+// is freed by a full recompile. Those that still do are bound to the new code,
+// but ones that the program has pointed elsewhere are left alone.
+IMPLSTATIC void remember_old_code(FileLinkData* fld) {
+  int n = 1 + fld->num_patch_segments;
+  CodeSegment* old = bumpcalloc(n, sizeof(CodeSegment), AL_Compile);
+  old[0] = (CodeSegment){fld->codeseg_base_address, fld->codeseg_code_size, NULL, 0};
+  for (int i = 0; i < fld->num_patch_segments; ++i)
+    old[i + 1] = fld->patch_segments[i];
+  C(old_code) = old;
+  C(num_old_code) = n;
+}
+
+// Returns the address of the pointer at |offset| in the existing global
+// |name|, if it points into the code that remember_old_code() saved.
+IMPLSTATIC char* stale_code_pointer(size_t file_index, char* name, bool is_static, int offset) {
+  UserContext* uc = user_context;
+  char* data = hashmap_get(&uc->global_data[is_static ? file_index : uc->num_files], name);
+  if (!data)
+    return NULL;
+  char* at = data + offset;
+  char* target = *(char**)at;
+  for (int i = 0; i < C(num_old_code); ++i) {
+    CodeSegment* seg = &C(old_code)[i];
+    if (target >= seg->base_address && target < seg->base_address + seg->code_size)
+      return at;
+  }
+  return NULL;
+}
+
+IMPLSTATIC void free_global_data(UserContext* ctx) {
+  for (size_t i = 0; i < ctx->num_files + 1; ++i) {
+    int iter = 0;
+    for (HashEntry* ent; (ent = hashmap_next(&ctx->global_data[i], &iter));) {
+      // The rest are released along with the code heap.
+      if (!code_heap_contains(ent->val))
+        free_large_data(ent->val);
+    }
+    hashmap_clear_manual_key_owned_value_unowned(&ctx->global_data[i]);
+  }
+}
+
+static void emit_data(Obj* prog) {
+  begin_file_rodata(C(file_index));
+  for (Obj* var = prog; var; var = var->next) {
+    // outaf("var->name %s %d %d %d %d\n", var->name, var->is_function, var->is_definition,
+    // var->is_static, var->is_tentative);
+    if (var->is_function)
+      continue;
+
+    if (!var->is_definition) {
+      continue;
+    }
+
+    if (var->is_rodata) {
+      intern_rodata(C(file_index), var->name, var->init_data, var->ty->size,
+                    global_data_alignment(var));
+      continue;
+    }
+
+    FileLinkData* fld = &user_context->files[C(file_index)];
+    char* fillp = allocate_global_data(C(file_index), var->name, var->is_static,
+                                       var->init_data != NULL, var->in_code_heap, var->ty->size,
+                                       global_data_alignment(var));
+    if (!fillp) {
+      for (Relocation* rel = var->rel; rel; rel = rel->next) {
+        char* at = stale_code_pointer(C(file_index), var->name, var->is_static, rel->offset);
+        if (!at)
+          continue;
+        if (rel->string_label) {
+          linkfixup_push(fld, *rel->string_label, at, rel->addend, NULL);
+        } else {
+          int offset = dasm_getpclabel(&C(dynasm), *rel->internal_code_label);
+          *((uintptr_t*)at) = (uintptr_t)(fld->codeseg_base_address + offset + rel->addend);
+        }
+      }
+      continue;
+    }
+
+    // .data or .tdata
+    if (var->init_data) {
+      Relocation* rel = var->rel;
+      int pos = 0;
+      while (pos < var->ty->size) {
+        if (rel && rel->offset == pos) {
+          assert(!(rel->string_label && rel->internal_code_label));  // Shouldn't be both.
+          assert(rel->string_label ||
+                 rel->internal_code_label);  // But should be at least one if we're here.
+
+          if (rel->string_label) {
+            linkfixup_push(fld, *rel->string_label, fillp, rel->addend, NULL);
+          } else {
+            int offset = dasm_getpclabel(&C(dynasm), *rel->internal_code_label);
+            *((uintptr_t*)fillp) = (uintptr_t)(fld->codeseg_base_address + offset + rel->addend);
+          }
+
+          rel = rel->next;
+          pos += 8;
+          fillp += 8;
+        } else {
+          *fillp++ = var->init_data[pos++];
+        }
+      }
+
+      continue;
+    }
+
+    // If no init_data, then already allocated and cleared (.bss).
+  }
+  end_file_rodata(C(file_index));
+}
+
+static void store_fp(int r, int offset, int sz) {
+  switch (sz) {
+    case 4:
+      //| movss dword [rbp+offset], xmm(r)
+      dasm_put(Dst, 685, (r), offset);
+#line 2593 "../../src/codegen.in.c"
+      return;
+    case 8:
+      //| movsd qword [rbp+offset], xmm(r)
+      dasm_put(Dst, 696, (r), offset);
+#line 2596 "../../src/codegen.in.c"
+      return;
+  }
+  unreachable();
+}
+
+static void store_gp(int r, int offset, int sz) {
+  switch (sz) {
+    case 1:
+      //| mov [rbp+offset], Rb(dasmargreg[r])
+      dasm_put(Dst, 1519, (dasmargreg[r]), offset);
+#line 2605 "../../src/codegen.in.c"
+      return;
+    case 2:
+      //| mov [rbp+offset], Rw(dasmargreg[r])
+      dasm_put(Dst, 1527, (dasmargreg[r]), offset);
+#line 2608 "../../src/codegen.in.c"
+      return;
+      return;
+    case 4:
+      //| mov [rbp+offset], Rd(dasmargreg[r])
+      dasm_put(Dst, 1528, (dasmargreg[r]), offset);
+#line 2612 "../../src/codegen.in.c"
+      return;
+    case 8:
+      //| mov [rbp+offset], Rq(dasmargreg[r])
+      dasm_put(Dst, 1536, (dasmargreg[r]), offset);
+#line 2615 "../../src/codegen.in.c"
+      return;
+    default:
+      for (int i = 0; i < sz; i++) {
+        //| mov [rbp+offset+i], Rb(dasmargreg[r])
+        //| shr Rq(dasmargreg[r]), 8
+        dasm_put(Dst, 707, (dasmargreg[r]), offset+i, (dasmargreg[r]));
+#line 2620 "../../src/codegen.in.c"
+      }
+      return;
+  }
+}
+
+#if X64WIN
+extern int __chkstk(void);
+#endif  // X64WIN
+
+static void emit_text(Obj* prog) {
+  // Preallocate the dasm labels so they can be used in functions out of order.
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+
+    fn->dasm_return_label = codegen_pclabel();
+    fn->dasm_entry_label = codegen_pclabel();
+    fn->dasm_end_of_function_label = codegen_pclabel();
+    fn->dasm_unwind_info_label = codegen_pclabel();
+  }
+
+  //| .code
+  dasm_put(Dst, 1544);
+#line 2642 "../../src/codegen.in.c"
+
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+
+    //| .align 16
+    //|=>fn->dasm_entry_label:
+    dasm_put(Dst, 1546, fn->dasm_entry_label);
+#line 2649 "../../src/codegen.in.c"
+
+    C(current_fn) = fn;
+
+#if X64WIN
+    record_line_syminfo(fn->ty->name->file->file_no, fn->ty->name->line_no, codegen_pclabel());
+#endif
+
+    // outaf("---- %s\n", fn->name);
+
+    // Prologue
+    //| push rbp
+    //| mov rbp, rsp
+    dasm_put(Dst, 1550);
+#line 2661 "../../src/codegen.in.c"
+
+#if X64WIN
+    // Stack probe on Windows if necessary. The MSDN reference for __chkstk says
+    // it's only necessary beyond 8k for x64, but cl does it at 4k.
+    if (fn->stack_size >= 4096) {
+      //| mov rax, fn->stack_size
+      dasm_put(Dst, 934, fn->stack_size);
+#line 2667 "../../src/codegen.in.c"
+      int got_load = got_load_label("__chkstk");
+      //|=>got_load:
+      //| .byte 0x4c, 0x8b, 0x15  // mov r10, [rip+disp32]
+      //| .dword 0
+      //| call r10
+      //| sub rsp, rax
+      dasm_put(Dst, 1555, got_load);
+#line 2673 "../../src/codegen.in.c"
+
+      // TODO: pdata emission
+    } else
+#endif
+
+    {
+      //| sub rsp, fn->stack_size
+      dasm_put(Dst, 631, fn->stack_size);
+#line 2680 "../../src/codegen.in.c"
+
+      // TODO: add a label here to assert that the prolog size is as expected
+
+#if X64WIN
+      // RtlAddFunctionTable() requires these to be at an offset with the same
+      // base as the function offsets, so we need to emit these into the main
+      // codeseg allocation, rather than just allocating them separately, since
+      // we can't easily guarantee a <4G offset to them otherwise.
+
+      // Unfortunately, we can't build another section with this as dynasm
+      // doesn't seem to allow resolving these offsets, so this is done later
+      //| .dword =>fn->dasm_entry_label
+      //| .dword =>fn->dasm_end_of_function_label
+      //| .dword =>fn->dasm_unwind_info_label
+
+      // TODO: probably info about rdi pushed for memsets.
+
+      // https://learn.microsoft.com/en-us/cpp/build/exception-handling-x64?view=msvc-170
+      enum {
+        UWOP_PUSH_NONVOL = 0,
+        UWOP_ALLOC_LARGE = 1,
+        UWOP_ALLOC_SMALL = 2,
+        UWOP_SET_FPREG = 3,
+      };
+
+      // These are the UNWIND_INFO structure that is referenced by the third
+      // element of RUNTIME_FUNCTION.
+      //| .pdata
+      dasm_put(Dst, 1571);
+#line 2708 "../../src/codegen.in.c"
+      // This takes care of cases where CountOfCodes is odd.
+      //| .align 4
+      //|=>fn->dasm_unwind_info_label:
+      //| .byte 1  /* Version:3 (1) and Flags:5 (0) */
+      dasm_put(Dst, 1573, fn->dasm_unwind_info_label, 1  /* Version:3 (1) and Flags:5 (0) */);
+#line 2712 "../../src/codegen.in.c"
+      bool small_stack = fn->stack_size / 8 - 1 <= 15;
+      if (small_stack) {
+        // We just happen to "know" this is the form used for small stack sizes.
+        // xxxxxxxxxxxx0000 55                   push        rbp
+        // xxxxxxxxxxxx0001 48 89 E5             mov         rbp,rsp
+        // xxxxxxxxxxxx0004 48 83 EC 10          sub         rsp,10h
+        // xxxxxxxxxxxx0009 ...
+        //| .byte 8  /* SizeOfProlog */
+        //| .byte 3  /* CountOfCodes */
+        dasm_put(Dst, 1578, 8  /* SizeOfProlog */, 3  /* CountOfCodes */);
+#line 2721 "../../src/codegen.in.c"
+      } else {
+        // And this one for larger reservations.
+        // xxxxxxxxxxxx0000 55                   push        rbp
+        // xxxxxxxxxxxx0001 48 89 E5             mov         rbp,rsp
+        // xxxxxxxxxxxx0004 48 81 EC B0 01 00 00 sub         rsp,1B0h
+        // xxxxxxxxxxxx000b ...
+        //| .byte 11  /* SizeOfProlog */
+        //| .byte 4  /* CountOfCodes */
+        dasm_put(Dst, 1578, 11  /* SizeOfProlog */, 4  /* CountOfCodes */);
+#line 2729 "../../src/codegen.in.c"
+      }
+      //| .byte 5  /* FrameRegister:4 (RBP) | FrameOffset:4: 0 offset */
+      dasm_put(Dst, 991, 5  /* FrameRegister:4 (RBP) | FrameOffset:4: 0 offset */);
+#line 2731 "../../src/codegen.in.c"
+
+      if (small_stack) {
+        //| .byte 8  /* CodeOffset */
+        //| .byte UWOP_ALLOC_SMALL | (((unsigned char)((fn->stack_size / 8) - 1)) << 4)
+        dasm_put(Dst, 1578, 8  /* CodeOffset */, UWOP_ALLOC_SMALL | (((unsigned char)((fn->stack_size / 8) - 1)) << 4));
+#line 2735 "../../src/codegen.in.c"
+      } else {
+        //| .byte 11  /* CodeOffset */
+        dasm_put(Dst, 991, 11  /* CodeOffset */);
+#line 2737 "../../src/codegen.in.c"
+        assert(fn->stack_size / 8 <= 65535 && "todo; not UWOP_ALLOC_LARGE 0-style");
+        //| .byte UWOP_ALLOC_LARGE
+        //| .word fn->stack_size / 8
+        dasm_put(Dst, 1581, UWOP_ALLOC_LARGE, fn->stack_size / 8);
+#line 2740 "../../src/codegen.in.c"
+      }
+      //| .byte 4  /* CodeOffset */
+      //| .byte UWOP_SET_FPREG
+      //| .byte 1  /* CodeOffset */
+      //| .byte UWOP_PUSH_NONVOL | (5 /* RBP */ << 4)
+      dasm_put(Dst, 1584, 4  /* CodeOffset */, UWOP_SET_FPREG, 1  /* CodeOffset */, UWOP_PUSH_NONVOL | (5 /* RBP */ << 4));
+#line 2745 "../../src/codegen.in.c"
+
+      //| .code
+      dasm_put(Dst, 1544);
+#line 2747 "../../src/codegen.in.c"
+#endif
+    }
+
+    //| mov [rbp+fn->alloca_bottom->offset], rsp
+    dasm_put(Dst, 1589, fn->alloca_bottom->offset);
+#line 2751 "../../src/codegen.in.c"
+
+#if !X64WIN
+    // Save arg registers if function is variadic
+    if (fn->va_area) {
+      int gp = 0, fp = 0;
+      for (Obj* var = fn->params; var; var = var->next) {
+        if (is_flonum(var->ty))
+          fp++;
+        else
+          gp++;
+      }
+
+      int off = fn->va_area->offset;
+
+      // va_elem
+      //| mov dword [rbp+off], gp*8            // gp_offset
+      //| mov dword [rbp+off+4], fp * 8 + 48   // fp_offset
+      //| mov [rbp+off+8], rbp                 // overflow_arg_area
+      //| add qword [rbp+off+8], 16
+      //| mov [rbp+off+16], rbp                // reg_save_area
+      //| add qword [rbp+off+16], off+24
+      dasm_put(Dst, 1594, off, gp*8, off+4, fp * 8 + 48, off+8, off+8, off+16, off+16, off+24);
+#line 2772 "../../src/codegen.in.c"
+
+      // __reg_save_area__
+      //| mov [rbp + off + 24], rdi
+      //| mov [rbp + off + 32], rsi
+      //| mov [rbp + off + 40], rdx
+      //| mov [rbp + off + 48], rcx
+      //| mov [rbp + off + 56], r8
+      //| mov [rbp + off + 64], r9
+      //| movsd qword [rbp + off + 72], xmm0
+      //| movsd qword [rbp + off + 80], xmm1
+      //| movsd qword [rbp + off + 88], xmm2
+      //| movsd qword [rbp + off + 96], xmm3
+      //| movsd qword [rbp + off + 104], xmm4
+      //| movsd qword [rbp + off + 112], xmm5
+      //| movsd qword [rbp + off + 120], xmm6
+      //| movsd qword [rbp + off + 128], xmm7
+      dasm_put(Dst, 1621, off + 24, off + 32, off + 40, off + 48, off + 56, off + 64, off + 72, off + 80, off + 88, off + 96, off + 104, off + 112, off + 120, off + 128);
+#line 2788 "../../src/codegen.in.c"
+    }
+#endif
+
+#if X64WIN
+    // If variadic, we have to store all registers; floats will have been
+    // duplicated into the integer registers.
+    if (fn->ty->is_variadic) {
+      //| mov [rbp + 16], CARG1
+      //| mov [rbp + 24], CARG2
+      //| mov [rbp + 32], CARG3
+      //| mov [rbp + 40], CARG4
+      dasm_put(Dst, 1694, 16, 24, 32, 40);
+#line 2799 "../../src/codegen.in.c"
+    } else {
+      // Save passed-by-register arguments to the stack
+      int reg = 0;
+      for (Obj* var = fn->params; var; var = var->next) {
+        if (var->offset >= 16 + PARAMETER_SAVE_SIZE)
+          continue;
+
+        Type* ty = var->ty;
+
+        switch (ty->kind) {
+          case TY_STRUCT:
+          case TY_UNION:
+            // It's either small and so passed in a register, or isn't and then
+            // we're instead storing the pointer to the larger struct.
+            if (type_passed_in_register(ty)) {
+              store_gp(reg++, var->offset, ty->size);
+            } else {
+              store_gp(reg++, var->offset, 8);
+            }
+            break;
+          case TY_FLOAT:
+          case TY_DOUBLE:
+            store_fp(reg++, var->offset, ty->size);
+            break;
+          default:
+            store_gp(reg++, var->offset, ty->size);
+            break;
+        }
+      }
+    }
+#else
+    // Save passed-by-register arguments to the stack
+    int gp = 0, fp = 0;
+    for (Obj* var = fn->params; var; var = var->next) {
+      if (var->offset > 0)
+        continue;
+
+      Type* ty = var->ty;
+
+      switch (ty->kind) {
+        case TY_STRUCT:
+        case TY_UNION:
+          assert(ty->size <= 16);
+          if (has_flonum(ty, 0, 8, 0))
+            store_fp(fp++, var->offset, MIN(8, ty->size));
+          else
+            store_gp(gp++, var->offset, MIN(8, ty->size));
+
+          if (ty->size > 8) {
+            if (has_flonum(ty, 8, 16, 0))
+              store_fp(fp++, var->offset + 8, ty->size - 8);
+            else
+              store_gp(gp++, var->offset + 8, ty->size - 8);
+          }
+          break;
+        case TY_FLOAT:
+        case TY_DOUBLE:
+          store_fp(fp++, var->offset, ty->size);
+          break;
+        default:
+          store_gp(gp++, var->offset, ty->size);
+      }
+    }
+#endif
+
+    // Emit code
+    gen_stmt(fn->body);
+    assert(C(depth) == 0);
+
+    // [https://www.sigbus.info/n1570#5.1.2.2.3p1] The C spec defines
+    // a special rule for the main function. Reaching the end of the
+    // main function is equivalent to returning 0, even though the
+    // behavior is undefined for the other functions.
+    if (strcmp(fn->name, "main") == 0) {
+      //| mov rax, 0
+      dasm_put(Dst, 737);
+#line 2874 "../../src/codegen.in.c"
+    }
+
+    // Epilogue
+    //|=>fn->dasm_return_label:
+    dasm_put(Dst, 0, fn->dasm_return_label);
+#line 2878 "../../src/codegen.in.c"
+#if X64WIN
+    // https://learn.microsoft.com/en-us/cpp/build/prolog-and-epilog?view=msvc-170#epilog-code
+    // says this the required form to recognize an epilog.
+    //| lea rsp, [rbp]
+    dasm_put(Dst, 1711);
+#line 2882 "../../src/codegen.in.c"
+#else
+    //| mov rsp, rbp
+    dasm_put(Dst, 1716);
+#line 2884 "../../src/codegen.in.c"
+#endif
+    //| pop rbp
+    //| ret
+    dasm_put(Dst, 1721);
+#line 2887 "../../src/codegen.in.c"
+
+    //|=>fn->dasm_end_of_function_label:
+    dasm_put(Dst, 0, fn->dasm_end_of_function_label);
+#line 2889 "../../src/codegen.in.c"
+  }
+}
+
+// Before all of a file's code is replaced, removes what its previous compile
+// exported, so that functions it no longer defines can't be found or linked
+// to. A global export is only removed if another file hasn't since taken it.
+IMPLSTATIC void remove_file_exports(size_t file_index) {
+  UserContext* uc = user_context;
+  FileLinkData* fld = &uc->files[file_index];
+  hashmap_clear_manual_key_owned_value_unowned(&uc->exports[file_index]);
+  HashMap* globals = &uc->exports[uc->num_files];
+  for (int i = 0; i < fld->num_functions; ++i) {
+    EmittedFunction* ef = &fld->functions[i];
+    Atom* name = ef->name;
+    if (!ef->is_static &&
+        hashmap_get_hashed(globals, name->name, name->len, name->hash) == ef->entry)
+      hashmap_delete2(globals, name->name, name->len);
+  }
+}
+
+static void fill_out_text_exports(Obj* prog, FileLinkData* fld, char* codeseg_base_address) {
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+
+    char* address;
+    if (fn->replaces_code)
+      address = find_emitted_function(fld, fn)->entry;
+    else
+      address = codeseg_base_address + dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    size_t idx = fn->is_static ? C(file_index) : user_context->num_files;
+    hashmap_put(&user_context->exports[idx], strdup(fn->name), address);
+  }
+}
+
+IMPLSTATIC void free_link_fixups(FileLinkData* fld) {
+  free(fld->fixups);
+  fld->fixups = NULL;
+  fld->flen = 0;
+  fld->fcap = 0;
+}
+
+// Points the direct data loads in the encoded code at the data, which must
+// have already been allocated. The labels in data_uses are replaced by their
+// offsets, for cache_store().
+static void fill_out_data_loads(char* codeseg_base_address) {
+  for (int i = 0; i < C(data_uses).len; ++i) {
+    IntIntInt* use = &C(data_uses).data[i];
+    use->a = dasm_getpclabel(&C(dynasm), use->a);
+    patch_data_load(C(file_index), codeseg_base_address + use->a, C(data_names).data[use->b],
+                    use->c);
+  }
+}
+
+IMPLSTATIC void patch_data_load(size_t file_index, char* load, char* name, bool is_static) {
+  size_t idx = is_static ? file_index : user_context->num_files;
+  char* data = hashmap_get(&user_context->global_data[idx], name);
+  if (!data)
+    ABORT("direct reference to unallocated data");
+  if (!code_heap_contains(data))
+    error("'%s' isn't in the code heap, so can't be referenced directly", name);
+  patch_rip_relative_load(load, data);
+}
+
+// |load| is a 7 byte instruction ending in a disp32 relative to its end.
+IMPLSTATIC void patch_rip_relative_load(char* load, char* target) {
+  int32_t disp = (int32_t)(target - (load + GOT_LOAD_SIZE));
+  memcpy(load + GOT_LOAD_SIZE - sizeof(disp), &disp, sizeof(disp));
+}
+
+// Points the GOT loads in the encoded code at their slots, and adds a fixup
+// for each slot. The labels in got_uses are replaced by their offsets, for
+// cache_store().
+static void fill_out_got(FileLinkData* fld, char* codeseg_base_address, char* got) {
+  char** users = bumpcalloc(C(got_names).len, sizeof(char*), AL_Compile);
+  for (int i = 0; i < C(got_uses).len; ++i) {
+    IntIntInt* use = &C(got_uses).data[i];
+    use->a = dasm_getpclabel(&C(dynasm), use->a);
+    use->c = dasm_getpclabel(&C(dynasm), use->c);
+    patch_rip_relative_load(codeseg_base_address + use->a, got + use->b * sizeof(void*));
+    users[use->b] = codeseg_base_address + use->c;
+  }
+
+  for (int i = 0; i < C(got_names).len; ++i)
+    linkfixup_push(fld, C(got_names).data[i], got + i * sizeof(void*), /*addend=*/0, users[i]);
+}
+
+#if X64WIN
+
+typedef struct RuntimeFunction {
+  unsigned long BeginAddress;
+  unsigned long EndAddress;
+  unsigned long UnwindData;
+} RuntimeFunction;
+
+static void emit_symbols_and_exception_function_table(Obj* prog,
+                                                      char* base_addr,
+                                                      int pdata_start_offset,
+                                                      int pdata_end_offset) {
+  int func_count = 0;
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+
+    ++func_count;
+  }
+
+  size_t alloc_size = (sizeof(RuntimeFunction) * func_count);
+
+  unregister_and_free_function_table_data(user_context);
+  char* function_table_data = malloc(alloc_size);
+  user_context->function_table_data = function_table_data;
+  char* pfuncs = function_table_data;
+
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+
+    RuntimeFunction* rf = (RuntimeFunction*)pfuncs;
+    int func_start_offset = dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    rf->BeginAddress = func_start_offset;
+    rf->EndAddress = dasm_getpclabel(&C(dynasm), fn->dasm_end_of_function_label);
+    rf->UnwindData = dasm_getpclabel(&C(dynasm), fn->dasm_unwind_info_label);
+    pfuncs += sizeof(RuntimeFunction);
+
+    if (user_context->generate_debug_symbols) {
+      DbpFunctionSymbol* dbp_func_sym =
+          dbp_add_function_symbol(user_context->dbp_ctx, fn->name, fn->ty->name->file->display_name,
+                                  dasm_getpclabel(&C(dynasm), fn->dasm_entry_label),
+                                  dasm_getpclabel(&C(dynasm), fn->dasm_end_of_function_label));
+      for (int i = 0; i < fn->file_line_label_data.len; ++i) {
+        // TODO: ignoring file index, might not be needed unless something got
+        // inlined (which doesn't happen). Maybe there's a macro case that could
+        // cause it already though?
+        int offset = dasm_getpclabel(&C(dynasm), fn->file_line_label_data.data[i].c);
+        dbp_add_line_mapping(user_context->dbp_ctx, dbp_func_sym, offset,
+                             fn->file_line_label_data.data[i].b);
+      }
+    }
+  }
+
+  if (user_context->generate_debug_symbols) {
+    char* unwind_base = base_addr + pdata_start_offset;
+    size_t unwind_len = pdata_end_offset - pdata_start_offset;
+    DbpExceptionTables exception_tables = {
+        .pdata = (DbpRUNTIME_FUNCTION*)user_context->function_table_data,
+        .num_pdata_entries = func_count,
+        .unwind_info = (unsigned char*)unwind_base,
+        .unwind_info_byte_length = unwind_len,
+    };
+    dbp_ready_to_execute(user_context->dbp_ctx, &exception_tables);
+  }
+
+  register_function_table_data(user_context, func_count, base_addr);
+}
+
+#else  // !X64WIN
+
+static void emit_symbols_and_exception_function_table(Obj* prog,
+                                                      char* base_addr,
+                                                      int pdata_start_offset,
+                                                      int pdata_end_offset) {
+  (void)prog;
+  (void)base_addr;
+  (void)pdata_start_offset;
+  (void)pdata_end_offset;
+}
+
+#endif
+
+IMPLSTATIC void codegen_init(void) {
+  dasm_init(&C(dynasm), DASM_MAXSECTION);
+  dasm_growpc(&C(dynasm), 1 << 16);  // Arbitrary number to avoid lots of reallocs of that array.
+
+  C(numlabels) = 1;
+}
+
+// A replaced function's old entry point is overwritten with `jmp [rip+0]`
+// followed by the absolute address of the new code.
+#define PATCH_JUMP_SIZE 14
+
+// After this many partial compiles, start over with a full compile so that
+// the old code that's no longer reachable is released.
+#define MAX_PATCH_SEGMENTS 16
+
+// The name of a function is almost always already interned, as that's where
+// the parser gets it from, so it doesn't need to be hashed again.
+static Atom* function_name_atom(Obj* fn) {
+  Token* name = fn->ty->name;
+  if (name && name->atom && name->atom->name == fn->name)
+    return name->atom;
+  return intern(fn->name, (int)strlen(fn->name));
+}
+
+static EmittedFunction* find_emitted_function(FileLinkData* fld, Obj* fn) {
+  Atom* name = function_name_atom(fn);
+  intptr_t index =
+      (intptr_t)hashmap_get_hashed(&fld->function_index, name->name, name->len, name->hash);
+  return index ? &fld->functions[index - 1] : NULL;
+}
+
+IMPLSTATIC EmittedFunction* add_emitted_function(FileLinkData* fld, Atom* name) {
+  if (fld->num_functions == fld->functions_cap) {
+    fld->functions_cap = MAX(8, fld->functions_cap * 2);
+    fld->functions = realloc(fld->functions, sizeof(EmittedFunction) * fld->functions_cap);
+  }
+  intptr_t index = ++fld->num_functions;
+  hashmap_put_hashed(&fld->function_index, name->name, name->len, name->hash, (void*)index);
+  EmittedFunction* ef = &fld->functions[index - 1];
+  *ef = (EmittedFunction){.name = name};
+  return ef;
+}
+
+static void free_emitted_functions(FileLinkData* fld) {
+  free(fld->functions);
+  fld->functions = NULL;
+  fld->num_functions = 0;
+  fld->functions_cap = 0;
+  hashmap_clear_manual_key_unowned_value_unowned(&fld->function_index);
+}
+
+static bool has_code_relocations(Obj* prog) {
+  for (Obj* var = prog; var; var = var->next) {
+    if (var->is_function)
+      continue;
+    for (Relocation* rel = var->rel; rel; rel = rel->next) {
+      if (rel->internal_code_label)
+        return true;
+    }
+  }
+  return false;
+}
+
+// If the previous code for this file can be partially reused, marks the
+// functions whose bodies are unchanged with |reuse_code| and returns true.
+// Otherwise, everything must be regenerated.
+static bool mark_reusable_functions(Obj* prog, FileLinkData* fld) {
+#if X64WIN
+  // The function table and debug information are per-segment.
+  (void)prog;
+  (void)fld;
+  return false;
+#else
+  if (!fld->codeseg_base_address || fld->num_patch_segments >= MAX_PATCH_SEGMENTS)
+    return false;
+
+  // Anything outside of function bodies (types, globals, declarations) being
+  // different could change the code generated for any function.
+  if (fld->toplevel_hash != compiler_state.parse__toplevel_hash)
+    return false;
+
+  // Pointers to labels are stored in data as absolute addresses.
+  if (has_code_relocations(prog))
+    return false;
+
+  int num_found = 0;
+  int num_unchanged = 0;
+  for (int i = 0; i < fld->num_functions; ++i)
+    fld->functions[i].reused = false;
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+    EmittedFunction* ef = find_emitted_function(fld, fn);
+    if (!ef)
+      continue;
+    ++num_found;
+    if (ef->content_hash == fn->content_hash)
+      ++num_unchanged;
+    else if (ef->entry == ef->address && ef->size < PATCH_JUMP_SIZE)
+      return false;
+  }
+
+  // All old functions must still be emitted so that they can be redirected,
+  // and there's no point if nothing is reused.
+  if (num_found != fld->num_functions || num_unchanged == 0)
+    return false;
+
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+    EmittedFunction* ef = find_emitted_function(fld, fn);
+    if (!ef)
+      continue;
+    if (ef->content_hash == fn->content_hash) {
+      fn->reuse_code = true;
+      ef->reused = true;
+    } else {
+      fn->replaces_code = true;
+    }
+  }
+  return true;
+#endif
+}
+
+static int compare_function_address(const void* a, const void* b) {
+  char* x = (*(EmittedFunction**)a)->address;
+  char* y = (*(EmittedFunction**)b)->address;
+  return x < y ? -1 : x > y;
+}
+
+// GOT slots used by reused code still need to be filled out at link time.
+// Other fixups are dropped and will be recreated by this compile.
+static void retain_reused_link_fixups(FileLinkData* fld) {
+  // Sorted by address, to find the function that each fixup's user is in.
+  EmittedFunction** reused =
+      bumpcalloc(MAX(fld->num_functions, 1), sizeof(EmittedFunction*), AL_Compile);
+  int num_reused = 0;
+  for (int i = 0; i < fld->num_functions; ++i) {
+    if (fld->functions[i].reused)
+      reused[num_reused++] = &fld->functions[i];
+  }
+  qsort(reused, num_reused, sizeof(EmittedFunction*), compare_function_address);
+
+  int kept = 0;
+  for (int i = 0; i < fld->flen; ++i) {
+    LinkFixup* lf = &fld->fixups[i];
+    // The number of reused functions that start at or before the user.
+    int lo = 0;
+    int hi = num_reused;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (reused[mid]->address <= lf->user)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo > 0 && lf->user < reused[lo - 1]->address + reused[lo - 1]->size)
+      fld->fixups[kept++] = *lf;
+  }
+  fld->flen = kept;
+}
+
+static void redirect_replaced_functions(Obj* prog, FileLinkData* fld, char* codeseg_base_address) {
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+    EmittedFunction* ef = find_emitted_function(fld, fn);
+    if (!ef)
+      continue;
+
+    char* target = codeseg_base_address + dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    code_heap_protect(ef->entry, PATCH_JUMP_SIZE, true);
+    static const unsigned char jmp_rip_indirect[6] = {0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+    memcpy(ef->entry, jmp_rip_indirect, sizeof(jmp_rip_indirect));
+    memcpy(ef->entry + sizeof(jmp_rip_indirect), &target, sizeof(target));
+    code_heap_protect(ef->entry, PATCH_JUMP_SIZE, false);
+  }
+}
+
+static void record_emitted_functions(Obj* prog,
+                                     FileLinkData* fld,
+                                     char* codeseg_base_address,
+                                     bool patching) {
+  if (!patching)
+    free_emitted_functions(fld);
+
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+    EmittedFunction* ef = patching ? find_emitted_function(fld, fn) : NULL;
+    if (!ef) {
+      ef = add_emitted_function(fld, function_name_atom(fn));
+      ef->entry = codeseg_base_address + dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    }
+    int entry = dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    int end = dasm_getpclabel(&C(dynasm), fn->dasm_end_of_function_label);
+    ef->content_hash = fn->content_hash;
+    ef->address = codeseg_base_address + entry;
+    ef->size = end - entry;
+    ef->is_static = fn->is_static;
+    ef->reused = false;
+  }
+
+  fld->toplevel_hash = compiler_state.parse__toplevel_hash;
+}
+
+static void resolve_code_relocations(Obj* prog) {
+  for (Obj* var = prog; var; var = var->next) {
+    if (var->is_function)
+      continue;
+    for (Relocation* rel = var->rel; rel; rel = rel->next) {
+      if (rel->internal_code_label)
+        rel->code_offset = dasm_getpclabel(&C(dynasm), *rel->internal_code_label);
+    }
+  }
+}
+
+IMPLSTATIC void free_code_segments(FileLinkData* fld) {
+#if X64WIN
+  if (fld->codeseg_in_debug_image) {
+    free_executable_memory(fld->codeseg_base_address, 0);
+    fld->codeseg_base_address = NULL;
+    fld->codeseg_got = NULL;
+    fld->codeseg_in_debug_image = false;
+  }
+#endif
+  code_heap_free(CH_Code, fld->codeseg_base_address, fld->codeseg_code_size);
+  code_heap_free(CH_Got, fld->codeseg_got, fld->codeseg_got_size);
+  fld->codeseg_base_address = NULL;
+  fld->codeseg_code_size = 0;
+  fld->codeseg_got = NULL;
+  fld->codeseg_got_size = 0;
+  for (int i = 0; i < fld->num_patch_segments; ++i) {
+    CodeSegment* seg = &fld->patch_segments[i];
+    code_heap_free(CH_Code, seg->base_address, seg->code_size);
+    code_heap_free(CH_Got, seg->got, seg->got_size);
+  }
+  free(fld->patch_segments);
+  fld->patch_segments = NULL;
+  fld->num_patch_segments = 0;
+
+  free_emitted_functions(fld);
+}
+
+IMPLSTATIC void codegen(Obj* prog, size_t file_index) {
+  C(file_index) = file_index;
+
+  FileLinkData* fld = &user_context->files[C(file_index)];
+  bool patching = mark_reusable_functions(prog, fld);
+  C(patched) = patching;
+
+  void* globals[dynasm_globals_MAX + 1];
+  dasm_setupglobal(&C(dynasm), globals, dynasm_globals_MAX + 1);
+
+  dasm_setup(&C(dynasm), dynasm_actions);
+
+  //| .pdata
+  dasm_put(Dst, 1571);
+#line 3316 "../../src/codegen.in.c"
+  int start_of_pdata = codegen_pclabel();
+  //|.align 4
+  //|=>start_of_pdata:
+  //| .code
+  dasm_put(Dst, 1724, start_of_pdata);
+#line 3320 "../../src/codegen.in.c"
+
+  assign_lvar_offsets(prog);
+  place_global_data(prog);
+  emit_text(prog);
+
+  //| .pdata
+  dasm_put(Dst, 1571);
+#line 3326 "../../src/codegen.in.c"
+  int end_of_pdata = codegen_pclabel();
+  //|=>end_of_pdata:
+  //| .code
+  dasm_put(Dst, 1726, end_of_pdata);
+#line 3329 "../../src/codegen.in.c"
+
+  stats_enter_phase(DYIBICC_PHASE_ENCODE);
+  size_t code_size;
+  dasm_link(&C(dynasm), &code_size);
+  C(code_bytes) = code_size;
+
+  size_t got_size = C(got_names).len * sizeof(void*);
+
+  char* codeseg_base_address;
+  char* got;
+  if (patching) {
+    codeseg_base_address = code_heap_alloc(CH_Code, code_size, 0);
+    got = code_heap_alloc(CH_Got, got_size, 0);
+    fld->patch_segments = realloc(fld->patch_segments,
+                                  sizeof(CodeSegment) * (fld->num_patch_segments + 1));
+    fld->patch_segments[fld->num_patch_segments++] =
+        (CodeSegment){codeseg_base_address, code_size, got, got_size};
+  } else {
+    remove_file_exports(C(file_index));
+    remember_old_code(fld);
+    free_code_segments(fld);
+    fld->codeseg_code_size = code_size;
+    fld->codeseg_got_size = got_size;
+#if X64WIN
+    if (user_context->generate_debug_symbols) {
+      // The GOT has to be in the image too, to be in range of the code.
+      size_t got_offset = align_to_u(MAX(code_size, 1), get_page_size());
+      user_context->dbp_ctx =
+          dbp_create(got_offset + align_to_u(got_size, get_page_size()),
+                     get_temp_pdb_filename(AL_Compile));
+      fld->codeseg_base_address = dbp_get_image_base(user_context->dbp_ctx);
+      fld->codeseg_got = fld->codeseg_base_address + got_offset;
+      fld->codeseg_in_debug_image = true;
+    } else {
+      fld->codeseg_base_address = code_heap_alloc(CH_Code, code_size, 0);
+      fld->codeseg_got = code_heap_alloc(CH_Got, got_size, 0);
+    }
+#else
+    fld->codeseg_base_address = code_heap_alloc(CH_Code, code_size, 0);
+    fld->codeseg_got = code_heap_alloc(CH_Got, got_size, 0);
+#endif
+    codeseg_base_address = fld->codeseg_base_address;
+    got = fld->codeseg_got;
+  }
+  // outaf("code_size: %zu, got_size: %zu\n", code_size, got_size);
+
+  fill_out_text_exports(prog, fld, codeseg_base_address);
+
+  if (patching)
+    retain_reused_link_fixups(fld);
+  else
+    free_link_fixups(fld);
+  emit_data(prog);  // This needs to point into code for fixups, so has to go late-ish.
+
+  dasm_encode(&C(dynasm), codeseg_base_address);
+  fill_out_got(fld, codeseg_base_address, got);
+  fill_out_data_loads(codeseg_base_address);
+
+#if 0
+  FILE* f = fopen("code.raw", "wb");
+  fwrite(codeseg_base_address, code_size, 1, f);
+  fclose(f);
+  system("ndisasm -b64 code.raw");
+#endif
+
+  int check_result = dasm_checkstep(&C(dynasm), 0);
+  if (check_result != DASM_S_OK) {
+    outaf("check_result: 0x%08x\n", check_result);
+    ABORT("dasm_checkstep failed");
+  }
+
+  if (patching)
+    redirect_replaced_functions(prog, fld, codeseg_base_address);
+  record_emitted_functions(prog, fld, codeseg_base_address, patching);
+
+  // Only a complete and relocatable segment can be saved.
+  if (compiler_state.cache__key && !patching && !C(position_dependent)) {
+    resolve_code_relocations(prog);
+    cache_store(prog, fld, code_size);
+  }
+
+  emit_symbols_and_exception_function_table(prog, codeseg_base_address,
+                                            dasm_getpclabel(&C(dynasm), start_of_pdata),
+                                            dasm_getpclabel(&C(dynasm), end_of_pdata));
+
+  // Only the GOT is written after this, by linking.
+  code_heap_protect(codeseg_base_address, code_size, false);
+
+  codegen_free();
+}
+
+// This can be called after a longjmp in update.
+IMPLSTATIC void codegen_free(void) {
+  if (C(dynasm)) {
+    dasm_free(&C(dynasm));
+  }
+}
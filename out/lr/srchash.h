@@ -0,0 +1 @@
+#define DYIBICC_SOURCE_HASH 0x1acd584664220387ULL
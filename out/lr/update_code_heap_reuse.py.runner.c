@@ -0,0 +1,204 @@
+
+#include "libdyibicc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void* get_host_helper_func(const char* name) {
+  (void)name;
+  return NULL;
+
+}
+
+static char initial_0[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x66,0x69,0x72,0x73,0x74,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x69,0x66,0x20,0x28,0x21,0x66,0x69,0x72,0x73,0x74,0x29,0xa,0x20,0x20,0x20,0x20,0x66,0x69,0x72,0x73,0x74,0x20,0x3d,0x20,0x28,0x76,0x6f,0x69,0x64,0x2a,0x29,0x6d,0x61,0x69,0x6e,0x3b,0xa,0x20,0x20,0x69,0x6e,0x74,0x20,0x78,0x20,0x3d,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x29,0x3b,0xa,0x20,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x28,0x28,0x76,0x6f,0x69,0x64,0x2a,0x29,0x6d,0x61,0x69,0x6e,0x20,0x3d,0x3d,0x20,0x66,0x69,0x72,0x73,0x74,0x29,0x20,0x2a,0x20,0x31,0x30,0x30,0x20,0x2b,0x20,0x78,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_0 = initial_0;
+static char initial_1[] = {0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x3b,0xa,0x7d,0xa,'\0'};
+static char* source_contents_1 = initial_1;
+
+static bool get_file_by_name(const char* filename, char** contents, size_t* size) {
+
+  if (strcmp("main.c", filename) == 0) {
+    *size = strlen(source_contents_0);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_0, *size);
+    return true;
+  }
+
+  if (strcmp("other.c", filename) == 0) {
+    *size = strlen(source_contents_1);
+    *contents = malloc(*size);
+    memcpy(*contents, source_contents_1, *size);
+    return true;
+  }
+
+
+
+  // Otherwise, fallback to normal file loading (for includes, etc.)
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    return false;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  rewind(fp);
+  *contents = malloc(*size);
+  fread(*contents, 1, *size, fp);
+  fclose(fp);
+  return true;
+}
+
+
+int main(void) {
+
+  char* include_paths[] = {
+    NULL
+  };
+  char* input_paths[] = {
+    "main.c", "other.c", NULL
+  };
+
+  DyibiccEnviromentData env_data = {
+      .include_paths = (const char**)include_paths,
+      .files = (const char**)input_paths,
+      .load_file_contents = get_file_by_name,
+      .get_function_address = get_host_helper_func,
+      .output_function = NULL,
+      .use_ansi_codes = false,
+      .generate_debug_symbols = false,
+      .cache_dir = NULL,
+  };
+
+
+  DyibiccContext* ctx = dyibicc_set_environment(&env_data);
+
+  int final_result = 0;
+  void* stable_main = NULL;
+  (void)stable_main;
+
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("initial update failed\n");
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step0[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x66,0x69,0x72,0x73,0x74,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x69,0x66,0x20,0x28,0x21,0x66,0x69,0x72,0x73,0x74,0x29,0xa,0x20,0x20,0x20,0x20,0x66,0x69,0x72,0x73,0x74,0x20,0x3d,0x20,0x28,0x76,0x6f,0x69,0x64,0x2a,0x29,0x6d,0x61,0x69,0x6e,0x3b,0xa,0x20,0x20,0x69,0x6e,0x74,0x20,0x78,0x20,0x3d,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x29,0x3b,0xa,0x20,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x28,0x28,0x76,0x6f,0x69,0x64,0x2a,0x29,0x6d,0x61,0x69,0x6e,0x20,0x3d,0x3d,0x20,0x66,0x69,0x72,0x73,0x74,0x29,0x20,0x2a,0x20,0x31,0x30,0x30,0x20,0x2b,0x20,0x78,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step0)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  static char contents_step1[] = {0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x31,0x3b,0xa,0x7d,0xa,'\0'};
+  if (!dyibicc_update(ctx, "other.c", contents_step1)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 101) {
+      printf("update_code_heap_reuse.py:32: got %d, but expected %d\n", result, 101);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_code_heap_reuse.py:32: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!((char*)dyibicc_find_export(ctx, "other") - (char*)dyibicc_find_export(ctx, "main") > 4096)) {
+    printf("update_code_heap_reuse.py:33: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!((size_t)dyibicc_find_export(ctx, "other") % 4096 == 0)) {
+    printf("update_code_heap_reuse.py:34: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step5[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x66,0x69,0x72,0x73,0x74,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x69,0x66,0x20,0x28,0x21,0x66,0x69,0x72,0x73,0x74,0x29,0xa,0x20,0x20,0x20,0x20,0x66,0x69,0x72,0x73,0x74,0x20,0x3d,0x20,0x28,0x76,0x6f,0x69,0x64,0x2a,0x29,0x6d,0x61,0x69,0x6e,0x3b,0xa,0x20,0x20,0x69,0x6e,0x74,0x20,0x78,0x20,0x3d,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x29,0x3b,0xa,0x20,0x20,0x54,0x45,0x4e,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x28,0x28,0x76,0x6f,0x69,0x64,0x2a,0x29,0x6d,0x61,0x69,0x6e,0x20,0x3d,0x3d,0x20,0x66,0x69,0x72,0x73,0x74,0x29,0x20,0x2a,0x20,0x31,0x30,0x30,0x20,0x2b,0x20,0x78,0x3b,0xa,0x7d,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step5)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 101) {
+      printf("update_code_heap_reuse.py:38: got %d, but expected %d\n", result, 101);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_code_heap_reuse.py:38: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  static char contents_step7[] = {0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x54,0x45,0x4e,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0x20,0x78,0x20,0x2b,0x3d,0x20,0x30,0x3b,0xa,0x23,0x64,0x65,0x66,0x69,0x6e,0x65,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0x20,0x54,0x45,0x4e,0xa,0x73,0x74,0x61,0x74,0x69,0x63,0x20,0x76,0x6f,0x69,0x64,0x2a,0x20,0x66,0x69,0x72,0x73,0x74,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x76,0x6f,0x69,0x64,0x29,0x3b,0xa,0x69,0x6e,0x74,0x20,0x6d,0x61,0x69,0x6e,0x28,0x76,0x6f,0x69,0x64,0x29,0x20,0x7b,0xa,0x20,0x20,0x69,0x66,0x20,0x28,0x21,0x66,0x69,0x72,0x73,0x74,0x29,0xa,0x20,0x20,0x20,0x20,0x66,0x69,0x72,0x73,0x74,0x20,0x3d,0x20,0x28,0x76,0x6f,0x69,0x64,0x2a,0x29,0x6d,0x61,0x69,0x6e,0x3b,0xa,0x20,0x20,0x69,0x6e,0x74,0x20,0x78,0x20,0x3d,0x20,0x6f,0x74,0x68,0x65,0x72,0x28,0x29,0x3b,0xa,0x20,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0x20,0x48,0x55,0x4e,0x44,0x52,0x45,0x44,0xa,0x20,0x20,0x72,0x65,0x74,0x75,0x72,0x6e,0x20,0x28,0x28,0x76,0x6f,0x69,0x64,0x2a,0x29,0x6d,0x61,0x69,0x6e,0x20,0x3d,0x3d,0x20,0x66,0x69,0x72,0x73,0x74,0x29,0x20,0x2a,0x20,0x31,0x30,0x30,0x20,0x2b,0x20,0x78,0x3b,0xa,0x7d,'\0'};
+  if (!dyibicc_update(ctx, "main.c", contents_step7)) {
+    final_result = 255;
+    goto fail;
+  }
+
+
+  {
+  void* entry_point = dyibicc_find_export(ctx, "main");
+  if (entry_point) {
+    int myargc = 1;
+    char* myargv[] = {"prog", NULL};
+    int result = ((int (*)(int, char**))entry_point)(myargc, myargv);
+    if (result != 101) {
+      printf("update_code_heap_reuse.py:42: got %d, but expected %d\n", result, 101);
+      final_result = 253;
+      goto fail;
+    } else {
+      printf("update_code_heap_reuse.py:42: OK (%d)\n", result);
+    }
+  } else {
+    printf("no entry point found\n");
+    final_result = 254;
+    goto fail;
+  }
+  }
+
+
+  printf("OK\n");
+fail:
+  dyibicc_free(ctx);
+
+  return final_result;
+}
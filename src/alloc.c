@@ -29,25 +29,102 @@ IMPLSTATIC jmp_buf toplevel_update_jmpbuf;
 IMPLSTATIC CompilerState compiler_state;
 IMPLSTATIC LinkerState linker_state;
 
-typedef struct HeapData {
+// Each bump heap is a chain of separately mapped chunks, so that a heap only
+// reserves what it has actually needed rather than a fixed worst-case size.
+// Chunks are kept across resets (with their pages handed back to the OS) so
+// that repeated updates don't keep remapping. All memory in a chunk past the
+// allocation pointer is known to be zero, so bumpcalloc() never clears.
+typedef struct Chunk {
+  struct Chunk* next;
   char* base;
-  char* alloc_pointer;
   size_t size;
+  size_t used;  // Only valid once the chunk is no longer current.
+} Chunk;
+
+typedef struct HeapData {
+  Chunk* chunks;       // In use, the current one first.
+  Chunk* free_chunks;  // Retained from earlier resets, entirely zero.
+  char* alloc_pointer;
+  char* alloc_limit;
+  size_t used_in_full_chunks;
+  size_t high_water;  // Most used this update, recorded on reset.
+  size_t chunk_size;  // Size of the next newly mapped chunk.
+  size_t initial_chunk_size;
 } HeapData;
 
+#define MAX_CHUNK_SIZE ((size_t)256 << 20)
+#define CHUNK_GRANULARITY ((size_t)1 << 20)
+#define PAGE_SIZE_FOR_RESET 4096
+
 static HeapData heap[NUM_BUMP_HEAPS] = {
-    {NULL, NULL, 1024 << 20},  // AL_Compile
-    {NULL, NULL, 128 << 20},   // AL_Temp
-    {NULL, NULL, 128 << 20},   // AL_Link
-    {NULL, NULL, 64 << 20},    // AL_UserContext
+    {.initial_chunk_size = 16 << 20},  // AL_Compile
+    {.initial_chunk_size = 1 << 20},   // AL_Temp
+    {.initial_chunk_size = 4 << 20},   // AL_Link
+    {.initial_chunk_size = 1 << 20},   // AL_UserContext
+    {.initial_chunk_size = 4 << 20},   // AL_Snapshot
 };
 
+static Chunk* map_chunk(size_t size) {
+  char* base = allocate_writable_memory(size);
+  if (!base) {
+    error("heap exhausted");
+  }
+  ASAN_POISON_MEMORY_REGION(base, size);
+  Chunk* chunk = calloc(1, sizeof(Chunk));
+  chunk->base = base;
+  chunk->size = size;
+  return chunk;
+}
+
+// Returns the first |used| bytes of |chunk| to zero, giving the pages back to
+// the OS rather than touching them. Fresh pages are zero-filled on next use.
+static void zero_chunk_pages(Chunk* chunk, size_t used) {
+  size_t len = MIN(align_to_u(used, PAGE_SIZE_FOR_RESET), chunk->size);
+  if (len == 0)
+    return;
+#if X64WIN
+  if (!VirtualFree(chunk->base, len, MEM_DECOMMIT) ||
+      !VirtualAlloc(chunk->base, len, MEM_COMMIT, PAGE_READWRITE)) {
+    memset(chunk->base, 0, len);
+  }
+#else
+  if (madvise(chunk->base, len, MADV_DONTNEED) != 0) {
+    memset(chunk->base, 0, len);
+  }
+#endif
+}
+
+// Makes a chunk with room for at least |needed| bytes current, reusing a
+// retained one if possible.
+static void push_chunk(HeapData* hd, size_t needed) {
+  if (hd->chunks) {
+    hd->chunks->used = hd->alloc_pointer - hd->chunks->base;
+    hd->used_in_full_chunks += hd->chunks->used;
+  }
+
+  Chunk* chunk = NULL;
+  for (Chunk** pc = &hd->free_chunks; *pc; pc = &(*pc)->next) {
+    if ((*pc)->size >= needed) {
+      chunk = *pc;
+      *pc = chunk->next;
+      break;
+    }
+  }
+  if (!chunk) {
+    if (hd->chunk_size == 0)
+      hd->chunk_size = hd->initial_chunk_size;
+    chunk = map_chunk(MAX(hd->chunk_size, align_to_u(needed, CHUNK_GRANULARITY)));
+    hd->chunk_size = MIN(hd->chunk_size * 2, MAX_CHUNK_SIZE);
+  }
+
+  chunk->next = hd->chunks;
+  hd->chunks = chunk;
+  hd->alloc_pointer = chunk->base;
+  hd->alloc_limit = chunk->base + chunk->size;
+}
+
 IMPLSTATIC void alloc_init(AllocLifetime lifetime) {
   assert(lifetime < NUM_BUMP_HEAPS);
-  HeapData* hd = &heap[lifetime];
-
-  hd->alloc_pointer = hd->base = allocate_writable_memory(hd->size);
-  ASAN_POISON_MEMORY_REGION(hd->base, hd->size);
   if (lifetime == AL_Compile) {
     memset(&compiler_state, 0, sizeof(compiler_state));
   } else if (lifetime == AL_Link) {
@@ -60,12 +137,36 @@ IMPLSTATIC void alloc_reset(AllocLifetime lifetime) {
   HeapData* hd = &heap[lifetime];
   // We allow double resets because we may longjmp out during error handling,
   // and don't know which heaps are initialized at that point.
-  if (hd->base) {
-    ASAN_POISON_MEMORY_REGION(hd->base, hd->size);
-    free_executable_memory(hd->base, hd->size);
-    hd->alloc_pointer = NULL;
-    hd->base = NULL;
+  if (hd->chunks) {
+    hd->high_water = MAX(hd->high_water, alloc_used(lifetime));
+    hd->chunks->used = hd->alloc_pointer - hd->chunks->base;
+  }
+  while (hd->chunks) {
+    Chunk* chunk = hd->chunks;
+    hd->chunks = chunk->next;
+    ASAN_POISON_MEMORY_REGION(chunk->base, chunk->size);
+    zero_chunk_pages(chunk, chunk->used);
+    chunk->used = 0;
+    chunk->next = hd->free_chunks;
+    hd->free_chunks = chunk;
   }
+  hd->alloc_pointer = NULL;
+  hd->alloc_limit = NULL;
+  hd->used_in_full_chunks = 0;
+}
+
+// Resets and additionally unmaps all the chunks retained by the heap.
+IMPLSTATIC void alloc_release(AllocLifetime lifetime) {
+  alloc_reset(lifetime);
+  HeapData* hd = &heap[lifetime];
+  while (hd->free_chunks) {
+    Chunk* chunk = hd->free_chunks;
+    hd->free_chunks = chunk->next;
+    free_executable_memory(chunk->base, chunk->size);
+    free(chunk);
+  }
+  hd->chunk_size = 0;
+  hd->high_water = 0;
 }
 
 IMPLSTATIC void* bumpcalloc(size_t num, size_t size, AllocLifetime lifetime) {
@@ -75,16 +176,34 @@ IMPLSTATIC void* bumpcalloc(size_t num, size_t size, AllocLifetime lifetime) {
 
   size_t toalloc = align_to_u(num * size, 8);
   HeapData* hd = &heap[lifetime];
+  if ((size_t)(hd->alloc_limit - hd->alloc_pointer) < toalloc) {
+    push_chunk(hd, toalloc);
+  }
   char* ret = hd->alloc_pointer;
   hd->alloc_pointer += toalloc;
-  if (hd->alloc_pointer > hd->base + hd->size) {
-    error("heap exhausted");
-  }
   ASAN_UNPOISON_MEMORY_REGION(ret, toalloc);
-  memset(ret, 0, toalloc);
   return ret;
 }
 
+IMPLSTATIC size_t alloc_used(AllocLifetime lifetime) {
+  assert(lifetime < NUM_BUMP_HEAPS);
+  HeapData* hd = &heap[lifetime];
+  if (!hd->chunks)
+    return 0;
+  return hd->used_in_full_chunks + (hd->alloc_pointer - hd->chunks->base);
+}
+
+IMPLSTATIC size_t alloc_high_water(AllocLifetime lifetime) {
+  assert(lifetime < NUM_BUMP_HEAPS);
+  return MAX(heap[lifetime].high_water, alloc_used(lifetime));
+}
+
+// Starts a new measurement period, from what's currently in use.
+IMPLSTATIC void alloc_reset_high_water(AllocLifetime lifetime) {
+  assert(lifetime < NUM_BUMP_HEAPS);
+  heap[lifetime].high_water = alloc_used(lifetime);
+}
+
 IMPLSTATIC void alloc_free(void* p, AllocLifetime lifetime) {
   (void)lifetime;
   assert(lifetime == AL_Manual);
@@ -95,27 +214,410 @@ IMPLSTATIC void* bumplamerealloc(void* old,
                                  size_t old_size,
                                  size_t new_size,
                                  AllocLifetime lifetime) {
+  if (lifetime != AL_Manual && new_size >= old_size) {
+    // Grow in place if |old| was the most recent allocation and there's room.
+    HeapData* hd = &heap[lifetime];
+    size_t old_aligned = align_to_u(old_size, 8);
+    size_t new_aligned = align_to_u(new_size, 8);
+    if (old && (char*)old + old_aligned == hd->alloc_pointer &&
+        (size_t)(hd->alloc_limit - (char*)old) >= new_aligned) {
+      ASAN_UNPOISON_MEMORY_REGION(hd->alloc_pointer, new_aligned - old_aligned);
+      hd->alloc_pointer = (char*)old + new_aligned;
+      return old;
+    }
+  }
   void* newptr = bumpcalloc(1, new_size, lifetime);
   memcpy(newptr, old, MIN(old_size, new_size));
   ASAN_POISON_MEMORY_REGION(old, old_size);
   return newptr;
 }
 
-IMPLSTATIC void* aligned_allocate(size_t size, size_t alignment) {
-  size = align_to_u(size, alignment);
+// All generated code, GOTs and global data live in one reservation, so that
+// all data and GOT slots are in range of a rip-relative access from any code.
+// Each kind has its own part of the reservation, so that linking can write
+// GOTs and programs can write data without touching the protection of code
+// pages. Pages are committed as the heap grows, and freed blocks are binned
+// by size for reuse, with wholly free pages handed back to the OS.
+//
+// Each block of code (a file's segment, or a patch segment) has pages of its
+// own, so that making a new block writable never stops the code of other
+// files from running, e.g. on another thread during an update.
+typedef struct CodeHeapLayout {
+  size_t size;
+  size_t alignment;  // Minimum, blocks are also a multiple of this in size. 0 for a page.
+} CodeHeapLayout;
+
+// The alignment of data is at least what global_data_alignment() gives arrays
+// of 16 bytes or more, so that placing them after smaller blocks doesn't leave
+// gaps that are too small to reuse.
+
+// Overridden by a test build, see gen.py.
+#ifndef CODE_HEAP_BSS_SIZE
+#define CODE_HEAP_BSS_SIZE ((size_t)1024 << 20)
+#endif
+
+// The total must be no more than 2GB for disp32 to reach everything.
+static const CodeHeapLayout code_heap_layout[NUM_CODE_HEAP_KINDS] = {
+    {(size_t)512 << 20, 0},    // CH_Code
+    {(size_t)64 << 20, 16},    // CH_Got
+    {(size_t)192 << 20, 16},   // CH_Rodata
+    {(size_t)256 << 20, 16},   // CH_Data
+    {CODE_HEAP_BSS_SIZE, 16},  // CH_Bss
+};
+
+typedef struct FreeRange {
+  struct FreeRange* next;  // In the same bin.
+  struct FreeRange* prev;
+  char* start;
+  char* end;
+} FreeRange;
+
+// Free ranges are binned by exact size below SMALL_FREE_RANGE_LIMIT, and by
+// power of two above it. All sizes are a multiple of 16, the smallest
+// alignment of any region.
+#define SMALL_FREE_RANGE_LIMIT 1024
+#define NUM_SMALL_FREE_BINS (SMALL_FREE_RANGE_LIMIT / 16)
+#define NUM_FREE_BINS (NUM_SMALL_FREE_BINS + 64)
+
+typedef struct CodeHeapRegion {
+  char* base;
+  char* limit;
+  char* top;        // Nothing at or above here is in use.
+  char* committed;  // End of the pages that have been made accessible.
+  size_t alignment;
+
+  // Free ranges are coalesced, so no two are adjacent. The maps are keyed by
+  // the address of either end of each range, so that a freed block can find
+  // its neighbours.
+  FreeRange* free_bins[NUM_FREE_BINS];
+  size_t num_free;
+  HashMap free_starts;
+  HashMap free_ends;
+
+  // Pages of string literals that have been made writable for new blocks,
+  // until code_heap_seal_rodata().
+  char* writable_start;
+  char* writable_end;
+} CodeHeapRegion;
+
+static char* code_heap_reservation;
+static size_t code_heap_reservation_size;
+static CodeHeapRegion code_heap[NUM_CODE_HEAP_KINDS];
+
+static void reserve_code_heap(void) {
+  size_t total = 0;
+  for (int i = 0; i < NUM_CODE_HEAP_KINDS; ++i)
+    total += code_heap_layout[i].size;
+
 #if X64WIN
-  return _aligned_malloc(size, alignment);
+  code_heap_reservation = VirtualAlloc(0, total, MEM_RESERVE, PAGE_NOACCESS);
+  if (!code_heap_reservation)
+    error("VirtualAlloc reserve of %zu failed: 0x%x", total, GetLastError());
 #else
-  return aligned_alloc(alignment, size);
+  code_heap_reservation =
+      mmap(0, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (code_heap_reservation == (void*)-1) {
+    code_heap_reservation = NULL;
+    error("failed to reserve code heap");
+  }
 #endif
+  code_heap_reservation_size = total;
+
+  char* base = code_heap_reservation;
+  for (int i = 0; i < NUM_CODE_HEAP_KINDS; ++i) {
+    code_heap[i] = (CodeHeapRegion){
+        .base = base,
+        .limit = base + code_heap_layout[i].size,
+        .top = base,
+        .committed = base,
+        .alignment = code_heap_layout[i].alignment ? code_heap_layout[i].alignment
+                                                    : get_page_size(),
+        .free_starts = {.alloc_lifetime = AL_Manual},
+        .free_ends = {.alloc_lifetime = AL_Manual},
+    };
+    base += code_heap_layout[i].size;
+  }
 }
 
-IMPLSTATIC void aligned_free(void* p) {
+static void commit_code_heap(CodeHeapRegion* r, char* end) {
+  if (end <= r->committed)
+    return;
+  char* new_committed = (char*)align_to_u((uintptr_t)end, get_page_size());
+  size_t len = new_committed - r->committed;
 #if X64WIN
-  _aligned_free(p);
+  if (!VirtualAlloc(r->committed, len, MEM_COMMIT, PAGE_READWRITE))
+    error("VirtualAlloc commit of %zu failed: 0x%x", len, GetLastError());
 #else
-  free(p);
+  if (mprotect(r->committed, len, PROT_READ | PROT_WRITE) != 0)
+    error("failed to commit code heap");
+#endif
+  r->committed = new_committed;
+}
+
+// Gives back the pages entirely within [start, end), which are unused.
+static void release_code_heap_pages(char* start, char* end) {
+  size_t page_size = get_page_size();
+  char* first = (char*)align_to_u((uintptr_t)start, page_size);
+  char* last = (char*)((uintptr_t)end & ~(page_size - 1));
+  if (first >= last)
+    return;
+#if X64WIN
+  // Decommitting would require tracking which pages need to be committed again
+  // on reuse, so they're kept.
+  (void)first;
+  (void)last;
+#else
+  madvise(first, last - first, MADV_DONTNEED);
+#endif
+}
+
+static int free_bin(size_t size) {
+  if (size < SMALL_FREE_RANGE_LIMIT)
+    return (int)(size / 16);
+  int log2 = 0;
+  while (size >> (log2 + 1))
+    ++log2;
+  return NUM_SMALL_FREE_BINS + log2 - 10;  // 2^10 == SMALL_FREE_RANGE_LIMIT.
+}
+
+static FreeRange* get_free_range(HashMap* map, char* addr) {
+  return hashmap_get2(map, (char*)&addr, sizeof(addr));
+}
+
+static void put_free_range(HashMap* map, char* addr, FreeRange* f) {
+  char* key = malloc(sizeof(addr));
+  memcpy(key, &addr, sizeof(addr));
+  hashmap_put2(map, key, sizeof(addr), f);
+}
+
+static void link_free_range(CodeHeapRegion* r, FreeRange* f) {
+  FreeRange** bin = &r->free_bins[free_bin(f->end - f->start)];
+  f->prev = NULL;
+  f->next = *bin;
+  if (*bin)
+    (*bin)->prev = f;
+  *bin = f;
+  put_free_range(&r->free_starts, f->start, f);
+  put_free_range(&r->free_ends, f->end, f);
+  ++r->num_free;
+}
+
+static void unlink_free_range(CodeHeapRegion* r, FreeRange* f) {
+  if (f->prev)
+    f->prev->next = f->next;
+  else
+    r->free_bins[free_bin(f->end - f->start)] = f->next;
+  if (f->next)
+    f->next->prev = f->prev;
+  hashmap_delete2(&r->free_starts, (char*)&f->start, sizeof(f->start));
+  hashmap_delete2(&r->free_ends, (char*)&f->end, sizeof(f->end));
+  --r->num_free;
+}
+
+// Adds [start, start+size) to the free ranges, merging with its neighbours,
+// and returns the range that now contains it.
+static FreeRange* add_free_range(CodeHeapRegion* r, char* start, size_t size) {
+  FreeRange* f = calloc(1, sizeof(FreeRange));
+  f->start = start;
+  f->end = start + size;
+  FreeRange* before = get_free_range(&r->free_ends, f->start);
+  if (before) {
+    unlink_free_range(r, before);
+    f->start = before->start;
+    free(before);
+  }
+  FreeRange* after = get_free_range(&r->free_starts, f->end);
+  if (after) {
+    unlink_free_range(r, after);
+    f->end = after->end;
+    free(after);
+  }
+  link_free_range(r, f);
+  return f;
+}
+
+// Takes |size| bytes aligned to |align| from the free ranges, or returns NULL.
+// Ranges of the exact size come first, then the smallest bin with one that's
+// big enough.
+static char* take_free_range(CodeHeapRegion* r, size_t size, size_t align) {
+  if (!r->num_free)
+    return NULL;
+  for (int b = free_bin(size); b < NUM_FREE_BINS; ++b) {
+    for (FreeRange* f = r->free_bins[b]; f; f = f->next) {
+      char* p = (char*)align_to_u((uintptr_t)f->start, align);
+      if (p > f->end || (size_t)(f->end - p) < size)
+        continue;
+      char* start = f->start;
+      char* end = f->end;
+      unlink_free_range(r, f);
+      free(f);
+      // Keep the parts before and after the block.
+      if (p != start)
+        add_free_range(r, start, p - start);
+      if (p + size != end)
+        add_free_range(r, p + size, end - (p + size));
+      return p;
+    }
+  }
+  return NULL;
+}
+
+// Makes the pages containing [p, p+size) writable, along with any between them
+// and the ones that already are, so that a file's new string literals can all
+// be made read-only again with a single call.
+static void make_rodata_writable(CodeHeapRegion* r, char* p, size_t size) {
+  size_t page_size = get_page_size();
+  char* start = (char*)((uintptr_t)p & ~(page_size - 1));
+  char* end = (char*)align_to_u((uintptr_t)p + size, page_size);
+  if (r->writable_start == r->writable_end)
+    r->writable_start = r->writable_end = start;
+  if (start < r->writable_start) {
+    code_heap_protect(start, r->writable_start - start, true);
+    r->writable_start = start;
+  }
+  if (end > r->writable_end) {
+    code_heap_protect(r->writable_end, end - r->writable_end, true);
+    r->writable_end = end;
+  }
+}
+
+// Returns a zeroed block of at least |size| bytes, aligned to |align| and to
+// the minimum for the kind (a page for code), or NULL if the kind's part of the
+// heap is full. Code is writable until code_heap_protect() makes it
+// executable, and string literals until code_heap_seal_rodata().
+IMPLSTATIC void* code_heap_try_alloc(CodeHeapKind kind, size_t size, size_t align) {
+  if (!code_heap_reservation)
+    reserve_code_heap();
+  CodeHeapRegion* r = &code_heap[kind];
+  align = MAX(align, r->alignment);
+  size = align_to_u(MAX(size, 1), r->alignment);
+
+  char* p = take_free_range(r, size, align);
+  if (!p) {
+    p = (char*)align_to_u((uintptr_t)r->top, align);
+    if (p > r->limit || (size_t)(r->limit - p) < size)
+      return NULL;
+    if (p != r->top)
+      add_free_range(r, r->top, p - r->top);
+    r->top = p + size;
+    commit_code_heap(r, r->top);
+  }
+
+  ASAN_UNPOISON_MEMORY_REGION(p, size);
+  if (kind == CH_Code)
+    code_heap_protect(p, size, true);
+  else if (kind == CH_Rodata)
+    make_rodata_writable(r, p, size);
+  memset(p, 0, size);
+  return p;
+}
+
+// As code_heap_try_alloc(), but it's an error if there's no room.
+IMPLSTATIC void* code_heap_alloc(CodeHeapKind kind, size_t size, size_t align) {
+  void* p = code_heap_try_alloc(kind, size, align);
+  if (!p)
+    error("code heap exhausted allocating %zu bytes", size);
+  return p;
+}
+
+// Returns the space left above the top of the region for |kind|, not counting
+// freed blocks. A block of |size| bytes aligned to |align| needs no more than
+// |size| + |align| of it.
+IMPLSTATIC size_t code_heap_room(CodeHeapKind kind) {
+  if (!code_heap_reservation)
+    return code_heap_layout[kind].size;
+  return code_heap[kind].limit - code_heap[kind].top;
+}
+
+IMPLSTATIC bool code_heap_contains(void* p) {
+  return code_heap_reservation && (char*)p >= code_heap_reservation &&
+         (char*)p < code_heap_reservation + code_heap_reservation_size;
+}
+
+IMPLSTATIC void code_heap_free(CodeHeapKind kind, void* p, size_t size) {
+  if (!p)
+    return;
+  CodeHeapRegion* r = &code_heap[kind];
+  size = align_to_u(MAX(size, 1), r->alignment);
+  FreeRange* f = add_free_range(r, p, size);
+  release_code_heap_pages(f->start, f->end);
+
+  // Let the bump area absorb a free range that ends at the top.
+  if (f->end == r->top) {
+    unlink_free_range(r, f);
+    r->top = f->start;
+    free(f);
+  }
+}
+
+// Sets the protection of the pages containing [p, p+size) in the code or
+// string literal parts of the code heap, either RW for writing, or back to RX
+// for code and read-only for string literals.
+IMPLSTATIC void code_heap_protect(void* p, size_t size, bool writable) {
+  size_t page_size = get_page_size();
+  char* start = (char*)((uintptr_t)p & ~(page_size - 1));
+  char* end = (char*)align_to_u((uintptr_t)p + MAX(size, 1), page_size);
+  bool is_code = (char*)p < code_heap[CH_Code].limit;
+  assert(is_code || ((char*)p >= code_heap[CH_Rodata].base && (char*)p < code_heap[CH_Rodata].limit));
+  bool ok = writable  ? make_memory_readwrite(start, end - start)
+            : is_code ? make_memory_executable(start, end - start)
+                      : make_memory_readonly(start, end - start);
+  if (!ok) {
+    error("failed to make %p size %zu %s", p, size,
+          writable ? "writable" : (is_code ? "executable" : "read-only"));
+  }
+}
+
+// Makes the string literals allocated since the last call read-only.
+IMPLSTATIC void code_heap_seal_rodata(void) {
+  CodeHeapRegion* r = &code_heap[CH_Rodata];
+  if (r->writable_start == r->writable_end)
+    return;
+  code_heap_protect(r->writable_start, r->writable_end - r->writable_start, false);
+  r->writable_start = r->writable_end = NULL;
+}
+
+IMPLSTATIC void code_heap_release(void) {
+  if (!code_heap_reservation)
+    return;
+  for (int i = 0; i < NUM_CODE_HEAP_KINDS; ++i) {
+    CodeHeapRegion* r = &code_heap[i];
+    for (int b = 0; b < NUM_FREE_BINS; ++b) {
+      while (r->free_bins[b]) {
+        FreeRange* f = r->free_bins[b];
+        r->free_bins[b] = f->next;
+        free(f);
+      }
+    }
+    hashmap_clear_manual_key_owned_value_unowned(&r->free_starts);
+    hashmap_clear_manual_key_owned_value_unowned(&r->free_ends);
+  }
+  // Not free_executable_memory(), as poisoning the whole reservation would be
+  // slow, and the address range is likely to be reused by the next context.
+#if X64WIN
+  VirtualFree(code_heap_reservation, 0, MEM_RELEASE);
+#else
+  munmap(code_heap_reservation, code_heap_reservation_size);
 #endif
+  code_heap_reservation = NULL;
+}
+
+// Global data that doesn't go in the code heap is mapped on its own, with the
+// mapping recorded just before the data. Returns NULL on failure.
+IMPLSTATIC void* allocate_large_data(size_t size, size_t align) {
+  size_t page_size = get_page_size();
+  size_t total = page_size + align + size;
+  char* base = allocate_writable_memory(total);
+  if (!base)
+    return NULL;
+  char* p = (char*)align_to_u((uintptr_t)base + page_size, MAX(align, 1));
+  ((char**)p)[-2] = base;
+  ((size_t*)p)[-1] = total;
+  return p;
+}
+
+IMPLSTATIC void free_large_data(void* p) {
+  free_executable_memory(((char**)p)[-2], ((size_t*)p)[-1]);
 }
 
 // Allocates RW memory of given size and returns a pointer to it. On failure,
@@ -158,6 +660,24 @@ IMPLSTATIC bool make_memory_readwrite(void* m, size_t size) {
 #endif
 }
 
+// Sets a R permission on the given memory, which must be page-aligned. Returns
+// true on success. On failure, prints out the error and returns false.
+IMPLSTATIC bool make_memory_readonly(void* m, size_t size) {
+#if X64WIN
+  DWORD old_protect;
+  if (!VirtualProtect(m, size, PAGE_READONLY, &old_protect)) {
+    error("VirtualProtect %p %zu failed: 0x%x\n", m, size, GetLastError());
+  }
+  return true;
+#else
+  if (mprotect(m, size, PROT_READ) == -1) {
+    perror("mprotect");
+    return false;
+  }
+  return true;
+#endif
+}
+
 // Sets a RX permission on the given memory, which must be page-aligned. Returns
 // 0 on success. On failure, prints out the error and returns -1.
 IMPLSTATIC bool make_memory_executable(void* m, size_t size) {
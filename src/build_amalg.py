@@ -53,6 +53,8 @@ def include_file(f, src):
                 continue
             if line.startswith('#include "compincl.h"'):
                 continue
+            if line.startswith('#include "srchash.h"'):
+                continue
             if line.startswith('#include "../include/all/reflect.h"'):
                 continue
             if line.startswith('#pragma once'):
@@ -0,0 +1,21 @@
+import hashlib
+import sys
+
+'''
+#define DYIBICC_SOURCE_HASH 0x<hash of the compiler's sources>ULL
+
+Mixed into the key of the on-disk cache (see cache.c), so that cached code is
+never used by a compiler that was built from different sources.
+'''
+
+def main():
+    out, inputs = sys.argv[1], sys.argv[2:]
+    h = hashlib.sha256()
+    for i in inputs:
+        with open(i, 'rb') as g:
+            h.update(g.read().replace(b'\r\n', b'\n'))
+    with open(out, 'w', newline='\n', encoding='utf-8') as f:
+        f.write('#define DYIBICC_SOURCE_HASH 0x%sULL\n' % h.hexdigest()[:16])
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,479 @@
+#include "dyibicc.h"
+
+#include "srchash.h"
+
+#if X64WIN
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+#define C(x) compiler_state.cache__##x
+
+// Must be incremented whenever the format below changes. Changes to the code
+// that's generated for a given input are covered by DYIBICC_SOURCE_HASH, a
+// hash of the compiler's sources that's part of every key.
+#define CACHE_VERSION 7
+
+static const char cache_magic[8] = {'d', 'y', 'i', 'b', 'i', 'c', 'c', 'c'};
+
+// A cache file is:
+//
+//   magic, version (u32), key (u64)
+//   code size (u32), number of GOT slots (u32), code bytes
+//   number of functions (u32), each:
+//     name (str), is_static (u8), offset (u32), size (u32), content hash (u64)
+//   toplevel hash (u64)
+//   for each GOT slot:
+//     name (str), slot index (u32), offset of the function using it (u32)
+//   number of GOT loads (u32), each:
+//     offset of the load instruction (u32), slot index (u32)
+//   number of data objects (u32), each:
+//     name (str), is_static (u8), is_rodata (u8), in code heap (u8),
+//     size (u32), align (u32),
+//     has initializer (u8), initializer bytes (size),
+//     number of relocations (u32), each:
+//       offset (u32), addend (u64), is_code (u8), code offset (u32) or name (str)
+//   number of direct data loads (u32), each:
+//     offset of the load instruction (u32), name (str), is_static (u8)
+//   hash of all the preceding bytes (u64)
+//
+// where a str is a u32 length followed by that many bytes and a '\0'.
+// Integers are in host byte order, as the cache is only valid for the
+// compiler that wrote it.
+
+typedef struct CacheWriter {
+  char* data;
+  size_t len;
+  size_t cap;
+} CacheWriter;
+
+static void put_bytes(CacheWriter* w, const void* p, size_t n) {
+  if (w->len + n > w->cap) {
+    size_t new_cap = MAX(w->cap * 2, w->len + n);
+    w->data = bumplamerealloc(w->data, w->cap, new_cap, AL_Compile);
+    w->cap = new_cap;
+  }
+  memcpy(w->data + w->len, p, n);
+  w->len += n;
+}
+
+static void put_u8(CacheWriter* w, uint8_t v) {
+  put_bytes(w, &v, sizeof(v));
+}
+
+static void put_u32(CacheWriter* w, uint32_t v) {
+  put_bytes(w, &v, sizeof(v));
+}
+
+static void put_u64(CacheWriter* w, uint64_t v) {
+  put_bytes(w, &v, sizeof(v));
+}
+
+static void put_str(CacheWriter* w, char* s) {
+  uint32_t len = (uint32_t)strlen(s);
+  put_u32(w, len);
+  put_bytes(w, s, len + 1);
+}
+
+typedef struct CacheReader {
+  char* p;
+  char* end;
+} CacheReader;
+
+// The whole file is verified against its trailing hash before it's read, so
+// running off the end can only happen if the writer was wrong.
+static void get_bytes(CacheReader* r, void* out, size_t n) {
+  if ((size_t)(r->end - r->p) < n)
+    ABORT("truncated cache file");
+  memcpy(out, r->p, n);
+  r->p += n;
+}
+
+static void skip_bytes(CacheReader* r, size_t n) {
+  if ((size_t)(r->end - r->p) < n)
+    ABORT("truncated cache file");
+  r->p += n;
+}
+
+static uint8_t get_u8(CacheReader* r) {
+  uint8_t v;
+  get_bytes(r, &v, sizeof(v));
+  return v;
+}
+
+static uint32_t get_u32(CacheReader* r) {
+  uint32_t v;
+  get_bytes(r, &v, sizeof(v));
+  return v;
+}
+
+static uint64_t get_u64(CacheReader* r) {
+  uint64_t v;
+  get_bytes(r, &v, sizeof(v));
+  return v;
+}
+
+// Points into the cache file's contents.
+static char* get_str(CacheReader* r) {
+  uint32_t len = get_u32(r);
+  char* s = r->p;
+  if ((size_t)(r->end - r->p) < (size_t)len + 1 || s[len] != '\0')
+    ABORT("bad string in cache file");
+  r->p += len + 1;
+  return s;
+}
+
+static bool cache_enabled(void) {
+#if X64WIN
+  // The function table for unwinding, and debug symbols, are not saved.
+  return false;
+#else
+  return user_context->cache_dir != NULL;
+#endif
+}
+
+static char* cache_path(uint64_t key) {
+  return format(AL_Compile, "%s/%016llx.dyc", user_context->cache_dir, (unsigned long long)key);
+}
+
+static uint64_t compute_key(Token* tok) {
+  uint64_t key = FNV_OFFSET_BASIS;
+  uint32_t version = CACHE_VERSION;
+  key = fnv_hash_extend(key, (char*)&version, sizeof(version));
+  uint64_t source_hash = DYIBICC_SOURCE_HASH;
+  key = fnv_hash_extend(key, (char*)&source_hash, sizeof(source_hash));
+  key = fnv_hash_extend(key, user_context->generate_debug_symbols ? "g" : "-", 1);
+  key = hash_tokens(key, tok, NULL);
+  // 0 is used to indicate that there's no key.
+  return key ? key : 1;
+}
+
+static char* read_cache_file(char* path, size_t* size) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp)
+    return NULL;
+  char* buf = NULL;
+  if (fseek(fp, 0, SEEK_END) == 0) {
+    long len = ftell(fp);
+    if (len > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+      buf = bumpcalloc(1, len, AL_Compile);
+      if (fread(buf, 1, len, fp) == (size_t)len)
+        *size = len;
+      else
+        buf = NULL;
+    }
+  }
+  fclose(fp);
+  return buf;
+}
+
+// Whether the writable globals in the cache file at |r| (just after its
+// header) would be placed where the cached code expects them, as
+// place_global_data() would for a compile. Globals that already exist stay
+// where they are, and new ones can only go in the code heap if there's room,
+// so a file cached by another context (or at another file index) may not fit.
+static bool data_placement_matches(CacheReader r, size_t file_index) {
+  UserContext* uc = user_context;
+  uint32_t code_size = get_u32(&r);
+  uint32_t num_got_slots = get_u32(&r);
+  skip_bytes(&r, code_size);
+  uint32_t num_functions = get_u32(&r);
+  for (uint32_t i = 0; i < num_functions; ++i) {
+    get_str(&r);
+    skip_bytes(&r, sizeof(uint8_t) + 2 * sizeof(uint32_t) + sizeof(uint64_t));
+  }
+  skip_bytes(&r, sizeof(uint64_t));  // toplevel_hash
+  for (uint32_t i = 0; i < num_got_slots; ++i) {
+    get_str(&r);
+    skip_bytes(&r, 2 * sizeof(uint32_t));
+  }
+  skip_bytes(&r, (size_t)get_u32(&r) * 2 * sizeof(uint32_t));  // GOT loads
+
+  size_t promised[NUM_CODE_HEAP_KINDS] = {0};
+  uint32_t num_data = get_u32(&r);
+  for (uint32_t i = 0; i < num_data; ++i) {
+    char* name = get_str(&r);
+    bool is_static = get_u8(&r);
+    bool is_rodata = get_u8(&r);
+    bool in_code_heap = get_u8(&r);
+    uint32_t data_size = get_u32(&r);
+    uint32_t align = get_u32(&r);
+    bool has_init_data = get_u8(&r);
+    if (is_rodata || has_init_data)
+      skip_bytes(&r, data_size);
+    uint32_t num_relocs = get_u32(&r);
+    for (uint32_t j = 0; j < num_relocs; ++j) {
+      skip_bytes(&r, sizeof(uint32_t) + sizeof(uint64_t));
+      if (get_u8(&r))
+        skip_bytes(&r, sizeof(uint32_t));
+      else
+        get_str(&r);
+    }
+
+    if (is_rodata)
+      continue;
+    char* existing = hashmap_get(&uc->global_data[is_static ? file_index : uc->num_files], name);
+    if (existing) {
+      if (code_heap_contains(existing) != in_code_heap)
+        return false;
+    } else if (in_code_heap) {
+      CodeHeapKind kind = has_init_data ? CH_Data : CH_Bss;
+      promised[kind] += (size_t)data_size + align;
+      if (promised[kind] > code_heap_room(kind))
+        return false;
+    }
+  }
+  return true;
+}
+
+// Computes the cache key for |tok|, the preprocessed contents of the file at
+// |file_index|, and if there's a matching entry in the cache, replaces all of
+// the file's code and data with the cached version. Returns true if the file
+// was loaded from the cache, in which case parsing and codegen are skipped.
+IMPLSTATIC bool cache_load(Token* tok, size_t file_index) {
+  C(key) = 0;
+  if (!cache_enabled())
+    return false;
+
+  C(key) = compute_key(tok);
+
+  size_t size;
+  char* contents = read_cache_file(cache_path(C(key)), &size);
+  if (!contents)
+    return false;
+
+  // Check that the file is complete and for the right compiler and key before
+  // changing anything.
+  size_t header_size = sizeof(cache_magic) + sizeof(uint32_t) + sizeof(uint64_t);
+  if (size < header_size + sizeof(uint64_t))
+    return false;
+  uint64_t stored_hash;
+  memcpy(&stored_hash, contents + size - sizeof(uint64_t), sizeof(stored_hash));
+  if (fnv_hash_extend(FNV_OFFSET_BASIS, contents, (int)(size - sizeof(uint64_t))) != stored_hash)
+    return false;
+  CacheReader r = {contents, contents + size - sizeof(uint64_t)};
+  char magic[sizeof(cache_magic)];
+  get_bytes(&r, magic, sizeof(magic));
+  if (memcmp(magic, cache_magic, sizeof(magic)) != 0 || get_u32(&r) != CACHE_VERSION ||
+      get_u64(&r) != C(key)) {
+    return false;
+  }
+  // Otherwise it's treated as a miss, and the file is compiled.
+  if (!data_placement_matches(r, file_index))
+    return false;
+
+  UserContext* uc = user_context;
+  FileLinkData* fld = &uc->files[file_index];
+
+  // Same as what codegen does for a full compile.
+  remove_file_exports(file_index);
+  remember_old_code(fld);
+  free_code_segments(fld);
+  free_link_fixups(fld);
+
+  uint32_t code_size = get_u32(&r);
+  uint32_t num_got_slots = get_u32(&r);
+  compiler_state.codegen__code_bytes = code_size;
+  fld->codeseg_code_size = code_size;
+  fld->codeseg_got_size = num_got_slots * sizeof(void*);
+  fld->codeseg_base_address = code_heap_alloc(CH_Code, fld->codeseg_code_size, 0);
+  fld->codeseg_got = code_heap_alloc(CH_Got, fld->codeseg_got_size, 0);
+  get_bytes(&r, fld->codeseg_base_address, code_size);
+  char* got = fld->codeseg_got;
+
+  uint32_t num_functions = get_u32(&r);
+  for (uint32_t i = 0; i < num_functions; ++i) {
+    char* name = get_str(&r);
+    EmittedFunction* ef = add_emitted_function(fld, intern(name, (int)strlen(name)));
+    ef->is_static = get_u8(&r);
+    ef->address = fld->codeseg_base_address + get_u32(&r);
+    ef->entry = ef->address;
+    ef->size = get_u32(&r);
+    ef->content_hash = get_u64(&r);
+    size_t idx = ef->is_static ? file_index : uc->num_files;
+    hashmap_put(&uc->exports[idx], strdup(ef->name->name), ef->address);
+  }
+  fld->toplevel_hash = get_u64(&r);
+
+  for (uint32_t i = 0; i < num_got_slots; ++i) {
+    char* name = get_str(&r);
+    char* slot = got + get_u32(&r) * sizeof(void*);
+    linkfixup_push(fld, name, slot, /*addend=*/0, fld->codeseg_base_address + get_u32(&r));
+  }
+
+  // The GOT isn't at a fixed distance from the code.
+  uint32_t num_got_loads = get_u32(&r);
+  for (uint32_t i = 0; i < num_got_loads; ++i) {
+    char* load = fld->codeseg_base_address + get_u32(&r);
+    patch_rip_relative_load(load, got + get_u32(&r) * sizeof(void*));
+  }
+
+  begin_file_rodata(file_index);
+  uint32_t num_data = get_u32(&r);
+  for (uint32_t i = 0; i < num_data; ++i) {
+    char* name = get_str(&r);
+    bool is_static = get_u8(&r);
+    bool is_rodata = get_u8(&r);
+    bool in_code_heap = get_u8(&r);
+    uint32_t data_size = get_u32(&r);
+    uint32_t align = get_u32(&r);
+    bool has_init_data = get_u8(&r);
+    char* data;
+    if (is_rodata) {
+      data = intern_rodata(file_index, name, r.p, data_size, align);
+      skip_bytes(&r, data_size);
+    } else {
+      data = allocate_global_data(file_index, name, is_static, has_init_data, in_code_heap,
+                                  data_size, align);
+      if (has_init_data) {
+        if (data)
+          get_bytes(&r, data, data_size);
+        else
+          skip_bytes(&r, data_size);
+      }
+    }
+
+    uint32_t num_relocs = get_u32(&r);
+    for (uint32_t j = 0; j < num_relocs; ++j) {
+      uint32_t offset = get_u32(&r);
+      long addend = (long)get_u64(&r);
+      // As in emit_data(), existing data is only written if it points at the
+      // old code.
+      char* at = data ? data + offset
+                      : (is_rodata ? NULL : stale_code_pointer(file_index, name, is_static, offset));
+      if (get_u8(&r)) {
+        uint32_t code_offset = get_u32(&r);
+        if (at)
+          *(uintptr_t*)at = (uintptr_t)(fld->codeseg_base_address + code_offset + addend);
+      } else {
+        char* label = get_str(&r);
+        if (at)
+          linkfixup_push(fld, label, at, (int)addend, NULL);
+      }
+    }
+  }
+  end_file_rodata(file_index);
+
+  uint32_t num_data_loads = get_u32(&r);
+  for (uint32_t i = 0; i < num_data_loads; ++i) {
+    char* load = fld->codeseg_base_address + get_u32(&r);
+    char* name = get_str(&r);
+    patch_data_load(file_index, load, name, get_u8(&r));
+  }
+
+  code_heap_protect(fld->codeseg_base_address, fld->codeseg_code_size, false);
+
+  return true;
+}
+
+// Saves the code and data that was just generated for |prog| to the cache.
+// |fld| must have been filled out by a complete (not patching) codegen.
+IMPLSTATIC void cache_store(Obj* prog, FileLinkData* fld, size_t code_size) {
+  if (!C(key))
+    return;
+
+  CacheWriter w = {0};
+  put_bytes(&w, cache_magic, sizeof(cache_magic));
+  put_u32(&w, CACHE_VERSION);
+  put_u64(&w, C(key));
+
+  // Fixups in data are recreated from the data relocations when loading.
+  char* base = fld->codeseg_base_address;
+  char* got = fld->codeseg_got;
+  char* got_end = got + fld->codeseg_got_size;
+  uint32_t num_got_slots = 0;
+  for (int i = 0; i < fld->flen; ++i) {
+    char* at = fld->fixups[i].at;
+    if (at >= got && at < got_end)
+      ++num_got_slots;
+  }
+
+  put_u32(&w, (uint32_t)code_size);
+  put_u32(&w, num_got_slots);
+  put_bytes(&w, base, code_size);
+
+  put_u32(&w, fld->num_functions);
+  for (int i = 0; i < fld->num_functions; ++i) {
+    EmittedFunction* ef = &fld->functions[i];
+    put_str(&w, ef->name->name);
+    put_u8(&w, ef->is_static);
+    put_u32(&w, (uint32_t)(ef->address - base));
+    put_u32(&w, (uint32_t)ef->size);
+    put_u64(&w, ef->content_hash);
+  }
+  put_u64(&w, fld->toplevel_hash);
+
+  for (int i = 0; i < fld->flen; ++i) {
+    char* at = fld->fixups[i].at;
+    if (at >= got && at < got_end) {
+      put_str(&w, fld->fixups[i].name->name);
+      put_u32(&w, (uint32_t)((at - got) / sizeof(void*)));
+      put_u32(&w, (uint32_t)(fld->fixups[i].user - base));
+    }
+  }
+
+  IntIntIntArray* got_uses = &compiler_state.codegen__got_uses;
+  put_u32(&w, got_uses->len);
+  for (int i = 0; i < got_uses->len; ++i) {
+    put_u32(&w, got_uses->data[i].a);
+    put_u32(&w, got_uses->data[i].b);
+  }
+
+  uint32_t num_data = 0;
+  for (Obj* var = prog; var; var = var->next) {
+    if (!var->is_function && var->is_definition)
+      ++num_data;
+  }
+  put_u32(&w, num_data);
+  for (Obj* var = prog; var; var = var->next) {
+    if (var->is_function || !var->is_definition)
+      continue;
+    put_str(&w, var->name);
+    put_u8(&w, var->is_static);
+    put_u8(&w, var->is_rodata);
+    put_u8(&w, var->in_code_heap);
+    put_u32(&w, var->ty->size);
+    put_u32(&w, global_data_alignment(var));
+    put_u8(&w, var->init_data != NULL);
+    if (var->init_data)
+      put_bytes(&w, var->init_data, var->ty->size);
+
+    uint32_t num_relocs = 0;
+    for (Relocation* rel = var->rel; rel; rel = rel->next)
+      ++num_relocs;
+    put_u32(&w, num_relocs);
+    for (Relocation* rel = var->rel; rel; rel = rel->next) {
+      put_u32(&w, rel->offset);
+      put_u64(&w, (uint64_t)rel->addend);
+      put_u8(&w, rel->internal_code_label != NULL);
+      if (rel->internal_code_label)
+        put_u32(&w, rel->code_offset);
+      else
+        put_str(&w, *rel->string_label);
+    }
+  }
+
+  IntIntIntArray* data_uses = &compiler_state.codegen__data_uses;
+  put_u32(&w, data_uses->len);
+  for (int i = 0; i < data_uses->len; ++i) {
+    put_u32(&w, data_uses->data[i].a);
+    put_str(&w, compiler_state.codegen__data_names.data[data_uses->data[i].b]);
+    put_u8(&w, (uint8_t)data_uses->data[i].c);
+  }
+
+  put_u64(&w, fnv_hash_extend(FNV_OFFSET_BASIS, w.data, (int)w.len));
+
+  // Written to a temporary and then renamed so that a concurrent reader never
+  // sees a partial file. Failures are ignored, the cache is only an
+  // optimization.
+  mkdir(user_context->cache_dir, 0755);
+  char* path = cache_path(C(key));
+  char* tmp_path = format(AL_Compile, "%s.tmp", path);
+  FILE* fp = fopen(tmp_path, "wb");
+  if (!fp)
+    return;
+  bool ok = fwrite(w.data, 1, w.len, fp) == w.len;
+  ok = fclose(fp) == 0 && ok;
+  if (!ok || rename(tmp_path, path) != 0)
+    remove(tmp_path);
+}
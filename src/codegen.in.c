@@ -70,6 +70,12 @@ static int dasmargreg[] = {REG_DI, REG_SI, REG_DX, REG_CX, REG_R8, REG_R9};
 
 static void gen_expr(Node* node);
 static void gen_stmt(Node* node);
+static EmittedFunction* find_emitted_function(FileLinkData* fld, Obj* fn);
+
+// Whether code for `fn` is generated by this compile.
+static bool is_emitted_function(Obj* fn) {
+  return fn->is_function && fn->is_definition && fn->is_live && !fn->reuse_code;
+}
 
 #if X64WIN
 static void record_line_syminfo(int file_no, int line_no, int pclabel) {
@@ -95,6 +101,86 @@ IMPLSTATIC int codegen_pclabel(void) {
   return ret;
 }
 
+// Code loads the address of symbols outside the file (and of functions whose
+// code is being reused or replaced) from a slot in the GOT, so linking never
+// writes to code. Returns a label at which a 7 byte `mov reg, [rip+disp32]`
+// should be emitted, whose disp32 is filled out by fill_out_got(). Slots are
+// shared by the loads in a function.
+#define GOT_LOAD_SIZE 7
+
+static int got_load_label(char* name) {
+  if (C(got_fn) != C(current_fn)) {
+    C(got_fn) = C(current_fn);
+    C(got_slots) = (HashMap){.alloc_lifetime = AL_Compile};
+  }
+  intptr_t slot = (intptr_t)hashmap_get(&C(got_slots), name);
+  if (!slot) {
+    strarray_push(&C(got_names), name, AL_Compile);
+    slot = C(got_names).len;
+    hashmap_put(&C(got_slots), name, (void*)slot);
+  }
+  int label = codegen_pclabel();
+  intintintarray_push(&C(got_uses),
+                      (IntIntInt){label, (int)slot - 1, C(current_fn)->dasm_entry_label},
+                      AL_Compile);
+  return label;
+}
+
+// Globals defined in this file are in range of the code, and don't move while
+// the code that refers to them is live: writable data is never reallocated
+// (see allocate_global_data()), and string literals that are unchanged keep
+// their pooled storage (see intern_rodata()). So code can refer to them with a
+// rip-relative lea rather than through the GOT. The exception is writable data
+// that's too big for the code heap, see place_global_data().
+static bool can_address_data_directly(Obj* var) {
+#if X64WIN
+  // The code is in the pdb image, rather than the code heap, in this case.
+  if (user_context->generate_debug_symbols)
+    return false;
+#endif
+  return var->is_definition && !var->is_tls && (var->is_rodata || var->in_code_heap);
+}
+
+// Writable globals at least this big are always allocated outside the code
+// heap (as with the medium code model's large data), so that a few large
+// arrays don't use up the space for everything else.
+#define LARGE_DATA_THRESHOLD (1 << 20)
+
+// Decides which of the writable globals defined in |prog| are in the code
+// heap, before code that refers to them is generated. Those that already exist
+// stay where they are. New ones go in the code heap if they're small enough
+// and there will be room for them when they're allocated by emit_data().
+static void place_global_data(Obj* prog) {
+  UserContext* uc = user_context;
+  size_t promised[NUM_CODE_HEAP_KINDS] = {0};
+  for (Obj* var = prog; var; var = var->next) {
+    if (var->is_function || !var->is_definition || var->is_rodata || var->is_tls)
+      continue;
+    size_t idx = var->is_static ? C(file_index) : uc->num_files;
+    char* existing = hashmap_get(&uc->global_data[idx], var->name);
+    if (existing) {
+      var->in_code_heap = code_heap_contains(existing);
+      continue;
+    }
+    CodeHeapKind kind = var->init_data ? CH_Data : CH_Bss;
+    size_t needed = (size_t)var->ty->size + global_data_alignment(var);
+    var->in_code_heap = var->ty->size < LARGE_DATA_THRESHOLD &&
+                        promised[kind] + needed <= code_heap_room(kind);
+    if (var->in_code_heap)
+      promised[kind] += needed;
+  }
+}
+
+// Returns a label at which a 7 byte `lea rax, [rip+disp32]` of |var| should be
+// emitted, whose disp32 is filled out by fill_out_data_loads().
+static int data_load_label(Obj* var) {
+  strarray_push(&C(data_names), var->name, AL_Compile);
+  int label = codegen_pclabel();
+  intintintarray_push(&C(data_uses), (IntIntInt){label, C(data_names).len - 1, var->is_static},
+                      AL_Compile);
+  return label;
+}
+
 static void push(void) {
   ///| push rax
   C(depth)++;
@@ -237,36 +323,31 @@ static void gen_addr(Node* node) {
 
       // Function
       if (node->ty->kind == TY_FUNC) {
-        if (node->var->is_definition) {
+        // A replaced function's address is its original entry, which is
+        // where the reused code and the exports refer to.
+        if (node->var->is_definition && !node->var->reuse_code && !node->var->replaces_code) {
           ///| lea rax, [=>node->var->dasm_entry_label]
         } else {
-          int fixup_location = codegen_pclabel();
-          strintarray_push(&C(fixups), (StringInt){node->var->name, fixup_location}, AL_Compile);
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4310)  // dynasm casts the top and bottom of the 64bit arg
-#endif
-          ///|=>fixup_location:
-          ///| mov64 rax, 0xc0dec0dec0dec0de
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
+          int got_load = got_load_label(node->var->name);
+          ///|=>got_load:
+          ///| .byte 0x48, 0x8b, 0x05  // mov rax, [rip+disp32]
+          ///| .dword 0
         }
         return;
       }
 
       // Global variable
-      int fixup_location = codegen_pclabel();
-      strintarray_push(&C(fixups), (StringInt){node->var->name, fixup_location}, AL_Compile);
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4310)  // dynasm casts the top and bottom of the 64bit arg
-#endif
-      ///|=>fixup_location:
-      ///| mov64 rax, 0xda7ada7ada7ada7a
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
+      if (can_address_data_directly(node->var)) {
+        int data_load = data_load_label(node->var);
+        ///|=>data_load:
+        ///| .byte 0x48, 0x8d, 0x05  // lea rax, [rip+disp32]
+        ///| .dword 0
+        return;
+      }
+      int got_load = got_load_label(node->var->name);
+      ///|=>got_load:
+      ///| .byte 0x48, 0x8b, 0x05  // mov rax, [rip+disp32]
+      ///| .dword 0
       return;
     case ND_DEREF:
       gen_expr(node->lhs);
@@ -1534,6 +1615,7 @@ static void gen_expr(Node* node) {
       return;
     case ND_REFLECT_TYPE_PTR:
       ///| mov64 rax, node->reflect_ty;
+      C(position_dependent) = true;
       return;
     case ND_CAS:
     case ND_LOCKCE: {
@@ -2219,7 +2301,11 @@ static void assign_lvar_offsets(Obj* prog) {
 
 #endif  // SysV
 
-static void linkfixup_push(FileLinkData* fld, char* target, char* fixup, int addend) {
+IMPLSTATIC void linkfixup_push(FileLinkData* fld,
+                               char* target,
+                               char* fixup,
+                               int addend,
+                               char* user) {
   if (!fld->fixups) {
     fld->fixups = calloc(8, sizeof(LinkFixup));
     fld->fcap = 8;
@@ -2230,10 +2316,210 @@ static void linkfixup_push(FileLinkData* fld, char* target, char* fixup, int add
     fld->fcap *= 2;
   }
 
-  fld->fixups[fld->flen++] = (LinkFixup){fixup, strdup(target), addend};
+  Atom* name = intern(target, (int)strlen(target));
+  fld->fixups[fld->flen++] = (LinkFixup){fixup, name, addend, user};
+}
+
+IMPLSTATIC int global_data_alignment(Obj* var) {
+  return (var->ty->kind == TY_ARRAY && var->ty->size >= 16) ? MAX(16, var->align) : var->align;
+}
+
+// String literals are pooled by contents across all files, so that identical
+// literals share storage, and so that a literal that's unchanged by a
+// recompile keeps its address (which code that's reused relies on). Each file
+// holds a reference to the entries used by its last compile.
+static void release_rodata(PooledRodata* entry) {
+  if (--entry->refs > 0)
+    return;
+  code_heap_free(CH_Rodata, entry->data, entry->size);
+  hashmap_delete2(&user_context->rodata_pool, entry->key, entry->keylen);
+  free(entry);
+}
+
+// Starts recreating the string literals of |file_index|. The names from the
+// previous compile are dropped, but their storage is kept until
+// end_file_rodata() so that literals that are interned again don't move.
+IMPLSTATIC void begin_file_rodata(size_t file_index) {
+  FileLinkData* fld = &user_context->files[file_index];
+  if (fld->num_prev_rodata)
+    end_file_rodata(file_index);  // The last compile didn't finish.
+  HashMap* statics = &user_context->global_data[file_index];
+  for (int i = 0; i < fld->num_rodata; ++i) {
+    if (hashmap_get(statics, fld->rodata[i].name) == fld->rodata[i].entry->data)
+      hashmap_delete(statics, fld->rodata[i].name);
+  }
+  fld->num_prev_rodata = fld->num_rodata;
+}
+
+IMPLSTATIC void end_file_rodata(size_t file_index) {
+  FileLinkData* fld = &user_context->files[file_index];
+  for (int i = 0; i < fld->num_prev_rodata; ++i) {
+    free(fld->rodata[i].name);
+    release_rodata(fld->rodata[i].entry);
+  }
+  fld->num_rodata -= fld->num_prev_rodata;
+  memmove(fld->rodata, fld->rodata + fld->num_prev_rodata, sizeof(FileRodata) * fld->num_rodata);
+  fld->num_prev_rodata = 0;
+
+  // Literals are shared by every file, so a write through one (which is
+  // undefined behaviour) faults rather than changing all of them. New ones are
+  // writable until here, so that they're all protected at once.
+  code_heap_seal_rodata();
+}
+
+// Returns the pooled storage for the string literal |name| of |file_index|
+// with the given contents, which must not be written to.
+IMPLSTATIC char* intern_rodata(size_t file_index, char* name, char* contents, int size, int align) {
+  UserContext* uc = user_context;
+  int keylen = size + (int)sizeof(align);
+  char* key = malloc(keylen);
+  memcpy(key, contents, size);
+  memcpy(key + size, &align, sizeof(align));
+  PooledRodata* entry = hashmap_get2(&uc->rodata_pool, key, keylen);
+  if (entry) {
+    free(key);
+  } else {
+    entry = calloc(1, sizeof(PooledRodata));
+    entry->data = code_heap_alloc(CH_Rodata, size, align);
+    memcpy(entry->data, contents, size);
+    entry->size = size;
+    entry->key = key;
+    entry->keylen = keylen;
+    hashmap_put2(&uc->rodata_pool, key, keylen, entry);
+  }
+  ++entry->refs;
+  C(data_bytes) += size;
+
+  FileLinkData* fld = &uc->files[file_index];
+  if (fld->num_rodata == fld->rodata_cap) {
+    fld->rodata_cap = MAX(fld->rodata_cap * 2, 16);
+    fld->rodata = realloc(fld->rodata, sizeof(FileRodata) * fld->rodata_cap);
+  }
+  fld->rodata[fld->num_rodata++] = (FileRodata){strdup(name), entry};
+  hashmap_put(&uc->global_data[file_index], strdup(name), entry->data);
+  return entry->data;
+}
+
+IMPLSTATIC void free_rodata_pool(UserContext* ctx) {
+  for (size_t i = 0; i < ctx->num_files; ++i) {
+    FileLinkData* fld = &ctx->files[i];
+    for (int j = 0; j < fld->num_rodata; ++j)
+      free(fld->rodata[j].name);
+    free(fld->rodata);
+    fld->rodata = NULL;
+    fld->num_rodata = 0;
+    fld->num_prev_rodata = 0;
+    fld->rodata_cap = 0;
+  }
+  // The storage itself is released along with the code heap.
+  hashmap_clear_manual_key_owned_value_owned(&ctx->rodata_pool);
+}
+
+// Returns zeroed storage for the writable global variable |name| that should
+// be initialized, or NULL if it already exists, in which case it keeps its
+// current value. New storage is in the code heap if |in_code_heap|, and
+// otherwise mapped separately. String literals are handled by intern_rodata()
+// instead.
+IMPLSTATIC char* allocate_global_data(size_t file_index,
+                                      char* name,
+                                      bool is_static,
+                                      bool has_init_data,
+                                      bool in_code_heap,
+                                      int size,
+                                      int align) {
+  // - if writeable data has an entry, it shouldn't be recreated. the
+  // dyo version doesn't reprocess kTypeInitializerDataRelocation or
+  // kTypeInitializerCodeRelocation; that's possibly a bug, but it'll
+  // need some testing to get a case where it comes up.
+  //
+  // TODO: if it changes from static to extern, is it the same
+  // variable? currently they're separate, so a switch causes a
+  // reinit, a leak, and some confusion.
+  //
+  // writable data can't be packed into a single allocation per file,
+  // because it doesn't move or reinit, but new ones get added as code
+  // evolves and we can't blow away or move the old ones. so each one is
+  // allocated separately from the data or bss part of the code heap (or
+  // mapped on its own if it's large), and lives as long as the context.
+
+  UserContext* uc = user_context;
+  C(data_bytes) += size;
+  size_t idx = is_static ? file_index : uc->num_files;
+
+  if (hashmap_get(&uc->global_data[idx], name)) {
+    // data already created and initialized, don't reinit.
+    return NULL;
+  }
+  char* global_data = in_code_heap
+                          ? code_heap_try_alloc(has_init_data ? CH_Data : CH_Bss, size, align)
+                          : allocate_large_data(size, align);
+  if (!global_data) {
+    error("couldn't allocate %d bytes for global '%s'%s", size, name,
+          in_code_heap ? ", the code heap is full" : "");
+  }
+
+  // TODO: Is this wrong (or above)? If writable |x| in one file
+  // already existed and |x| in another is added, then it'll be
+  // silently ignored.
+  // Need to figure out where/how to have a duplicate symbol check.
+#if 0
+      if (!was_freed) {
+        void* prev = hashmap_get(&uc->global_data[idx], strings.data[name_index]);
+        if (prev) {
+          outaf("duplicated symbol: %s\n", strings.data[name_index]);
+          goto fail;
+        }
+      }
+#endif
+  hashmap_put(&uc->global_data[idx], strdup(name), global_data);
+  return global_data;
+}
+
+// Writable data isn't reinitialized when its file is recompiled, so pointers
+// in it to the file's functions would be left pointing at the old code, which
+// is freed by a full recompile. Those that still do are bound to the new code,
+// but ones that the program has pointed elsewhere are left alone.
+IMPLSTATIC void remember_old_code(FileLinkData* fld) {
+  int n = 1 + fld->num_patch_segments;
+  CodeSegment* old = bumpcalloc(n, sizeof(CodeSegment), AL_Compile);
+  old[0] = (CodeSegment){fld->codeseg_base_address, fld->codeseg_code_size, NULL, 0};
+  for (int i = 0; i < fld->num_patch_segments; ++i)
+    old[i + 1] = fld->patch_segments[i];
+  C(old_code) = old;
+  C(num_old_code) = n;
+}
+
+// Returns the address of the pointer at |offset| in the existing global
+// |name|, if it points into the code that remember_old_code() saved.
+IMPLSTATIC char* stale_code_pointer(size_t file_index, char* name, bool is_static, int offset) {
+  UserContext* uc = user_context;
+  char* data = hashmap_get(&uc->global_data[is_static ? file_index : uc->num_files], name);
+  if (!data)
+    return NULL;
+  char* at = data + offset;
+  char* target = *(char**)at;
+  for (int i = 0; i < C(num_old_code); ++i) {
+    CodeSegment* seg = &C(old_code)[i];
+    if (target >= seg->base_address && target < seg->base_address + seg->code_size)
+      return at;
+  }
+  return NULL;
+}
+
+IMPLSTATIC void free_global_data(UserContext* ctx) {
+  for (size_t i = 0; i < ctx->num_files + 1; ++i) {
+    int iter = 0;
+    for (HashEntry* ent; (ent = hashmap_next(&ctx->global_data[i], &iter));) {
+      // The rest are released along with the code heap.
+      if (!code_heap_contains(ent->val))
+        free_large_data(ent->val);
+    }
+    hashmap_clear_manual_key_owned_value_unowned(&ctx->global_data[i]);
+  }
 }
 
 static void emit_data(Obj* prog) {
+  begin_file_rodata(C(file_index));
   for (Obj* var = prog; var; var = var->next) {
     // outaf("var->name %s %d %d %d %d\n", var->name, var->is_function, var->is_definition,
     // var->is_static, var->is_tentative);
@@ -2244,65 +2530,30 @@ static void emit_data(Obj* prog) {
       continue;
     }
 
-    int align =
-        (var->ty->kind == TY_ARRAY && var->ty->size >= 16) ? MAX(16, var->align) : var->align;
-
-    // - rodata, always free existing entry in either static/extern
-    // global_data, and then recreate and reinitialize
-    //
-    // - if writeable data has an entry, it shouldn't be recreated. the
-    // dyo version doesn't reprocess kTypeInitializerDataRelocation or
-    // kTypeInitializerCodeRelocation; that's possibly a bug, but it'll
-    // need some testing to get a case where it comes up.
-    //
-    // TODO: if it changes from static to extern, is it the same
-    // variable? currently they're separate, so a switch causes a
-    // reinit, a leak, and some confusion.
-    //
-    // can't easily make a large single data segment allocation for all
-    // data because 1) the rodata change size link-over-link (put in
-    // codeseg?); 2) wdata don't move or reinit, but new ones get added
-    // as code evolves and we can't blow away or move the old ones.
-    //
-    // for now, just continue with individual regular aligned_allocate
-    // for all data objects and maintain their addresses here.
-
-    UserContext* uc = user_context;
-    // bool was_freed = false;
-    size_t idx = var->is_static ? C(file_index) : uc->num_files;
-    void* prev = hashmap_get(&user_context->global_data[idx], var->name);
-    if (prev) {
-      if (var->is_rodata) {
-        aligned_free(prev);
-        // was_freed = true;
-      } else {
-        // data already created and initialized, don't reinit.
-        continue;
-      }
+    if (var->is_rodata) {
+      intern_rodata(C(file_index), var->name, var->init_data, var->ty->size,
+                    global_data_alignment(var));
+      continue;
     }
 
-    void* global_data = aligned_allocate(var->ty->size, align);
-    memset(global_data, 0, var->ty->size);
-
-    // TODO: Is this wrong (or above)? If writable |x| in one file
-    // already existed and |x| in another is added, then it'll be
-    // silently ignored. If it's rodata it'll be silently replaced here
-    // by getting thrown away above and then recreated.
-    // Need to figure out where/how to have a duplicate symbol check.
-#if 0
-      if (!was_freed) {
-        void* prev = hashmap_get(&uc->global_data[idx], strings.data[name_index]);
-        if (prev) {
-          outaf("duplicated symbol: %s\n", strings.data[name_index]);
-          goto fail;
+    FileLinkData* fld = &user_context->files[C(file_index)];
+    char* fillp = allocate_global_data(C(file_index), var->name, var->is_static,
+                                       var->init_data != NULL, var->in_code_heap, var->ty->size,
+                                       global_data_alignment(var));
+    if (!fillp) {
+      for (Relocation* rel = var->rel; rel; rel = rel->next) {
+        char* at = stale_code_pointer(C(file_index), var->name, var->is_static, rel->offset);
+        if (!at)
+          continue;
+        if (rel->string_label) {
+          linkfixup_push(fld, *rel->string_label, at, rel->addend, NULL);
+        } else {
+          int offset = dasm_getpclabel(&C(dynasm), *rel->internal_code_label);
+          *((uintptr_t*)at) = (uintptr_t)(fld->codeseg_base_address + offset + rel->addend);
         }
       }
-#endif
-    // TODO: intern
-    hashmap_put(&uc->global_data[idx], strdup(var->name), global_data);
-
-    char* fillp = global_data;
-    FileLinkData* fld = &uc->files[C(file_index)];
+      continue;
+    }
 
     // .data or .tdata
     if (var->init_data) {
@@ -2315,7 +2566,7 @@ static void emit_data(Obj* prog) {
                  rel->internal_code_label);  // But should be at least one if we're here.
 
           if (rel->string_label) {
-            linkfixup_push(fld, *rel->string_label, fillp, rel->addend);
+            linkfixup_push(fld, *rel->string_label, fillp, rel->addend, NULL);
           } else {
             int offset = dasm_getpclabel(&C(dynasm), *rel->internal_code_label);
             *((uintptr_t*)fillp) = (uintptr_t)(fld->codeseg_base_address + offset + rel->addend);
@@ -2334,6 +2585,7 @@ static void emit_data(Obj* prog) {
 
     // If no init_data, then already allocated and cleared (.bss).
   }
+  end_file_rodata(C(file_index));
 }
 
 static void store_fp(int r, int offset, int sz) {
@@ -2379,7 +2631,7 @@ extern int __chkstk(void);
 static void emit_text(Obj* prog) {
   // Preallocate the dasm labels so they can be used in functions out of order.
   for (Obj* fn = prog; fn; fn = fn->next) {
-    if (!fn->is_function || !fn->is_definition || !fn->is_live)
+    if (!is_emitted_function(fn))
       continue;
 
     fn->dasm_return_label = codegen_pclabel();
@@ -2391,9 +2643,10 @@ static void emit_text(Obj* prog) {
   ///| .code
 
   for (Obj* fn = prog; fn; fn = fn->next) {
-    if (!fn->is_function || !fn->is_definition || !fn->is_live)
+    if (!is_emitted_function(fn))
       continue;
 
+    ///| .align 16
     ///|=>fn->dasm_entry_label:
 
     C(current_fn) = fn;
@@ -2413,17 +2666,10 @@ static void emit_text(Obj* prog) {
     // it's only necessary beyond 8k for x64, but cl does it at 4k.
     if (fn->stack_size >= 4096) {
       ///| mov rax, fn->stack_size
-      int fixup_location = codegen_pclabel();
-      strintarray_push(&C(fixups), (StringInt){"__chkstk", fixup_location}, AL_Compile);
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4310)  // dynasm casts the top and bottom of the 64bit arg
-#endif
-      ///|=>fixup_location:
-      ///| mov64 r10, 0xc0dec0dec0dec0de
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
+      int got_load = got_load_label("__chkstk");
+      ///|=>got_load:
+      ///| .byte 0x4c, 0x8b, 0x15  // mov r10, [rip+disp32]
+      ///| .dword 0
       ///| call r10
       ///| sub rsp, rax
 
@@ -2645,43 +2891,88 @@ static void emit_text(Obj* prog) {
   }
 }
 
-static void fill_out_text_exports(Obj* prog, char* codeseg_base_address) {
-  // per-file from any previous need to be cleared out for this round.
-  hashmap_clear_manual_key_owned_value_unowned(&user_context->exports[C(file_index)]);
+// Before all of a file's code is replaced, removes what its previous compile
+// exported, so that functions it no longer defines can't be found or linked
+// to. A global export is only removed if another file hasn't since taken it.
+IMPLSTATIC void remove_file_exports(size_t file_index) {
+  UserContext* uc = user_context;
+  FileLinkData* fld = &uc->files[file_index];
+  hashmap_clear_manual_key_owned_value_unowned(&uc->exports[file_index]);
+  HashMap* globals = &uc->exports[uc->num_files];
+  for (int i = 0; i < fld->num_functions; ++i) {
+    EmittedFunction* ef = &fld->functions[i];
+    Atom* name = ef->name;
+    if (!ef->is_static &&
+        hashmap_get_hashed(globals, name->name, name->len, name->hash) == ef->entry)
+      hashmap_delete2(globals, name->name, name->len);
+  }
+}
 
+static void fill_out_text_exports(Obj* prog, FileLinkData* fld, char* codeseg_base_address) {
   for (Obj* fn = prog; fn; fn = fn->next) {
-    if (!fn->is_function || !fn->is_definition || !fn->is_live)
+    if (!is_emitted_function(fn))
       continue;
 
-    int offset = dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    char* address;
+    if (fn->replaces_code)
+      address = find_emitted_function(fld, fn)->entry;
+    else
+      address = codeseg_base_address + dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
     size_t idx = fn->is_static ? C(file_index) : user_context->num_files;
-    hashmap_put(&user_context->exports[idx], strdup(fn->name), codeseg_base_address + offset);
+    hashmap_put(&user_context->exports[idx], strdup(fn->name), address);
   }
 }
 
 IMPLSTATIC void free_link_fixups(FileLinkData* fld) {
-  for (int i = 0; i < fld->flen; ++i) {
-    free(fld->fixups[i].name);
-  }
   free(fld->fixups);
   fld->fixups = NULL;
   fld->flen = 0;
   fld->fcap = 0;
 }
 
-static void fill_out_fixups(FileLinkData* fld) {
-  for (int i = 0; i < C(fixups).len; ++i) {
-    int offset = dasm_getpclabel(&C(dynasm), C(fixups).data[i].i);
-    // +2 is a hack taking advantage of the fact that import fixups are always
-    // of the form `mov64 rax, <ADDR>` which is encoded as:
-    //   48 B8 <8 byte address>
-    // so skip over the mov64 prefix and point directly at the address to be
-    // slapped into place.
-    offset += 2;
+// Points the direct data loads in the encoded code at the data, which must
+// have already been allocated. The labels in data_uses are replaced by their
+// offsets, for cache_store().
+static void fill_out_data_loads(char* codeseg_base_address) {
+  for (int i = 0; i < C(data_uses).len; ++i) {
+    IntIntInt* use = &C(data_uses).data[i];
+    use->a = dasm_getpclabel(&C(dynasm), use->a);
+    patch_data_load(C(file_index), codeseg_base_address + use->a, C(data_names).data[use->b],
+                    use->c);
+  }
+}
 
-    char* fixup = fld->codeseg_base_address + offset;
-    linkfixup_push(fld, C(fixups).data[i].str, fixup, /*addend=*/0);
+IMPLSTATIC void patch_data_load(size_t file_index, char* load, char* name, bool is_static) {
+  size_t idx = is_static ? file_index : user_context->num_files;
+  char* data = hashmap_get(&user_context->global_data[idx], name);
+  if (!data)
+    ABORT("direct reference to unallocated data");
+  if (!code_heap_contains(data))
+    error("'%s' isn't in the code heap, so can't be referenced directly", name);
+  patch_rip_relative_load(load, data);
+}
+
+// |load| is a 7 byte instruction ending in a disp32 relative to its end.
+IMPLSTATIC void patch_rip_relative_load(char* load, char* target) {
+  int32_t disp = (int32_t)(target - (load + GOT_LOAD_SIZE));
+  memcpy(load + GOT_LOAD_SIZE - sizeof(disp), &disp, sizeof(disp));
+}
+
+// Points the GOT loads in the encoded code at their slots, and adds a fixup
+// for each slot. The labels in got_uses are replaced by their offsets, for
+// cache_store().
+static void fill_out_got(FileLinkData* fld, char* codeseg_base_address, char* got) {
+  char** users = bumpcalloc(C(got_names).len, sizeof(char*), AL_Compile);
+  for (int i = 0; i < C(got_uses).len; ++i) {
+    IntIntInt* use = &C(got_uses).data[i];
+    use->a = dasm_getpclabel(&C(dynasm), use->a);
+    use->c = dasm_getpclabel(&C(dynasm), use->c);
+    patch_rip_relative_load(codeseg_base_address + use->a, got + use->b * sizeof(void*));
+    users[use->b] = codeseg_base_address + use->c;
   }
+
+  for (int i = 0; i < C(got_names).len; ++i)
+    linkfixup_push(fld, C(got_names).data[i], got + i * sizeof(void*), /*addend=*/0, users[i]);
 }
 
 #if X64WIN
@@ -2698,7 +2989,7 @@ static void emit_symbols_and_exception_function_table(Obj* prog,
                                                       int pdata_end_offset) {
   int func_count = 0;
   for (Obj* fn = prog; fn; fn = fn->next) {
-    if (!fn->is_function || !fn->is_definition || !fn->is_live)
+    if (!is_emitted_function(fn))
       continue;
 
     ++func_count;
@@ -2712,7 +3003,7 @@ static void emit_symbols_and_exception_function_table(Obj* prog,
   char* pfuncs = function_table_data;
 
   for (Obj* fn = prog; fn; fn = fn->next) {
-    if (!fn->is_function || !fn->is_definition || !fn->is_live)
+    if (!is_emitted_function(fn))
       continue;
 
     RuntimeFunction* rf = (RuntimeFunction*)pfuncs;
@@ -2724,7 +3015,7 @@ static void emit_symbols_and_exception_function_table(Obj* prog,
 
     if (user_context->generate_debug_symbols) {
       DbpFunctionSymbol* dbp_func_sym =
-          dbp_add_function_symbol(user_context->dbp_ctx, fn->name, fn->ty->name->filename,
+          dbp_add_function_symbol(user_context->dbp_ctx, fn->name, fn->ty->name->file->display_name,
                                   dasm_getpclabel(&C(dynasm), fn->dasm_entry_label),
                                   dasm_getpclabel(&C(dynasm), fn->dasm_end_of_function_label));
       for (int i = 0; i < fn->file_line_label_data.len; ++i) {
@@ -2774,9 +3065,250 @@ IMPLSTATIC void codegen_init(void) {
   C(numlabels) = 1;
 }
 
+// A replaced function's old entry point is overwritten with `jmp [rip+0]`
+// followed by the absolute address of the new code.
+#define PATCH_JUMP_SIZE 14
+
+// After this many partial compiles, start over with a full compile so that
+// the old code that's no longer reachable is released.
+#define MAX_PATCH_SEGMENTS 16
+
+// The name of a function is almost always already interned, as that's where
+// the parser gets it from, so it doesn't need to be hashed again.
+static Atom* function_name_atom(Obj* fn) {
+  Token* name = fn->ty->name;
+  if (name && name->atom && name->atom->name == fn->name)
+    return name->atom;
+  return intern(fn->name, (int)strlen(fn->name));
+}
+
+static EmittedFunction* find_emitted_function(FileLinkData* fld, Obj* fn) {
+  Atom* name = function_name_atom(fn);
+  intptr_t index =
+      (intptr_t)hashmap_get_hashed(&fld->function_index, name->name, name->len, name->hash);
+  return index ? &fld->functions[index - 1] : NULL;
+}
+
+IMPLSTATIC EmittedFunction* add_emitted_function(FileLinkData* fld, Atom* name) {
+  if (fld->num_functions == fld->functions_cap) {
+    fld->functions_cap = MAX(8, fld->functions_cap * 2);
+    fld->functions = realloc(fld->functions, sizeof(EmittedFunction) * fld->functions_cap);
+  }
+  intptr_t index = ++fld->num_functions;
+  hashmap_put_hashed(&fld->function_index, name->name, name->len, name->hash, (void*)index);
+  EmittedFunction* ef = &fld->functions[index - 1];
+  *ef = (EmittedFunction){.name = name};
+  return ef;
+}
+
+static void free_emitted_functions(FileLinkData* fld) {
+  free(fld->functions);
+  fld->functions = NULL;
+  fld->num_functions = 0;
+  fld->functions_cap = 0;
+  hashmap_clear_manual_key_unowned_value_unowned(&fld->function_index);
+}
+
+static bool has_code_relocations(Obj* prog) {
+  for (Obj* var = prog; var; var = var->next) {
+    if (var->is_function)
+      continue;
+    for (Relocation* rel = var->rel; rel; rel = rel->next) {
+      if (rel->internal_code_label)
+        return true;
+    }
+  }
+  return false;
+}
+
+// If the previous code for this file can be partially reused, marks the
+// functions whose bodies are unchanged with |reuse_code| and returns true.
+// Otherwise, everything must be regenerated.
+static bool mark_reusable_functions(Obj* prog, FileLinkData* fld) {
+#if X64WIN
+  // The function table and debug information are per-segment.
+  (void)prog;
+  (void)fld;
+  return false;
+#else
+  if (!fld->codeseg_base_address || fld->num_patch_segments >= MAX_PATCH_SEGMENTS)
+    return false;
+
+  // Anything outside of function bodies (types, globals, declarations) being
+  // different could change the code generated for any function.
+  if (fld->toplevel_hash != compiler_state.parse__toplevel_hash)
+    return false;
+
+  // Pointers to labels are stored in data as absolute addresses.
+  if (has_code_relocations(prog))
+    return false;
+
+  int num_found = 0;
+  int num_unchanged = 0;
+  for (int i = 0; i < fld->num_functions; ++i)
+    fld->functions[i].reused = false;
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+    EmittedFunction* ef = find_emitted_function(fld, fn);
+    if (!ef)
+      continue;
+    ++num_found;
+    if (ef->content_hash == fn->content_hash)
+      ++num_unchanged;
+    else if (ef->entry == ef->address && ef->size < PATCH_JUMP_SIZE)
+      return false;
+  }
+
+  // All old functions must still be emitted so that they can be redirected,
+  // and there's no point if nothing is reused.
+  if (num_found != fld->num_functions || num_unchanged == 0)
+    return false;
+
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+    EmittedFunction* ef = find_emitted_function(fld, fn);
+    if (!ef)
+      continue;
+    if (ef->content_hash == fn->content_hash) {
+      fn->reuse_code = true;
+      ef->reused = true;
+    } else {
+      fn->replaces_code = true;
+    }
+  }
+  return true;
+#endif
+}
+
+static int compare_function_address(const void* a, const void* b) {
+  char* x = (*(EmittedFunction**)a)->address;
+  char* y = (*(EmittedFunction**)b)->address;
+  return x < y ? -1 : x > y;
+}
+
+// GOT slots used by reused code still need to be filled out at link time.
+// Other fixups are dropped and will be recreated by this compile.
+static void retain_reused_link_fixups(FileLinkData* fld) {
+  // Sorted by address, to find the function that each fixup's user is in.
+  EmittedFunction** reused =
+      bumpcalloc(MAX(fld->num_functions, 1), sizeof(EmittedFunction*), AL_Compile);
+  int num_reused = 0;
+  for (int i = 0; i < fld->num_functions; ++i) {
+    if (fld->functions[i].reused)
+      reused[num_reused++] = &fld->functions[i];
+  }
+  qsort(reused, num_reused, sizeof(EmittedFunction*), compare_function_address);
+
+  int kept = 0;
+  for (int i = 0; i < fld->flen; ++i) {
+    LinkFixup* lf = &fld->fixups[i];
+    // The number of reused functions that start at or before the user.
+    int lo = 0;
+    int hi = num_reused;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (reused[mid]->address <= lf->user)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo > 0 && lf->user < reused[lo - 1]->address + reused[lo - 1]->size)
+      fld->fixups[kept++] = *lf;
+  }
+  fld->flen = kept;
+}
+
+static void redirect_replaced_functions(Obj* prog, FileLinkData* fld, char* codeseg_base_address) {
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+    EmittedFunction* ef = find_emitted_function(fld, fn);
+    if (!ef)
+      continue;
+
+    char* target = codeseg_base_address + dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    code_heap_protect(ef->entry, PATCH_JUMP_SIZE, true);
+    static const unsigned char jmp_rip_indirect[6] = {0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+    memcpy(ef->entry, jmp_rip_indirect, sizeof(jmp_rip_indirect));
+    memcpy(ef->entry + sizeof(jmp_rip_indirect), &target, sizeof(target));
+    code_heap_protect(ef->entry, PATCH_JUMP_SIZE, false);
+  }
+}
+
+static void record_emitted_functions(Obj* prog,
+                                     FileLinkData* fld,
+                                     char* codeseg_base_address,
+                                     bool patching) {
+  if (!patching)
+    free_emitted_functions(fld);
+
+  for (Obj* fn = prog; fn; fn = fn->next) {
+    if (!is_emitted_function(fn))
+      continue;
+    EmittedFunction* ef = patching ? find_emitted_function(fld, fn) : NULL;
+    if (!ef) {
+      ef = add_emitted_function(fld, function_name_atom(fn));
+      ef->entry = codeseg_base_address + dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    }
+    int entry = dasm_getpclabel(&C(dynasm), fn->dasm_entry_label);
+    int end = dasm_getpclabel(&C(dynasm), fn->dasm_end_of_function_label);
+    ef->content_hash = fn->content_hash;
+    ef->address = codeseg_base_address + entry;
+    ef->size = end - entry;
+    ef->is_static = fn->is_static;
+    ef->reused = false;
+  }
+
+  fld->toplevel_hash = compiler_state.parse__toplevel_hash;
+}
+
+static void resolve_code_relocations(Obj* prog) {
+  for (Obj* var = prog; var; var = var->next) {
+    if (var->is_function)
+      continue;
+    for (Relocation* rel = var->rel; rel; rel = rel->next) {
+      if (rel->internal_code_label)
+        rel->code_offset = dasm_getpclabel(&C(dynasm), *rel->internal_code_label);
+    }
+  }
+}
+
+IMPLSTATIC void free_code_segments(FileLinkData* fld) {
+#if X64WIN
+  if (fld->codeseg_in_debug_image) {
+    free_executable_memory(fld->codeseg_base_address, 0);
+    fld->codeseg_base_address = NULL;
+    fld->codeseg_got = NULL;
+    fld->codeseg_in_debug_image = false;
+  }
+#endif
+  code_heap_free(CH_Code, fld->codeseg_base_address, fld->codeseg_code_size);
+  code_heap_free(CH_Got, fld->codeseg_got, fld->codeseg_got_size);
+  fld->codeseg_base_address = NULL;
+  fld->codeseg_code_size = 0;
+  fld->codeseg_got = NULL;
+  fld->codeseg_got_size = 0;
+  for (int i = 0; i < fld->num_patch_segments; ++i) {
+    CodeSegment* seg = &fld->patch_segments[i];
+    code_heap_free(CH_Code, seg->base_address, seg->code_size);
+    code_heap_free(CH_Got, seg->got, seg->got_size);
+  }
+  free(fld->patch_segments);
+  fld->patch_segments = NULL;
+  fld->num_patch_segments = 0;
+
+  free_emitted_functions(fld);
+}
+
 IMPLSTATIC void codegen(Obj* prog, size_t file_index) {
   C(file_index) = file_index;
 
+  FileLinkData* fld = &user_context->files[C(file_index)];
+  bool patching = mark_reusable_functions(prog, fld);
+  C(patched) = patching;
+
   void* globals[dynasm_globals_MAX + 1];
   dasm_setupglobal(&C(dynasm), globals, dynasm_globals_MAX + 1);
 
@@ -2789,6 +3321,7 @@ IMPLSTATIC void codegen(Obj* prog, size_t file_index) {
   ///| .code
 
   assign_lvar_offsets(prog);
+  place_global_data(prog);
   emit_text(prog);
 
   ///| .pdata
@@ -2796,42 +3329,66 @@ IMPLSTATIC void codegen(Obj* prog, size_t file_index) {
   ///|=>end_of_pdata:
   ///| .code
 
+  stats_enter_phase(DYIBICC_PHASE_ENCODE);
   size_t code_size;
   dasm_link(&C(dynasm), &code_size);
-
-  FileLinkData* fld = &user_context->files[C(file_index)];
-  if (fld->codeseg_base_address) {
-    free_executable_memory(fld->codeseg_base_address, fld->codeseg_size);
-  }
-  // VirtualAlloc and mmap don't accept 0.
-  if (code_size == 0)
-    code_size = 1;
-  unsigned int page_sized = (unsigned int)align_to_u(code_size, get_page_size());
-
-  fld->codeseg_size = page_sized;
-#if X64WIN
-  if (user_context->generate_debug_symbols) {
-    user_context->dbp_ctx = dbp_create(fld->codeseg_size, get_temp_pdb_filename(AL_Compile));
-    fld->codeseg_base_address = dbp_get_image_base(user_context->dbp_ctx);
+  C(code_bytes) = code_size;
+
+  size_t got_size = C(got_names).len * sizeof(void*);
+
+  char* codeseg_base_address;
+  char* got;
+  if (patching) {
+    codeseg_base_address = code_heap_alloc(CH_Code, code_size, 0);
+    got = code_heap_alloc(CH_Got, got_size, 0);
+    fld->patch_segments = realloc(fld->patch_segments,
+                                  sizeof(CodeSegment) * (fld->num_patch_segments + 1));
+    fld->patch_segments[fld->num_patch_segments++] =
+        (CodeSegment){codeseg_base_address, code_size, got, got_size};
   } else {
-    fld->codeseg_base_address = allocate_writable_memory(page_sized);
-  }
+    remove_file_exports(C(file_index));
+    remember_old_code(fld);
+    free_code_segments(fld);
+    fld->codeseg_code_size = code_size;
+    fld->codeseg_got_size = got_size;
+#if X64WIN
+    if (user_context->generate_debug_symbols) {
+      // The GOT has to be in the image too, to be in range of the code.
+      size_t got_offset = align_to_u(MAX(code_size, 1), get_page_size());
+      user_context->dbp_ctx =
+          dbp_create(got_offset + align_to_u(got_size, get_page_size()),
+                     get_temp_pdb_filename(AL_Compile));
+      fld->codeseg_base_address = dbp_get_image_base(user_context->dbp_ctx);
+      fld->codeseg_got = fld->codeseg_base_address + got_offset;
+      fld->codeseg_in_debug_image = true;
+    } else {
+      fld->codeseg_base_address = code_heap_alloc(CH_Code, code_size, 0);
+      fld->codeseg_got = code_heap_alloc(CH_Got, got_size, 0);
+    }
 #else
-  fld->codeseg_base_address = allocate_writable_memory(page_sized);
+    fld->codeseg_base_address = code_heap_alloc(CH_Code, code_size, 0);
+    fld->codeseg_got = code_heap_alloc(CH_Got, got_size, 0);
 #endif
-  // outaf("code_size: %zu, page_sized: %zu\n", code_size, page_sized);
+    codeseg_base_address = fld->codeseg_base_address;
+    got = fld->codeseg_got;
+  }
+  // outaf("code_size: %zu, got_size: %zu\n", code_size, got_size);
 
-  fill_out_text_exports(prog, fld->codeseg_base_address);
+  fill_out_text_exports(prog, fld, codeseg_base_address);
 
-  free_link_fixups(fld);
+  if (patching)
+    retain_reused_link_fixups(fld);
+  else
+    free_link_fixups(fld);
   emit_data(prog);  // This needs to point into code for fixups, so has to go late-ish.
-  fill_out_fixups(fld);
 
-  dasm_encode(&C(dynasm), fld->codeseg_base_address);
+  dasm_encode(&C(dynasm), codeseg_base_address);
+  fill_out_got(fld, codeseg_base_address, got);
+  fill_out_data_loads(codeseg_base_address);
 
 #if 0
   FILE* f = fopen("code.raw", "wb");
-  fwrite(fld->codeseg_base_address, code_size, 1, f);
+  fwrite(codeseg_base_address, code_size, 1, f);
   fclose(f);
   system("ndisasm -b64 code.raw");
 #endif
@@ -2842,10 +3399,23 @@ IMPLSTATIC void codegen(Obj* prog, size_t file_index) {
     ABORT("dasm_checkstep failed");
   }
 
-  emit_symbols_and_exception_function_table(prog, fld->codeseg_base_address,
+  if (patching)
+    redirect_replaced_functions(prog, fld, codeseg_base_address);
+  record_emitted_functions(prog, fld, codeseg_base_address, patching);
+
+  // Only a complete and relocatable segment can be saved.
+  if (compiler_state.cache__key && !patching && !C(position_dependent)) {
+    resolve_code_relocations(prog);
+    cache_store(prog, fld, code_size);
+  }
+
+  emit_symbols_and_exception_function_table(prog, codeseg_base_address,
                                             dasm_getpclabel(&C(dynasm), start_of_pdata),
                                             dasm_getpclabel(&C(dynasm), end_of_pdata));
 
+  // Only the GOT is written after this, by linking.
+  code_heap_protect(codeseg_base_address, code_size, false);
+
   codegen_free();
 }
 
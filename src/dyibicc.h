@@ -67,6 +67,14 @@
 #include <strings.h>
 #endif
 
+// SSE2 is part of the x64 baseline, so is used without runtime detection.
+#if defined(__SSE2__) || defined(_M_X64)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#else
+#define HAVE_SSE2 0
+#endif
+
 #define MAX(x, y) ((x) < (y) ? (y) : (x))
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 
@@ -88,17 +96,20 @@ typedef struct DbpFunctionSymbol DbpFunctionSymbol;
 //
 // alloc.c
 //
+// Heaps are in the same order as DyibiccHeap.
 typedef enum AllocLifetime {
   AL_Compile = 0,  // Must be 0 so that 0-initialized structs default to this storage.
   AL_Temp,
   AL_Link,
   AL_UserContext,
+  AL_Snapshot,  // Header snapshots, all of which are discarded together.
   NUM_BUMP_HEAPS,
   AL_Manual = NUM_BUMP_HEAPS,
 } AllocLifetime;
 
 IMPLSTATIC void alloc_init(AllocLifetime lifetime);
 IMPLSTATIC void alloc_reset(AllocLifetime lifetime);
+IMPLSTATIC void alloc_release(AllocLifetime lifetime);
 
 IMPLSTATIC void* bumpcalloc(size_t num, size_t size, AllocLifetime lifetime);
 IMPLSTATIC void* bumplamerealloc(void* old,
@@ -106,11 +117,35 @@ IMPLSTATIC void* bumplamerealloc(void* old,
                                  size_t new_size,
                                  AllocLifetime lifetime);
 IMPLSTATIC void alloc_free(void* p, AllocLifetime lifetime);  // AL_Manual only.
-
-IMPLSTATIC void* aligned_allocate(size_t size, size_t alignment);
-IMPLSTATIC void aligned_free(void* p);
+IMPLSTATIC size_t alloc_used(AllocLifetime lifetime);
+IMPLSTATIC size_t alloc_high_water(AllocLifetime lifetime);
+IMPLSTATIC void alloc_reset_high_water(AllocLifetime lifetime);
+
+// Generated code, the GOTs it loads from, and global data are sub-allocated
+// from a single reservation shared by all files, see code_heap_alloc().
+typedef enum CodeHeapKind {
+  CH_Code,    // Executable once written, see code_heap_protect().
+  CH_Got,     // Always writable.
+  CH_Rodata,  // Pooled string literals, see code_heap_seal_rodata().
+  CH_Data,    // Initialized globals.
+  CH_Bss,     // Zero-initialized globals.
+  NUM_CODE_HEAP_KINDS,
+} CodeHeapKind;
+
+IMPLSTATIC void* code_heap_try_alloc(CodeHeapKind kind, size_t size, size_t align);
+IMPLSTATIC void* code_heap_alloc(CodeHeapKind kind, size_t size, size_t align);
+IMPLSTATIC size_t code_heap_room(CodeHeapKind kind);
+IMPLSTATIC bool code_heap_contains(void* p);
+IMPLSTATIC void code_heap_free(CodeHeapKind kind, void* p, size_t size);
+IMPLSTATIC void code_heap_protect(void* p, size_t size, bool writable);
+IMPLSTATIC void code_heap_seal_rodata(void);
+IMPLSTATIC void code_heap_release(void);
+
+IMPLSTATIC void* allocate_large_data(size_t size, size_t align);
+IMPLSTATIC void free_large_data(void* p);
 IMPLSTATIC void* allocate_writable_memory(size_t size);
 IMPLSTATIC bool make_memory_readwrite(void* m, size_t size);
+IMPLSTATIC bool make_memory_readonly(void* m, size_t size);
 IMPLSTATIC bool make_memory_executable(void* m, size_t size);
 IMPLSTATIC void free_executable_memory(void* p, size_t size);
 
@@ -126,17 +161,6 @@ typedef struct {
   int len;
 } StringArray;
 
-typedef struct StringInt {
-  char* str;
-  int i;
-} StringInt;
-
-typedef struct StringIntArray {
-  StringInt* data;
-  int capacity;
-  int len;
-} StringIntArray;
-
 typedef struct FilePtrArray {
   File** data;
   int capacity;
@@ -164,19 +188,30 @@ typedef struct IntIntIntArray {
 IMPLSTATIC char* bumpstrndup(const char* s, size_t n, AllocLifetime lifetime);
 IMPLSTATIC char* bumpstrdup(const char* s, AllocLifetime lifetime);
 IMPLSTATIC char* dirname(char* s);
+IMPLSTATIC char* canonicalize_path(const char* path);
 IMPLSTATIC uint64_t align_to_u(uint64_t n, uint64_t align);
 IMPLSTATIC int64_t align_to_s(int64_t n, int64_t align);
 IMPLSTATIC unsigned int get_page_size(void);
+IMPLSTATIC double get_time_seconds(void);
+IMPLSTATIC int lowest_set_bit(unsigned int mask);
 IMPLSTATIC void strarray_push(StringArray* arr, char* s, AllocLifetime lifetime);
-IMPLSTATIC void strintarray_push(StringIntArray* arr, StringInt item, AllocLifetime lifetime);
 IMPLSTATIC void fileptrarray_push(FilePtrArray* arr, File* item, AllocLifetime lifetime);
 IMPLSTATIC void tokenptrarray_push(TokenPtrArray* arr, Token* item, AllocLifetime lifetime);
-#if X64WIN
 IMPLSTATIC void intintintarray_push(IntIntIntArray* arr, IntIntInt item, AllocLifetime lifetime);
-#endif
 IMPLSTATIC char* format(AllocLifetime lifetime, char* fmt, ...)
     __attribute__((format(printf, 2, 3)));
 IMPLSTATIC char* read_file_wrap_user(char* path, AllocLifetime lifetime);
+
+typedef struct FileStat {
+  bool exists;
+  int64_t mtime;  // Nanoseconds, where available.
+  int64_t size;
+} FileStat;
+
+IMPLSTATIC FileStat* stat_file(char* path);
+IMPLSTATIC char* read_file_cached(char* path, AllocLifetime lifetime);
+IMPLSTATIC void invalidate_file_cache(char* changed_path);
+IMPLSTATIC void free_file_cache(UserContext* ctx);
 IMPLSTATIC NORETURN void error(char* fmt, ...) __attribute__((format(printf, 1, 2)));
 IMPLSTATIC NORETURN void error_at(char* loc, char* fmt, ...) __attribute__((format(printf, 2, 3)));
 IMPLSTATIC NORETURN void error_tok(Token* tok, char* fmt, ...)
@@ -203,38 +238,66 @@ typedef enum {
   TK_NUM,      // Numeric literals
   TK_PP_NUM,   // Preprocessing numbers
   TK_EOF,      // End-of-file markers
+  TK_LAZY,     // Rest of a file that hasn't been tokenized yet
 } TokenKind;
 
 struct File {
   char* name;
   char* contents;
+  size_t size;  // strlen(contents)
   int file_no;  // Index into tokenize__all_tokenized_files.
 
-  // For #line directive
+  // For #line directive. Tokens passed through the preprocessor after a #line
+  // are moved to |presumed|, a copy of the File with the name and line offset
+  // in effect at that point, so tokens don't each need to carry those.
   char* display_name;
   int line_delta;
+  File* presumed;
 };
 
 // Token type
+// An interned identifier. There's a single Atom for each distinct spelling for
+// the lifetime of the context, so they can be compared by pointer, and the hash
+// of the text is only computed once.
+typedef struct Atom {
+  char* name;  // NUL-terminated
+  int len;
+  int id;           // Dense index, in order of first appearance.
+  bool is_keyword;  // Set by intern_keywords().
+  uint64_t hash;    // hash_bytes(name, len)
+} Atom;
+
+// The macro expansion that produced a token: the macros that must not be
+// expanded again (see preprocess.c) and the macro name token that was expanded.
+// Runs of tokens from the same expansion share one.
+typedef struct Expansion {
+  Hideset* hideset;
+  Token* origin;
+} Expansion;
+
+// Tokens are kept to a single cache line. Payloads that only some kinds have
+// share storage, and rarely used data (floating point values, macro expansion
+// info, #line remapping) is out of line.
 typedef struct Token Token;
 struct Token {
-  TokenKind kind;    // Token kind
-  Token* next;       // Next token
-  int64_t val;       // If kind is TK_NUM, its value
-  long double fval;  // If kind is TK_NUM, its value
-  char* loc;         // Token location
-  int len;           // Token length
-  Type* ty;          // Used if TK_NUM or TK_STR
-  char* str;         // String literal contents including terminating '\0'
-
-  File* file;        // Source location
-  char* filename;    // Filename
-  int line_no;       // Line number
-  int line_delta;    // Line number
-  bool at_bol;       // True if this token is at beginning of line
-  bool has_space;    // True if this token follows a space character
-  Hideset* hideset;  // For macro expansion
-  Token* origin;     // If this is expanded from a macro, the original token
+  TokenKind kind;  // Token kind
+  int len;         // Token length
+  Token* next;     // Next token
+  char* loc;       // Token location
+  File* file;      // Source location
+  int line_no;     // Line number
+  bool at_bol;     // True if this token is at beginning of line
+  bool has_space;  // True if this token follows a space character
+  union {
+    Atom* atom;  // If kind is TK_IDENT (or TK_KEYWORD), the interned spelling
+    Type* ty;    // If kind is TK_NUM or TK_STR
+  };
+  union {
+    int64_t val;        // If kind is TK_NUM and ty is an integer, its value
+    long double* fval;  // If kind is TK_NUM and ty is floating point, its value
+    char* str;          // If kind is TK_STR, contents including terminating '\0'
+  };
+  Expansion* expansion;  // NULL if not produced by a macro expansion
 };
 
 IMPLSTATIC bool equal(Token* tok, char* op);
@@ -244,8 +307,14 @@ IMPLSTATIC void convert_pp_tokens(Token* tok);
 IMPLSTATIC File* new_file(char* name, char* contents);
 IMPLSTATIC Token* tokenize_string_literal(Token* tok, Type* basety);
 IMPLSTATIC Token* tokenize(File* file);
+IMPLSTATIC void resume_tokenizing(Token* tok);
+IMPLSTATIC void skip_conditional_text(Token* tok, bool stop_at_else);
+IMPLSTATIC bool conditional_ends_file(Token* tok);
 IMPLSTATIC Token* tokenize_file(char* filename);
 IMPLSTATIC Token* tokenize_filecontents(char* path, char* contents);
+IMPLSTATIC uint64_t hash_tokens(uint64_t hash, Token* tok, Token* end);
+IMPLSTATIC Atom* intern(char* s, int len);
+IMPLSTATIC void intern_keywords(void);
 
 #define unreachable() error_internal(__FILE__, __LINE__, "unreachable")
 #define ABORT(msg) error_internal(__FILE__, __LINE__, msg)
@@ -259,6 +328,8 @@ IMPLSTATIC void init_macros(void);
 IMPLSTATIC void define_macro(char* name, char* buf);
 IMPLSTATIC void undef_macro(char* name);
 IMPLSTATIC Token* preprocess(Token* tok);
+IMPLSTATIC Token* preprocess_file(Token* tok);
+IMPLSTATIC void invalidate_header_snapshots(char* changed_path);
 IMPLSTATIC Token* add_container_instantiations(Token* tok);
 
 //
@@ -297,11 +368,15 @@ struct Obj {
   bool is_tentative;
   bool is_tls;
   bool is_rodata;
+  bool in_code_heap;  // Writable data that's addressed directly, see place_global_data().
   char* init_data;
   Relocation* rel;
 
   // Function
   bool is_inline;
+  bool reuse_code;        // Code from a previous compile is unchanged and used instead.
+  bool replaces_code;     // Code from a previous compile jumps to this instead.
+  uint64_t content_hash;  // Hash of the tokens of the body.
   Obj* params;
   Node* body;
   Obj* locals;
@@ -323,6 +398,7 @@ struct Relocation {
   int offset;
   char** string_label;
   int* internal_code_label;
+  int code_offset;  // internal_code_label resolved, only set when caching.
   long addend;
 };
 
@@ -585,6 +661,19 @@ IMPLSTATIC void codegen_init(void);
 IMPLSTATIC void codegen(Obj* prog, size_t file_index);
 IMPLSTATIC void codegen_free(void);
 IMPLSTATIC int codegen_pclabel(void);
+IMPLSTATIC int global_data_alignment(Obj* var);
+IMPLSTATIC void begin_file_rodata(size_t file_index);
+IMPLSTATIC void end_file_rodata(size_t file_index);
+IMPLSTATIC char* intern_rodata(size_t file_index, char* name, char* contents, int size, int align);
+IMPLSTATIC void free_rodata_pool(UserContext* ctx);
+IMPLSTATIC char* allocate_global_data(size_t file_index,
+                                      char* name,
+                                      bool is_static,
+                                      bool has_init_data,
+                                      bool in_code_heap,
+                                      int size,
+                                      int align);
+IMPLSTATIC void free_global_data(UserContext* ctx);
 #if X64WIN
 IMPLSTATIC bool type_passed_in_register(Type* ty);
 #endif
@@ -607,28 +696,45 @@ typedef struct {
   char* key;
   int keylen;
   void* val;
+  uint64_t hash;
 } HashEntry;
 
 struct HashMap {
-  HashEntry* buckets;
+  HashEntry* buckets;  // Followed by |capacity| control bytes, see hashmap.c.
   int capacity;
   int used;
+  int deleted;
   AllocLifetime alloc_lifetime;
 };
 
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+
+IMPLSTATIC uint64_t fnv_hash_extend(uint64_t hash, char* s, int len);
+IMPLSTATIC uint64_t hash_bytes(char* s, int len);
 IMPLSTATIC void* hashmap_get(HashMap* map, char* key);
 IMPLSTATIC void* hashmap_get2(HashMap* map, char* key, int keylen);
+IMPLSTATIC void* hashmap_get_hashed(HashMap* map, char* key, int keylen, uint64_t hash);
+IMPLSTATIC void* hashmap_get_token(HashMap* map, Token* tok);
 IMPLSTATIC void hashmap_put(HashMap* map, char* key, void* val);
 IMPLSTATIC void hashmap_put2(HashMap* map, char* key, int keylen, void* val);
+IMPLSTATIC void hashmap_put_hashed(HashMap* map, char* key, int keylen, uint64_t hash, void* val);
 IMPLSTATIC void hashmap_delete(HashMap* map, char* key);
 IMPLSTATIC void hashmap_delete2(HashMap* map, char* key, int keylen);
-IMPLSTATIC void hashmap_clear_manual_key_owned_value_owned_aligned(HashMap* map);
+IMPLSTATIC HashEntry* hashmap_next(HashMap* map, int* iter);
+IMPLSTATIC void hashmap_clear_manual_key_owned_value_owned(HashMap* map);
 IMPLSTATIC void hashmap_clear_manual_key_owned_value_unowned(HashMap* map);
+IMPLSTATIC void hashmap_clear_manual_key_unowned_value_unowned(HashMap* map);
 
 //
 // link.c
 //
+typedef struct StableExportBlock StableExportBlock;
+
 IMPLSTATIC bool link_all_files(void);
+IMPLSTATIC void* get_stable_export(char* name);
+IMPLSTATIC void free_stable_exports(UserContext* ctx);
+IMPLSTATIC void free_link_refs(UserContext* ctx);
+IMPLSTATIC void register_host_symbols(const char** names, void** addresses, size_t count);
 
 //
 // Entire compiler state in one struct and linker in a second for clearing, esp.
@@ -652,32 +758,139 @@ typedef struct LinkFixup {
   // The address to fix up.
   void* at;
 
-  // Name of the symbol at which the fixup should point.
-  // TODO: Intern pool for all the import/export/global names.
-  char* name;
+  // Name of the symbol at which the fixup should point, see intern().
+  Atom* name;
 
   // Added to the address that |name| resolves to.
   int addend;
+
+  // For GOT slots, the entry of the function whose code loads from the slot.
+  char* user;
 } LinkFixup;
 
+// Code, and its GOT (table of addresses of symbols referenced by the code),
+// which are separately allocated from the code heap so that the code can be
+// left executable while the GOT is written by linking.
+typedef struct CodeSegment {
+  char* base_address;
+  size_t code_size;
+  char* got;
+  size_t got_size;
+} CodeSegment;
+
+// Storage for string literals, shared by all those with the same contents and
+// alignment in any file. See intern_rodata().
+typedef struct PooledRodata {
+  char* data;
+  size_t size;
+  int refs;
+  char* key;  // Contents followed by alignment, owned by rodata_pool.
+  int keylen;
+} PooledRodata;
+
+typedef struct FileRodata {
+  char* name;
+  PooledRodata* entry;
+} FileRodata;
+
+// A function that has code in the main codeseg, or a patch segment.
+typedef struct EmittedFunction {
+  Atom* name;
+  uint64_t content_hash;
+  // Address of the function, which doesn't change when the function is
+  // replaced: the code there is overwritten by a jump to the current code.
+  char* entry;
+  char* address;  // Of the current code, which |size| is the size of.
+  size_t size;
+  bool is_static;
+  bool reused;  // Only meaningful during codegen.
+} EmittedFunction;
+
 typedef struct FileLinkData {
   char* source_name;
   char* codeseg_base_address;  // Just the address, not a string.
-  size_t codeseg_size;
+  size_t codeseg_code_size;
+  char* codeseg_got;  // See CodeSegment.
+  size_t codeseg_got_size;
+#if X64WIN
+  bool codeseg_in_debug_image;  // Allocated by dbp_create() rather than the code heap.
+#endif
+
+  // When only some function bodies change, only those functions are emitted
+  // into a new patch segment, and the rest of the code is reused. The previous
+  // entry points of the changed functions are overwritten with a jump to the
+  // new code.
+  CodeSegment* patch_segments;
+  int num_patch_segments;
+
+  // All functions with live code, and the toplevel hash of the translation
+  // unit they were generated from.
+  EmittedFunction* functions;
+  int num_functions;
+  int functions_cap;
+  HashMap function_index;  // Name -> index in |functions| + 1. Lifetime is AL_Manual.
+  uint64_t toplevel_hash;
 
   LinkFixup* fixups;
   int flen;
   int fcap;
+
+  // The pooled string literals used by the last compile. While compiling, the
+  // first num_prev_rodata are those of the previous compile. See
+  // begin_file_rodata().
+  FileRodata* rodata;
+  int num_rodata;
+  int num_prev_rodata;
+  int rodata_cap;
+
+  // Whether |fixups| have all been resolved since they last changed, and a
+  // count of the times they've been resolved from scratch. See link.c.
+  bool fixups_linked;
+  int link_generation;
+
+  // Set of all files #included (directly or transitively) by the last compile
+  // of source_name. Keys are canonicalized paths. Lifetime is AL_Manual.
+  HashMap includes;
+
+  // Set when the file is selected to be compiled, and cleared when it has
+  // been. It stays set if the compile fails, as |includes| can't name a header
+  // that wasn't found, so the next change to any file retries it.
+  bool compile_pending;
 } FileLinkData;
 
+IMPLSTATIC void linkfixup_push(FileLinkData* fld,
+                               char* target,
+                               char* fixup,
+                               int addend,
+                               char* user);
+IMPLSTATIC void patch_rip_relative_load(char* load, char* target);
+IMPLSTATIC void patch_data_load(size_t file_index, char* load, char* name, bool is_static);
 IMPLSTATIC void free_link_fixups(FileLinkData* fld);
+IMPLSTATIC void free_code_segments(FileLinkData* fld);
+IMPLSTATIC void remember_old_code(FileLinkData* fld);
+IMPLSTATIC char* stale_code_pointer(size_t file_index, char* name, bool is_static, int offset);
+IMPLSTATIC EmittedFunction* add_emitted_function(FileLinkData* fld, Atom* name);
+IMPLSTATIC void remove_file_exports(size_t file_index);
+
+//
+// cache.c
+//
+IMPLSTATIC bool cache_load(Token* tok, size_t file_index);
+IMPLSTATIC void cache_store(Obj* prog, FileLinkData* fld, size_t code_size);
+
+//
+// main.c
+//
+IMPLSTATIC DyibiccPhase stats_enter_phase(DyibiccPhase phase);
 
 struct UserContext {
   DyibiccLoadFileContents load_file_contents;
+  bool map_source_files;  // load_file_contents is the default, so files can be mapped instead.
   DyibiccFunctionLookupFn get_function_address;
   DyibiccOutputFn output_function;
   bool use_ansi_codes;
   bool generate_debug_symbols;
+  char* cache_dir;  // NULL if not caching.
 
   size_t num_include_paths;
   char** include_paths;
@@ -695,6 +908,50 @@ struct UserContext {
 
   HashMap reflect_types;
 
+  // Identifier text -> Atom*, see intern().
+  HashMap atoms;
+  int num_atoms;
+
+  // Key of a run of system #includes -> HeaderSnapshot*. See preprocess.c.
+  HashMap header_snapshots;
+
+  // Canonical path -> CachedFile*, and #include name -> ResolvedInclude*.
+  // These persist across updates, see util.c and preprocess.c.
+  HashMap file_cache;
+  HashMap include_path_cache;
+
+  // Canonical path -> FileStat*, only valid for the duration of an update.
+  HashMap stat_cache;
+
+  // Path as given -> canonicalize_path() of it, also only for an update.
+  HashMap canonical_paths;
+
+  // Name -> address of symbols from outside the compiled code, both those
+  // passed to dyibicc_register_symbols(), and the results of earlier lookups
+  // through get_function_address, etc. Keys are interned.
+  HashMap host_symbols;
+  bool host_symbols_registered;  // Since the last link, which has to re-resolve them.
+
+  // String literal contents and alignment -> PooledRodata*. AL_Manual.
+  HashMap rodata_pool;
+
+  // Global symbol name -> LinkRefs*, the fixups that refer to it. See link.c.
+  HashMap link_refs;
+
+  // Exported name -> slot in a StableExportBlock, see link.c.
+  HashMap stable_exports;
+  StableExportBlock* stable_export_blocks;
+
+  // See dyibicc_get_stats(). file_stats is an array of num_files.
+  DyibiccStats stats;
+  DyibiccFileStats* file_stats;
+
+  // What the update in progress is doing, so that its stats can be completed
+  // if it fails. link_start is 0 when not linking.
+  double update_start;
+  double link_start;
+  bool compiling_file;
+
 #if X64WIN
   char* function_table_data;
   DbpContext* dbp_ctx;
@@ -708,7 +965,8 @@ typedef struct CompilerState {
   File* tokenize__current_file;  // Input file
   bool tokenize__at_bol;         // True if the current position is at the beginning of a line
   bool tokenize__has_space;      // True if the current position follows a space character
-  HashMap tokenize__keyword_map;
+  int tokenize__line_no;         // Line number of the current position
+  size_t tokenize__num_tokens;
   FilePtrArray tokenize__all_tokenized_files;
 
   // preprocess.c
@@ -720,9 +978,16 @@ typedef struct CompilerState {
   HashMap preprocess__builtin_includes_map;
 
   int preprocess__include_next_idx;
-  HashMap preprocess__include_path_cache;
   HashMap preprocess__include_guards;
+  HashMap preprocess__hidesets;               // Sorted Atom* array -> Hideset*.
+  HashMap preprocess__hideset_unions;         // Pair of Hideset* -> Hideset*.
+  HashMap preprocess__hideset_intersections;  // Pair of Hideset* -> Hideset*.
   int preprocess__counter_macro_i;
+  HashMap* preprocess__include_deps;  // Points at FileLinkData.includes of the file being compiled.
+  bool preprocess__capturing_snapshot;
+  StringArray preprocess__snapshot_includes;
+  bool preprocess__expanded_base_file;
+  size_t preprocess__num_macro_expansions;
 
   // parse.c
   Obj* parse__locals;   // All local variable instances created during parsing are accumulated to
@@ -739,8 +1004,13 @@ typedef struct CompilerState {
                                 // statement. Otherwise, NULL.
   Obj* parse__builtin_alloca;
   int parse__unique_name_id;
+  int parse__fn_unique_name_id;
+  TokenPtrArray parse__function_bodies;  // Pairs of [start, end) of each function body.
+  uint64_t parse__toplevel_hash;         // Hash of all tokens outside of function bodies.
   HashMap parse__typename_map;
   bool parse__evaluating_pp_const;
+  size_t parse__num_nodes;
+  size_t parse__num_objs;
 
   // codegen.in.c
   int codegen__depth;
@@ -748,10 +1018,32 @@ typedef struct CompilerState {
   dasm_State* codegen__dynasm;
   Obj* codegen__current_fn;
   int codegen__numlabels;
-  StringIntArray codegen__fixups;
+  StringArray codegen__got_names;  // Symbol of each GOT slot.
+  // Label of load, GOT slot, entry label of function. Offsets in the code
+  // rather than labels once the code is encoded.
+  IntIntIntArray codegen__got_uses;
+  HashMap codegen__got_slots;        // Name -> GOT slot + 1, for got_fn.
+  Obj* codegen__got_fn;
+  // Label of lea, index in data_names, whether static. Offsets in the code
+  // rather than labels once the code is encoded. See data_load_label().
+  IntIntIntArray codegen__data_uses;
+  StringArray codegen__data_names;
+  bool codegen__position_dependent;  // Code contains absolute addresses of non-code.
+  bool codegen__patched;             // Only functions that changed were emitted.
+  size_t codegen__code_bytes;
+  size_t codegen__data_bytes;
+  // The file's code before a full recompile, see stale_code_pointer().
+  CodeSegment* codegen__old_code;
+  int codegen__num_old_code;
+
+  // cache.c
+  uint64_t cache__key;  // Key of the file being compiled, or 0 if not caching.
 
   // main.c
   char* main__base_file;
+  DyibiccPhase main__phase;  // Phase that time is currently being charged to.
+  double main__phase_start;
+  double main__phase_seconds[DYIBICC_NUM_PHASES];
 } CompilerState;
 
 typedef struct LinkerState {
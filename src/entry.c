@@ -17,23 +17,6 @@ static bool take_arg(char* arg) {
   return false;
 }
 
-// Returns the contents of a given file. Doesn't support '-' for reading from
-// stdin.
-static bool read_file(const char* path, char** contents, size_t* size) {
-  FILE* fp = fopen(path, "rb");
-  if (!fp) {
-    return false;
-  }
-
-  fseek(fp, 0, SEEK_END);
-  *size = ftell(fp);
-  rewind(fp);
-  *contents = malloc(*size);
-  fread(*contents, 1, *size, fp);
-  fclose(fp);
-  return true;
-}
-
 static void parse_args(int argc,
                        char** argv,
                        char** entry_point_override,
@@ -109,7 +92,7 @@ int main(int argc, char** argv) {
   DyibiccEnviromentData env_data = {
       .include_paths = (const char**)include_paths.data,
       .files = (const char**)input_paths.data,
-      .load_file_contents = read_file,
+      .load_file_contents = NULL,
       .get_function_address = NULL,
       .output_function = NULL,
       .use_ansi_codes = isatty(fileno(stdout)),
@@ -14,6 +14,7 @@ ROOT_DIR = os.path.normpath(
 FILELIST = [
     'type.c',
     'alloc.c',
+    'cache.c',
     'entry.c',
     'fuzz_entry.c',
     'hashmap.c',
@@ -137,7 +138,7 @@ def generate(platform, config, settings, cmdlines, tests, upd_tests, fuzz_tests)
         f.write('root = ../../src\n')
         f.write('\n')
         f.write('rule cc\n')
-        f.write('  command = ' + cmdlines['COMPILE'] + '\n')
+        f.write('  command = ' + cmdlines['COMPILE'] + ' $defines\n')
         f.write('  description = CC $out\n')
         f.write('  deps = ' + ('msvc' if platform == 'w' else 'gcc') + '\n')
         if platform != 'w':
@@ -165,6 +166,9 @@ def generate(platform, config, settings, cmdlines, tests, upd_tests, fuzz_tests)
         f.write('rule compincl\n')
         f.write('  command = %s $root/build_compiler_includes_header.py $out $in\n' % sys.executable)
         f.write('\n')
+        f.write('rule srchash\n')
+        f.write('  command = %s $root/build_source_hash_header.py $out $in\n' % sys.executable)
+        f.write('\n')
 
         objs = []
 
@@ -186,6 +190,7 @@ def generate(platform, config, settings, cmdlines, tests, upd_tests, fuzz_tests)
             obj = os.path.splitext(src)[0] + obj_ext
             objs.append(obj)
             extra_deps = ' | compincl.h' if src == 'preprocess.c' else ''
+            extra_deps = ' | srchash.h' if src == 'cache.c' else extra_deps
             f.write('build %s: cc $root/%s%s\n' % (obj, src, extra_deps))
 
         compiler_include_headers = pathlib.Path('include').rglob('*.h')
@@ -193,10 +198,16 @@ def generate(platform, config, settings, cmdlines, tests, upd_tests, fuzz_tests)
                 (' '.join([os.path.join('$root', '..', x).replace('\\', '/')
                            for x in compiler_include_headers])))
 
+        # Everything that affects the code that's generated for a given input.
+        f.write('build srchash.h: srchash %s | $root/build_source_hash_header.py\n' %
+                ' '.join(['$root/' + x for x in FILELIST + ['codegen.in.c', 'dyibicc.h']] +
+                         ['$root/dynasm/dasm_proto.h', '$root/dynasm/dasm_x86.h']))
+
         EXTRAS_FOR_AMALG = [
                 '$root/dyibicc.h',
                 '$root/../include/all/reflect.h',
                 'compincl.h',
+                'srchash.h',
                 '$root/dynasm/dasm_proto.h',
                 '$root/dynasm/dasm_x86.h',
         ]
@@ -212,6 +223,13 @@ def generate(platform, config, settings, cmdlines, tests, upd_tests, fuzz_tests)
 
         f.write('build libdyibicc%s: cc embed/libdyibicc.c\n' % obj_ext)
 
+        # Update tests named *_small_heap.py are linked with a build that has
+        # little space in the code heap for zeroed data, so that running out of
+        # it doesn't need a lot of memory.
+        f.write('build libdyibicc_small_heap%s: cc embed/libdyibicc.c\n' % obj_ext)
+        f.write('  defines = %sCODE_HEAP_BSS_SIZE=%d\n' %
+                ('/D' if platform == 'w' else '-D', 16 << 20))
+
         dyibiccexe = 'dyibicc' + exe_ext
         f.write('build %s: link %s\n' % (dyibiccexe, ' '.join(objs)))
 
@@ -260,8 +278,9 @@ def generate(platform, config, settings, cmdlines, tests, upd_tests, fuzz_tests)
             tmpexe = os.path.basename(testpy) + '.runner' + exe_ext
             f.write('build %s: genupdaterunner $root/../%s | $root/../test/test_helpers_for_update.py\n' % (
                 tmpc, testpy))
-            f.write('build %s: testcexe %s libdyibicc%s | embed/libdyibicc.h\n' % (
-                tmpexe, tmpc, obj_ext))
+            lib = 'libdyibicc_small_heap' if testpy.endswith('_small_heap.py') else 'libdyibicc'
+            f.write('build %s: testcexe %s %s%s | embed/libdyibicc.h\n' % (
+                tmpexe, tmpc, lib, obj_ext))
             f.write('build %s: runbin %s\n' % (testpy, tmpexe))
             alltests.append(testpy)
 
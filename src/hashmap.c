@@ -1,21 +1,37 @@
-// This is an implementation of the open-addressing hash table.
+// This is an implementation of the open-addressing hash table, in the style of
+// SwissTable.
+//
+// Alongside the array of entries there's an array of one byte per slot, the
+// control bytes. A full slot's control byte holds 7 bits of its key's hash, so
+// a group of 16 slots can be checked for candidate matches with one SSE2
+// compare, and only those candidates have their key compared. The capacity is
+// a power of two, and probing moves between groups in a triangular sequence,
+// which visits every group.
 
 #include "dyibicc.h"
 
+#if X64WIN
+#include <intrin.h>
+#endif
+
 // Initial hash bucket size
 #define INIT_SIZE 16
 
-// Rehash if the usage exceeds 70%.
-#define HIGH_WATERMARK 70
+#define GROUP_SIZE 16
+
+// Rehash if the full and deleted slots exceed 7/8 of the capacity. This also
+// guarantees that probing always reaches an empty slot.
+#define HIGH_WATERMARK 87
 
 // We'll keep the usage below 50% after rehashing.
 #define LOW_WATERMARK 50
 
-// Represents a deleted hash entry
-#define TOMBSTONE ((void*)-1)
+// Control byte values. Full slots have the high bit set, and the top 7 bits of
+// the hash in the rest.
+#define CTRL_EMPTY 0x00
+#define CTRL_DELETED 0x01
 
-static uint64_t fnv_hash(char* s, int len) {
-  uint64_t hash = 0xcbf29ce484222325;
+IMPLSTATIC uint64_t fnv_hash_extend(uint64_t hash, char* s, int len) {
   for (int i = 0; i < len; i++) {
     hash *= 0x100000001b3;
     hash ^= (unsigned char)s[i];
@@ -23,93 +39,203 @@ static uint64_t fnv_hash(char* s, int len) {
   return hash;
 }
 
+static uint64_t hash_mix(uint64_t a, uint64_t b) {
+#if X64WIN
+  uint64_t hi;
+  uint64_t lo = _umul128(a, b, &hi);
+  return lo ^ hi;
+#else
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#endif
+}
+
+static uint64_t read64(unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t read32(unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// The hash of all keys, a variant of wyhash which consumes 8 or 16 bytes at a
+// time rather than FNV-1a's one.
+IMPLSTATIC uint64_t hash_bytes(char* s, int len) {
+  static const uint64_t p0 = 0xa0761d6478bd642full;
+  static const uint64_t p1 = 0xe7037ed1a0b428dbull;
+  unsigned char* p = (unsigned char*)s;
+  uint64_t h = p0;
+  uint64_t a = 0;
+  uint64_t b = 0;
+  if (len <= 16) {
+    if (len >= 8) {
+      a = read64(p);
+      b = read64(p + len - 8);
+    } else if (len >= 4) {
+      a = read32(p);
+      b = read32(p + len - 4);
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+    }
+  } else {
+    int i = len;
+    for (; i > 16; i -= 16, p += 16)
+      h = hash_mix(read64(p) ^ p1, read64(p + 8) ^ h);
+    a = read64(p + i - 16);
+    b = read64(p + i - 8);
+  }
+  return hash_mix(p1 ^ (uint64_t)len, hash_mix(a ^ p1, b ^ h));
+}
+
+static uint8_t ctrl_for_hash(uint64_t hash) {
+  return 0x80 | (uint8_t)(hash >> 57);
+}
+
+static uint8_t* ctrl_bytes(HashMap* map) {
+  return (uint8_t*)(map->buckets + map->capacity);
+}
+
+static bool is_full(HashMap* map, int i) {
+  return ctrl_bytes(map)[i] & 0x80;
+}
+
+// Bitmask of the slots in the group at |group| whose control byte is |c|.
+static unsigned int group_match(uint8_t* group, uint8_t c) {
+#if HAVE_SSE2
+  __m128i v = _mm_loadu_si128((__m128i*)group);
+  return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)c)));
+#else
+  unsigned int mask = 0;
+  for (int i = 0; i < GROUP_SIZE; i++) {
+    if (group[i] == c)
+      mask |= 1u << i;
+  }
+  return mask;
+#endif
+}
+
+// Bitmask of the slots in the group at |group| that are empty or deleted.
+static unsigned int group_match_free(uint8_t* group) {
+#if HAVE_SSE2
+  __m128i v = _mm_loadu_si128((__m128i*)group);
+  return ~(unsigned int)_mm_movemask_epi8(v) & 0xffff;
+#else
+  unsigned int mask = 0;
+  for (int i = 0; i < GROUP_SIZE; i++) {
+    if (!(group[i] & 0x80))
+      mask |= 1u << i;
+  }
+  return mask;
+#endif
+}
+
+static void allocate_buckets(HashMap* map, int cap) {
+  // Entries followed by the control bytes, in a single allocation.
+  map->buckets = bumpcalloc(1, cap * (sizeof(HashEntry) + 1), map->alloc_lifetime);
+  map->capacity = cap;
+  map->used = 0;
+  map->deleted = 0;
+}
+
+// Claims the first empty or deleted slot in the probe sequence for |hash|. The
+// key must not already be present.
+static HashEntry* insert_new_entry(HashMap* map, char* key, int keylen, uint64_t hash) {
+  uint8_t* ctrl = ctrl_bytes(map);
+  int group_mask = map->capacity / GROUP_SIZE - 1;
+  int g = (int)(hash & (uint64_t)group_mask);
+  for (int step = 1;; step++) {
+    unsigned int free_slots = group_match_free(ctrl + g * GROUP_SIZE);
+    if (free_slots) {
+      int i = g * GROUP_SIZE + lowest_set_bit(free_slots);
+      if (ctrl[i] == CTRL_DELETED)
+        map->deleted--;
+      ctrl[i] = ctrl_for_hash(hash);
+      HashEntry* ent = &map->buckets[i];
+      ent->key = key;
+      ent->keylen = keylen;
+      ent->hash = hash;
+      map->used++;
+      return ent;
+    }
+    g = (g + step) & group_mask;
+  }
+}
+
 // Make room for new entires in a given hashmap by removing
 // tombstones and possibly extending the bucket size.
 static void rehash(HashMap* map) {
-  // Compute the size of the new hashmap.
-  int nkeys = 0;
-  for (int i = 0; i < map->capacity; i++)
-    if (map->buckets[i].key && map->buckets[i].key != TOMBSTONE)
-      nkeys++;
-
   int cap = map->capacity;
-  while ((nkeys * 100) / cap >= LOW_WATERMARK)
+  while ((map->used * 100) / cap >= LOW_WATERMARK)
     cap = cap * 2;
   assert(cap > 0);
 
   // Create a new hashmap and copy all key-values.
   HashMap map2 = {0};
-  map2.buckets = bumpcalloc(cap, sizeof(HashEntry), map->alloc_lifetime);
-  map2.capacity = cap;
   map2.alloc_lifetime = map->alloc_lifetime;
+  allocate_buckets(&map2, cap);
 
   for (int i = 0; i < map->capacity; i++) {
-    HashEntry* ent = &map->buckets[i];
-    if (ent->key && ent->key != TOMBSTONE) {
-      hashmap_put2(&map2, ent->key, ent->keylen, ent->val);
+    if (is_full(map, i)) {
+      HashEntry* ent = &map->buckets[i];
+      insert_new_entry(&map2, ent->key, ent->keylen, ent->hash)->val = ent->val;
     }
   }
 
-  assert(map2.used == nkeys);
+  assert(map2.used == map->used);
   if (map->alloc_lifetime == AL_Manual) {
     alloc_free(map->buckets, map->alloc_lifetime);
   }
   *map = map2;
 }
 
-static bool match(HashEntry* ent, char* key, int keylen) {
-  return ent->key && ent->key != TOMBSTONE && ent->keylen == keylen &&
-         memcmp(ent->key, key, keylen) == 0;
-}
-
-static HashEntry* get_entry(HashMap* map, char* key, int keylen) {
+static HashEntry* get_entry(HashMap* map, char* key, int keylen, uint64_t hash) {
   if (!map->buckets)
     return NULL;
 
-  uint64_t hash = fnv_hash(key, keylen);
-
-  for (int i = 0; i < map->capacity; i++) {
-    HashEntry* ent = &map->buckets[(hash + i) % map->capacity];
-    if (match(ent, key, keylen))
-      return ent;
-    if (ent->key == NULL)
+  uint8_t* ctrl = ctrl_bytes(map);
+  uint8_t c = ctrl_for_hash(hash);
+  int group_mask = map->capacity / GROUP_SIZE - 1;
+  int g = (int)(hash & (uint64_t)group_mask);
+  for (int step = 1;; step++) {
+    uint8_t* group = ctrl + g * GROUP_SIZE;
+    for (unsigned int m = group_match(group, c); m; m &= m - 1) {
+      HashEntry* ent = &map->buckets[g * GROUP_SIZE + lowest_set_bit(m)];
+      if (ent->hash == hash && ent->keylen == keylen &&
+          (ent->key == key || memcmp(ent->key, key, keylen) == 0))
+        return ent;
+    }
+    // Insertion would have used an empty slot in this group, so the key isn't
+    // further along.
+    if (group_match(group, CTRL_EMPTY))
       return NULL;
+    g = (g + step) & group_mask;
   }
-  unreachable();
 }
 
-static HashEntry* get_or_insert_entry(HashMap* map, char* key, int keylen) {
+static HashEntry* get_or_insert_entry(HashMap* map, char* key, int keylen, uint64_t hash) {
+  HashEntry* ent = get_entry(map, key, keylen, hash);
+  if (ent) {
+    if (map->alloc_lifetime == AL_Manual) {
+      free(ent->key);
+    }
+    ent->key = key;
+    return ent;
+  }
+
   if (!map->buckets) {
-    map->buckets = bumpcalloc(INIT_SIZE, sizeof(HashEntry), map->alloc_lifetime);
-    map->capacity = INIT_SIZE;
-  } else if ((map->used * 100) / map->capacity >= HIGH_WATERMARK) {
+    allocate_buckets(map, INIT_SIZE);
+  } else if (((map->used + map->deleted + 1) * 100) / map->capacity >= HIGH_WATERMARK) {
     rehash(map);
   }
 
-  uint64_t hash = fnv_hash(key, keylen);
-
-  for (int i = 0; i < map->capacity; i++) {
-    HashEntry* ent = &map->buckets[(hash + i) % map->capacity];
-
-    if (match(ent, key, keylen)) {
-      if (map->alloc_lifetime == AL_Manual) {
-        free(ent->key);
-      }
-      ent->key = key;
-      return ent;
-    }
-
-    // It is tempting to allow a TOMBSTONE entry to be reused here, but they
-    // cannot be, see: https://github.com/rui314/chibicc/issues/135.
-
-    if (ent->key == NULL) {
-      ent->key = key;
-      ent->keylen = keylen;
-      map->used++;
-      return ent;
-    }
-  }
-  unreachable();
+  // Unlike a tombstone in a linearly probed table, a deleted slot can be
+  // reused here, because the lookup above has already established that the key
+  // isn't anywhere in the probe sequence.
+  return insert_new_entry(map, key, keylen, hash);
 }
 
 IMPLSTATIC void* hashmap_get(HashMap* map, char* key) {
@@ -117,16 +243,33 @@ IMPLSTATIC void* hashmap_get(HashMap* map, char* key) {
 }
 
 IMPLSTATIC void* hashmap_get2(HashMap* map, char* key, int keylen) {
-  HashEntry* ent = get_entry(map, key, keylen);
+  return hashmap_get_hashed(map, key, keylen, hash_bytes(key, keylen));
+}
+
+// |hash| must be hash_bytes(key, keylen), e.g. as cached in an Atom.
+IMPLSTATIC void* hashmap_get_hashed(HashMap* map, char* key, int keylen, uint64_t hash) {
+  HashEntry* ent = get_entry(map, key, keylen, hash);
   return ent ? ent->val : NULL;
 }
 
+// Looks up an identifier token by its atom if it has one, so that the text
+// isn't hashed again.
+IMPLSTATIC void* hashmap_get_token(HashMap* map, Token* tok) {
+  if ((tok->kind == TK_IDENT || tok->kind == TK_KEYWORD) && tok->atom)
+    return hashmap_get_hashed(map, tok->atom->name, tok->atom->len, tok->atom->hash);
+  return hashmap_get2(map, tok->loc, tok->len);
+}
+
 IMPLSTATIC void hashmap_put(HashMap* map, char* key, void* val) {
   hashmap_put2(map, key, (int)strlen(key), val);
 }
 
 IMPLSTATIC void hashmap_put2(HashMap* map, char* key, int keylen, void* val) {
-  HashEntry* ent = get_or_insert_entry(map, key, keylen);
+  hashmap_put_hashed(map, key, keylen, hash_bytes(key, keylen), val);
+}
+
+IMPLSTATIC void hashmap_put_hashed(HashMap* map, char* key, int keylen, uint64_t hash, void* val) {
+  HashEntry* ent = get_or_insert_entry(map, key, keylen, hash);
   ent->val = val;
 }
 
@@ -135,29 +278,43 @@ IMPLSTATIC void hashmap_delete(HashMap* map, char* key) {
 }
 
 IMPLSTATIC void hashmap_delete2(HashMap* map, char* key, int keylen) {
-  HashEntry* ent = get_entry(map, key, keylen);
+  HashEntry* ent = get_entry(map, key, keylen, hash_bytes(key, keylen));
   if (ent) {
     if (map->alloc_lifetime == AL_Manual) {
       free(ent->key);
     }
-    ent->key = TOMBSTONE;
+    ent->key = NULL;
+    ent->val = NULL;
+    ctrl_bytes(map)[ent - map->buckets] = CTRL_DELETED;
+    map->used--;
+    map->deleted++;
   }
 }
 
-// keys strdup'd with AL_Manual, and values that are the data segment
-// allocations allocated by aligned_allocate.
-IMPLSTATIC void hashmap_clear_manual_key_owned_value_owned_aligned(HashMap* map) {
+// Returns the next entry in |map|, in no particular order, or NULL after the
+// last one. |*iter| should be 0 to start.
+IMPLSTATIC HashEntry* hashmap_next(HashMap* map, int* iter) {
+  for (; *iter < map->capacity; ++*iter) {
+    if (is_full(map, *iter))
+      return &map->buckets[(*iter)++];
+  }
+  return NULL;
+}
+
+// keys strdup'd with AL_Manual, and values that are malloc()d.
+IMPLSTATIC void hashmap_clear_manual_key_owned_value_owned(HashMap* map) {
   assert(map->alloc_lifetime == AL_Manual);
   for (int i = 0; i < map->capacity; i++) {
     HashEntry* ent = &map->buckets[i];
-    if (ent->key && ent->key != TOMBSTONE) {
+    if (is_full(map, i)) {
       alloc_free(ent->key, map->alloc_lifetime);
-      aligned_free(ent->val);
+      free(ent->val);
     }
   }
   alloc_free(map->buckets, map->alloc_lifetime);
   map->buckets = NULL;
   map->used = 0;
+  map->deleted = 0;
   map->capacity = 0;
 }
 
@@ -167,7 +324,7 @@ IMPLSTATIC void hashmap_clear_manual_key_owned_value_unowned(HashMap* map) {
   assert(map->alloc_lifetime == AL_Manual);
   for (int i = 0; i < map->capacity; i++) {
     HashEntry* ent = &map->buckets[i];
-    if (ent->key && ent->key != TOMBSTONE) {
+    if (is_full(map, i)) {
       alloc_free(ent->key, map->alloc_lifetime);
       // ent->val points into codeseg, not to be freed here.
     }
@@ -175,5 +332,17 @@ IMPLSTATIC void hashmap_clear_manual_key_owned_value_unowned(HashMap* map) {
   alloc_free(map->buckets, map->alloc_lifetime);
   map->buckets = NULL;
   map->used = 0;
+  map->deleted = 0;
+  map->capacity = 0;
+}
+
+// keys that are owned elsewhere (e.g. Atom names), and values that aren't
+// allocations.
+IMPLSTATIC void hashmap_clear_manual_key_unowned_value_unowned(HashMap* map) {
+  assert(map->alloc_lifetime == AL_Manual);
+  alloc_free(map->buckets, map->alloc_lifetime);
+  map->buckets = NULL;
+  map->used = 0;
+  map->deleted = 0;
   map->capacity = 0;
 }
@@ -338,53 +338,267 @@ static void* symbol_lookup(char* name) {
 #endif
 }
 
-IMPLSTATIC bool link_all_files(void) {
+static void* get_symbol(HashMap* map, Atom* name) {
+  return hashmap_get_hashed(map, name->name, name->len, name->hash);
+}
+
+// Symbols from outside of the compiled code are looked up once per context,
+// and kept along with those registered by dyibicc_register_symbols().
+static void* host_symbol_lookup(Atom* name) {
   UserContext* uc = user_context;
+  void* address = get_symbol(&uc->host_symbols, name);
+  if (!address) {
+    address = symbol_lookup(name->name);
+    if (address)
+      hashmap_put_hashed(&uc->host_symbols, name->name, name->len, name->hash, address);
+  }
+  return address;
+}
 
-  if (uc->num_files == 0)
-    return false;
+IMPLSTATIC void register_host_symbols(const char** names, void** addresses, size_t count) {
+  UserContext* uc = user_context;
+  for (size_t i = 0; i < count; ++i) {
+    Atom* name = intern((char*)names[i], (int)strlen(names[i]));
+    hashmap_put_hashed(&uc->host_symbols, name->name, name->len, name->hash, addresses[i]);
+  }
+  uc->host_symbols_registered = true;
+}
 
-  // Process fixups.
-  for (size_t i = 0; i < uc->num_files; ++i) {
-    FileLinkData* fld = &uc->files[i];
+// Stable exports are stubs of `jmp [rip+disp32]` through a table of targets
+// that's in the page following the stubs, so the stub code is written once
+// when a block is created, and retargeting is a single aligned pointer store.
+#define STABLE_STUB_SIZE 8
+
+struct StableExportBlock {
+  StableExportBlock* next;
+  char* stubs;  // Executable, and followed by |targets| at +page_size.
+  void** targets;
+  size_t capacity;
+  size_t used;
+};
+
+static void missing_stable_export(void) {
+  outaf("called a stable export that's no longer defined\n");
+  abort();
+}
+
+static StableExportBlock* new_stable_export_block(void) {
+  size_t page_size = get_page_size();
+  StableExportBlock* block = calloc(1, sizeof(StableExportBlock));
+  block->stubs = allocate_writable_memory(page_size * 2);
+  if (!block->stubs)
+    error("failed to allocate stable exports");
+  block->targets = (void**)(block->stubs + page_size);
+  block->capacity = page_size / STABLE_STUB_SIZE;
+
+  // The displacement from the end of each stub's jmp to its target slot is
+  // the same for every stub.
+  int32_t disp = (int32_t)(page_size - 6);
+  for (size_t i = 0; i < block->capacity; ++i) {
+    unsigned char* stub = (unsigned char*)block->stubs + i * STABLE_STUB_SIZE;
+    stub[0] = 0xff;
+    stub[1] = 0x25;
+    memcpy(&stub[2], &disp, sizeof(disp));
+    stub[6] = 0xcc;
+    stub[7] = 0xcc;
+    block->targets[i] = (void*)missing_stable_export;
+  }
+  if (!make_memory_executable(block->stubs, page_size))
+    error("failed to make stable exports executable");
+  return block;
+}
+
+IMPLSTATIC void* get_stable_export(char* name) {
+  UserContext* uc = user_context;
+  void** slot = hashmap_get(&uc->stable_exports, name);
+  if (slot) {
+    StableExportBlock* block = uc->stable_export_blocks;
+    while ((char*)slot < (char*)block->targets ||
+           (char*)slot >= (char*)(block->targets + block->capacity))
+      block = block->next;
+    return block->stubs + (slot - block->targets) * STABLE_STUB_SIZE;
+  }
+
+  void* target = hashmap_get(&uc->exports[uc->num_files], name);
+  if (!target)
+    return NULL;
+
+  StableExportBlock* block = uc->stable_export_blocks;
+  if (!block || block->used == block->capacity) {
+    block = new_stable_export_block();
+    block->next = uc->stable_export_blocks;
+    uc->stable_export_blocks = block;
+  }
+  size_t index = block->used++;
+  block->targets[index] = target;
+  hashmap_put(&uc->stable_exports, strdup(name), &block->targets[index]);
+  return block->stubs + index * STABLE_STUB_SIZE;
+}
+
+// Points all stable exports at the current code. A symbol that's no longer
+// exported is pointed at a function that reports the error.
+static void retarget_stable_exports(void) {
+  UserContext* uc = user_context;
+  int iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&uc->stable_exports, &iter));) {
+    void* target = hashmap_get(&uc->exports[uc->num_files], ent->key);
+    *(void* volatile*)ent->val = target ? target : (void*)missing_stable_export;
+  }
+}
+
+IMPLSTATIC void free_stable_exports(UserContext* ctx) {
+  hashmap_clear_manual_key_owned_value_unowned(&ctx->stable_exports);
+  while (ctx->stable_export_blocks) {
+    StableExportBlock* block = ctx->stable_export_blocks;
+    ctx->stable_export_blocks = block->next;
+    free_executable_memory(block->stubs, get_page_size() * 2);
+    free(block);
+  }
+}
+
+// Fixups of files that haven't been recompiled since the last link only need
+// to change if the symbol they refer to has moved. Fixups that resolve to
+// global (or host) symbols are indexed by name so that a relink can re-resolve
+// each name once and only rewrite the sites of those that moved. Fixups that
+// resolve to a file's own statics only change when that file is recompiled,
+// in which case all of its fixups are linked again anyway.
+typedef struct LinkRef {
+  int file_index;
+  int fixup_index;
+  int generation;  // Of the file when this was added, see is_live_ref().
+} LinkRef;
+
+typedef struct LinkRefs {
+  Atom* name;
+  void* address;  // What the name resolved to at the last link.
+  LinkRef* refs;
+  int len;
+  int cap;
+} LinkRefs;
+
+static bool is_live_ref(LinkRef* ref) {
+  FileLinkData* fld = &user_context->files[ref->file_index];
+  return fld->fixups_linked && fld->link_generation == ref->generation;
+}
+
+static void* resolve_global_symbol(Atom* name) {
+  UserContext* uc = user_context;
+  void* target_address = get_symbol(&uc->global_data[uc->num_files], name);
+  if (!target_address) {
+    target_address = get_symbol(&uc->exports[uc->num_files], name);
+    if (!target_address)
+      target_address = host_symbol_lookup(name);
+  }
+  return target_address;
+}
+
+static void write_fixup(LinkFixup* fixup, void* target_address) {
+  *((uintptr_t*)fixup->at) = (uintptr_t)target_address + fixup->addend;
+}
+
+// Re-resolves every indexed name, and rewrites the fixups of files that
+// haven't been recompiled for those that have moved. Names that are no longer
+// referenced by any such file are dropped.
+static bool relink_moved_symbols(void) {
+  UserContext* uc = user_context;
+  int iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&uc->link_refs, &iter));) {
+    LinkRefs* lr = ent->val;
+    int kept = 0;
+    for (int i = 0; i < lr->len; ++i) {
+      if (is_live_ref(&lr->refs[i]))
+        lr->refs[kept++] = lr->refs[i];
+    }
+    lr->len = kept;
+    if (kept == 0) {
+      free(lr->refs);
+      free(lr);
+      hashmap_delete(&uc->link_refs, ent->key);
+      continue;
+    }
 
-    if (!make_memory_readwrite(fld->codeseg_base_address, fld->codeseg_size)) {
-      outaf("failed to make %p size %zu readwrite\n", fld->codeseg_base_address, fld->codeseg_size);
+    void* target_address = resolve_global_symbol(lr->name);
+    if (!target_address) {
+      outaf("undefined symbol: %s\n", lr->name->name);
       return false;
     }
+    if (target_address == lr->address)
+      continue;
+
+    lr->address = target_address;
+    for (int i = 0; i < lr->len; ++i) {
+      LinkRef* ref = &lr->refs[i];
+      write_fixup(&uc->files[ref->file_index].fixups[ref->fixup_index], target_address);
+    }
+  }
+  return true;
+}
+
+// Resolves all the fixups of file |file_index|, adding those that refer to
+// global symbols to the index.
+static bool link_file(size_t file_index) {
+  UserContext* uc = user_context;
+  FileLinkData* fld = &uc->files[file_index];
+  ++fld->link_generation;
 
-    for (int j = 0; j < fld->flen; ++j) {
-      void* fixup_address = fld->fixups[j].at;
-      char* name = fld->fixups[j].name;
-      int addend = fld->fixups[j].addend;
+  for (int j = 0; j < fld->flen; ++j) {
+    Atom* name = fld->fixups[j].name;
 
-      void* target_address = hashmap_get(&uc->global_data[i], name);
-      if (!target_address) {
-        target_address = hashmap_get(&uc->exports[i], name);
+    void* target_address = get_symbol(&uc->global_data[file_index], name);
+    if (!target_address)
+      target_address = get_symbol(&uc->exports[file_index], name);
+    if (!target_address) {
+      LinkRefs* lr = get_symbol(&uc->link_refs, name);
+      if (!lr) {
+        target_address = resolve_global_symbol(name);
         if (!target_address) {
-          target_address = hashmap_get(&uc->global_data[uc->num_files], name);
-          if (!target_address) {
-            target_address = hashmap_get(&uc->exports[uc->num_files], name);
-            if (!target_address) {
-              target_address = symbol_lookup(name);
-              if (!target_address) {
-                outaf("undefined symbol: %s\n", name);
-                return false;
-              }
-            }
-          }
+          outaf("undefined symbol: %s\n", name->name);
+          return false;
         }
+        lr = calloc(1, sizeof(LinkRefs));
+        lr->name = name;
+        lr->address = target_address;
+        hashmap_put_hashed(&uc->link_refs, strdup(name->name), name->len, name->hash, lr);
       }
+      target_address = lr->address;
 
-      *((uintptr_t*)fixup_address) = (uintptr_t)target_address + addend;
+      if (lr->len == lr->cap) {
+        lr->cap = lr->cap ? lr->cap * 2 : 4;
+        lr->refs = realloc(lr->refs, sizeof(LinkRef) * lr->cap);
+      }
+      lr->refs[lr->len++] = (LinkRef){(int)file_index, j, fld->link_generation};
     }
 
-    if (!make_memory_executable(fld->codeseg_base_address, fld->codeseg_size)) {
-      outaf("failed to make %p size %zu executable\n", fld->codeseg_base_address,
-            fld->codeseg_size);
+    write_fixup(&fld->fixups[j], target_address);
+  }
+
+  fld->fixups_linked = true;
+  return true;
+}
+
+IMPLSTATIC void free_link_refs(UserContext* ctx) {
+  int iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&ctx->link_refs, &iter));)
+    free(((LinkRefs*)ent->val)->refs);
+  hashmap_clear_manual_key_owned_value_owned(&ctx->link_refs);
+}
+
+IMPLSTATIC bool link_all_files(void) {
+  UserContext* uc = user_context;
+
+  if (uc->num_files == 0)
+    return false;
+
+  // Process fixups. These are all in GOTs or data, so code is never written.
+  // Names are re-resolved first, so that the files being linked from scratch
+  // can use the index's addresses.
+  if (!relink_moved_symbols())
+    return false;
+  for (size_t i = 0; i < uc->num_files; ++i) {
+    if (!uc->files[i].fixups_linked && !link_file(i))
       return false;
-    }
   }
 
+  retarget_stable_exports();
   return true;
 }
@@ -104,6 +104,8 @@ DyibiccContext* dyibicc_set_environment(DyibiccEnviromentData* env_data) {
 
   // Don't currently need dyibicc_include_dir once sys_inc_paths are added to.
 
+  size_t cache_dir_len = env_data->cache_dir ? strlen(env_data->cache_dir) + 1 : 0;
+
   size_t total_source_files_len = 0;
   size_t num_files = 0;
   for (const char** p = env_data->files; *p; ++p) {
@@ -115,8 +117,10 @@ DyibiccContext* dyibicc_set_environment(DyibiccEnviromentData* env_data) {
       sizeof(UserContext) +                       // base structure
       (num_include_paths * sizeof(char*)) +       // array in base structure
       (num_files * sizeof(FileLinkData)) +        // array in base structure
+      (num_files * sizeof(DyibiccFileStats)) +    // array in base structure
       (total_include_paths_len * sizeof(char)) +  // pointed to by include_paths
       (total_source_files_len * sizeof(char)) +   // pointed to by FileLinkData.source_name
+      (cache_dir_len * sizeof(char)) +            // pointed to by cache_dir
       ((num_files + 1) * sizeof(HashMap)) +       // +1 beyond num_files for fully global dataseg
       ((num_files + 1) * sizeof(HashMap))         // +1 beyond num_files for fully global exports
       ;
@@ -126,6 +130,7 @@ DyibiccContext* dyibicc_set_environment(DyibiccEnviromentData* env_data) {
   data->load_file_contents = env_data->load_file_contents;
   if (!data->load_file_contents) {
     data->load_file_contents = default_load_file_fn;
+    data->map_source_files = true;
   }
   data->get_function_address = env_data->get_function_address;
   data->output_function = env_data->output_function;
@@ -145,6 +150,9 @@ DyibiccContext* dyibicc_set_environment(DyibiccEnviromentData* env_data) {
   data->files = (FileLinkData*)d;
   d += sizeof(FileLinkData) * num_files;
 
+  data->file_stats = (DyibiccFileStats*)d;
+  d += sizeof(DyibiccFileStats) * num_files;
+
   data->global_data = (HashMap*)d;
   d += sizeof(HashMap) * (num_files + 1);
 
@@ -165,12 +173,19 @@ DyibiccContext* dyibicc_set_environment(DyibiccEnviromentData* env_data) {
 
   i = 0;
   for (const char** p = env_data->files; *p; ++p) {
+    data->file_stats[i].name = d;
     FileLinkData* dld = &data->files[i++];
     dld->source_name = d;
     strcpy(dld->source_name, *p);
     d += strlen(*p) + 1;
   }
 
+  if (env_data->cache_dir) {
+    data->cache_dir = d;
+    strcpy(data->cache_dir, env_data->cache_dir);
+    d += cache_dir_len;
+  }
+
   // These maps store an arbitrary number of symbols, and they must persist
   // beyond AL_Link (to be saved for relink updates) so they must be manually
   // managed.
@@ -178,7 +193,19 @@ DyibiccContext* dyibicc_set_environment(DyibiccEnviromentData* env_data) {
     data->global_data[j].alloc_lifetime = AL_Manual;
     data->exports[j].alloc_lifetime = AL_Manual;
   }
+  for (size_t j = 0; j < num_files; ++j) {
+    data->files[j].includes.alloc_lifetime = AL_Manual;
+    data->files[j].function_index.alloc_lifetime = AL_Manual;
+  }
   data->reflect_types.alloc_lifetime = AL_UserContext;
+  data->atoms.alloc_lifetime = AL_UserContext;
+  data->rodata_pool.alloc_lifetime = AL_Manual;
+  data->host_symbols.alloc_lifetime = AL_UserContext;
+  data->header_snapshots.alloc_lifetime = AL_Snapshot;
+  data->file_cache.alloc_lifetime = AL_Manual;
+  data->include_path_cache.alloc_lifetime = AL_Manual;
+  data->stable_exports.alloc_lifetime = AL_Manual;
+  data->link_refs.alloc_lifetime = AL_Manual;
 
   if ((size_t)(d - (char*)data) != total_size) {
     ABORT("incorrect size calculation");
@@ -187,21 +214,48 @@ DyibiccContext* dyibicc_set_environment(DyibiccEnviromentData* env_data) {
   user_context = data;
   alloc_reset(AL_Temp);
   alloc_init(AL_UserContext);
+  alloc_init(AL_Snapshot);
+  intern_keywords();
   return (DyibiccContext*)data;
 }
 
+void dyibicc_get_stats(DyibiccContext* context, DyibiccStats* stats) {
+  UserContext* ctx = (UserContext*)context;
+  *stats = ctx->stats;
+  for (size_t i = 0; i < ctx->num_files; ++i) {
+    FileLinkData* fld = &ctx->files[i];
+    stats->code_bytes += fld->codeseg_code_size;
+    for (int j = 0; j < fld->num_patch_segments; ++j)
+      stats->code_bytes += fld->patch_segments[j].code_size;
+    stats->data_bytes += ctx->file_stats[i].data_bytes;
+  }
+  for (int i = 0; i < DYIBICC_NUM_HEAPS; ++i)
+    stats->heap_high_water[i] = alloc_high_water((AllocLifetime)i);
+  stats->num_files = ctx->num_files;
+  stats->files = ctx->file_stats;
+}
+
 void dyibicc_free(DyibiccContext* context) {
   UserContext* ctx = (UserContext*)context;
   assert(ctx == user_context && "only one context currently supported");
-  for (size_t i = 0; i < ctx->num_files + 1; ++i) {
-    hashmap_clear_manual_key_owned_value_owned_aligned(&ctx->global_data[i]);
+  free_global_data(ctx);
+  for (size_t i = 0; i < ctx->num_files + 1; ++i)
     hashmap_clear_manual_key_owned_value_unowned(&ctx->exports[i]);
+  free_file_cache(ctx);
+  free_stable_exports(ctx);
+  free_link_refs(ctx);
+  free_rodata_pool(ctx);
+  hashmap_clear_manual_key_owned_value_owned(&ctx->include_path_cache);
+  for (int i = 0; i < NUM_BUMP_HEAPS; ++i) {
+    alloc_release((AllocLifetime)i);
   }
-  alloc_reset(AL_UserContext);
 
   for (size_t i = 0; i < ctx->num_files; ++i) {
     free_link_fixups(&ctx->files[i]);
+    free_code_segments(&ctx->files[i]);
+    hashmap_clear_manual_key_owned_value_unowned(&ctx->files[i].includes);
   }
+  code_heap_release();
 #if X64WIN
   unregister_and_free_function_table_data(ctx);
 #endif
@@ -209,8 +263,78 @@ void dyibicc_free(DyibiccContext* context) {
   user_context = NULL;
 }
 
-bool dyibicc_update(DyibiccContext* context, char* filename, char* contents) {
+// Charges the time since the last phase change to the current phase, and makes
+// |phase| current. Returns the previous phase so that it can be restored.
+IMPLSTATIC DyibiccPhase stats_enter_phase(DyibiccPhase phase) {
+  double now = get_time_seconds();
+  DyibiccPhase prev = C(phase);
+  C(phase_seconds)[prev] += now - C(phase_start);
+  C(phase) = phase;
+  C(phase_start) = now;
+  return prev;
+}
+
+static void record_file_stats(UserContext* ctx, size_t file_index, bool from_cache, double start) {
+  stats_enter_phase(C(phase));
+
+  DyibiccFileStats* fs = &ctx->file_stats[file_index];
+  fs->compiled_in_last_update = true;
+  fs->loaded_from_cache = from_cache;
+  fs->patched = compiler_state.codegen__patched;
+  memcpy(fs->phase_seconds, C(phase_seconds), sizeof(fs->phase_seconds));
+  fs->total_seconds = C(phase_start) - start;
+  fs->num_tokens = compiler_state.tokenize__num_tokens;
+  fs->num_macro_expansions = compiler_state.preprocess__num_macro_expansions;
+  fs->num_nodes = compiler_state.parse__num_nodes;
+  fs->num_objs = compiler_state.parse__num_objs;
+  fs->code_bytes = compiler_state.codegen__code_bytes;
+  fs->data_bytes = compiler_state.codegen__data_bytes;
+
+  DyibiccStats* stats = &ctx->stats;
+  for (int i = 0; i < DYIBICC_NUM_PHASES; ++i)
+    stats->phase_seconds[i] += fs->phase_seconds[i];
+  ++stats->num_files_compiled;
+  stats->num_tokens += fs->num_tokens;
+  stats->num_macro_expansions += fs->num_macro_expansions;
+  stats->num_nodes += fs->num_nodes;
+  stats->num_objs += fs->num_objs;
+}
+
+// Completes the stats of an update that's failing with an error, charging the
+// time since the last phase change to whichever phase was running.
+static void record_failed_update_stats(UserContext* ctx) {
+  double now = get_time_seconds();
+  DyibiccStats* stats = &ctx->stats;
+  if (ctx->link_start) {
+    stats->phase_seconds[DYIBICC_PHASE_LINK] = now - ctx->link_start;
+  } else if (ctx->compiling_file) {
+    stats_enter_phase(C(phase));
+    for (int i = 0; i < DYIBICC_NUM_PHASES; ++i)
+      stats->phase_seconds[i] += C(phase_seconds)[i];
+  }
+  stats->update_seconds = now - ctx->update_start;
+  ctx->link_start = 0;
+  ctx->compiling_file = false;
+}
+
+// Whether the file at |dld| needs to be recompiled when |changed_path| has
+// been modified, either because it's the file itself, or because it was
+// #included (possibly indirectly) by the last compile of it. A file whose last
+// compile failed might have been missing |changed_path|, so depends on it.
+static bool depends_on(FileLinkData* dld, char* changed_path) {
+  if (dld->compile_pending)
+    return true;
+  if (strcmp(canonicalize_path(dld->source_name), changed_path) == 0)
+    return true;
+  return hashmap_get(&dld->includes, changed_path) != NULL;
+}
+
+// If |changed_path| is non-NULL, only files that depend on it are recompiled.
+// Otherwise, if |filename| is non-NULL only that file is recompiled, using
+// |contents|, and if both are NULL, all files are recompiled.
+static bool update_internal(UserContext* ctx, char* filename, char* contents, char* changed_path) {
   if (setjmp(toplevel_update_jmpbuf) != 0) {
+    record_failed_update_stats(ctx);
     codegen_free();
     alloc_reset(AL_Compile);
     alloc_reset(AL_Temp);
@@ -220,23 +344,66 @@ bool dyibicc_update(DyibiccContext* context, char* filename, char* contents) {
     return false;
   }
 
-  UserContext* ctx = (UserContext*)context;
   bool link_result = true;
 
   assert(ctx == user_context && "only one context currently supported");
 
+  ctx->update_start = get_time_seconds();
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+  for (size_t i = 0; i < ctx->num_files; ++i)
+    ctx->file_stats[i].compiled_in_last_update = false;
+  for (int i = 0; i < NUM_BUMP_HEAPS; ++i)
+    alloc_reset_high_water((AllocLifetime)i);
+
+  alloc_init(AL_Temp);
+  ctx->stat_cache = (HashMap){.alloc_lifetime = AL_Temp};
+  ctx->canonical_paths = (HashMap){.alloc_lifetime = AL_Temp};
+  if (changed_path)
+    changed_path = canonicalize_path(changed_path);
+
+  // When everything is being reloaded, any header might have changed too.
+  if (changed_path) {
+    invalidate_header_snapshots(changed_path);
+    invalidate_file_cache(changed_path);
+  } else if (!filename) {
+    invalidate_header_snapshots(NULL);
+    invalidate_file_cache(NULL);
+  }
+
+  // All the files to be compiled are marked first, so that if one fails, the
+  // ones after it are retried too.
+  for (size_t i = 0; i < ctx->num_files; ++i) {
+    FileLinkData* dld = &ctx->files[i];
+    if (changed_path) {
+      if (depends_on(dld, changed_path))
+        dld->compile_pending = true;
+    } else if (!filename || strcmp(dld->source_name, filename) == 0) {
+      // If a specific update is provided, we only compile that one.
+      dld->compile_pending = true;
+    }
+  }
+
   bool compiled_any = false;
   {
     for (size_t i = 0; i < ctx->num_files; ++i) {
       FileLinkData* dld = &ctx->files[i];
 
-      if (filename && strcmp(dld->source_name, filename) != 0) {
-        // If a specific update is provided, we only compile that one.
+      if (!dld->compile_pending)
+        continue;
+      // A file that failed earlier isn't retried by an update of another one,
+      // as |contents| are only for |filename|.
+      if (filename && strcmp(dld->source_name, filename) != 0)
         continue;
-      }
 
       {
         alloc_init(AL_Compile);
+        double file_start = C(phase_start) = get_time_seconds();
+        C(phase) = DYIBICC_PHASE_PREPROCESS;
+        ctx->compiling_file = true;
+
+        // Rebuilt from scratch as the file is preprocessed below.
+        hashmap_clear_manual_key_owned_value_unowned(&dld->includes);
+        compiler_state.preprocess__include_deps = &dld->includes;
 
         init_macros();
         C(base_file) = dld->source_name;
@@ -248,33 +415,81 @@ bool dyibicc_update(DyibiccContext* context, char* filename, char* contents) {
         }
         if (!tok)
           error("%s: %s", C(base_file), strerror(errno));
-        tok = preprocess(tok);
+        tok = preprocess_file(tok);
         tok = add_container_instantiations(tok);
 
-        codegen_init();  // Initializes dynasm so that parse() can assign labels.
+        // All of the file's fixups are recreated (or partly retained) below, so
+        // have to be linked again.
+        dld->fixups_linked = false;
+
+        stats_enter_phase(DYIBICC_PHASE_CODEGEN);
+        bool from_cache = cache_load(tok, i);
+        if (!from_cache) {
+          stats_enter_phase(DYIBICC_PHASE_PARSE);
+          codegen_init();  // Initializes dynasm so that parse() can assign labels.
 
-        Obj* prog = parse(tok);
-        codegen(prog, i);
+          Obj* prog = parse(tok);
+          stats_enter_phase(DYIBICC_PHASE_CODEGEN);
+          codegen(prog, i);
+        }
 
+        record_file_stats(ctx, i, from_cache, file_start);
+        ctx->compiling_file = false;
         compiled_any = true;
+        dld->compile_pending = false;
 
         alloc_reset(AL_Compile);
       }
     }
 
-    if (compiled_any) {
+    // Newly registered symbols are picked up by relinking, even if nothing
+    // was compiled, and files that a failed link didn't finish are retried.
+    bool link_pending = compiled_any || ctx->host_symbols_registered;
+    for (size_t i = 0; i < ctx->num_files; ++i)
+      link_pending |= !ctx->files[i].fixups_linked;
+    if (link_pending) {
       alloc_init(AL_Link);
 
+      ctx->link_start = get_time_seconds();
       link_result = link_all_files();
+      if (link_result)
+        ctx->host_symbols_registered = false;
+      ctx->stats.phase_seconds[DYIBICC_PHASE_LINK] = get_time_seconds() - ctx->link_start;
+      ctx->link_start = 0;
 
       alloc_reset(AL_Link);
     }
   }
 
+  alloc_reset(AL_Temp);
+  ctx->stats.update_seconds = get_time_seconds() - ctx->update_start;
   return link_result;
 }
 
+bool dyibicc_update(DyibiccContext* context, char* filename, char* contents) {
+  return update_internal((UserContext*)context, filename, contents, NULL);
+}
+
+bool dyibicc_update_changed(DyibiccContext* context, const char* path) {
+  return update_internal((UserContext*)context, NULL, NULL, (char*)path);
+}
+
 void* dyibicc_find_export(DyibiccContext* context, char* name) {
   UserContext* ctx = (UserContext*)context;
   return hashmap_get(&ctx->exports[ctx->num_files], name);
 }
+
+void dyibicc_register_symbols(DyibiccContext* context,
+                              const char** names,
+                              void** addresses,
+                              size_t count) {
+  (void)context;
+  assert((UserContext*)context == user_context && "only one context currently supported");
+  register_host_symbols(names, addresses, count);
+}
+
+void* dyibicc_find_stable_export(DyibiccContext* context, char* name) {
+  (void)context;
+  assert((UserContext*)context == user_context && "only one context currently supported");
+  return get_stable_export(name);
+}
@@ -141,7 +141,7 @@ static void leave_scope(void) {
 // Find a variable by name.
 static VarScope* find_var(Token* tok) {
   for (Scope* sc = C(scope); sc; sc = sc->next) {
-    VarScope* sc2 = hashmap_get2(&sc->vars, tok->loc, tok->len);
+    VarScope* sc2 = hashmap_get_token(&sc->vars, tok);
     if (sc2)
       return sc2;
   }
@@ -150,7 +150,7 @@ static VarScope* find_var(Token* tok) {
 
 static Type* find_tag(Token* tok) {
   for (Scope* sc = C(scope); sc; sc = sc->next) {
-    Type* ty = hashmap_get2(&sc->tags, tok->loc, tok->len);
+    Type* ty = hashmap_get_token(&sc->tags, tok);
     if (ty)
       return ty;
   }
@@ -159,6 +159,7 @@ static Type* find_tag(Token* tok) {
 
 static Node* new_node(NodeKind kind, Token* tok) {
   Node* node = bumpcalloc(1, sizeof(Node), AL_Compile);
+  ++C(num_nodes);
   node->kind = kind;
   node->tok = tok;
   return node;
@@ -278,6 +279,7 @@ static Initializer* new_initializer(Type* ty, bool is_flexible, Token* err_tok)
 
 static Obj* new_var(char* name, Type* ty) {
   Obj* var = bumpcalloc(1, sizeof(Obj), AL_Compile);
+  ++C(num_objs);
   var->name = name;
   var->ty = ty;
   var->align = ty->align;
@@ -303,6 +305,11 @@ static Obj* new_gvar(char* name, Type* ty) {
 }
 
 static char* new_unique_name(void) {
+  // Inside a function body, names are numbered per function rather than per
+  // file so that they're stable across updates that only change other
+  // functions. This allows code for unchanged functions to be reused.
+  if (C(current_fn) && C(scope)->next)
+    return format(AL_Compile, "L..%s.%d", C(current_fn)->name, C(fn_unique_name_id)++);
   return format(AL_Compile, "L..%d", C(unique_name_id)++);
 }
 
@@ -320,7 +327,8 @@ static Obj* new_string_literal(char* p, Type* ty) {
 static char* get_ident(Token* tok) {
   if (tok->kind != TK_IDENT)
     error_tok(tok, "expected an identifier");
-  return bumpstrndup(tok->loc, tok->len, AL_Compile);
+  // Interned, so names used as keys can be matched by pointer.
+  return tok->atom ? tok->atom->name : bumpstrndup(tok->loc, tok->len, AL_Compile);
 }
 
 static Type* find_typedef(Token* tok) {
@@ -333,7 +341,8 @@ static Type* find_typedef(Token* tok) {
 }
 
 static void push_tag_scope(Token* tok, Type* ty) {
-  hashmap_put2(&C(scope)->tags, tok->loc, tok->len, ty);
+  Atom* atom = tok->atom ? tok->atom : intern(tok->loc, tok->len);
+  hashmap_put_hashed(&C(scope)->tags, atom->name, atom->len, atom->hash, ty);
 }
 
 // declspec = ("void" | "_Bool" | "char" | "short" | "int" | "long"
@@ -1576,7 +1585,7 @@ static bool is_typename(Token* tok) {
       hashmap_put(&C(typename_map), kw[i], (void*)1);
   }
 
-  return hashmap_get2(&C(typename_map), tok->loc, tok->len) || find_typedef(tok);
+  return hashmap_get_token(&C(typename_map), tok) || find_typedef(tok);
 }
 
 // asm-stmt = "asm" ("volatile" | "inline")* "(" string-literal ")"
@@ -2776,7 +2785,7 @@ static Type* struct_union_decl(Token** rest, Token* tok) {
   if (tag) {
     // If this is a redefinition, overwrite a previous type.
     // Otherwise, register the struct type.
-    Type* ty2 = hashmap_get2(&C(scope)->tags, tag->loc, tag->len);
+    Type* ty2 = hashmap_get_token(&C(scope)->tags, tag);
     if (ty2) {
       if (ty2->size >= 0)
         error_tok(tag, "redefinition of type");
@@ -3572,7 +3581,7 @@ static Node* primary(Token** rest, Token* tok) {
     Node* node;
     if (is_flonum(tok->ty)) {
       node = new_node(ND_NUM, tok);
-      node->fval = tok->fval;
+      node->fval = *tok->fval;
     } else {
       node = new_num(tok->val, tok);
     }
@@ -3691,6 +3700,7 @@ static Token* function(Token* tok, Type* basety, VarAttr* attr) {
     return tok;
 
   C(current_fn) = fn;
+  C(fn_unique_name_id) = 0;
   C(locals) = NULL;
   enter_scope();
   create_param_lvars(ty->params);
@@ -3716,6 +3726,7 @@ static Token* function(Token* tok, Type* basety, VarAttr* attr) {
 #endif
   fn->alloca_bottom = new_lvar("__alloca_size__", pointer_to(ty_char));
 
+  Token* body_start = tok;
   tok = skip(tok, "{");
 
   // [https://www.sigbus.info/n1570#6.4.2.2p1] "__func__" is
@@ -3732,6 +3743,10 @@ static Token* function(Token* tok, Type* basety, VarAttr* attr) {
   fn->locals = C(locals);
   leave_scope();
   resolve_goto_labels();
+
+  fn->content_hash = hash_tokens(FNV_OFFSET_BASIS, body_start, tok);
+  tokenptrarray_push(&C(function_bodies), body_start, AL_Compile);
+  tokenptrarray_push(&C(function_bodies), tok, AL_Compile);
   return tok;
 }
 
@@ -3805,6 +3820,24 @@ static void scan_globals(void) {
   C(globals) = head.next;
 }
 
+// Hashes everything in the translation unit except for function bodies, i.e.
+// all declarations, types, and function signatures. If this is unchanged, a
+// function whose body is unchanged will generate the same code.
+static uint64_t hash_toplevel_tokens(Token* tok) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  int i = 0;
+  while (tok->kind != TK_EOF) {
+    if (i < C(function_bodies).len && tok == C(function_bodies).data[i]) {
+      tok = C(function_bodies).data[i + 1];
+      i += 2;
+      continue;
+    }
+    hash = hash_tokens(hash, tok, tok->next);
+    tok = tok->next;
+  }
+  return hash;
+}
+
 static void declare_builtin_functions(void) {
   Type* ty = func_type(pointer_to(ty_void));
   ty->params = copy_type(ty_int);
@@ -3814,13 +3847,14 @@ static void declare_builtin_functions(void) {
 
 // program = (typedef | function-definition | global-variable)*
 IMPLSTATIC Obj* parse(Token* tok) {
+  Token* start = tok;
   C(scope) = &C(empty_scope);
 
   declare_builtin_functions();
   C(globals) = NULL;
 
   while (tok->kind != TK_EOF) {
-    // logerr("%s:%d\n", tok->filename, tok->line_no);
+    // logerr("%s:%d\n", tok->file->display_name, tok->line_no);
     VarAttr attr = {0};
     Type* basety = declspec(&tok, tok, &attr);
 
@@ -3846,5 +3880,7 @@ IMPLSTATIC Obj* parse(Token* tok) {
 
   // Remove redundant tentative definitions.
   scan_globals();
+
+  C(toplevel_hash) = hash_toplevel_tokens(start);
   return C(globals);
 }
@@ -48,6 +48,7 @@ typedef Token* macro_handler_fn(Macro* mac, Token*);
 
 struct Macro {
   char* name;
+  Atom* atom;  // Interned |name|, for hidesets.
   bool is_objlike;  // Object-like or function-like
   MacroParam* params;
   char* va_args_name;
@@ -64,10 +65,14 @@ struct CondIncl {
   bool included;
 };
 
+// A set of macro names, as an array of atoms sorted by id. Hidesets are
+// hash-consed, so there's a single instance of each distinct set in a compile,
+// which lets unions and intersections be memoized by pointer. NULL is the
+// empty set.
 typedef struct Hideset Hideset;
 struct Hideset {
-  Hideset* next;
-  char* name;
+  int len;
+  Atom* atoms[];
 };
 
 static Token* preprocess2(Token* tok);
@@ -88,6 +93,10 @@ static Token* skip_line(Token* tok) {
   return tok;
 }
 
+static Hideset* token_hideset(Token* tok) {
+  return tok->expansion ? tok->expansion->hideset : NULL;
+}
+
 static Token* copy_token(Token* tok) {
   Token* t = bumpcalloc(1, sizeof(Token), AL_Compile);
   *t = *tok;
@@ -99,70 +108,176 @@ static Token* new_eof(Token* tok) {
   Token* t = copy_token(tok);
   t->kind = TK_EOF;
   t->len = 0;
+  t->atom = NULL;
   return t;
 }
 
-static Hideset* new_hideset(char* name) {
-  Hideset* hs = bumpcalloc(1, sizeof(Hideset), AL_Compile);
-  hs->name = name;
+static Hideset* intern_hideset(Atom** atoms, int len) {
+  if (len == 0)
+    return NULL;
+
+  int keylen = len * (int)sizeof(Atom*);
+  Hideset* hs = hashmap_get2(&C(hidesets), (char*)atoms, keylen);
+  if (hs)
+    return hs;
+
+  hs = bumpcalloc(1, sizeof(Hideset) + keylen, AL_Compile);
+  hs->len = len;
+  memcpy(hs->atoms, atoms, keylen);
+  hashmap_put2(&C(hidesets), (char*)hs->atoms, keylen, hs);
   return hs;
 }
 
+static Hideset* new_hideset(Atom* atom) {
+  return intern_hideset(&atom, 1);
+}
+
+static Hideset* get_memoized_hideset(HashMap* map, Hideset* hs1, Hideset* hs2) {
+  Hideset* key[2] = {hs1, hs2};
+  return hashmap_get2(map, (char*)key, sizeof(key));
+}
+
+static void put_memoized_hideset(HashMap* map, Hideset* hs1, Hideset* hs2, Hideset* result) {
+  Hideset** key = bumpcalloc(2, sizeof(Hideset*), AL_Compile);
+  key[0] = hs1;
+  key[1] = hs2;
+  hashmap_put2(map, (char*)key, 2 * sizeof(Hideset*), result);
+}
+
 static Hideset* hideset_union(Hideset* hs1, Hideset* hs2) {
-  Hideset head = {0};
-  Hideset* cur = &head;
+  if (!hs1 || hs1 == hs2)
+    return hs2;
+  if (!hs2)
+    return hs1;
+
+  Hideset* hs = get_memoized_hideset(&C(hideset_unions), hs1, hs2);
+  if (hs)
+    return hs;
+
+  // Merge the two sorted arrays.
+  Atom** atoms = bumpcalloc(hs1->len + hs2->len, sizeof(Atom*), AL_Compile);
+  int i = 0, j = 0, n = 0;
+  while (i < hs1->len && j < hs2->len) {
+    if (hs1->atoms[i]->id < hs2->atoms[j]->id) {
+      atoms[n++] = hs1->atoms[i++];
+    } else if (hs1->atoms[i]->id > hs2->atoms[j]->id) {
+      atoms[n++] = hs2->atoms[j++];
+    } else {
+      atoms[n++] = hs1->atoms[i++];
+      j++;
+    }
+  }
+  while (i < hs1->len)
+    atoms[n++] = hs1->atoms[i++];
+  while (j < hs2->len)
+    atoms[n++] = hs2->atoms[j++];
 
-  for (; hs1; hs1 = hs1->next)
-    cur = cur->next = new_hideset(hs1->name);
-  cur->next = hs2;
-  return head.next;
+  hs = intern_hideset(atoms, n);
+  put_memoized_hideset(&C(hideset_unions), hs1, hs2, hs);
+  return hs;
 }
 
-static bool hideset_contains(Hideset* hs, char* s, int len) {
-  for (; hs; hs = hs->next)
-    if (strlen(hs->name) == (size_t)len && !strncmp(hs->name, s, len))
-      return true;
-  return false;
+static bool hideset_contains(Hideset* hs, Atom* atom) {
+  if (!hs)
+    return false;
+  int lo = 0;
+  int hi = hs->len;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (hs->atoms[mid]->id < atom->id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < hs->len && hs->atoms[lo] == atom;
 }
 
 static Hideset* hideset_intersection(Hideset* hs1, Hideset* hs2) {
-  Hideset head = {0};
-  Hideset* cur = &head;
+  if (!hs1 || !hs2)
+    return NULL;
+  if (hs1 == hs2)
+    return hs1;
+
+  // An empty result isn't memoized, but is cheap to compute again.
+  Hideset* hs = get_memoized_hideset(&C(hideset_intersections), hs1, hs2);
+  if (hs)
+    return hs;
+
+  Atom** atoms = bumpcalloc(MIN(hs1->len, hs2->len), sizeof(Atom*), AL_Compile);
+  int i = 0, j = 0, n = 0;
+  while (i < hs1->len && j < hs2->len) {
+    if (hs1->atoms[i]->id < hs2->atoms[j]->id) {
+      i++;
+    } else if (hs1->atoms[i]->id > hs2->atoms[j]->id) {
+      j++;
+    } else {
+      atoms[n++] = hs1->atoms[i++];
+      j++;
+    }
+  }
 
-  for (; hs1; hs1 = hs1->next)
-    if (hideset_contains(hs2, hs1->name, (int)strlen(hs1->name)))
-      cur = cur->next = new_hideset(hs1->name);
-  return head.next;
+  hs = intern_hideset(atoms, n);
+  if (hs)
+    put_memoized_hideset(&C(hideset_intersections), hs1, hs2, hs);
+  return hs;
 }
 
-static Token* add_hideset(Token* tok, Hideset* hs) {
+// Builds the expansion of a macro in front of |rest|: each token of |tok| has
+// |hs| added to its hideset and |origin| set. The tokens are copied, unless
+// |in_place|, in which case |tok| must be a list that was just created for this
+// expansion and isn't referenced elsewhere (e.g. the result of subst()).
+static Token* splice_expansion(Token* tok,
+                               Hideset* hs,
+                               Token* origin,
+                               Token* rest,
+                               bool in_place) {
   Token head = {0};
   Token* cur = &head;
 
-  for (; tok; tok = tok->next) {
-    Token* t = copy_token(tok);
-    t->hideset = hideset_union(t->hideset, hs);
+  // Runs of tokens usually share a hideset, so they can share an Expansion too.
+  Hideset* last_in = NULL;
+  Expansion* last_out = NULL;
+
+  for (; tok->kind != TK_EOF; tok = tok->next) {
+    Token* t = in_place ? tok : copy_token(tok);
+    Hideset* t_hs = token_hideset(t);
+    if (!last_out || t_hs != last_in) {
+      last_in = t_hs;
+      last_out = bumpcalloc(1, sizeof(Expansion), AL_Compile);
+      last_out->hideset = hideset_union(t_hs, hs);
+      last_out->origin = origin;
+    }
+    t->expansion = last_out;
     cur = cur->next = t;
   }
+  cur->next = rest;
   return head.next;
 }
 
-// Append tok2 to the end of tok1.
-static Token* append(Token* tok1, Token* tok2) {
+// Links |tok2| after the last non-EOF token of |tok1|, without copying. |tok1|
+// must be a list that isn't referenced from anywhere else, such as the tokens
+// just read from an #include. If the end of |tok1| hasn't been tokenized yet,
+// |tok2| is linked once it is, by resume_tokenizing().
+static Token* splice(Token* tok1, Token* tok2) {
   if (tok1->kind == TK_EOF)
     return tok2;
 
-  Token head = {0};
-  Token* cur = &head;
-
-  for (; tok1->kind != TK_EOF; tok1 = tok1->next)
-    cur = cur->next = copy_token(tok1);
-  cur->next = tok2;
-  return head.next;
+  Token* last = tok1;
+  while (last->next->kind != TK_EOF && last->next->kind != TK_LAZY)
+    last = last->next;
+  if (last->next->kind == TK_LAZY)
+    last->next->next = tok2;
+  else
+    last->next = tok2;
+  return tok1;
 }
 
 static Token* skip_cond_incl2(Token* tok) {
   while (tok->kind != TK_EOF) {
+    if (tok->kind == TK_LAZY) {
+      skip_conditional_text(tok, false);
+      continue;
+    }
     if (is_hash(tok) &&
         (equal(tok->next, "if") || equal(tok->next, "ifdef") || equal(tok->next, "ifndef"))) {
       tok = skip_cond_incl2(tok->next->next);
@@ -179,6 +294,10 @@ static Token* skip_cond_incl2(Token* tok) {
 // Nested `#if` and `#endif` are skipped.
 static Token* skip_cond_incl(Token* tok) {
   while (tok->kind != TK_EOF) {
+    if (tok->kind == TK_LAZY) {
+      skip_conditional_text(tok, true);
+      continue;
+    }
     if (is_hash(tok) &&
         (equal(tok->next, "if") || equal(tok->next, "ifdef") || equal(tok->next, "ifndef"))) {
       tok = skip_cond_incl2(tok->next->next);
@@ -317,12 +436,13 @@ static CondIncl* push_cond_incl(Token* tok, bool included) {
 static Macro* find_macro(Token* tok) {
   if (tok->kind != TK_IDENT)
     return NULL;
-  return hashmap_get2(&C(macros), tok->loc, tok->len);
+  return hashmap_get_token(&C(macros), tok);
 }
 
 static Macro* add_macro(char* name, bool is_objlike, Token* body) {
   Macro* m = bumpcalloc(1, sizeof(Macro), AL_Compile);
   m->name = name;
+  m->atom = intern(name, (int)strlen(name));
   m->is_objlike = is_objlike;
   m->body = body;
   hashmap_put(&C(macros), name, m);
@@ -365,7 +485,7 @@ static MacroParam* read_macro_params(Token** rest, Token* tok, char** va_args_na
 static Macro* read_macro_definition(Token** rest, Token* tok) {
   if (tok->kind != TK_IDENT)
     error_tok(tok, "macro name must be an identifier");
-  char* name = bumpstrndup(tok->loc, tok->len, AL_Compile);
+  char* name = tok->atom->name;
   tok = tok->next;
 
   if (!tok->has_space && equal(tok, "(")) {
@@ -389,6 +509,10 @@ static MacroArg* read_macro_arg_one(Token** rest, Token* tok, bool read_rest) {
   int level = 0;
 
   for (;;) {
+    if (tok->kind == TK_LAZY) {
+      resume_tokenizing(tok);
+      continue;
+    }
     if (level == 0 && equal(tok, ")"))
       break;
     if (level == 0 && !read_rest && equal(tok, ","))
@@ -635,26 +759,22 @@ static bool file_exists_in_builtins(char* path) {
 }
 
 static bool file_exists(char* path) {
-  struct stat st;
-
   if (file_exists_in_builtins(path))
     return true;
 
-  return !stat(path, &st);
+  return stat_file(path)->exists;
 }
 
 // If tok is a macro, expand it and return true.
 // Otherwise, do nothing and return false.
 static bool expand_macro(Token** rest, Token* tok) {
-  if (hideset_contains(tok->hideset, tok->loc, tok->len))
-    return false;
-
   Macro* m = find_macro(tok);
-  if (!m)
+  if (!m || hideset_contains(token_hideset(tok), m->atom))
     return false;
 
   // Built-in dynamic macro application such as __LINE__
   if (m->handler) {
+    ++C(num_macro_expansions);
     *rest = m->handler(m, tok);
     if (!m->handler_advances) {
       (*rest)->next = tok->next;
@@ -664,11 +784,9 @@ static bool expand_macro(Token** rest, Token* tok) {
 
   // Object-like macro application
   if (m->is_objlike) {
-    Hideset* hs = hideset_union(tok->hideset, new_hideset(m->name));
-    Token* body = add_hideset(m->body, hs);
-    for (Token* t = body; t->kind != TK_EOF; t = t->next)
-      t->origin = tok;
-    *rest = append(body, tok->next);
+    ++C(num_macro_expansions);
+    Hideset* hs = hideset_union(token_hideset(tok), new_hideset(m->atom));
+    *rest = splice_expansion(m->body, hs, tok, tok->next, false);
     (*rest)->at_bol = tok->at_bol;
     (*rest)->has_space = tok->has_space;
     return true;
@@ -680,6 +798,7 @@ static bool expand_macro(Token** rest, Token* tok) {
     return false;
 
   // Function-like macro application
+  ++C(num_macro_expansions);
   Token* macro_token = tok;
   MacroArg* args = read_macro_args(&tok, tok, m->params, m->va_args_name);
   Token* rparen = tok;
@@ -689,33 +808,44 @@ static bool expand_macro(Token** rest, Token* tok) {
   // for the new tokens should be. We take the interesection of the
   // macro token and the closing parenthesis and use it as a new hideset
   // as explained in the Dave Prossor's algorithm.
-  Hideset* hs = hideset_intersection(macro_token->hideset, rparen->hideset);
-  hs = hideset_union(hs, new_hideset(m->name));
+  Hideset* hs = hideset_intersection(token_hideset(macro_token), token_hideset(rparen));
+  hs = hideset_union(hs, new_hideset(m->atom));
 
   Token* body = subst(m->body, args);
-  body = add_hideset(body, hs);
-  for (Token* t = body; t->kind != TK_EOF; t = t->next)
-    t->origin = macro_token;
-  *rest = append(body, tok->next);
+  *rest = splice_expansion(body, hs, macro_token, tok->next, true);
   (*rest)->at_bol = macro_token->at_bol;
   (*rest)->has_space = macro_token->has_space;
   return true;
 }
 
+// Where an #include name was last found, kept across updates in
+// UserContext.include_path_cache.
+typedef struct ResolvedInclude {
+  int next_idx;
+  char path[];
+} ResolvedInclude;
+
 IMPLSTATIC char* search_include_paths(char* filename) {
   if (filename[0] == '/')
     return filename;
 
-  char* cached = hashmap_get(&C(include_path_cache), filename);
-  if (cached)
-    return cached;
+  ResolvedInclude* cached = hashmap_get(&user_context->include_path_cache, filename);
+  if (cached && file_exists(cached->path)) {
+    C(include_next_idx) = cached->next_idx;
+    return bumpstrdup(cached->path, AL_Compile);
+  }
 
   // Search a file from the include paths.
   for (int i = 0; i < (int)user_context->num_include_paths; i++) {
     char* path = format(AL_Compile, "%s/%s", user_context->include_paths[i], filename);
     if (!file_exists(path))
       continue;
-    hashmap_put(&C(include_path_cache), filename, path);
+    size_t len = strlen(path);
+    ResolvedInclude* ri = malloc(sizeof(ResolvedInclude) + len + 1);
+    ri->next_idx = i + 1;
+    memcpy(ri->path, path, len + 1);
+    free(cached);
+    hashmap_put(&user_context->include_path_cache, strdup(filename), ri);
     C(include_next_idx) = i + 1;
     return path;
   }
@@ -791,28 +921,33 @@ static char* detect_include_guard(Token* tok) {
   char* macro = bumpstrndup(tok->loc, tok->len, AL_Compile);
   tok = tok->next;
 
-  if (!is_hash(tok) || !equal(tok->next, "define") || !equal(tok->next->next, macro))
+  // The rest of the file follows the #ifndef line untokenized, so the end of
+  // the file can be checked without tokenizing all of it.
+  if (tok->kind != TK_LAZY || !conditional_ends_file(tok))
     return NULL;
 
-  // Read until the end of the file.
-  while (tok->kind != TK_EOF) {
-    if (!is_hash(tok)) {
-      tok = tok->next;
-      continue;
-    }
+  resume_tokenizing(tok);
+  if (!is_hash(tok) || !equal(tok->next, "define") || !equal(tok->next->next, macro))
+    return NULL;
+  return macro;
+}
 
-    if (equal(tok->next, "endif") && tok->next->next->kind == TK_EOF)
-      return macro;
+// Remember that the file currently being compiled depends on `path`, so that
+// a later change to `path` recompiles it.
+static void record_include_dependency(char* path) {
+  if (!C(include_deps))
+    return;
 
-    if (equal(tok, "if") || equal(tok, "ifdef") || equal(tok, "ifndef"))
-      tok = skip_cond_incl(tok->next);
-    else
-      tok = tok->next;
-  }
-  return NULL;
+  char* canonical = canonicalize_path(path);
+  if (!hashmap_get(C(include_deps), canonical))
+    hashmap_put(C(include_deps), strdup(canonical), (void*)1);
+  if (C(capturing_snapshot))
+    strarray_push(&C(snapshot_includes), canonical, AL_Compile);
 }
 
 static Token* include_file(Token* tok, char* path, Token* filename_tok) {
+  record_include_dependency(path);
+
   // Check for "#pragma once"
   if (hashmap_get(&C(pragma_once), path))
     return tok;
@@ -838,7 +973,7 @@ static Token* include_file(Token* tok, char* path, Token* filename_tok) {
   if (guard_name)
     hashmap_put(&C(include_guards), path, guard_name);
 
-  return append(tok2, tok);
+  return splice(tok2, tok);
 }
 
 // Read #line arguments
@@ -849,7 +984,15 @@ static void read_line_marker(Token** rest, Token* tok) {
 
   if (tok->kind != TK_NUM || tok->ty->kind != TY_INT)
     error_tok(tok, "invalid line marker");
-  start->file->line_delta = (int)(tok->val - start->line_no);
+  // The tokens that follow are moved to a copy of the File that has the values
+  // in effect from here on. The File itself is left alone, as tokens that were
+  // already passed through still refer to it.
+  File* file = start->file;
+  File* presumed = bumpcalloc(1, sizeof(File), AL_Compile);
+  *presumed = file->presumed ? *file->presumed : *file;
+  presumed->line_delta = (int)(tok->val - start->line_no);
+  presumed->presumed = NULL;
+  file->presumed = presumed;
 
   tok = tok->next;
   if (tok->kind == TK_EOF)
@@ -857,7 +1000,7 @@ static void read_line_marker(Token** rest, Token* tok) {
 
   if (tok->kind != TK_STR)
     error_tok(tok, "filename expected");
-  start->file->display_name = tok->str;
+  presumed->display_name = tok->str;
 }
 
 // Visit all tokens in `tok` while evaluating preprocessing
@@ -867,14 +1010,19 @@ static Token* preprocess2(Token* tok) {
   Token* cur = &head;
 
   while (tok->kind != TK_EOF) {
+    if (tok->kind == TK_LAZY) {
+      resume_tokenizing(tok);
+      continue;
+    }
+
     // If it is a macro, expand it.
     if (expand_macro(&tok, tok))
       continue;
 
     // Pass through if it is not a "#".
     if (!is_hash(tok)) {
-      tok->line_delta = tok->file->line_delta;
-      tok->filename = tok->file->display_name;
+      if (tok->file->presumed)
+        tok->file = tok->file->presumed;
       cur = cur->next = tok;
       tok = tok->next;
       continue;
@@ -937,6 +1085,8 @@ static Token* preprocess2(Token* tok) {
       if (tok->next->kind == TK_EOF) {
         error_tok(tok, "unterminated #ifdef");
       }
+      if (tok->next->at_bol)
+        error_tok(tok, "no macro name given in #ifdef directive");
       tok = skip_line(tok->next->next);
       if (!defined)
         tok = skip_cond_incl(tok);
@@ -949,6 +1099,8 @@ static Token* preprocess2(Token* tok) {
       if (tok->next->kind == TK_EOF) {
         error_tok(tok, "unterminated #ifndef");
       }
+      if (tok->next->at_bol)
+        error_tok(tok, "no macro name given in #ifndef directive");
       tok = skip_line(tok->next->next);
       if (defined)
         tok = skip_cond_incl(tok);
@@ -1046,18 +1198,29 @@ static Macro* add_builtin(char* name, macro_handler_fn* fn) {
   return m;
 }
 
+// The token that was expanded to eventually produce |tok|.
+static Token* root_origin(Token* tok) {
+  while (tok->expansion)
+    tok = tok->expansion->origin;
+  return tok;
+}
+
+// The File as changed by any #line directives, for tokens that haven't been
+// passed through yet.
+static File* presumed_file(Token* tok) {
+  return tok->file->presumed ? tok->file->presumed : tok->file;
+}
+
 static Token* file_macro(Macro* m, Token* tmpl) {
   (void)m;
-  while (tmpl->origin)
-    tmpl = tmpl->origin;
-  return new_str_token(tmpl->file->display_name, tmpl);
+  tmpl = root_origin(tmpl);
+  return new_str_token(presumed_file(tmpl)->display_name, tmpl);
 }
 
 static Token* line_macro(Macro* m, Token* tmpl) {
   (void)m;
-  while (tmpl->origin)
-    tmpl = tmpl->origin;
-  int i = tmpl->line_no + tmpl->file->line_delta;
+  tmpl = root_origin(tmpl);
+  int i = tmpl->line_no + presumed_file(tmpl)->line_delta;
   return new_num_token(i, tmpl);
 }
 
@@ -1077,6 +1240,7 @@ static Token* timestamp_macro(Macro* m, Token* tmpl) {
 
 static Token* base_file_macro(Macro* m, Token* tmpl) {
   (void)m;
+  C(expanded_base_file) = true;
   return new_str_token(compiler_state.main__base_file, tmpl);
 }
 
@@ -1135,6 +1299,7 @@ static Token* container_vec_setup(Macro* m, Token* tok) {
 
   char* key = format(AL_Compile, "type:vec,arg:%s", key_as_ident);
   if (!hashmap_get(&C(container_included), key)) {
+    DyibiccPhase prev_phase = stats_enter_phase(DYIBICC_PHASE_CONTAINERS);
     append_to_container_tokens(preprocess(
         tokenize(new_file(tok->file->name, format(AL_Compile,
                                                   "#define __dyibicc_internal_include__ 1\n"
@@ -1145,6 +1310,7 @@ static Token* container_vec_setup(Macro* m, Token* tok) {
                                                   key_as_arg, key_as_ident)))));
 
     hashmap_put(&C(container_included), key, (void*)1);
+    stats_enter_phase(prev_phase);
   }
 
   Token* ret = tokenize(new_file(tok->file->name, format(AL_Compile, "_Vec$%s", key_as_ident)));
@@ -1164,6 +1330,7 @@ static Token* container_map_setup(Macro* m, Token* tok) {
   char* key = format(AL_Compile, "type:map,arg:%s,arg:%s", key_as_ident, val_as_ident);
 
   if (!hashmap_get(&C(container_included), key)) {
+    DyibiccPhase prev_phase = stats_enter_phase(DYIBICC_PHASE_CONTAINERS);
     append_to_container_tokens(preprocess(tokenize(
         new_file(tok->file->name, format(AL_Compile,
                                          "#define __dyibicc_internal_include__ 1\n"
@@ -1175,6 +1342,7 @@ static Token* container_map_setup(Macro* m, Token* tok) {
                                          key_as_arg, val_as_arg, key_as_ident, val_as_ident)))));
 
     hashmap_put(&C(container_included), key, (void*)1);
+    stats_enter_phase(prev_phase);
   }
 
   Token* ret = tokenize(
@@ -1364,19 +1532,356 @@ static void join_adjacent_string_literals(Token* tok) {
   }
 }
 
-// Entry point function of the preprocessor.
-IMPLSTATIC Token* preprocess(Token* tok) {
-  tok = preprocess2(tok);
+//
+// Header snapshots
+//
+// Most files start with the same run of `#include <...>` lines for system
+// headers. The result of preprocessing such a prefix (the output tokens, and
+// the macro, include guard, and #pragma once tables) is captured the first
+// time it's seen, and later files that start with the same includes restore
+// it rather than reading, tokenizing, and expanding the headers again.
+//
+// Snapshots are never modified once captured. Restored tokens are copied,
+// and restored macros are shared as expansion always copies the body.
+//
+
+// Once snapshots use this much memory, they're all discarded before
+// capturing another.
+#define MAX_SNAPSHOT_BYTES (128 << 20)
+
+typedef struct HeaderSnapshot {
+  Token* tokens;  // Output of preprocess2() for the prefix, ending with TK_EOF.
+  HashMap macros;
+  HashMap include_guards;
+  HashMap pragma_once;
+  StringArray includes;     // Canonicalized paths of every file in the prefix.
+  FileStat* include_stats;  // Of each of |includes|, when captured.
+  int counter_macro_i;
+  int include_next_idx;
+} HeaderSnapshot;
+
+typedef struct SnapshotFile {
+  File* copy;
+  size_t len;
+} SnapshotFile;
+
+// Memoization of things that are referenced from many tokens while copying.
+typedef struct SnapshotCopier {
+  HashMap strings;   // Contents -> copy.
+  HashMap files;     // File* -> SnapshotFile*.
+  HashMap tokens;      // Token* -> copy, only used for Expansion.origin.
+  HashMap hidesets;    // Hideset* -> copy.
+  HashMap expansions;  // Expansion* -> copy.
+} SnapshotCopier;
+
+static void* get_by_pointer(HashMap* map, void* p) {
+  return hashmap_get2(map, (char*)&p, sizeof(p));
+}
+
+static void put_by_pointer(HashMap* map, void* p, void* val) {
+  void** key = bumpcalloc(1, sizeof(void*), AL_Compile);
+  *key = p;
+  hashmap_put2(map, (char*)key, sizeof(p), val);
+}
+
+static char* snapshot_str(SnapshotCopier* sc, char* s) {
+  if (!s)
+    return NULL;
+  char* copy = hashmap_get(&sc->strings, s);
+  if (!copy) {
+    copy = bumpstrdup(s, AL_Snapshot);
+    hashmap_put(&sc->strings, copy, copy);
+  }
+  return copy;
+}
+
+static SnapshotFile* snapshot_file(SnapshotCopier* sc, File* file) {
+  SnapshotFile* sf = get_by_pointer(&sc->files, file);
+  if (sf)
+    return sf;
+
+  sf = bumpcalloc(1, sizeof(SnapshotFile), AL_Compile);
+  sf->len = strlen(file->contents);
+  sf->copy = bumpcalloc(1, sizeof(File), AL_Snapshot);
+  *sf->copy = *file;
+  sf->copy->name = snapshot_str(sc, file->name);
+  sf->copy->display_name = snapshot_str(sc, file->display_name);
+  sf->copy->contents = bumpstrndup(file->contents, sf->len, AL_Snapshot);
+  put_by_pointer(&sc->files, file, sf);
+  if (file->presumed)
+    sf->copy->presumed = snapshot_file(sc, file->presumed)->copy;
+  return sf;
+}
+
+// Hidesets are shared by many tokens, so are only copied once. Atoms live as
+// long as the context, so can be referenced directly.
+static Hideset* snapshot_hideset(SnapshotCopier* sc, Hideset* hs) {
+  if (!hs)
+    return NULL;
+  Hideset* copy = get_by_pointer(&sc->hidesets, hs);
+  if (!copy) {
+    size_t size = sizeof(Hideset) + hs->len * sizeof(Atom*);
+    copy = bumpcalloc(1, size, AL_Snapshot);
+    memcpy(copy, hs, size);
+    put_by_pointer(&sc->hidesets, hs, copy);
+  }
+  return copy;
+}
+
+static Expansion* snapshot_expansion(SnapshotCopier* sc, Expansion* exp);
+
+static Token* snapshot_token(SnapshotCopier* sc, Token* tok) {
+  Token* t = bumpcalloc(1, sizeof(Token), AL_Snapshot);
+  *t = *tok;
+  t->next = NULL;
+
+  // Tokens point into the contents of their file, which error reporting relies
+  // on, so keep that relationship in the copy.
+  SnapshotFile* sf = snapshot_file(sc, tok->file);
+  t->file = sf->copy;
+  if (tok->loc >= tok->file->contents && tok->loc + tok->len <= tok->file->contents + sf->len)
+    t->loc = sf->copy->contents + (tok->loc - tok->file->contents);
+  else
+    t->loc = bumpstrndup(tok->loc, tok->len, AL_Snapshot);
+
+  // Non-array types on tokens are always the static builtin types.
+  if (tok->kind == TK_STR) {
+    t->ty = bumpcalloc(1, sizeof(Type), AL_Snapshot);
+    *t->ty = *tok->ty;
+    t->str = bumpcalloc(1, tok->ty->size, AL_Snapshot);
+    memcpy(t->str, tok->str, tok->ty->size);
+  } else if (tok->kind == TK_NUM && is_flonum(tok->ty)) {
+    t->fval = bumpcalloc(1, sizeof(long double), AL_Snapshot);
+    *t->fval = *tok->fval;
+  }
+  t->expansion = tok->expansion ? snapshot_expansion(sc, tok->expansion) : NULL;
+  return t;
+}
+
+static Token* snapshot_origin(SnapshotCopier* sc, Token* tok) {
+  Token* t = get_by_pointer(&sc->tokens, tok);
+  if (!t) {
+    t = snapshot_token(sc, tok);
+    put_by_pointer(&sc->tokens, tok, t);
+  }
+  return t;
+}
+
+static Expansion* snapshot_expansion(SnapshotCopier* sc, Expansion* exp) {
+  Expansion* copy = get_by_pointer(&sc->expansions, exp);
+  if (!copy) {
+    copy = bumpcalloc(1, sizeof(Expansion), AL_Snapshot);
+    copy->hideset = snapshot_hideset(sc, exp->hideset);
+    copy->origin = snapshot_origin(sc, exp->origin);
+    put_by_pointer(&sc->expansions, exp, copy);
+  }
+  return copy;
+}
+
+// Copies up to and including the terminating TK_EOF.
+static Token* snapshot_token_list(SnapshotCopier* sc, Token* tok) {
+  Token head = {0};
+  Token* cur = &head;
+  for (; tok; tok = tok->next) {
+    cur = cur->next = snapshot_token(sc, tok);
+    if (tok->kind == TK_EOF)
+      break;
+  }
+  return head.next;
+}
+
+static Macro* snapshot_macro(SnapshotCopier* sc, Macro* m) {
+  Macro* copy = bumpcalloc(1, sizeof(Macro), AL_Snapshot);
+  *copy = *m;
+  copy->name = snapshot_str(sc, m->name);
+  copy->va_args_name = snapshot_str(sc, m->va_args_name);
+  copy->body = snapshot_token_list(sc, m->body);
+
+  MacroParam head = {0};
+  MacroParam* cur = &head;
+  for (MacroParam* mp = m->params; mp; mp = mp->next) {
+    cur = cur->next = bumpcalloc(1, sizeof(MacroParam), AL_Snapshot);
+    cur->name = snapshot_str(sc, mp->name);
+  }
+  copy->params = head.next;
+  return copy;
+}
+
+static void capture_header_snapshot(char* key, Token* tokens) {
+  if (alloc_used(AL_Snapshot) > MAX_SNAPSHOT_BYTES)
+    invalidate_header_snapshots(NULL);
+
+  SnapshotCopier sc = {0};
+  HeaderSnapshot* hs = bumpcalloc(1, sizeof(HeaderSnapshot), AL_Snapshot);
+  hs->tokens = snapshot_token_list(&sc, tokens);
+
+  hs->macros.alloc_lifetime = AL_Snapshot;
+  int iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&C(macros), &iter));) {
+    hashmap_put2(&hs->macros, bumpstrndup(ent->key, ent->keylen, AL_Snapshot), ent->keylen,
+                 snapshot_macro(&sc, ent->val));
+  }
+
+  hs->include_guards.alloc_lifetime = AL_Snapshot;
+  iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&C(include_guards), &iter));)
+    hashmap_put(&hs->include_guards, snapshot_str(&sc, ent->key), snapshot_str(&sc, ent->val));
+
+  hs->pragma_once.alloc_lifetime = AL_Snapshot;
+  iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&C(pragma_once), &iter));)
+    hashmap_put(&hs->pragma_once, snapshot_str(&sc, ent->key), (void*)1);
+
+  hs->include_stats = bumpcalloc(C(snapshot_includes).len, sizeof(FileStat), AL_Snapshot);
+  for (int i = 0; i < C(snapshot_includes).len; ++i) {
+    strarray_push(&hs->includes, snapshot_str(&sc, C(snapshot_includes).data[i]), AL_Snapshot);
+    hs->include_stats[i] = *stat_file(C(snapshot_includes).data[i]);
+  }
+
+  hs->counter_macro_i = C(counter_macro_i);
+  hs->include_next_idx = C(include_next_idx);
+
+  hashmap_put(&user_context->header_snapshots, bumpstrdup(key, AL_Snapshot), hs);
+}
+
+static Token* restore_header_snapshot(HeaderSnapshot* hs) {
+  C(macros) = (HashMap){0};
+  int iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&hs->macros, &iter));)
+    hashmap_put2(&C(macros), ent->key, ent->keylen, ent->val);
+
+  iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&hs->include_guards, &iter));)
+    hashmap_put(&C(include_guards), ent->key, ent->val);
+
+  iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&hs->pragma_once, &iter));)
+    hashmap_put(&C(pragma_once), ent->key, ent->val);
+
+  for (int i = 0; i < hs->includes.len; ++i)
+    record_include_dependency(hs->includes.data[i]);
+
+  C(counter_macro_i) = hs->counter_macro_i;
+  C(include_next_idx) = hs->include_next_idx;
+
+  Token head = {0};
+  Token* cur = &head;
+  for (Token* tok = hs->tokens;; tok = tok->next) {
+    cur = cur->next = copy_token(tok);
+    if (tok->kind == TK_STR)
+      cur->ty = array_of(tok->ty->base, tok->ty->array_len, NULL);
+    if (tok->kind == TK_EOF)
+      break;
+  }
+  return head.next;
+}
+
+// As with read_file_cached(), a header that's been modified on disk since the
+// snapshot was captured makes it unusable, even if the host didn't pass it to
+// dyibicc_update_changed().
+static bool header_snapshot_is_current(HeaderSnapshot* hs) {
+  for (int i = 0; i < hs->includes.len; ++i) {
+    FileStat* fs = stat_file(hs->includes.data[i]);
+    FileStat* was = &hs->include_stats[i];
+    if (fs->exists != was->exists || fs->mtime != was->mtime || fs->size != was->size)
+      return false;
+  }
+  return true;
+}
+
+// Discards all snapshots if |changed_path| is NULL, or if any of them include
+// it.
+IMPLSTATIC void invalidate_header_snapshots(char* changed_path) {
+  HashMap* snapshots = &user_context->header_snapshots;
+  if (changed_path) {
+    bool found = false;
+    int iter = 0;
+    for (HashEntry* ent; !found && (ent = hashmap_next(snapshots, &iter));) {
+      HeaderSnapshot* hs = ent->val;
+      for (int i = 0; i < hs->includes.len && !found; ++i)
+        found = strcmp(hs->includes.data[i], changed_path) == 0;
+    }
+    if (!found)
+      return;
+  }
+
+  alloc_reset(AL_Snapshot);
+  alloc_init(AL_Snapshot);
+  *snapshots = (HashMap){.alloc_lifetime = AL_Snapshot};
+}
+
+// Returns the end of the run of `#include <...>` lines at the start of |tok|,
+// and sets |*key| to the list of their names.
+static Token* find_system_include_prefix(Token* tok, char** key) {
+  *key = "";
+  while (is_hash(tok) && equal(tok->next, "include") && equal(tok->next->next, "<")) {
+    Token* start = tok->next->next;
+    Token* end = start->next;
+    for (; !equal(end, ">"); end = end->next) {
+      if (end->at_bol || end->kind == TK_EOF)
+        return tok;
+    }
+    if (!end->next->at_bol && end->next->kind != TK_EOF)
+      return tok;
+    *key = format(AL_Compile, "%s<%s>\n", *key, join_tokens(start->next, end));
+    tok = end->next;
+  }
+  return tok;
+}
+
+static Token* preprocess_with_header_snapshot(Token* tok) {
+  char* key;
+  Token* rest = find_system_include_prefix(tok, &key);
+  if (rest == tok)
+    return preprocess2(tok);
+
+  Token* prefix;
+  HeaderSnapshot* hs = hashmap_get(&user_context->header_snapshots, key);
+  if (hs && header_snapshot_is_current(hs)) {
+    prefix = restore_header_snapshot(hs);
+  } else {
+    // Preprocess only the prefix by ending it early, so that the state at the
+    // end of it can be captured.
+    Token* last = tok;
+    while (last->next != rest)
+      last = last->next;
+    last->next = new_eof(rest);
+
+    C(capturing_snapshot) = true;
+    prefix = preprocess2(tok);
+    C(capturing_snapshot) = false;
+
+    // Headers that are using __BASE_FILE__ or instantiating containers leave
+    // state behind that's specific to this file.
+    if (!C(cond_incl) && !C(expanded_base_file) && C(container_tokens).len == 0)
+      capture_header_snapshot(key, prefix);
+  }
+
+  return splice(prefix, preprocess2(rest));
+}
+
+static Token* finish_preprocess(Token* tok) {
   if (C(cond_incl))
     error_tok(C(cond_incl)->tok, "unterminated conditional directive");
   convert_pp_tokens(tok);
   join_adjacent_string_literals(tok);
 
   for (Token* t = tok; t; t = t->next)
-    t->line_no += t->line_delta;
+    t->line_no += t->file->line_delta;
   return tok;
 }
 
+// Entry point function of the preprocessor.
+IMPLSTATIC Token* preprocess(Token* tok) {
+  return finish_preprocess(preprocess2(tok));
+}
+
+// Same as preprocess(), for the top level of a translation unit, where header
+// snapshots can be used.
+IMPLSTATIC Token* preprocess_file(Token* tok) {
+  return finish_preprocess(preprocess_with_header_snapshot(tok));
+}
+
 IMPLSTATIC Token* add_container_instantiations(Token* tok) {
   // Reverse order is important. They were appended as included, so we need to
   // maintain that order here.
@@ -8,7 +8,8 @@
 
 // Consumes the current token if it matches `op`.
 IMPLSTATIC bool equal(Token* tok, char* op) {
-  return strncmp(tok->loc, op, tok->len) == 0 && op[tok->len] == '\0';
+  // Most comparisons fail, and usually on the first character.
+  return tok->loc[0] == op[0] && strncmp(tok->loc, op, tok->len) == 0 && op[tok->len] == '\0';
 }
 
 // Ensure that the current token is `op`.
@@ -27,14 +28,50 @@ IMPLSTATIC bool consume(Token** rest, Token* tok, char* str) {
   return false;
 }
 
+// Extends |hash| with the spelling of the tokens in [tok, end).
+IMPLSTATIC uint64_t hash_tokens(uint64_t hash, Token* tok, Token* end) {
+  for (; tok != end && tok->kind != TK_EOF; tok = tok->next) {
+    // Adjacent string literals have been joined into the first one, so its
+    // spelling doesn't cover the whole string. The same bytes can also be
+    // different strings, e.g. u"ab" and "a\0b\0\0", so include the type of
+    // the elements.
+    if (tok->kind == TK_STR) {
+      char elem[2] = {(char)tok->ty->base->size, tok->ty->base->is_unsigned};
+      hash = fnv_hash_extend(hash, elem, sizeof(elem));
+      hash = fnv_hash_extend(hash, tok->str, tok->ty->size);
+    } else {
+      hash = fnv_hash_extend(hash, tok->loc, tok->len);
+    }
+    hash = fnv_hash_extend(hash, " ", 1);
+  }
+  return hash;
+}
+
+// Returns the unique Atom for the identifier |s|.
+IMPLSTATIC Atom* intern(char* s, int len) {
+  uint64_t hash = hash_bytes(s, len);
+  Atom* atom = hashmap_get_hashed(&user_context->atoms, s, len, hash);
+  if (atom)
+    return atom;
+
+  atom = bumpcalloc(1, sizeof(Atom), AL_UserContext);
+  atom->name = bumpstrndup(s, len, AL_UserContext);
+  atom->len = len;
+  atom->id = user_context->num_atoms++;
+  atom->hash = hash;
+  hashmap_put_hashed(&user_context->atoms, atom->name, len, hash, atom);
+  return atom;
+}
+
 // Create a new token.
 static Token* new_token(TokenKind kind, char* start, char* end) {
   Token* tok = bumpcalloc(1, sizeof(Token), AL_Compile);
+  ++C(num_tokens);
   tok->kind = kind;
   tok->loc = start;
   tok->len = (int)(end - start);
   tok->file = C(current_file);
-  tok->filename = C(current_file)->display_name;
+  tok->line_no = C(line_no);
   tok->at_bol = C(at_bol);
   tok->has_space = C(has_space);
 
@@ -46,18 +83,157 @@ static bool startswith(char* p, char* q) {
   return strncmp(p, q, strlen(q)) == 0;
 }
 
+// The helpers below scan the long runs of bytes (whitespace, comments,
+// identifiers, numbers and string contents) that make up most of a large
+// source file. Each examines [p, end) and returns a pointer to the first byte
+// that isn't part of the run, or |end|. With SSE2, 16 bytes are classified at
+// a time. Loads never go past |end|; the remainder is handled by the scalar
+// loops.
+#if HAVE_SSE2
+// Bytes >= 0x80 compare as negative, so are never in an ASCII range.
+static __m128i bytes_in_range(__m128i v, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static __m128i bytes_equal(__m128i v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+static __m128i bytes_alnum(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  return _mm_or_si128(bytes_in_range(lower, 'a', 'z'), bytes_in_range(v, '0', '9'));
+}
+
+// Offset of the first byte for which |in_run| is not set, or 16.
+static int run_length(__m128i in_run) {
+  unsigned int stop = ~(unsigned int)_mm_movemask_epi8(in_run) & 0xffff;
+  return stop ? lowest_set_bit(stop) : 16;
+}
+#endif
+
+static bool is_horizontal_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static char* skip_horizontal_space(char* p, char* end) {
+#if HAVE_SSE2
+  for (; p + 16 <= end; p += 16) {
+    __m128i v = _mm_loadu_si128((__m128i*)p);
+    __m128i space = _mm_or_si128(
+        bytes_equal(v, ' '), _mm_andnot_si128(bytes_equal(v, '\n'), bytes_in_range(v, '\t', '\r')));
+    int n = run_length(space);
+    if (n < 16)
+      return p + n;
+  }
+#endif
+  while (p < end && is_horizontal_space(*p))
+    p++;
+  return p;
+}
+
+static bool is_ascii_ident1(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$';
+}
+
+static bool is_ascii_ident2(char c) {
+  return is_ascii_ident1(c) || (c >= '0' && c <= '9');
+}
+
+static char* skip_ascii_ident_chars(char* p, char* end) {
+#if HAVE_SSE2
+  for (; p + 16 <= end; p += 16) {
+    __m128i v = _mm_loadu_si128((__m128i*)p);
+    __m128i ident =
+        _mm_or_si128(bytes_alnum(v), _mm_or_si128(bytes_equal(v, '_'), bytes_equal(v, '$')));
+    int n = run_length(ident);
+    if (n < 16)
+      return p + n;
+  }
+#endif
+  while (p < end && is_ascii_ident2(*p))
+    p++;
+  return p;
+}
+
+static char* skip_pp_number_chars(char* p, char* end) {
+#if HAVE_SSE2
+  for (; p + 16 <= end; p += 16) {
+    __m128i v = _mm_loadu_si128((__m128i*)p);
+    int n = run_length(_mm_or_si128(bytes_alnum(v), bytes_equal(v, '.')));
+    if (n < 16)
+      return p + n;
+  }
+#endif
+  while (p < end && (isalnum((unsigned char)*p) || *p == '.'))
+    p++;
+  return p;
+}
+
+// Returns the start of the terminating "*/", or NULL if there isn't one.
+static char* find_block_comment_end(char* p, char* end) {
+#if HAVE_SSE2
+  for (; p + 17 <= end; p += 16) {
+    __m128i star = bytes_equal(_mm_loadu_si128((__m128i*)p), '*');
+    __m128i slash = bytes_equal(_mm_loadu_si128((__m128i*)(p + 1)), '/');
+    unsigned int found = (unsigned int)_mm_movemask_epi8(_mm_and_si128(star, slash));
+    if (found)
+      return p + lowest_set_bit(found);
+  }
+#endif
+  for (; p + 1 < end; p++) {
+    if (p[0] == '*' && p[1] == '/')
+      return p;
+  }
+  return NULL;
+}
+
+// Returns the first '"', '\\' or newline.
+static char* find_string_special(char* p, char* end) {
+#if HAVE_SSE2
+  for (; p + 16 <= end; p += 16) {
+    __m128i v = _mm_loadu_si128((__m128i*)p);
+    __m128i special =
+        _mm_or_si128(bytes_equal(v, '"'), _mm_or_si128(bytes_equal(v, '\\'), bytes_equal(v, '\n')));
+    unsigned int found = (unsigned int)_mm_movemask_epi8(special);
+    if (found)
+      return p + lowest_set_bit(found);
+  }
+#endif
+  while (p < end && *p != '"' && *p != '\\' && *p != '\n')
+    p++;
+  return p;
+}
+
+// Tokens other than comments and malformed character literals never contain a
+// newline, so the line number only needs to be advanced past those.
+static void count_newlines(char* p, char* end) {
+  while ((p = memchr(p, '\n', end - p))) {
+    C(line_no)++;
+    p++;
+  }
+}
+
 // Read an identifier and returns the length of it.
 // If p does not point to a valid identifier, 0 is returned.
-static int read_ident(char* start) {
+static int read_ident(char* start, char* end) {
   char* p = start;
-  uint32_t c = decode_utf8(&p, p);
 
-  if (!is_ident1(c))
-    return 0;
+  // Most identifiers are entirely ASCII, only fall back to decoding UTF-8 at
+  // the first byte that isn't.
+  if (is_ascii_ident1(*p)) {
+    p = skip_ascii_ident_chars(p + 1, end);
+    if ((unsigned char)*p < 0x80)
+      return (int)(p - start);
+  } else {
+    uint32_t c = decode_utf8(&p, p);
+    if (!is_ident1(c))
+      return 0;
+  }
 
   for (;;) {
     char* q;
-    c = decode_utf8(&q, p);
+    uint32_t c = decode_utf8(&q, p);
     if (!is_ident2(c))
       return (int)(p - start);
     p = q;
@@ -74,77 +250,99 @@ static int from_hex(char c) {
 
 // Read a punctuator token from p and returns its length.
 static int read_punct(char* p) {
-  static char* kw[] = {
-      "<<=", ">>=", "...", "..", "==", "!=", "<=", ">=", "->", "+=", "-=", "*=",
-      "/=",  "++",  "--", "%=",  "&=", "|=", "^=", "&&", "||", "<<", ">>", "##",
-  };
-
-  for (size_t i = 0; i < sizeof(kw) / sizeof(*kw); i++)
-    if (startswith(p, kw[i]))
-      return (int)strlen(kw[i]);
-
-  return ispunct(*p) ? 1 : 0;
+  // "<<=", ">>=", "...", "..", "==", "!=", "<=", ">=", "->", "+=", "-=", "*=",
+  // "/=", "++", "--", "%=", "&=", "|=", "^=", "&&", "||", "<<", ">>" and "##",
+  // matched by their first character.
+  switch (p[0]) {
+    case '<':
+    case '>':
+      if (p[1] == p[0])
+        return p[2] == '=' ? 3 : 2;
+      return p[1] == '=' ? 2 : 1;
+    case '.':
+      if (p[1] == '.')
+        return p[2] == '.' ? 3 : 2;
+      return 1;
+    case '-':
+      return p[1] == '-' || p[1] == '=' || p[1] == '>' ? 2 : 1;
+    case '+':
+    case '&':
+    case '|':
+      return p[1] == p[0] || p[1] == '=' ? 2 : 1;
+    case '=':
+    case '!':
+    case '*':
+    case '/':
+    case '%':
+    case '^':
+      return p[1] == '=' ? 2 : 1;
+    case '#':
+      return p[1] == '#' ? 2 : 1;
+  }
+  return ispunct((unsigned char)*p) ? 1 : 0;
 }
 
-static bool is_keyword(Token* tok) {
-  if (C(keyword_map).capacity == 0) {
-    static char* kw[] = {
-      "return",
-      "if",
-      "else",
-      "for",
-      "while",
-      "int",
-      "sizeof",
-      "char",
-      "struct",
-      "union",
-      "short",
-      "long",
-      "void",
-      "typedef",
-      "_Bool",
-      "enum",
-      "static",
-      "goto",
-      "break",
-      "continue",
-      "switch",
-      "case",
-      "default",
-      "extern",
-      "_Alignof",
-      "_Alignas",
-      "do",
-      "signed",
-      "unsigned",
-      "const",
-      "volatile",
-      "auto",
-      "register",
-      "restrict",
-      "__restrict",
-      "__restrict__",
-      "_Noreturn",
-      "float",
-      "double",
-      "typeof",
-      "asm",
-      "_Thread_local",
-      "__thread",
-      "_Atomic",
-      "__attribute__",
+// Keywords are interned when the context is created, so that whether an
+// identifier is one is a flag on its atom, rather than a lookup per token.
+IMPLSTATIC void intern_keywords(void) {
+  static char* kw[] = {
+    "return",
+    "if",
+    "else",
+    "for",
+    "while",
+    "int",
+    "sizeof",
+    "char",
+    "struct",
+    "union",
+    "short",
+    "long",
+    "void",
+    "typedef",
+    "_Bool",
+    "enum",
+    "static",
+    "goto",
+    "break",
+    "continue",
+    "switch",
+    "case",
+    "default",
+    "extern",
+    "_Alignof",
+    "_Alignas",
+    "do",
+    "signed",
+    "unsigned",
+    "const",
+    "volatile",
+    "auto",
+    "register",
+    "restrict",
+    "__restrict",
+    "__restrict__",
+    "_Noreturn",
+    "float",
+    "double",
+    "typeof",
+    "asm",
+    "_Thread_local",
+    "__thread",
+    "_Atomic",
+    "__attribute__",
 
 #if X64WIN
-      "__int64",
+    "__int64",
 #endif
-    };
+  };
 
-    for (size_t i = 0; i < sizeof(kw) / sizeof(*kw); i++)
-      hashmap_put(&C(keyword_map), kw[i], (void*)1);
-  }
+  for (size_t i = 0; i < sizeof(kw) / sizeof(*kw); i++)
+    intern(kw[i], (int)strlen(kw[i]))->is_keyword = true;
+}
 
-  return hashmap_get2(&C(keyword_map), tok->loc, tok->len);
+static bool is_keyword(Token* tok) {
+  return tok->atom && tok->atom->is_keyword;
 }
 
 static int read_escaped_char(char** new_pos, char* p) {
@@ -209,28 +407,40 @@ static int read_escaped_char(char** new_pos, char* p) {
   }
 }
 
-// Find a closing double-quote.
-static char* string_literal_end(char* p) {
+// Find a closing double-quote. |end| bounds the scan, and is the end of the
+// file or of the token being reread.
+static char* string_literal_end(char* p, char* end) {
   char* start = p;
-  for (; *p != '"'; p++) {
-    if (*p == '\n' || *p == '\0')
+  for (;;) {
+    p = find_string_special(p, end);
+    if (p == end || *p == '\n')
       error_at(start, "unclosed string literal");
-    if (*p == '\\')
-      p++;
+    if (*p == '"')
+      return p;
+    // Skip the escaped character.
+    if (p + 1 == end)
+      error_at(start, "unclosed string literal");
+    p += 2;
   }
-  return p;
 }
 
-static Token* read_string_literal(char* start, char* quote) {
-  char* end = string_literal_end(quote + 1);
+static Token* read_string_literal(char* start, char* quote, char* limit) {
+  char* end = string_literal_end(quote + 1, limit);
   char* buf = bumpcalloc(1, end - quote, AL_Compile);
   int len = 0;
 
   for (char* p = quote + 1; p < end;) {
-    if (*p == '\\')
+    if (*p == '\\') {
       buf[len++] = (char)read_escaped_char(&p, p + 1);
-    else
-      buf[len++] = *p++;
+      continue;
+    }
+    // Copy everything up to the next escape at once.
+    char* q = memchr(p, '\\', end - p);
+    if (!q)
+      q = end;
+    memcpy(buf + len, p, q - p);
+    len += (int)(q - p);
+    p = q;
   }
 
   Token* tok = new_token(TK_STR, start, end + 1);
@@ -246,8 +456,8 @@ static Token* read_string_literal(char* start, char* quote) {
 // equal to or larger than that are encoded in 4 bytes. Each 2 bytes
 // in the 4 byte sequence is called "surrogate", and a 4 byte sequence
 // is called a "surrogate pair".
-static Token* read_utf16_string_literal(char* start, char* quote) {
-  char* end = string_literal_end(quote + 1);
+static Token* read_utf16_string_literal(char* start, char* quote, char* limit) {
+  char* end = string_literal_end(quote + 1, limit);
   uint16_t* buf = bumpcalloc(2, end - start, AL_Compile);
   int len = 0;
 
@@ -279,8 +489,8 @@ static Token* read_utf16_string_literal(char* start, char* quote) {
 //
 // UTF-32 is a fixed-width encoding for Unicode. Each code point is
 // encoded in 4 bytes.
-static Token* read_utf32_string_literal(char* start, char* quote, Type* ty) {
-  char* end = string_literal_end(quote + 1);
+static Token* read_utf32_string_literal(char* start, char* quote, Type* ty, char* limit) {
+  char* end = string_literal_end(quote + 1, limit);
   uint32_t* buf = bumpcalloc(4, end - quote, AL_Compile);
   int len = 0;
 
@@ -315,11 +525,38 @@ static Token* read_char_literal(char* start, char* quote, Type* ty) {
   Token* tok = new_token(TK_NUM, start, end + 1);
   tok->val = c;
   tok->ty = ty;
+  count_newlines(start, end);
   return tok;
 }
 
+static int digit_value(char c) {
+  if ('0' <= c && c <= '9')
+    return c - '0';
+  if ('a' <= c && c <= 'z')
+    return c - 'a' + 10;
+  if ('A' <= c && c <= 'Z')
+    return c - 'A' + 10;
+  return INT_MAX;
+}
+
+// As strtoull(), without the locale, whitespace and sign handling. Values that
+// are too large saturate, also like strtoull().
+static uint64_t read_uint(char** rest, char* p, int base) {
+  uint64_t val = 0;
+  uint64_t limit = UINT64_MAX / base;
+  bool overflow = false;
+  for (int d; (d = digit_value(*p)) < base; p++) {
+    if (val > limit || val * base > UINT64_MAX - d)
+      overflow = true;
+    val = val * base + d;
+  }
+  *rest = p;
+  return overflow ? UINT64_MAX : val;
+}
+
 static bool convert_pp_int(Token* tok) {
   char* p = tok->loc;
+  char* end = tok->loc + tok->len;
 
   // Read a binary, octal, decimal or hexadecimal number.
   int base = 10;
@@ -333,13 +570,15 @@ static bool convert_pp_int(Token* tok) {
     base = 8;
   }
 
-  int64_t val = strtoull(p, &p, base);
+  int64_t val = read_uint(&p, p, base);
 
   // Read U, L or LL suffixes.
   bool l = false;
   bool u = false;
 
-  if (startswith(p, "LLU") || startswith(p, "LLu") || startswith(p, "llU") ||
+  if (p == end) {
+    // Most constants don't have a suffix.
+  } else if (startswith(p, "LLU") || startswith(p, "LLu") || startswith(p, "llU") ||
       startswith(p, "llu") || startswith(p, "ULL") || startswith(p, "Ull") ||
       startswith(p, "uLL") || startswith(p, "ull")) {
     p += 3;
@@ -366,7 +605,7 @@ static bool convert_pp_int(Token* tok) {
     u = true;
   }
 
-  if (p != tok->loc + tok->len)
+  if (p != end)
     return false;
 
   // Infer a type.
@@ -403,6 +642,83 @@ static bool convert_pp_int(Token* tok) {
   return true;
 }
 
+// Decimal floating point constants of up to 19 significant digits with a
+// small exponent, i.e. almost all of them, are converted here without going
+// through the C library. When the digits are exactly representable in the
+// target type and so is the power of ten, a single multiplication or division
+// is correctly rounded (Clinger's fast path). Returns false for anything else,
+// which is then left to strtod() and friends.
+static bool read_float_fast(Token* tok, Type** ty, long double* val) {
+  static const double pow10_double[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+  static const float pow10_float[] = {
+      1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+  };
+
+  char* p = tok->loc;
+  uint64_t digits = 0;
+  int num_digits = 0;
+  int exp10 = 0;
+  bool any_digits = false;
+
+  for (; isdigit((unsigned char)*p); p++, any_digits = true) {
+    if (num_digits == 19)
+      return false;
+    digits = digits * 10 + (*p - '0');
+    num_digits += digits != 0;
+  }
+  if (*p == '.') {
+    for (p++; isdigit((unsigned char)*p); p++, any_digits = true) {
+      if (num_digits == 19)
+        return false;
+      digits = digits * 10 + (*p - '0');
+      num_digits += digits != 0;
+      exp10--;
+    }
+  }
+  if (!any_digits)
+    return false;
+
+  if (*p == 'e' || *p == 'E') {
+    p++;
+    bool neg = *p == '-';
+    if (*p == '+' || *p == '-')
+      p++;
+    if (!isdigit((unsigned char)*p))
+      return false;
+    int e = 0;
+    for (; isdigit((unsigned char)*p); p++) {
+      if (e > 1000)
+        return false;
+      e = e * 10 + (*p - '0');
+    }
+    exp10 += neg ? -e : e;
+  }
+
+  bool is_float = *p == 'f' || *p == 'F';
+  if (is_float)
+    p++;
+  if (p != tok->loc + tok->len)
+    return false;
+
+  if (is_float) {
+    if (digits > (1 << 24) || exp10 < -10 || exp10 > 10)
+      return false;
+    float f = (float)digits;
+    *val = exp10 < 0 ? f / pow10_float[-exp10] : f * pow10_float[exp10];
+    *ty = ty_float;
+  } else {
+    if (digits > (1ULL << 53) || exp10 < -22 || exp10 > 22)
+      return false;
+    double d = (double)digits;
+    *val = exp10 < 0 ? d / pow10_double[-exp10] : d * pow10_double[exp10];
+    *ty = ty_double;
+  }
+  return true;
+}
+
 // The definition of the numeric literal at the preprocessing stage
 // is more relaxed than the definition of that at the later stages.
 // In order to handle that, a numeric literal is tokenized as a
@@ -416,25 +732,31 @@ static void convert_pp_number(Token* tok) {
     return;
 
   // If it's not an integer, it must be a floating point constant.
-  char* end;
-  long double val = strtold(tok->loc, &end);
-
   Type* ty;
-  if (*end == 'f' || *end == 'F') {
-    ty = ty_float;
-    end++;
-  } else if (*end == 'l' || *end == 'L') {
-    ty = ty_ldouble;
-    end++;
-  } else {
-    ty = ty_double;
-  }
+  long double val;
+  if (!read_float_fast(tok, &ty, &val)) {
+    char* end;
+    val = strtold(tok->loc, &end);
+
+    if (*end == 'f' || *end == 'F') {
+      ty = ty_float;
+      val = strtof(tok->loc, NULL);
+      end++;
+    } else if (*end == 'l' || *end == 'L') {
+      ty = ty_ldouble;
+      end++;
+    } else {
+      ty = ty_double;
+      val = strtod(tok->loc, NULL);
+    }
 
-  if (tok->loc + tok->len != end)
-    error_tok(tok, "invalid numeric constant");
+    if (tok->loc + tok->len != end)
+      error_tok(tok, "invalid numeric constant");
+  }
 
   tok->kind = TK_NUM;
-  tok->fval = val;
+  tok->fval = bumpcalloc(1, sizeof(long double), AL_Compile);
+  *tok->fval = val;
   tok->ty = ty;
 }
 
@@ -447,57 +769,57 @@ IMPLSTATIC void convert_pp_tokens(Token* tok) {
   }
 }
 
-// Initialize line info for all tokens.
-static void add_line_numbers(Token* tok) {
-  char* p = C(current_file)->contents;
-  int n = 1;
-
-  do {
-    if (p == tok->loc) {
-      tok->line_no = n;
-      tok = tok->next;
-    }
-    if (*p == '\n')
-      n++;
-  } while (*p++);
-}
-
 Token* tokenize_string_literal(Token* tok, Type* basety) {
   Token* t;
   if (basety->size == 2)
-    t = read_utf16_string_literal(tok->loc, tok->loc);
+    t = read_utf16_string_literal(tok->loc, tok->loc, tok->loc + tok->len);
   else
-    t = read_utf32_string_literal(tok->loc, tok->loc, basety);
+    t = read_utf32_string_literal(tok->loc, tok->loc, basety, tok->loc + tok->len);
+  t->line_no = tok->line_no;
   t->next = tok->next;
   return t;
 }
 
-// Tokenize a given string and returns new tokens.
-Token* tokenize(File* file) {
+static bool is_conditional_directive(char* name, int len) {
+  return (len == 2 && !memcmp(name, "if", 2)) || (len == 5 && !memcmp(name, "ifdef", 5)) ||
+         (len == 6 && !memcmp(name, "ifndef", 6)) || (len == 4 && !memcmp(name, "elif", 4)) ||
+         (len == 4 && !memcmp(name, "else", 4));
+}
+
+// Tokenizes |file| from |p|, which must be at the start of a line. If |lazy|,
+// tokenizing stops after the first line that's an #if, #ifdef, #ifndef, #elif
+// or #else, and the rest of the file is represented by a TK_LAZY token. The
+// preprocessor then either continues from there with resume_tokenizing(), or
+// skips over a group that's excluded without making tokens for it at all with
+// skip_conditional_text().
+static Token* tokenize_from(File* file, char* p, int line_no, bool lazy) {
+  DyibiccPhase prev_phase = stats_enter_phase(DYIBICC_PHASE_TOKENIZE);
   C(current_file) = file;
 
-  char* p = file->contents;
+  char* end = file->contents + file->size;
   Token head = {0};
   Token* cur = &head;
+  bool stop_at_newline = false;
 
   C(at_bol) = true;
   C(has_space) = false;
+  C(line_no) = line_no;
 
   while (*p) {
     // Skip line comments.
     if (p[0] == '/' && p[1] == '/') {
-      p += 2;
-      while (*p && *p != '\n')
-        p++;
+      char* q = memchr(p + 2, '\n', end - (p + 2));
+      p = q ? q : end;
       C(has_space) = true;
       continue;
     }
 
     // Skip block comments.
     if (p[0] == '/' && p[1] == '*') {
-      char* q = strstr(p + 2, "*/");
+      char* q = find_block_comment_end(p + 2, end);
       if (!q)
         error_at(p, "unclosed block comment");
+      count_newlines(p + 2, q);
       p = q + 2;
       C(has_space) = true;
       continue;
@@ -506,14 +828,20 @@ Token* tokenize(File* file) {
     // Skip newline.
     if (*p == '\n') {
       p++;
+      C(line_no)++;
       C(at_bol) = true;
       C(has_space) = false;
+      if (stop_at_newline) {
+        cur = cur->next = new_token(TK_LAZY, p, p);
+        stats_enter_phase(prev_phase);
+        return head.next;
+      }
       continue;
     }
 
     // Skip whitespace characters.
     if (isspace((unsigned char)*p)) {
-      p++;
+      p = skip_horizontal_space(p + 1, end);
       C(has_space) = true;
       continue;
     }
@@ -522,9 +850,9 @@ Token* tokenize(File* file) {
     if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
       char* q = p++;
       for (;;) {
-        if (p[0] && p[1] && strchr("eEpP", p[0]) && strchr("+-", p[1]))
-          p += 2;
-        else if (isalnum((unsigned char)*p) || *p == '.')
+        p = skip_pp_number_chars(p, end);
+        // A sign is part of the number after an exponent, e.g. 1e+5 or 0x1p-3.
+        if ((*p == '+' || *p == '-') && strchr("eEpP", p[-1]))
           p++;
         else
           break;
@@ -535,35 +863,35 @@ Token* tokenize(File* file) {
 
     // String literal
     if (*p == '"') {
-      cur = cur->next = read_string_literal(p, p);
+      cur = cur->next = read_string_literal(p, p, end);
       p += cur->len;
       continue;
     }
 
     // UTF-8 string literal
     if (startswith(p, "u8\"")) {
-      cur = cur->next = read_string_literal(p, p + 2);
+      cur = cur->next = read_string_literal(p, p + 2, end);
       p += cur->len;
       continue;
     }
 
     // UTF-16 string literal
     if (startswith(p, "u\"")) {
-      cur = cur->next = read_utf16_string_literal(p, p + 1);
+      cur = cur->next = read_utf16_string_literal(p, p + 1, end);
       p += cur->len;
       continue;
     }
 
     // Wide string literal
     if (startswith(p, "L\"")) {
-      cur = cur->next = read_utf32_string_literal(p, p + 1, ty_int);
+      cur = cur->next = read_utf32_string_literal(p, p + 1, ty_int, end);
       p += cur->len;
       continue;
     }
 
     // UTF-32 string literal
     if (startswith(p, "U\"")) {
-      cur = cur->next = read_utf32_string_literal(p, p + 1, ty_uint);
+      cur = cur->next = read_utf32_string_literal(p, p + 1, ty_uint, end);
       p += cur->len;
       continue;
     }
@@ -599,9 +927,14 @@ Token* tokenize(File* file) {
     }
 
     // Identifier or keyword
-    int ident_len = read_ident(p);
+    int ident_len = read_ident(p, end);
     if (ident_len) {
+      Token* prev = cur;
       cur = cur->next = new_token(TK_IDENT, p, p + ident_len);
+      cur->atom = intern(p, ident_len);
+      if (lazy && prev->kind == TK_PUNCT && prev->at_bol && prev->len == 1 && *prev->loc == '#' &&
+          is_conditional_directive(p, ident_len))
+        stop_at_newline = true;
       p += cur->len;
       continue;
     }
@@ -618,62 +951,236 @@ Token* tokenize(File* file) {
   }
 
   cur = cur->next = new_token(TK_EOF, p, p);
-  add_line_numbers(head.next);
+  stats_enter_phase(prev_phase);
   return head.next;
 }
 
+// Tokenize a given string and returns new tokens.
+Token* tokenize(File* file) {
+  return tokenize_from(file, file->contents, 1, false);
+}
+
+// Replaces the TK_LAZY token |tok|, in place, with the tokens that follow it up
+// to the next conditional directive. If |tok| was linked to something with
+// splice(), that's linked after the end of the file instead.
+IMPLSTATIC void resume_tokenizing(Token* tok) {
+  Token head = {0};
+  head.next = tokenize_from(tok->file, tok->loc, tok->line_no, true);
+
+  Token* last = &head;
+  while (last->next->kind != TK_EOF && last->next->kind != TK_LAZY)
+    last = last->next;
+  if (last->next->kind == TK_LAZY)
+    last->next->next = tok->next;
+  else if (tok->next)
+    last->next = tok->next;
+
+  *tok = *head.next;
+}
+
+// The following scan the text of an excluded group a line at a time, only
+// looking for directives, with string literals and comments skipped so that
+// a '#' in them isn't mistaken for one. Skipped text is never tokenized, so
+// it doesn't have to be valid.
+
+// Skips spaces and block comments, which may span lines.
+static char* skip_space_and_comments(char* p, char* end, int* newlines) {
+  for (;;) {
+    p = skip_horizontal_space(p, end);
+    if (p[0] != '/' || p[1] != '*')
+      return p;
+    char* q = find_block_comment_end(p + 2, end);
+    if (!q)
+      return end;
+    for (char* n = p; (n = memchr(n, '\n', q - n)); n++)
+      ++*newlines;
+    p = q + 2;
+  }
+}
+
+// Returns the start of the next line. Unlike tokens, unterminated quotes are
+// allowed, and end at the end of the line.
+static char* skip_text_line(char* p, char* end, int* newlines) {
+  for (;;) {
+    p += strcspn(p, "\n/\"'");
+    switch (*p) {
+      case '\0':
+        return p;
+      case '\n':
+        ++*newlines;
+        return p + 1;
+      case '/':
+        if (p[1] == '*')
+          p = skip_space_and_comments(p, end, newlines);
+        else if (p[1] == '/')
+          p += strcspn(p, "\n");
+        else
+          p++;
+        break;
+      default: {
+        char* q = p + 1;
+        for (;;) {
+          q += strcspn(q, *p == '"' ? "\"\\\n" : "'\\\n");
+          if (*q == '\\' && q[1] && q[1] != '\n')
+            q += 2;
+          else
+            break;
+        }
+        p = *q == *p ? q + 1 : q;
+        break;
+      }
+    }
+  }
+}
+
+// If the line at |*p| is a directive, returns its name and sets |*len|. |*p|
+// is advanced past what was read.
+static char* directive_name(char** p, char* end, int* len, int* newlines) {
+  char* q = skip_space_and_comments(*p, end, newlines);
+  if (*q != '#') {
+    *p = q;
+    return NULL;
+  }
+  char* name = skip_space_and_comments(q + 1, end, newlines);
+  *len = (int)(skip_ascii_ident_chars(name, end) - name);
+  *p = name + *len;
+  return name;
+}
+
+static bool directive_is(char* name, int len, char* str) {
+  return name && len == (int)strlen(str) && !memcmp(name, str, len);
+}
+
+// Returns the start of the line with the #endif that ends the group at |p|,
+// or, if |stop_at_else|, an #elif or #else at the same level. Nested
+// conditionals are skipped.
+static char* skip_group(char* p, char* end, bool stop_at_else, int* newlines) {
+  int depth = 0;
+  while (p < end) {
+    char* line = p;
+    int line_newlines = *newlines;
+    int len;
+    char* name = directive_name(&p, end, &len, newlines);
+
+    if (directive_is(name, len, "if") || directive_is(name, len, "ifdef") ||
+        directive_is(name, len, "ifndef")) {
+      depth++;
+    } else if (directive_is(name, len, "endif")) {
+      if (depth-- == 0) {
+        *newlines = line_newlines;
+        return line;
+      }
+    } else if (depth == 0 && stop_at_else &&
+               (directive_is(name, len, "elif") || directive_is(name, len, "else"))) {
+      *newlines = line_newlines;
+      return line;
+    }
+
+    p = skip_text_line(p, end, newlines);
+  }
+  return end;
+}
+
+// Skips the excluded group at the TK_LAZY token |tok| (see skip_group()),
+// and then continues as resume_tokenizing() from the directive that ends it.
+IMPLSTATIC void skip_conditional_text(Token* tok, bool stop_at_else) {
+  int newlines = 0;
+  tok->loc = skip_group(tok->loc, tok->file->contents + tok->file->size, stop_at_else, &newlines);
+  tok->line_no += newlines;
+  resume_tokenizing(tok);
+}
+
+// Whether the group at the TK_LAZY token |tok| is ended by an #endif that's
+// only followed by spaces and comments, as with an include guard.
+IMPLSTATIC bool conditional_ends_file(Token* tok) {
+  char* end = tok->file->contents + tok->file->size;
+  int newlines = 0;
+  char* p = skip_group(tok->loc, end, true, &newlines);
+
+  int len;
+  char* name = directive_name(&p, end, &len, &newlines);
+  if (!directive_is(name, len, "endif"))
+    return false;
+
+  p = skip_space_and_comments(p, end, &newlines);
+  while (*p == '\n' || *p == '/') {
+    if (p[0] == '/' && p[1] == '/')
+      p += strcspn(p, "\n");
+    else if (*p == '\n')
+      p = skip_space_and_comments(p + 1, end, &newlines);
+    else if (p[1] == '*')
+      p = skip_space_and_comments(p, end, &newlines);
+    else
+      return false;
+  }
+  return p == end;
+}
+
 IMPLSTATIC File* new_file(char* name, char* contents) {
   File* file = bumpcalloc(1, sizeof(File), AL_Compile);
   file->name = name;
   file->display_name = name;
   file->contents = contents;
+  file->size = strlen(contents);
   return file;
 }
 
-// Replaces \r or \r\n with \n.
-static void canonicalize_newline(char* p) {
-  int i = 0, j = 0;
-
-  while (p[i]) {
-    if (p[i] == '\r' && p[i + 1] == '\n') {
-      i += 2;
-      p[j++] = '\n';
-    } else if (p[i] == '\r') {
-      i++;
-      p[j++] = '\n';
-    } else {
-      p[j++] = p[i++];
-    }
-  }
-
-  p[j] = '\0';
+// Length of the newline at |p|: 2 for \r\n, 1 for \n or \r, otherwise 0.
+static int newline_length(char* p) {
+  if (*p == '\n')
+    return 1;
+  if (*p == '\r')
+    return p[1] == '\n' ? 2 : 1;
+  return 0;
 }
 
-// Removes backslashes followed by a newline.
-static void remove_backslash_newline(char* p) {
-  int i = 0, j = 0;
+// Replaces \r or \r\n with \n and removes backslashes followed by a newline, in
+// a single pass. Most files have neither, in which case nothing is written.
+// Returns false if there can't be any \u or \U escapes to convert.
+static bool canonicalize_lines(char* p) {
+  char* q = p;
+  bool maybe_universal = false;
 
   // We want to keep the number of newline characters so that
   // the logical line number matches the physical one.
   // This counter maintain the number of newlines we have removed.
   int n = 0;
 
-  while (p[i]) {
-    if (p[i] == '\\' && p[i + 1] == '\n') {
-      i += 2;
-      n++;
-    } else if (p[i] == '\n') {
-      p[j++] = p[i++];
-      for (; n > 0; n--)
-        p[j++] = '\n';
-    } else {
-      p[j++] = p[i++];
+  for (;;) {
+    size_t len = strcspn(p, n ? "\r\n\\" : "\r\\");
+    if (q != p)
+      memmove(q, p, len);
+    p += len;
+    q += len;
+
+    if (*p == '\0')
+      break;
+
+    if (*p == '\\') {
+      int nl = newline_length(p + 1);
+      if (nl) {
+        // A continuation could join a backslash and a 'u' or 'U'.
+        p += 1 + nl;
+        n++;
+        maybe_universal = true;
+        continue;
+      }
+      if (p[1] == 'u' || p[1] == 'U')
+        maybe_universal = true;
+      *q++ = *p++;
+      continue;
     }
+
+    p += newline_length(p);
+    *q++ = '\n';
+    for (; n > 0; n--)
+      *q++ = '\n';
   }
 
   for (; n > 0; n--)
-    p[j++] = '\n';
-  p[j] = '\0';
+    *q++ = '\n';
+  *q = '\0';
+  return maybe_universal;
 }
 
 static uint32_t read_universal_char(char* p, int len) {
@@ -720,6 +1227,15 @@ static void convert_universal_chars(char* p) {
   *q = '\0';
 }
 
+// Whether canonicalize_lines() or convert_universal_chars() might change |p|.
+static bool needs_canonicalizing(char* p) {
+  for (p += strcspn(p, "\r\\"); *p; p += 1 + strcspn(p + 1, "\r\\")) {
+    if (*p == '\r' || p[1] == '\n' || p[1] == '\r' || p[1] == 'u' || p[1] == 'U')
+      return true;
+  }
+  return false;
+}
+
 Token* tokenize_filecontents(char* path, char* p) {
   // UTF-8 texts may start with a 3-byte "BOM" marker sequence.
   // If exists, just skip them because they are useless bytes.
@@ -728,18 +1244,24 @@ Token* tokenize_filecontents(char* path, char* p) {
   if (!memcmp(p, "\xef\xbb\xbf", 3))
     p += 3;
 
-  canonicalize_newline(p);
-  remove_backslash_newline(p);
-  convert_universal_chars(p);
+  // The contents may be shared (e.g. cached across updates, or mapped read-only
+  // from the file), so are copied if they have to be normalized.
+  if (needs_canonicalizing(p)) {
+    DyibiccPhase prev_phase = stats_enter_phase(DYIBICC_PHASE_TOKENIZE);
+    p = bumpstrdup(p, AL_Compile);
+    if (canonicalize_lines(p))
+      convert_universal_chars(p);
+    stats_enter_phase(prev_phase);
+  }
 
   File* file = new_file(path, p);
   file->file_no = C(all_tokenized_files).len;
   fileptrarray_push(&C(all_tokenized_files), file, AL_Compile);
-  return tokenize(file);
+  return tokenize_from(file, p, 1, true);
 }
 
 Token* tokenize_file(char* path) {
-  char* p = read_file_wrap_user(path, AL_Compile);
+  char* p = read_file_cached(path, AL_Compile);
   if (!p)
     return NULL;
   return tokenize_filecontents(path, p);
@@ -4,6 +4,8 @@
 #include <windows.h>
 #else
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #endif
 
@@ -45,6 +47,95 @@ IMPLSTATIC char* dirname(char* s) {
   return s;
 }
 
+static bool is_path_separator(char c) {
+#if X64WIN
+  return c == '/' || c == '\\';
+#else
+  return c == '/';
+#endif
+}
+
+// Removes the last component of the path in [buf, *end) for a following "..",
+// unless there isn't one that can be removed.
+static bool pop_path_component(char* buf, char** end) {
+  char* d = *end;
+  if (d == buf || (d == buf + 1 && buf[0] == '/'))
+    return false;
+  char* s = d;
+  while (s > buf && s[-1] != '/')
+    s--;
+  if ((d - s == 2 && s[0] == '.' && s[1] == '.') || (s == buf && d[-1] == ':'))
+    return false;
+  *end = s;
+  return true;
+}
+
+// Returns an absolute spelling of `path` with "." and ".." components and
+// repeated separators removed, and '/' as the separator, so that the same file
+// reached via different #include spellings (or passed to
+// dyibicc_update_changed() differently) compares equal. Symbolic links are
+// resolved for paths that exist. Results are valid until the end of the
+// update.
+IMPLSTATIC char* canonicalize_path(const char* path) {
+  char* canonical = hashmap_get(&user_context->canonical_paths, (char*)path);
+  if (canonical)
+    return canonical;
+
+#if X64WIN
+  char full[MAX_PATH];
+  DWORD full_len = GetFullPathNameA(path, sizeof(full), full, NULL);
+  const char* resolved = full_len > 0 && full_len < sizeof(full) ? full : path;
+#else
+  char full[PATH_MAX];
+  const char* resolved = realpath(path, full);
+  if (!resolved) {
+    // Files that are only provided by load_file_contents are normalized
+    // lexically, relative to the working directory.
+    resolved = path;
+    size_t path_len = strlen(path);
+    if (path[0] != '/' && getcwd(full, sizeof(full)) &&
+        strlen(full) + 1 + path_len < sizeof(full)) {
+      strcat(full, "/");
+      strcat(full, path);
+      resolved = full;
+    }
+  }
+#endif
+
+  char* buf = bumpcalloc(1, strlen(resolved) + 2, AL_Temp);
+  char* d = buf;
+  const char* p = resolved;
+  if (is_path_separator(*p))
+    *d++ = '/';
+  while (*p) {
+    while (is_path_separator(*p))
+      p++;
+    const char* end = p;
+    while (*end && !is_path_separator(*end))
+      end++;
+    size_t len = end - p;
+    if (len == 0)
+      break;
+    bool is_dot = len == 1 && p[0] == '.';
+    bool is_dot_dot = len == 2 && p[0] == '.' && p[1] == '.';
+    if (!is_dot && !(is_dot_dot && pop_path_component(buf, &d))) {
+      if (d > buf && d[-1] != '/')
+        *d++ = '/';
+      memcpy(d, p, len);
+      d += len;
+    }
+    p = end;
+  }
+  if (d > buf + 1 && d[-1] == '/')
+    d--;
+  if (d == buf)
+    *d++ = '.';
+  *d = '\0';
+
+  hashmap_put(&user_context->canonical_paths, bumpstrdup(path, AL_Temp), buf);
+  return buf;
+}
+
 // Round up `n` to the nearest multiple of `align`. For instance,
 // align_to(5, 8) returns 8 and align_to(11, 8) returns 16.
 IMPLSTATIC uint64_t align_to_u(uint64_t n, uint64_t align) {
@@ -65,6 +156,31 @@ IMPLSTATIC unsigned int get_page_size(void) {
 #endif
 }
 
+// Monotonic time in seconds, for measuring durations only.
+IMPLSTATIC double get_time_seconds(void) {
+#if X64WIN
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// |mask| must be non-zero.
+IMPLSTATIC int lowest_set_bit(unsigned int mask) {
+#if X64WIN
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
 IMPLSTATIC void strarray_push(StringArray* arr, char* s, AllocLifetime lifetime) {
   if (!arr->data) {
     arr->data = bumpcalloc(8, sizeof(char*), lifetime);
@@ -82,23 +198,6 @@ IMPLSTATIC void strarray_push(StringArray* arr, char* s, AllocLifetime lifetime)
   arr->data[arr->len++] = s;
 }
 
-IMPLSTATIC void strintarray_push(StringIntArray* arr, StringInt item, AllocLifetime lifetime) {
-  if (!arr->data) {
-    arr->data = bumpcalloc(8, sizeof(StringInt), lifetime);
-    arr->capacity = 8;
-  }
-
-  if (arr->capacity == arr->len) {
-    arr->data = bumplamerealloc(arr->data, sizeof(StringInt) * arr->capacity,
-                                sizeof(StringInt) * arr->capacity * 2, lifetime);
-    arr->capacity *= 2;
-    for (int i = arr->len; i < arr->capacity; i++)
-      arr->data[i] = (StringInt){NULL, -1};
-  }
-
-  arr->data[arr->len++] = item;
-}
-
 IMPLSTATIC void fileptrarray_push(FilePtrArray* arr, File* item, AllocLifetime lifetime) {
   if (!arr->data) {
     arr->data = bumpcalloc(8, sizeof(File*), lifetime);
@@ -133,7 +232,6 @@ IMPLSTATIC void tokenptrarray_push(TokenPtrArray* arr, Token* item, AllocLifetim
   arr->data[arr->len++] = item;
 }
 
-#if X64WIN
 IMPLSTATIC void intintintarray_push(IntIntIntArray* arr, IntIntInt item, AllocLifetime lifetime) {
   if (!arr->data) {
     arr->data = bumpcalloc(8, sizeof(IntIntInt), lifetime);
@@ -150,7 +248,6 @@ IMPLSTATIC void intintintarray_push(IntIntIntArray* arr, IntIntInt item, AllocLi
 
   arr->data[arr->len++] = item;
 }
-#endif
 
 // Returns the contents of a given file. Doesn't support '-' for reading from
 // stdin.
@@ -167,6 +264,151 @@ IMPLSTATIC char* read_file_wrap_user(char* path, AllocLifetime lifetime) {
   return buf;
 }
 
+// File contents from load_file_contents, kept across updates so that headers
+// that haven't changed aren't loaded again on every recompile of the files
+// that #include them. Only files that can be stat()d are cached, and an entry
+// is only used while the file's modification time and size are unchanged.
+// The contents are never modified (the tokenizer copies a file if it has to
+// normalize it), so when the default loader is in use they're mapped directly.
+typedef struct CachedFile {
+  int64_t mtime;
+  int64_t file_size;
+  char* contents;      // NUL-terminated. Either |data|, or a mapping of the file.
+  size_t mapped_size;  // Non-zero if |contents| is mapped.
+  char data[];
+} CachedFile;
+
+static int64_t stat_mtime_ns(struct stat* st) {
+#if X64WIN
+  return (int64_t)st->st_mtime * 1000000000;
+#else
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+// Results are remembered for the rest of the current update, so that
+// searching the include paths doesn't repeatedly stat() the same candidates.
+IMPLSTATIC FileStat* stat_file(char* path) {
+  char* canonical = canonicalize_path(path);
+  FileStat* fs = hashmap_get(&user_context->stat_cache, canonical);
+  if (fs)
+    return fs;
+
+  fs = bumpcalloc(1, sizeof(FileStat), AL_Temp);
+  struct stat st;
+  if (stat(path, &st) == 0) {
+    fs->exists = true;
+    fs->mtime = stat_mtime_ns(&st);
+    fs->size = (int64_t)st.st_size;
+  }
+  hashmap_put(&user_context->stat_cache, canonical, fs);
+  return fs;
+}
+
+#if !X64WIN
+// Maps |path| read-only if it's |size| bytes. The zero fill at the end of the
+// last page terminates the contents, so files that exactly fill their last
+// page (and empty files, which can't be mapped) are read instead.
+static char* map_file(char* path, int64_t size) {
+  if (size <= 0 || size % get_page_size() == 0)
+    return NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  void* p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size == size)
+    p = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? NULL : p;
+}
+#endif
+
+static CachedFile* load_cached_file(char* path, FileStat* fs) {
+  CachedFile* cf = NULL;
+#if !X64WIN
+  char* mapped = user_context->map_source_files ? map_file(path, fs->size) : NULL;
+  if (mapped) {
+    cf = calloc(1, sizeof(CachedFile));
+    cf->contents = mapped;
+    cf->mapped_size = (size_t)fs->size;
+  }
+#endif
+
+  if (!cf) {
+    char* contents;
+    size_t size;
+    if (!user_context->load_file_contents(path, &contents, &size))
+      return NULL;
+    cf = calloc(1, sizeof(CachedFile) + size + 1);
+    memcpy(cf->data, contents, size);
+    free(contents);
+    cf->contents = cf->data;
+  }
+
+  cf->mtime = fs->mtime;
+  cf->file_size = fs->size;
+  return cf;
+}
+
+static void free_cached_file(CachedFile* cf) {
+#if !X64WIN
+  if (cf->mapped_size)
+    munmap(cf->contents, cf->mapped_size);
+#endif
+  free(cf);
+}
+
+// As read_file_wrap_user(), but returns previously loaded contents if the file
+// hasn't been modified since. For files that can be cached, the returned
+// contents are shared and must not be modified. They stay valid until the
+// start of the next update.
+IMPLSTATIC char* read_file_cached(char* path, AllocLifetime lifetime) {
+  FileStat* fs = stat_file(path);
+  if (!fs->exists)
+    return read_file_wrap_user(path, lifetime);
+
+  char* canonical = canonicalize_path(path);
+  CachedFile* cf = hashmap_get(&user_context->file_cache, canonical);
+  if (!cf || cf->mtime != fs->mtime || cf->file_size != fs->size) {
+    CachedFile* loaded = load_cached_file(path, fs);
+    if (!loaded)
+      return NULL;
+    hashmap_put(&user_context->file_cache, strdup(canonical), loaded);
+    if (cf)
+      free_cached_file(cf);
+    cf = loaded;
+  }
+  return cf->contents;
+}
+
+// Drops the cached contents of |changed_path| (which must be canonicalized), so
+// that it's loaded again even if its modification time is unchanged. When
+// |changed_path| is NULL, everything is being reloaded, and cached contents
+// are still validated against the file, but how #include names were resolved
+// is forgotten, as a newly created header may now shadow one found later in
+// the include paths.
+IMPLSTATIC void invalidate_file_cache(char* changed_path) {
+  if (!changed_path) {
+    hashmap_clear_manual_key_owned_value_owned(&user_context->include_path_cache);
+    return;
+  }
+
+  CachedFile* cf = hashmap_get(&user_context->file_cache, changed_path);
+  if (cf) {
+    hashmap_delete(&user_context->file_cache, changed_path);
+    free_cached_file(cf);
+  }
+}
+
+IMPLSTATIC void free_file_cache(UserContext* ctx) {
+  int iter = 0;
+  for (HashEntry* ent; (ent = hashmap_next(&ctx->file_cache, &iter));)
+    free_cached_file(ent->val);
+  hashmap_clear_manual_key_owned_value_unowned(&ctx->file_cache);
+}
+
 // Takes a printf-style format string and returns a formatted string.
 IMPLSTATIC char* format(AllocLifetime lifetime, char* fmt, ...) {
   char buf[4096];
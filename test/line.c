@@ -16,6 +16,15 @@ int main() {
   ASSERT(201, __LINE__);
   ASSERT(0, strcmp(__FILE__, "xyz"));
 
+  /* A comment
+     spanning lines */ ASSERT(205, __LINE__);
+  ASSERT(206, __LINE__ + \
+          0);
+  ASSERT(208, __LINE__);
+  ASSERT(209, '\
+a' + __LINE__ - 'a');
+  ASSERT(211, __LINE__);
+
   printf("OK\n");
   return 0;
 }
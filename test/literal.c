@@ -97,6 +97,15 @@ int main() {
   ASSERT(__SIZEOF_LONG_DOUBLE__, sizeof(5.l));
   ASSERT(__SIZEOF_LONG_DOUBLE__, sizeof(2.0L));
 
+  ASSERT(1, 0.1 == 1e-1);
+  ASSERT(1, 0.1f == 1e-1f);
+  ASSERT(1, 0.1f == (float)0.1L);
+  ASSERT(1, 123456789012345678e-3 == 123456789012345.678);
+  ASSERT(1, 16777217.0f == 16777216.0f);
+  ASSERT(1, 0x1.8p1 == 3.0);
+  ASSERT(1, 1e300 * 1e-300 < 1.5);
+  ASSERT(1, 18446744073709551615u == 0xffffffffffffffff);
+
   assert(1, size\
 of(char), \
          "sizeof(char)");
@@ -32,6 +32,16 @@ int main() {
 #endif
 #endif
 
+#if 0
+  Excluded text isn't tokenized, so it doesn't have to be valid: it's "unclosed.
+  /* #endif in a comment
+#else */
+  "#endif in a string"
+  // #endif in a line comment \
+#endif
+#endif
+  ASSERT(43, __LINE__);
+
   int m = 0;
 
 #if 1
@@ -0,0 +1,45 @@
+#include "test.h"
+
+// Many string literals and arrays that are aligned to 16 bytes, but are sizes
+// that aren't a multiple of 16. Placing them shouldn't get slower with the
+// number already placed.
+
+#define S(n) "a sixteen byte aligned literal " #n
+#define S10(n) S(n##0), S(n##1), S(n##2), S(n##3), S(n##4), S(n##5), S(n##6), S(n##7), S(n##8), S(n##9)
+#define S100(n) S10(n##0), S10(n##1), S10(n##2), S10(n##3), S10(n##4), S10(n##5), S10(n##6), S10(n##7), S10(n##8), S10(n##9)
+#define S1000(n) S100(n##0), S100(n##1), S100(n##2), S100(n##3), S100(n##4), S100(n##5), S100(n##6), S100(n##7), S100(n##8), S100(n##9)
+#define S10000(n) S1000(n##0), S1000(n##1), S1000(n##2), S1000(n##3), S1000(n##4), S1000(n##5), S1000(n##6), S1000(n##7), S1000(n##8), S1000(n##9)
+
+static char* literals[] = {S10000(1), S10000(2)};
+
+#define G(n) char g##n[20] = #n;
+#define G10(n) G(n##0) G(n##1) G(n##2) G(n##3) G(n##4) G(n##5) G(n##6) G(n##7) G(n##8) G(n##9)
+#define G100(n) G10(n##0) G10(n##1) G10(n##2) G10(n##3) G10(n##4) G10(n##5) G10(n##6) G10(n##7) G10(n##8) G10(n##9)
+#define G1000(n) G100(n##0) G100(n##1) G100(n##2) G100(n##3) G100(n##4) G100(n##5) G100(n##6) G100(n##7) G100(n##8) G100(n##9)
+#define G10000(n) G1000(n##0) G1000(n##1) G1000(n##2) G1000(n##3) G1000(n##4) G1000(n##5) G1000(n##6) G1000(n##7) G1000(n##8) G1000(n##9)
+
+G10000(1)
+G10000(2)
+
+int main() {
+  int n = sizeof(literals) / sizeof(literals[0]);
+  ASSERT(20000, n);
+
+  int aligned = 0;
+  int distinct = 0;
+  for (int i = 0; i < n; i++) {
+    aligned += ((unsigned long)literals[i] & 15) == 0;
+    distinct += i == 0 || literals[i] != literals[i - 1];
+  }
+  ASSERT(20000, aligned);
+  ASSERT(20000, distinct);
+  ASSERT(0, strcmp(literals[0], "a sixteen byte aligned literal 10000"));
+  ASSERT(0, strcmp(literals[19999], "a sixteen byte aligned literal 29999"));
+
+  ASSERT(0, ((unsigned long)g10000 | (unsigned long)g29999) & 15);
+  ASSERT(0, strcmp(g10000, "10000"));
+  ASSERT(0, strcmp(g29999, "29999"));
+
+  printf("OK\n");
+  return 0;
+}
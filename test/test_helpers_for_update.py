@@ -6,13 +6,15 @@ _MAIN_TEMPLATE = r'''
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+%(cache_dir_includes)s%(disk_dir_includes)s
 void* get_host_helper_func(const char* name) {
   (void)name;
 %(helper_lookups)s
 }
 
+%(header_declarations)s
 static bool get_file_by_name(const char* filename, char** contents, size_t* size) {
+%(header_contents)s
 %(initial_file_contents)s
 
   // Otherwise, fallback to normal file loading (for includes, etc.)
@@ -30,7 +32,9 @@ static bool get_file_by_name(const char* filename, char** contents, size_t* size
   return true;
 }
 
+%(cache_dir_functions)s
 int main(void) {
+%(cache_dir_setup)s
   char* include_paths[] = {
     %(include_paths)s
   };
@@ -46,11 +50,15 @@ int main(void) {
       .output_function = NULL,
       .use_ansi_codes = false,
       .generate_debug_symbols = false,
+      .cache_dir = %(cache_dir)s,
   };
 
+%(setup)s
   DyibiccContext* ctx = dyibicc_set_environment(&env_data);
 
   int final_result = 0;
+  void* stable_main = NULL;
+  (void)stable_main;
 
   if (!dyibicc_update(ctx, NULL, NULL)) {
     printf("initial update failed\n");
@@ -63,10 +71,54 @@ int main(void) {
   printf("OK\n");
 fail:
   dyibicc_free(ctx);
+%(cache_dir_cleanup)s
   return final_result;
 }
 '''
 
+# The cache directory is created fresh for each run, so that the test doesn't
+# depend on what earlier runs left behind.
+_CACHE_DIR_INCLUDES = r'''
+#ifndef _WIN32
+#include <dirent.h>
+#include <unistd.h>
+#endif
+'''
+
+_CACHE_DIR_FUNCTIONS = r'''
+static void remove_cache_dir(const char* path) {
+#ifdef _WIN32
+  (void)path;  // The cache isn't implemented on Windows.
+#else
+  DIR* dir = opendir(path);
+  if (!dir)
+    return;
+  struct dirent* ent;
+  while ((ent = readdir(dir))) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+      continue;
+    char file[1024];
+    snprintf(file, sizeof(file), "%s/%s", path, ent->d_name);
+    unlink(file);
+  }
+  closedir(dir);
+  rmdir(path);
+#endif
+}
+'''
+
+_CACHE_DIR_SETUP = r'''
+#ifdef _WIN32
+  char cache_dir[] = "%(cache_dir)s";
+#else
+  char cache_dir[] = "%(cache_dir)s.XXXXXX";
+  if (!mkdtemp(cache_dir)) {
+    printf("couldn't create cache dir\n");
+    return 1;
+  }
+#endif
+'''
+
 _UPDATE_FILE_TEMPLATE = r'''
   static char contents_step%(step)d[] = %(contents)s;
   if (!dyibicc_update(ctx, "%(filename)s", contents_step%(step)d)) {
@@ -75,6 +127,86 @@ _UPDATE_FILE_TEMPLATE = r'''
   }
 '''
 
+_UPDATE_HEADER_TEMPLATE = r'''
+  static char contents_step%(step)d[] = %(contents)s;
+  header_contents_%(index)d = contents_step%(step)d;
+  if (!dyibicc_update_changed(ctx, "%(path)s")) {
+    final_result = 255;
+    goto fail;
+  }
+'''
+
+_UPDATE_SOURCE_CHANGED_TEMPLATE = r'''
+  static char contents_step%(step)d[] = %(contents)s;
+  source_contents_%(index)d = contents_step%(step)d;
+  if (!dyibicc_update_changed(ctx, "%(path)s")) {
+    final_result = 255;
+    goto fail;
+  }
+'''
+
+_RESTART_TEMPLATE = r'''
+%(reset_sources)s
+  dyibicc_free(ctx);
+  stable_main = NULL;
+  ctx = dyibicc_set_environment(&env_data);
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    printf("update after restart failed\n");
+    final_result = 255;
+    goto fail;
+  }
+'''
+
+_WRITE_DISK_FILE_TEMPLATE = r'''
+  {
+  static char disk_contents_step%(step)d[] = %(contents)s;
+  FILE* fp = fopen("%(filename)s", "wb");
+  fwrite(disk_contents_step%(step)d, 1, sizeof(disk_contents_step%(step)d) - 1, fp);
+  fclose(fp);
+  }
+'''
+
+_DISK_DIR_INCLUDES = r'''
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <sys/stat.h>
+#endif
+'''
+
+_DISK_DIR_TEMPLATE = r'''
+  mkdir("%(path)s", 0755);
+'''
+
+_REMOVE_DISK_FILE_TEMPLATE = r'''
+  remove("%(filename)s");
+'''
+
+_UPDATE_DISK_FILE_CHANGED_TEMPLATE = r'''
+  if (!dyibicc_update_changed(ctx, "%(path)s")) {
+    final_result = 255;
+    goto fail;
+  }
+'''
+
+_UPDATE_CHANGED_FAILS_TEMPLATE = r'''
+  static char contents_step%(step)d[] = %(contents)s;
+  %(contents_var)s_%(index)d = contents_step%(step)d;
+  if (dyibicc_update_changed(ctx, "%(path)s")) {
+    printf("%(exp_file)s:%(exp_line)d: update succeeded, but expected failure\n");
+    final_result = 251;
+    goto fail;
+  }
+'''
+
+_UPDATE_ALL_TEMPLATE = r'''
+  if (!dyibicc_update(ctx, NULL, NULL)) {
+    final_result = 255;
+    goto fail;
+  }
+'''
+
 _CALL_ENTRY_TEMPLATE = r'''
   {
   void* entry_point = dyibicc_find_export(ctx, "main");
@@ -96,15 +228,56 @@ _CALL_ENTRY_TEMPLATE = r'''
   }
   }
 '''
+_CALL_STABLE_ENTRY_TEMPLATE = r'''
+  {
+  if (!stable_main)
+    stable_main = dyibicc_find_stable_export(ctx, "main");
+  int myargc = 1;
+  char* myargv[] = {"prog", NULL};
+  int result = ((int (*)(int, char**))stable_main)(myargc, myargv);
+  if (result != %(desired_result)d) {
+    printf("%(exp_file)s:%(exp_line)d: got %%d, but expected %%d\n", result, %(desired_result)d);
+    final_result = 253;
+    goto fail;
+  } else {
+    printf("%(exp_file)s:%(exp_line)d: OK (%%d)\n", result);
+  }
+  }
+'''
 
+_REGISTER_SYMBOL_TEMPLATE = r'''
+  {
+  const char* names[] = {"%(name)s"};
+  void* addresses[] = {(void*)%(host_name)s};
+  dyibicc_register_symbols(ctx, names, addresses, 1);
+  }
+'''
+
+_CHECK_STATS_TEMPLATE = r'''
+  {
+  DyibiccStats stats;
+  dyibicc_get_stats(ctx, &stats);
+  if (!(%(condition)s)) {
+    printf("%(exp_file)s:%(exp_line)d: stats check failed\n");
+    final_result = 252;
+    goto fail;
+  }
+  }
+'''
 
+
+_setup = []
 _steps = []
 _current = {}
 _is_dirty = {}
 _include_paths = []
 _initial_file_contents = {}
+_headers = []
+_initial_header_contents = {}
 _extra_host = []
 _host_helper_funcs = []
+_cache_dir = None
+_uses_disk_dir = False
 
 
 def _string_as_c_array(s):
@@ -123,16 +296,96 @@ def add_host_helper_func(*funcnames):
     _host_helper_funcs.extend(funcnames)
 
 
+def _is_header(f):
+    return f.endswith('.h')
+
+
 def initial(file_to_contents):
     global _steps
     global _current
     for f, c in file_to_contents.items():
         _current[f] = c
-        _is_dirty[f] = True
-        _initial_file_contents[f] = c
+        if _is_header(f):
+            # Headers are served from memory by the host's load function, and
+            # changes to them are applied with dyibicc_update_changed().
+            _headers.append(f)
+            _initial_header_contents[f] = c
+            _is_dirty[f] = False
+        else:
+            _is_dirty[f] = True
+            _initial_file_contents[f] = c
     update_ok()
 
 
+def cache_dir(path):
+    """Sets cache_dir to a new, empty, directory whose name starts with
+    |path|, removed when the test finishes."""
+    global _cache_dir
+    _cache_dir = path
+
+
+def restart():
+    """Simulates restarting the host process: the context is freed and
+    recreated, and the .c files are loaded with their initial contents."""
+    global _steps
+    update_ok()
+    reset_sources = ''
+    for f in _current:
+        if not _is_header(f):
+            _current[f] = _initial_file_contents[f]
+            i = list(_initial_file_contents).index(f)
+            reset_sources += '  source_contents_%d = initial_%d;\n' % (i, i)
+    _steps.append(_RESTART_TEMPLATE % {'reset_sources': reset_sources})
+
+
+def disk_file(path, contents):
+    """Writes |path| to disk (relative to the test's working directory), before
+    the context is created if called before initial()."""
+    global _steps
+    step = _WRITE_DISK_FILE_TEMPLATE % {
+        'filename': path,
+        'contents': '{' + _string_as_c_array(contents) + '}',
+        'step': len(_setup) + len(_steps)}
+    if _current:
+        _steps.append(step)
+    else:
+        _setup.append(step)
+
+
+def disk_dir(path):
+    """Creates the directory |path| (relative to the test's working directory)
+    if it doesn't exist, before the context is created."""
+    global _uses_disk_dir
+    _uses_disk_dir = True
+    _setup.append(_DISK_DIR_TEMPLATE % {'path': path})
+
+
+def remove_disk_file(path):
+    """Removes |path| from disk, e.g. so that a file written by disk_file() in
+    an earlier run doesn't exist when the test starts."""
+    global _steps
+    step = _REMOVE_DISK_FILE_TEMPLATE % {'filename': path}
+    if _current:
+        _steps.append(step)
+    else:
+        _setup.append(step)
+
+
+def disk_file_changed(path):
+    """Calls dyibicc_update_changed() with |path|, a file written with
+    disk_file(). Other pending edits are applied first, as with update_ok()."""
+    global _steps
+    update_ok()
+    _steps.append(_UPDATE_DISK_FILE_CHANGED_TEMPLATE % {'path': path})
+
+
+def update_all():
+    """Reloads everything, as with dyibicc_update(ctx, NULL, NULL)."""
+    global _steps
+    update_ok()
+    _steps.append(_UPDATE_ALL_TEMPLATE)
+
+
 def include_path(path):
     global _include_paths
     _include_paths.append(path)
@@ -142,7 +395,14 @@ def update_ok():
     global _steps
     global _current
     for f, dirty in _is_dirty.items():
-        if dirty:
+        if dirty and _is_header(f):
+            _steps.append(_UPDATE_HEADER_TEMPLATE % {
+                'path': f,
+                'contents': '{' + _string_as_c_array(_current[f]) + '}',
+                'index': _headers.index(f),
+                'step': len(_steps)})
+            _is_dirty[f] = False
+        elif dirty:
             _steps.append(_UPDATE_FILE_TEMPLATE % {
                 'filename': f,
                 'contents': '{' + _string_as_c_array(_current[f]) + '}',
@@ -150,6 +410,52 @@ def update_ok():
             _is_dirty[f] = False
 
 
+def update_changed_fails(filename, path=None):
+    """As update_changed(), but checks that the update fails."""
+    import inspect
+    previous_frame = inspect.currentframe().f_back
+    (exp_file, line_number, _, _, _) = inspect.getframeinfo(previous_frame)
+    exp_file = os.path.split(exp_file)[1]
+    global _steps
+    _is_dirty[filename] = False
+    update_ok()
+    if _is_header(filename):
+        contents_var = 'header_contents'
+        index = _headers.index(filename)
+    else:
+        contents_var = 'source_contents'
+        index = list(_initial_file_contents).index(filename)
+    _steps.append(_UPDATE_CHANGED_FAILS_TEMPLATE % {
+        'path': path or filename,
+        'contents': '{' + _string_as_c_array(_current[filename]) + '}',
+        'contents_var': contents_var,
+        'index': index,
+        'exp_file': exp_file,
+        'exp_line': line_number,
+        'step': len(_steps)})
+
+
+def update_changed(filename, path=None):
+    """Applies the edits to |filename| (a header or .c file) by having the host
+    serve its new contents, and calling dyibicc_update_changed() with |path|,
+    which defaults to |filename|. Other pending edits are applied first, as
+    with update_ok()."""
+    global _steps
+    _is_dirty[filename] = False
+    update_ok()
+    if _is_header(filename):
+        template = _UPDATE_HEADER_TEMPLATE
+        index = _headers.index(filename)
+    else:
+        template = _UPDATE_SOURCE_CHANGED_TEMPLATE
+        index = list(_initial_file_contents).index(filename)
+    _steps.append(template % {
+        'path': path or filename,
+        'contents': '{' + _string_as_c_array(_current[filename]) + '}',
+        'index': index,
+        'step': len(_steps)})
+
+
 def expect(rv):
     import inspect
     previous_frame = inspect.currentframe().f_back
@@ -162,6 +468,42 @@ def expect(rv):
         'exp_line': line_number})
 
 
+def expect_stable(rv):
+    """As expect(), but calls main through the pointer returned by
+    dyibicc_find_stable_export() the first time, rather than looking it up."""
+    import inspect
+    previous_frame = inspect.currentframe().f_back
+    (filename, line_number, _, _, _) = inspect.getframeinfo(previous_frame)
+    filename = os.path.split(filename)[1]
+    global _steps
+    _steps.append(_CALL_STABLE_ENTRY_TEMPLATE % {
+        'desired_result': rv,
+        'exp_file': filename,
+        'exp_line': line_number})
+
+
+def register_symbol(name, host_name):
+    """Provides |host_name| (see add_to_host()) as |name| with
+    dyibicc_register_symbols(), taking effect at the next update."""
+    global _steps
+    _steps.append(_REGISTER_SYMBOL_TEMPLATE % {'name': name, 'host_name': host_name})
+
+
+def check_stats(condition):
+    """Checks the C expression |condition| of |stats|, the DyibiccStats for
+    the most recent update."""
+    import inspect
+    previous_frame = inspect.currentframe().f_back
+    (filename, line_number, _, _, _) = inspect.getframeinfo(previous_frame)
+    filename = os.path.split(filename)[1]
+    global _steps
+    update_ok()
+    _steps.append(_CHECK_STATS_TEMPLATE % {
+        'condition': condition,
+        'exp_file': filename,
+        'exp_line': line_number})
+
+
 def sub(filename, line, find, replace_with):
     global _current
     cur = _current[filename]
@@ -176,21 +518,35 @@ def done():
     global _current
     global _include_paths
     global _initial_file_contents
-    files = ['"%s"' % x for x in _current.keys()] + ['NULL']
+    files = ['"%s"' % x for x in _current.keys() if not _is_header(x)] + ['NULL']
     incs = ['"%s"' % x for x in _include_paths] + ['NULL']
     _include_paths.append('NULL')
     initials = ''
     counter = 0
+    header_decls = ''
     for f, c in _initial_file_contents.items():
+        # Changed by update_changed(), and reset by restart().
+        header_decls += ('static char initial_%d[] = {' % counter) + _string_as_c_array(c) + '};\n'
+        header_decls += 'static char* source_contents_%d = initial_%d;\n' % (counter, counter)
         initials += '  if (strcmp("%s", filename) == 0) {\n' % f
-        initials += ('    static char initial_%d[] = {' % counter) + _string_as_c_array(c) + '};\n'
         # Has to be malloc+copied because the compiler assumes it should free.
-        initials += '    *contents = malloc(%d);\n' % len(c)
-        initials += '    memcpy(*contents, initial_%d, %d);\n' % (counter, len(c))
-        initials += '    *size = %d;\n' % len(c)
+        initials += '    *size = strlen(source_contents_%d);\n' % counter
+        initials += '    *contents = malloc(*size);\n'
+        initials += '    memcpy(*contents, source_contents_%d, *size);\n' % counter
         initials += '    return true;\n'
         initials += '  }\n\n'
         counter += 1
+    header_contents = ''
+    for i, f in enumerate(_headers):
+        header_decls += ('static char header_initial_%d[] = {' % i) + \
+            _string_as_c_array(_initial_header_contents[f]) + '};\n'
+        header_decls += 'static char* header_contents_%d = header_initial_%d;\n' % (i, i)
+        header_contents += '  if (strcmp("%s", filename) == 0) {\n' % f
+        header_contents += '    *size = strlen(header_contents_%d);\n' % i
+        header_contents += '    *contents = malloc(*size);\n'
+        header_contents += '    memcpy(*contents, header_contents_%d, *size);\n' % i
+        header_contents += '    return true;\n'
+        header_contents += '  }\n\n'
     helper_lookups = ''
     for x in _host_helper_funcs:
         helper_lookups += '  if (strcmp("%s", name) == 0) return (void*)%s;\n' % (x, x)
@@ -198,8 +554,17 @@ def done():
     with open(sys.argv[1], 'w', newline='\n') as f:
         f.write('\n'.join(_extra_host))
         f.write(_MAIN_TEMPLATE % {
+                'header_declarations': header_decls,
+                'header_contents': header_contents,
                 'initial_file_contents': initials,
                 'helper_lookups': helper_lookups,
                 'include_paths': ', '.join(incs),
+                'cache_dir': 'cache_dir' if _cache_dir else 'NULL',
+                'cache_dir_includes': _CACHE_DIR_INCLUDES if _cache_dir else '',
+                'disk_dir_includes': _DISK_DIR_INCLUDES if _uses_disk_dir else '',
+                'cache_dir_functions': _CACHE_DIR_FUNCTIONS if _cache_dir else '',
+                'cache_dir_setup': _CACHE_DIR_SETUP % {'cache_dir': _cache_dir} if _cache_dir else '',
+                'cache_dir_cleanup': '  remove_cache_dir(cache_dir);' if _cache_dir else '',
                 'input_paths': ', '.join(files),
+                'setup': '\n'.join(_setup),
                 'steps': '\n'.join(_steps)})
@@ -0,0 +1,49 @@
+from test_helpers_for_update import *
+
+SRC = '''\
+static int table(int i) {
+  static void* labels[] = {&&zero, &&one};
+  goto *labels[i];
+zero:
+  return 10;
+one:
+  return 20;
+}
+static const char msg[] = "hello";
+static int counter;
+int (*fp)(int) = table;
+int main(void) {
+  return table(1) + fp(0) + msg[1] - 'e' + ++counter;
+}
+'''
+
+cache_dir('update_cache.cache')
+initial({'main.c': SRC})
+expect(31)
+
+# The new context loads the code that was just compiled from the cache, and
+# has its own fresh data.
+restart()
+expect(31)
+check_stats('stats.files[0].loaded_from_cache')
+
+sub('main.c', 5, '10', '11')
+update_ok()
+expect(33)
+
+# Back to the original contents, which is also in the cache.
+restart()
+expect(31)
+check_stats('stats.files[0].loaded_from_cache')
+
+# A file that differs only in the type of a literal with the same bytes isn't
+# the same file.
+sub('main.c', 13, "msg[1] - 'e'", "u\"ab\"[1] - 'b'")
+update_ok()
+expect(32)
+sub('main.c', 13, 'u"ab"', '"a\\0b\\0\\0"')
+update_ok()
+expect(-65)
+check_stats('!stats.files[0].loaded_from_cache')
+
+done()
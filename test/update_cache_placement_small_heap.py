@@ -0,0 +1,44 @@
+from test_helpers_for_update import *
+
+# This runs with 16MB in the code heap for zeroed data (see gen.py). The cached
+# code for a.c addresses |g| directly, because it was in the code heap when
+# a.c was compiled. b.c fills the rest of the space with arrays that are
+# placed before its own static |g| (globals are placed in the reverse of the
+# order they're defined in), so that's outside of the code heap. When the
+# arrays are removed from b.c it has the same contents as a.c, but the cached
+# code can't be used for it, as its |g| stays where it is, so it's compiled.
+SHARED = '''\
+static int g[200000];
+int bump(void) {
+  return ++g[0];
+}
+'''
+
+FILL = SHARED.replace('bump', 'bump_b') + '''\
+#define TEN(X, n) X(n##0) X(n##1) X(n##2) X(n##3) X(n##4) X(n##5) X(n##6) X(n##7) X(n##8) X(n##9)
+#define ARRAYS(X) TEN(X, 1) TEN(X, 2) TEN(X, 3) TEN(X, 4) TEN(X, 5)
+#define DEFINE(i) static char f##i[400000];
+ARRAYS(DEFINE)
+'''
+
+MAIN = '''\
+int bump(void);
+int main(void) {
+  return bump();
+}
+'''
+
+cache_dir('update_cache_placement_small_heap.cache')
+initial({'a.c': SHARED, 'b.c': FILL, 'main.c': MAIN})
+expect(1)
+expect(2)
+
+# b.c's bump() replaces a.c's, and uses b.c's |g|.
+sub('b.c', 2, 'bump_b', 'bump')
+sub('b.c', 8, 'ARRAYS(DEFINE)', '')
+update_ok()
+expect(1)
+expect(2)
+check_stats('!stats.files[1].loaded_from_cache')
+
+done()
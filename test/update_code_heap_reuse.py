@@ -0,0 +1,41 @@
+from test_helpers_for_update import *
+
+# Each file's code has pages of its own, so other.c's doesn't share a page
+# with the end of main.c's.
+#
+# main.c's code comes first in the code heap, followed by other.c's. When
+# main.c shrinks, and then grows back to its original size, its code must
+# reuse the pages that were freed below other.c's rather than growing the
+# heap.
+MAIN = '''\
+#define TEN x += 0; x += 0; x += 0; x += 0; x += 0; x += 0; x += 0; x += 0; x += 0; x += 0;
+#define HUNDRED TEN TEN TEN TEN TEN TEN TEN TEN TEN TEN
+int other(void);
+int main(void) {
+  int x = other();
+  HUNDRED HUNDRED HUNDRED HUNDRED
+  return x;
+}
+'''
+
+OTHER = '''\
+int other(void) {
+  return 1;
+}
+'''
+
+initial({'main.c': MAIN, 'other.c': OTHER})
+expect(1)
+check_stats('(char*)dyibicc_find_export(ctx, "other") - (char*)dyibicc_find_export(ctx, "main") > 4096')
+check_stats('(size_t)dyibicc_find_export(ctx, "other") % 4096 == 0')
+
+sub('main.c', 6, 'HUNDRED HUNDRED HUNDRED HUNDRED', 'TEN')
+update_ok()
+expect(1)
+
+sub('main.c', 6, 'TEN', 'HUNDRED HUNDRED HUNDRED HUNDRED')
+update_ok()
+expect(1)
+check_stats('(char*)dyibicc_find_export(ctx, "main") < (char*)dyibicc_find_export(ctx, "other")')
+
+done()
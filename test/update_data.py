@@ -0,0 +1,44 @@
+from test_helpers_for_update import *
+
+MAIN = '''\
+int counter;
+static int table[4] = {10, 20, 30, 40};
+int get_counter(void);
+static int letter(void) {
+  return "abc"[1];
+}
+int main(void) {
+  ++counter;
+  return counter + table[0] + letter() + get_counter();
+}
+'''
+
+OTHER = '''\
+extern int counter;
+int get_counter(void) {
+  return counter;
+}
+'''
+
+initial({'main.c': MAIN, 'other.c': OTHER})
+expect(110)
+expect(112)
+
+# Only main() is regenerated. Globals keep their values, and the string
+# literal in the reused letter() is still found.
+sub('main.c', 9, 'table[0]', 'table[1]')
+update_ok()
+expect(124)
+
+# other.c reads the same counter that main.c writes.
+sub('other.c', 3, 'counter', 'counter * 2')
+update_ok()
+expect(130)
+
+# A new global makes main.c compile in full, but existing globals stay.
+sub('main.c', 1, 'counter', 'counter, extra = 1000')
+sub('main.c', 9, 'table[1]', 'table[1] + extra')
+update_ok()
+expect(1133)
+
+done()
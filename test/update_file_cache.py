@@ -0,0 +1,26 @@
+from test_helpers_for_update import *
+
+# The header is on disk, so its contents are cached across updates, and
+# reloaded when its modification time or size changes.
+disk_file('update_file_cache.h', '#define VALUE 10\n')
+
+SRC = '''\
+#include "update_file_cache.h"
+int main(void) {
+  return VALUE;
+}
+'''
+
+initial({'main.c': SRC})
+expect(10)
+
+disk_file('update_file_cache.h', '#define VALUE 120\n')
+update_all()
+expect(120)
+
+# Unrelated change, the header is unchanged.
+sub('main.c', 3, 'VALUE', 'VALUE + 1')
+update_ok()
+expect(121)
+
+done()
@@ -0,0 +1,67 @@
+from test_helpers_for_update import *
+
+SRC = '''\
+int is_changed(int (*f)(void));
+static int counter(void) {
+  static int n;
+  return ++n;
+}
+int changed(void);
+int (*fp)(void) = changed;
+int changed(void) {
+  return (fp == changed) * 1;
+}
+int main(void) {
+  return changed() * 100 + fp() * 10 + counter() + (fp != changed || !is_changed(fp)) * 1000;
+}
+'''
+
+OTHER = '''\
+int changed(void);
+int is_changed(int (*f)(void)) {
+  return f == changed;
+}
+'''
+
+initial({'main.c': SRC, 'other.c': OTHER})
+update_ok()
+expect(111)
+
+# Only the body of changed() is different, so counter() and main() keep their
+# code, and calls to the old changed() are redirected. Its address is still the
+# same from the new code, the reused code, data, and other files.
+sub('main.c', 9, '1;', '2;')
+update_ok()
+expect(222)
+check_stats('stats.files[0].patched')
+
+# Again, replacing the already replaced function.
+sub('main.c', 9, '2;', '("abc"[0] - 94);')
+update_ok()
+expect(333)
+check_stats('stats.files[0].patched')
+
+# And when both are changed.
+sub('main.c', 12, '100', '0')
+sub('main.c', 9, '("abc"[0] - 94);', '4;')
+update_ok()
+expect(44)
+check_stats('stats.files[0].patched')
+
+# A literal with the same bytes but a different type is a different body.
+sub('main.c', 9, '4;', '(u"ab"[1] + 4);')
+update_ok()
+expect(1025)
+check_stats('stats.files[0].patched')
+sub('main.c', 9, 'u"ab"', '"a\\0b\\0\\0"')
+update_ok()
+expect(46)
+check_stats('stats.files[0].patched')
+
+# Changes outside of function bodies cause everything to be regenerated.
+sub('main.c', 7, 'changed;', 'changed, *fp2 = changed;')
+update_ok()
+expect(47)
+check_stats('!stats.files[0].patched')
+
+done()
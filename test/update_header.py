@@ -0,0 +1,49 @@
+from test_helpers_for_update import *
+
+HDR = '''\
+#define VALUE 10
+'''
+
+SRC1 = '''\
+#include "value.h"
+extern int other(void);
+int main(void) {
+  return VALUE + other();
+}
+'''
+
+SRC2 = '''\
+int other(void) {
+  return 1;
+}
+'''
+
+initial({'main.c': SRC1, 'second.c': SRC2, 'value.h': HDR})
+update_ok()
+expect(11)
+
+# Only main.c includes the header, so only it should be recompiled.
+sub('value.h', 1, '10', '20')
+update_ok()
+expect(21)
+check_stats('stats.files[0].compiled_in_last_update && !stats.files[1].compiled_in_last_update')
+
+# The header is found by its canonical path, however it's spelled.
+sub('value.h', 1, '20', '30')
+update_changed('value.h', 'unused/.././value.h')
+expect(31)
+check_stats('stats.files[0].compiled_in_last_update && !stats.files[1].compiled_in_last_update')
+
+# Changes to a .c file can also be applied by path.
+sub('second.c', 2, '1', '2')
+update_changed('second.c')
+expect(32)
+check_stats('!stats.files[0].compiled_in_last_update && stats.files[1].compiled_in_last_update')
+
+# Or by passing the new contents to dyibicc_update().
+sub('second.c', 2, '2', '3')
+update_ok()
+expect(33)
+check_stats('!stats.files[0].compiled_in_last_update && stats.files[1].compiled_in_last_update')
+
+done()
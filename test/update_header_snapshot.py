@@ -0,0 +1,40 @@
+from test_helpers_for_update import *
+
+HDR = '''\
+#define VALUE 10
+#define STR "ab" "c"
+typedef struct Pair { int a, b; } Pair;
+static inline int pair_sum(Pair p) { return p.a + p.b; }
+'''
+
+SRC1 = '''\
+#include <value.h>
+#include <string.h>
+extern int other(void);
+int main(void) {
+  Pair p = {VALUE, 1};
+  return pair_sum(p) + other() + (int)strlen(STR) + __COUNTER__;
+}
+'''
+
+# Starts with the same system includes, so uses the snapshot of them from
+# main.c.
+SRC2 = '''\
+#include <value.h>
+#include <string.h>
+int other(void) {
+  Pair p = {VALUE, VALUE};
+  return pair_sum(p) + __LINE__;
+}
+'''
+
+initial({'main.c': SRC1, 'second.c': SRC2, 'value.h': HDR})
+update_ok()
+expect(39)
+
+# Both files depend on the header through the snapshot.
+sub('value.h', 1, '10', '20')
+update_ok()
+expect(69)
+
+done()
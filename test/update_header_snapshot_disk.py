@@ -0,0 +1,32 @@
+from test_helpers_for_update import *
+
+# The header is on disk, and changes without the host telling us about it, so
+# the snapshot of it has to be checked against the file.
+disk_file('update_header_snapshot_disk.h', '#define VALUE 10\n')
+include_path('.')
+
+SRC1 = '''\
+#include <update_header_snapshot_disk.h>
+extern int other(void);
+int main(void) {
+  return VALUE + other();
+}
+'''
+
+SRC2 = '''\
+#include <update_header_snapshot_disk.h>
+int other(void) {
+  return VALUE;
+}
+'''
+
+initial({'main.c': SRC1, 'second.c': SRC2})
+expect(20)
+
+# Only main.c is recompiled, so second.c still has the old value.
+disk_file('update_header_snapshot_disk.h', '#define VALUE 300\n')
+sub('main.c', 4, 'VALUE', 'VALUE + 1')
+update_ok()
+expect(311)
+
+done()
@@ -0,0 +1,23 @@
+from test_helpers_for_update import *
+
+# |big| is at least LARGE_DATA_THRESHOLD, so is mapped outside of the code heap
+# and reached through the GOT, while |small| is addressed directly. Neither is
+# reinitialized by an update.
+MAIN = '''\
+static char big[2 << 20];
+int small = 5;
+int main(void) {
+  big[sizeof(big) - 1] += 1;
+  small += 1;
+  return big[sizeof(big) - 1] * 10 + small;
+}
+'''
+
+initial({'main.c': MAIN})
+expect(16)
+
+sub('main.c', 6, '* 10', '* 100')
+update_ok()
+expect(207)
+
+done()
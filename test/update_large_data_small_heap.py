@@ -0,0 +1,27 @@
+from test_helpers_for_update import *
+
+# This runs with 16MB in the code heap for zeroed data (see gen.py). Each
+# array is below LARGE_DATA_THRESHOLD, but they don't all fit, so those that
+# are placed after the space runs out are mapped outside of the code heap.
+# All of them keep their contents across an update.
+MAIN = '''\
+#define TEN(X, n) X(n##0) X(n##1) X(n##2) X(n##3) X(n##4) X(n##5) X(n##6) X(n##7) X(n##8) X(n##9)
+#define ARRAYS(X) TEN(X, 1) TEN(X, 2)
+#define DEFINE(i) static char a##i[1000000];
+#define BUMP(i) a##i[sizeof(a##i) - 1] += 1; total += a##i[sizeof(a##i) - 1];
+ARRAYS(DEFINE)
+int main(void) {
+  int total = 0;
+  ARRAYS(BUMP)
+  return total * 1;
+}
+'''
+
+initial({'main.c': MAIN})
+expect(20)
+
+sub('main.c', 9, '* 1', '* 2')
+update_ok()
+expect(80)
+
+done()
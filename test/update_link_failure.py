@@ -0,0 +1,34 @@
+from test_helpers_for_update import *
+
+# A file whose link failed is linked again by the next update, even if that
+# update doesn't compile anything, so that it fails too rather than reporting
+# success with main.c's call to missing() unresolved.
+MAIN = '''\
+int other(void);
+int main(void) {
+  return other() + 1;
+}
+'''
+
+OTHER = '''\
+int other(void) {
+  return 10;
+}
+'''
+
+initial({'main.c': MAIN, 'other.c': OTHER, 'unused.h': '#define UNUSED 1\n'})
+expect(11)
+
+sub('main.c', 1, 'other', 'missing')
+sub('main.c', 3, 'other', 'missing')
+update_changed_fails('main.c')
+
+sub('unused.h', 1, '1', '2')
+update_changed_fails('unused.h')
+
+sub('main.c', 1, 'missing', 'other')
+sub('main.c', 3, 'missing', 'other')
+update_changed('main.c')
+expect(11)
+
+done()
@@ -0,0 +1,36 @@
+from test_helpers_for_update import *
+
+# The header doesn't exist until after the first compile that includes it, and
+# is then found in an include path, not where the failed compile looked last.
+disk_dir('update_missing_header_dir')
+remove_disk_file('update_missing_header_dir/update_missing_header.h')
+include_path('update_missing_header_dir')
+
+SRC1 = '''\
+#define VALUE 1
+extern int other(void);
+int main(void) {
+  return VALUE + other();
+}
+'''
+
+SRC2 = '''\
+int other(void) {
+  return 10;
+}
+'''
+
+initial({'main.c': SRC1, 'second.c': SRC2})
+expect(11)
+
+sub('main.c', 1, '#define VALUE 1', '#include <update_missing_header.h>')
+update_changed_fails('main.c')
+
+# main.c's last compile failed, so creating the header it was missing
+# recompiles it, even though the failed compile couldn't record where it is.
+disk_file('update_missing_header_dir/update_missing_header.h', '#define VALUE 2\n')
+disk_file_changed('update_missing_header_dir/update_missing_header.h')
+expect(12)
+check_stats('stats.files[0].compiled_in_last_update && !stats.files[1].compiled_in_last_update')
+
+done()
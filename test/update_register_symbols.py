@@ -0,0 +1,50 @@
+from test_helpers_for_update import *
+
+add_to_host('''
+int get_value(void) { return 1; }
+int registered_value(void) { return 2; }
+int other_registered_value(void) { return 3; }
+int third_registered_value(void) { return 4; }
+''')
+add_host_helper_func('get_value')
+
+MAIN = '''\
+int get_value(void);
+int other(void);
+int main(void) {
+  return get_value() + other();
+}
+'''
+
+OTHER = '''\
+int other(void) {
+  return 10;
+}
+'''
+
+initial({'main.c': MAIN, 'other.c': OTHER, 'unused.h': 'int unused;\n'})
+expect(11)
+
+update_all()
+expect(11)
+
+# Registered symbols override the lookup, and are relinked into main.c even
+# though only other.c changes.
+register_symbol('get_value', 'registered_value')
+sub('other.c', 2, '10', '20')
+update_ok()
+expect(22)
+
+# A full update reloads other.c's initial contents.
+register_symbol('get_value', 'other_registered_value')
+update_all()
+expect(13)
+
+# Nothing includes unused.h, so this update compiles nothing, but still links
+# the newly registered symbol.
+register_symbol('get_value', 'third_registered_value')
+sub('unused.h', 1, 'unused', 'still_unused')
+update_ok()
+expect(14)
+
+done()
@@ -0,0 +1,42 @@
+from test_helpers_for_update import *
+
+# main.c is never recompiled, so its references to the other files are only
+# updated by relinking when what they refer to moves.
+MAIN = '''\
+extern int other(void);
+extern const int table[2];
+extern int counter;
+int main(void) {
+  return other() + table[1] + counter;
+}
+'''
+
+SECOND = '''\
+const int table[2] = {1, 2};
+int counter = 10;
+int other(void) {
+  return 100;
+}
+'''
+
+THIRD = '''\
+int unrelated(void) {
+  return 5;
+}
+'''
+
+initial({'main.c': MAIN, 'second.c': SECOND, 'third.c': THIRD})
+expect(112)
+
+# Nothing main.c uses moves.
+sub('third.c', 2, '5', '6')
+update_ok()
+expect(112)
+
+# The function moves, the globals are already initialized so are kept.
+sub('second.c', 2, 'int counter = 10;', 'int counter = 10; int more = 1;')
+sub('second.c', 4, '100', '200')
+update_ok()
+expect(212)
+
+done()
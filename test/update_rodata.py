@@ -0,0 +1,40 @@
+from test_helpers_for_update import *
+
+MAIN = '''\
+const char* other_str(void);
+static const char* first;
+static int extra(void) {
+  return 1;
+}
+int main(void) {
+  if (!first)
+    first = "keep";
+  return (first == "keep") * 100 + ("shared" == other_str()) * 10 + extra();
+}
+'''
+
+OTHER = '''\
+const char* other_str(void) {
+  return "shared";
+}
+'''
+
+# Identical literals in different files share storage.
+initial({'main.c': MAIN, 'other.c': OTHER})
+expect(111)
+
+# main() is reused, and its literals are still where it expects.
+sub('main.c', 4, '1', '2')
+update_ok()
+expect(112)
+
+# main() is regenerated, but the unchanged literal keeps its address.
+sub('main.c', 9, '* 10 +', '* 20 +')
+update_ok()
+expect(122)
+
+sub('other.c', 2, 'shared', 'changed')
+update_ok()
+expect(102)
+
+done()
@@ -0,0 +1,59 @@
+from test_helpers_for_update import *
+
+add_to_host(r'''
+#ifdef _WIN32
+#include <windows.h>
+int is_read_only(char* p) {
+  MEMORY_BASIC_INFORMATION mbi;
+  VirtualQuery(p, &mbi, sizeof(mbi));
+  return mbi.Protect == PAGE_READONLY;
+}
+#else
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+static sigjmp_buf fault_jmp;
+static void on_fault(int sig) {
+  (void)sig;
+  siglongjmp(fault_jmp, 1);
+}
+int is_read_only(char* p) {
+  struct sigaction sa, old;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_fault;
+  sigaction(SIGSEGV, &sa, &old);
+  int faulted = 1;
+  if (!sigsetjmp(fault_jmp, 1)) {
+    *(volatile char*)p = *p;
+    faulted = 0;
+  }
+  sigaction(SIGSEGV, &old, NULL);
+  return faulted;
+}
+#endif
+''')
+add_host_helper_func('is_read_only')
+
+# String literals are shared by all the files that use them, so they're
+# read-only, including those added by an update, or loaded from the cache.
+MAIN = '''\
+int is_read_only(char* p);
+int buf[4];
+int main(void) {
+  return is_read_only("first") * 10 + is_read_only((char*)buf);
+}
+'''
+
+cache_dir('update_rodata_protect.cache')
+initial({'main.c': MAIN})
+expect(10)
+
+sub('main.c', 4, '"first"', '"second"')
+update_ok()
+expect(10)
+
+restart()
+expect(10)
+check_stats('stats.files[0].loaded_from_cache')
+
+done()
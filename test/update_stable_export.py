@@ -0,0 +1,72 @@
+from test_helpers_for_update import *
+
+add_to_host(r'''
+static void* gone_stub;
+#ifdef _WIN32
+static int aborts(void* fn) {
+  (void)fn;
+  return 1;  // Not checked.
+}
+#else
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+// Whether calling |fn| aborts, which is done in a child process.
+static int aborts(void* fn) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    ((void (*)(void))fn)();
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+#endif
+''')
+
+# The stable address of main is looked up once, and keeps calling the current
+# code through both partial and full recompiles.
+SRC = '''\
+int helper(void) {
+  return 1;
+}
+int main(void) {
+  return helper() + 10;
+}
+'''
+
+OTHER = '''\
+int gone(void) {
+  return 7;
+}
+'''
+
+initial({'main.c': SRC, 'other.c': OTHER})
+expect_stable(11)
+
+# Only helper() changes, so the rest of the code is reused.
+sub('main.c', 2, '1', '2')
+update_ok()
+expect_stable(12)
+
+# A new global changes everything, so the file's code is replaced entirely.
+sub('main.c', 1, 'int helper', 'int g = 100; int helper')
+sub('main.c', 5, '10', 'g')
+update_ok()
+expect_stable(102)
+expect(102)
+
+update_all()
+expect_stable(11)
+
+# A function that's no longer defined can't be found, and calling its stable
+# address reports that rather than running freed code.
+check_stats('(gone_stub = dyibicc_find_stable_export(ctx, "gone")) != NULL')
+check_stats('((int (*)(void))gone_stub)() == 7')
+sub('other.c', 1, 'gone', 'kept')
+update_ok()
+check_stats('dyibicc_find_export(ctx, "gone") == NULL && aborts(gone_stub)')
+expect_stable(11)
+
+done()
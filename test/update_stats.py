@@ -0,0 +1,53 @@
+from test_helpers_for_update import *
+
+MAIN = '''\
+#define TWICE(x) ((x) * 2)
+int other(void);
+int value = 5;
+int main(void) {
+  return TWICE(value) + other();
+}
+'''
+
+OTHER = '''\
+int other(void) {
+  return 1;
+}
+'''
+
+initial({'main.c': MAIN, 'other.c': OTHER, 'unused.h': 'int unused;\n'})
+expect(11)
+check_stats('stats.num_files == 2 && stats.code_bytes > 0')
+check_stats('stats.files[0].data_bytes >= sizeof(int)')
+
+update_all()
+expect(11)
+check_stats('stats.num_files_compiled == 2')
+check_stats('stats.num_tokens > 0 && stats.num_macro_expansions > 0')
+check_stats('stats.num_nodes > 0 && stats.num_objs >= 3')
+check_stats('stats.update_seconds > 0 && stats.phase_seconds[DYIBICC_PHASE_PARSE] > 0')
+check_stats('stats.heap_high_water[DYIBICC_HEAP_COMPILE] > 0')
+check_stats('stats.files[0].compiled_in_last_update && stats.files[1].compiled_in_last_update')
+
+# Only main.c is recompiled, other.c keeps the stats of its last compile.
+sub('main.c', 5, 'TWICE(value)', 'value')
+update_ok()
+expect(6)
+check_stats('stats.num_files_compiled == 1 && stats.num_macro_expansions == 0')
+check_stats('stats.files[0].compiled_in_last_update && !stats.files[1].compiled_in_last_update')
+check_stats('stats.files[1].num_tokens > 0')
+
+# Nothing includes unused.h, so nothing is compiled, and the high water marks
+# are only for this update.
+sub('unused.h', 1, 'unused', 'still_unused')
+update_ok()
+check_stats('stats.num_files_compiled == 0')
+check_stats('stats.heap_high_water[DYIBICC_HEAP_COMPILE] == 0')
+
+# A failed update still has the time up to the error.
+sub('main.c', 3, 'int value = 5;', '#error stop')
+update_changed_fails('main.c')
+check_stats('stats.update_seconds > 0 && stats.phase_seconds[DYIBICC_PHASE_PREPROCESS] > 0')
+check_stats('stats.phase_seconds[DYIBICC_PHASE_PREPROCESS] <= stats.update_seconds')
+
+done()